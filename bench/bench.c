@@ -0,0 +1,552 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../includes/gb.h"
+#include "../includes/bios.h"
+#include "../includes/video.h"
+#include "../includes/batch.h"
+#include "../includes/runahead.h"
+
+// Benchmark harness for the core: `make bench`
+// Human readable results on stderr, JSON on stdout (or --json file)
+
+int DEBUG_MODE = 0;
+
+#define ROM_SIZE   0x8000
+#define STREAM_END 0x3F00 // synthetic streams fill 0x0100..STREAM_END then jump back
+
+typedef struct {
+    char name[48];
+    const char *unit;
+    double value;
+    uint64_t iterations;
+    double seconds;
+    int decimals;       // of value in the JSON
+} BenchResult;
+
+static BenchResult results[64];
+static int result_count = 0;
+static const char *filter = NULL;
+static volatile uint32_t sink; // keep the compiler from removing the loops
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int selected(const char *name) {
+    return !filter || strstr(name, filter) != NULL;
+}
+
+static void record(const char *name, const char *unit, uint64_t iterations, double seconds) {
+    BenchResult *r = &results[result_count++];
+    snprintf(r->name, sizeof(r->name), "%s", name);
+    r->unit = unit;
+    r->iterations = iterations;
+    r->seconds = seconds;
+    r->value = seconds > 0 ? iterations / seconds : 0;
+    r->decimals = 0;
+    fprintf(stderr, "  %-24s %14.0f %s\n", name, r->value, unit);
+}
+
+static const BenchResult *find_result(const char *name) {
+    for (int i = 0; i < result_count; i++) {
+        if (strcmp(results[i].name, name) == 0) return &results[i];
+    }
+    return NULL;
+}
+
+// Speedup of one result over another measured before it (below 1: a regression)
+static void record_ratio(const char *name, const char *faster, const char *slower) {
+    const BenchResult *a = find_result(faster);
+    const BenchResult *b = find_result(slower);
+    if (!a || !b || b->value <= 0) return;
+
+    BenchResult *r = &results[result_count++];
+    snprintf(r->name, sizeof(r->name), "%s", name);
+    r->unit = "x";
+    r->iterations = 0;
+    r->seconds = 0;
+    r->value = a->value / b->value;
+    r->decimals = 2;
+    fprintf(stderr, "  %-24s %14.2f x %s / %s%s\n", name, r->value, faster, slower, r->value < 1 ? "  ⚠️" : "");
+}
+
+// ===== CPU: synthetic instruction streams =====
+typedef struct {
+    const char *name;
+    uint8_t pattern[16];
+    uint8_t length;
+} Stream;
+
+static const Stream streams[] = {
+    { "cpu_nop",        { 0x00 }, 1 },
+    // LD B,C  LD C,B  LD C,A  LD D,C  LD D,A  LD E,H  LD H,B  LD H,A  LD A,D  LD A,E
+    { "cpu_ld_r_r",     { 0x41, 0x4C, 0x4F, 0x51, 0x57, 0x5C, 0x60, 0x67, 0x7A, 0x7B }, 10 },
+    // INC B  DEC B  INC C  DEC C  DEC A  XOR A  OR C  ADD A,A  CPL  CP d8
+    { "cpu_alu",        { 0x04, 0x05, 0x0C, 0x0D, 0x3D, 0xAF, 0xB1, 0x87, 0x2F, 0xFE, 0x12 }, 11 },
+    // LD HL,C000  LD (HL+),A  LD (HL-),A  LD (HL),A  LD DE,C010  LD A,(DE)  INC DE
+    { "cpu_load_store", { 0x21, 0x00, 0xC0, 0x22, 0x32, 0x77, 0x11, 0x10, 0xC0, 0x1A, 0x13 }, 11 },
+    // LD B,d8  JR NC,+0  JR C,+0  JR +0  JR NZ,+0  JR Z,+0
+    { "cpu_branch",     { 0x06, 0x00, 0x30, 0x00, 0x38, 0x00, 0x18, 0x00, 0x20, 0x00, 0x28, 0x00 }, 12 },
+    // CALL 3FF0 (RET)  PUSH BC  POP BC
+    { "cpu_call_ret",   { 0xCD, 0xF0, 0x3F, 0xC5, 0xC1 }, 5 },
+    // INC HL  DEC BC  ADD HL,DE  INC DE  LD A,(HL+)  LD A,(HL-)  PUSH HL  POP DE  PUSH AF  POP BC  ADD HL,BC  DEC DE
+    { "cpu_pairs",      { 0x23, 0x0B, 0x19, 0x13, 0x2A, 0x3A, 0xE5, 0xD1, 0xF5, 0xC1, 0x09, 0x1B }, 12 },
+};
+
+static void build_stream_rom(uint8_t *rom, const Stream *s) {
+    memset(rom, 0x00, ROM_SIZE);
+
+    uint16_t pc = 0x0100;
+    while (pc + s->length <= STREAM_END) {
+        memcpy(&rom[pc], s->pattern, s->length);
+        pc += s->length;
+    }
+    // JP 0x0100
+    rom[pc] = 0xC3;
+    rom[pc + 1] = 0x00;
+    rom[pc + 2] = 0x01;
+
+    rom[0x3FF0] = 0xC9; // RET, target of cpu_call_ret
+}
+
+static void bench_cpu(uint64_t steps) {
+    static uint8_t rom[ROM_SIZE];
+    static GameBoy gb;
+
+    for (size_t i = 0; i < sizeof(streams) / sizeof(streams[0]); i++) {
+        const Stream *s = &streams[i];
+        if (!selected(s->name)) continue;
+
+        build_stream_rom(rom, s);
+        gb_init(&gb);
+        gb_load_rom(&gb, rom, ROM_SIZE);
+
+        uint64_t cycles = 0;
+        double start = now_seconds();
+        for (uint64_t n = 0; n < steps; n++) {
+            cycles += cpu_step(&gb.cpu, &gb.mmu);
+        }
+        double elapsed = now_seconds() - start;
+        sink += (uint32_t)cycles;
+
+        record(s->name, "instr/s", steps, elapsed);
+        gb_free(&gb);
+    }
+}
+
+// ===== MMU: read/write throughput per region =====
+typedef struct {
+    const char *name;
+    uint16_t start;
+    uint16_t size;
+    uint8_t writable;
+} Region;
+
+static const Region regions[] = {
+    { "rom0", 0x0000, 0x4000, 0 },
+    { "romx", 0x4000, 0x4000, 0 },
+    { "vram", 0x8000, 0x2000, 1 },
+    { "eram", 0xA000, 0x2000, 1 },
+    { "wram", 0xC000, 0x2000, 1 },
+    { "oam",  0xFE00, 0x00A0, 1 },
+    { "io",   0xFF00, 0x0080, 0 }, // writes have side effects (DMA, ...)
+    { "hram", 0xFF80, 0x007F, 1 },
+};
+
+static void bench_mmu(uint64_t accesses) {
+    static uint8_t rom[ROM_SIZE];
+    static GameBoy gb;
+    char name[48];
+
+    gb_init(&gb);
+    gb_load_rom(&gb, rom, ROM_SIZE);
+    gb.mmu.ram_enabled = 1;
+    mmu_update_map(&gb.mmu);
+
+    for (size_t i = 0; i < sizeof(regions) / sizeof(regions[0]); i++) {
+        const Region *r = &regions[i];
+
+        snprintf(name, sizeof(name), "mmu_read_%s", r->name);
+        if (selected(name)) {
+            uint32_t sum = 0;
+            uint16_t offset = 0;
+            double start = now_seconds();
+            for (uint64_t n = 0; n < accesses; n++) {
+                sum += mmu_read(&gb.mmu, r->start + offset);
+                if (++offset == r->size) offset = 0;
+            }
+            double elapsed = now_seconds() - start;
+            sink += sum;
+            record(name, "reads/s", accesses, elapsed);
+        }
+
+        snprintf(name, sizeof(name), "mmu_write_%s", r->name);
+        if (r->writable && selected(name)) {
+            uint16_t offset = 0;
+            double start = now_seconds();
+            for (uint64_t n = 0; n < accesses; n++) {
+                mmu_write(&gb.mmu, r->start + offset, (uint8_t)n);
+                if (++offset == r->size) offset = 0;
+            }
+            double elapsed = now_seconds() - start;
+            record(name, "writes/s", accesses, elapsed);
+        }
+    }
+
+    gb_free(&gb);
+}
+
+// Busy screen: noisy tiles, window on the bottom half and 40 sprites
+static void busy_screen(GameBoy *gb) {
+    gb_init(gb);
+    for (int i = 0; i < 0x2000; i++) {
+        gb->mmu.vram[i] = (uint8_t)(i * 37 + (i >> 5));
+    }
+    for (int i = 0; i < 40; i++) {
+        gb->mmu.oam[i * 4]     = 16 + (i * 7) % 144;
+        gb->mmu.oam[i * 4 + 1] = 8 + (i * 13) % 160;
+        gb->mmu.oam[i * 4 + 2] = (uint8_t)i;
+        gb->mmu.oam[i * 4 + 3] = (uint8_t)(i << 4);
+    }
+    gb->mmu.io[0x40] = 0xF3; // LCD, window, sprites, BG on
+    gb->mmu.io[0x4A] = 72;
+    gb->mmu.io[0x4B] = 7;
+}
+
+// ===== PPU: scanlines per second =====
+// ppu_lines redraws every line (VRAM touched each line), ppu_lines_cached is a static screen
+static void bench_ppu(const char *name, int dirty, uint64_t lines) {
+    static GameBoy gb;
+
+    if (!selected(name)) return;
+
+    busy_screen(&gb);
+
+    double start = now_seconds();
+    for (uint64_t n = 0; n < lines; n++) {
+        if (dirty) mmu_write(&gb.mmu, 0x9FFF, (uint8_t)n);
+        ppu_step(&gb.ppu, &gb.mmu, PPU_LINE_CYCLES);
+    }
+    double elapsed = now_seconds() - start;
+    sink += gb.ppu.framebuffer[100][100];
+
+    // Only visible lines are rendered: count those
+    record(name, "lines/s", lines * SCREEN_HEIGHT / PPU_LINES, elapsed);
+}
+
+// ===== Output stage: each filter up to 960x864 =====
+static void bench_video(uint64_t frames) {
+    static GameBoy gb;
+    static Video video;
+    static const VideoFilter filters[] = {
+        VIDEO_FILTER_NEAREST, VIDEO_FILTER_SCALE2X, VIDEO_FILTER_SCALE3X, VIDEO_FILTER_XBR
+    };
+
+    // One busy frame (worst case for the filters: few flat areas)
+    busy_screen(&gb);
+    for (int line = 0; line < PPU_LINES; line++) {
+        ppu_step(&gb.ppu, &gb.mmu, PPU_LINE_CYCLES);
+    }
+
+    for (size_t i = 0; i < sizeof(filters) / sizeof(filters[0]); i++) {
+        char name[48];
+        snprintf(name, sizeof(name), "video_%s_6x", video_filter_name(filters[i]));
+        if (!selected(name)) continue;
+        if (video_init(&video, 6, filters[i]) != 0) continue;
+
+        double start = now_seconds();
+        for (uint64_t n = 0; n < frames; n++) {
+            video_render(&video, &gb.ppu, 0);
+        }
+        double elapsed = now_seconds() - start;
+        sink += video.output[video.width * 100 + 100];
+
+        record(name, "frames/s", frames, elapsed);
+        video_free(&video);
+    }
+}
+
+// LCD ghosting at 1x: the busy frame alternates with a blank one (sprite
+// flicker, every pixel blends), compared with the same frames without it
+static void bench_ghosting(uint64_t frames) {
+    static GameBoy busy, blank;
+    static Video video;
+
+    busy_screen(&busy);
+    for (int line = 0; line < PPU_LINES; line++) {
+        ppu_step(&busy.ppu, &busy.mmu, PPU_LINE_CYCLES);
+    }
+    ppu_init(&blank.ppu);
+
+    for (int percent = 0; percent <= 50; percent += 50) {
+        const char *name = percent ? "video_ghosting_1x" : "video_nearest_1x";
+        if (!selected(name)) continue;
+        if (video_init(&video, 1, VIDEO_FILTER_NEAREST) != 0 || video_set_ghosting(&video, percent) != 0) continue;
+
+        double start = now_seconds();
+        for (uint64_t n = 0; n < frames; n++) {
+            video_render(&video, (n & 1) ? &blank.ppu : &busy.ppu, 0);
+        }
+        double elapsed = now_seconds() - start;
+        sink += video.output[SCREEN_WIDTH * 100 + 100];
+
+        record(name, "frames/s", frames, elapsed);
+        video_free(&video);
+    }
+}
+
+// ===== Whole frames on the embedded boot ROM =====
+// (the scrolling logo redraws every frame: frameskip saves most of the PPU work,
+// the render thread takes it off the CPU's thread)
+static void bench_frames(const char *name, uint8_t frameskip, GBAccuracy accuracy, int ppuThread, uint64_t frames) {
+    static uint8_t rom[ROM_SIZE];
+    static GameBoy gb;
+
+    if (!selected(name)) return;
+
+    // Cartridge with the Nintendo logo (taken from the boot ROM) so the boot sequence has something to check
+    memset(rom, 0, ROM_SIZE);
+    memcpy(&rom[0x104], &biosArray[0xA8], 0x30);
+
+    gb_init_accuracy(&gb, accuracy);
+    gb_load_rom(&gb, rom, ROM_SIZE);
+    mmu_load_bios(&gb.mmu, biosArray, bios_size);
+    gb.cpu.PC = 0x0000;
+    ppu_set_frameskip(&gb.ppu, frameskip);
+    if (ppuThread) ppu_start_worker(&gb.ppu, &gb.mmu);
+
+    double start = now_seconds();
+    for (uint64_t n = 0; n < frames; n++) {
+        gb_run_frame(&gb);
+    }
+    double elapsed = now_seconds() - start;
+
+    record(name, "frames/s", frames, elapsed);
+    gb_free(&gb);
+}
+
+// Same boot frames, each one shown from a fork run 2 frames ahead (runahead.h)
+static void bench_runahead(uint64_t frames) {
+    static uint8_t rom[ROM_SIZE];
+    static GameBoy gb;
+    static RunAhead ra;
+
+    if (!selected("frames_runahead2")) return;
+
+    memset(rom, 0, ROM_SIZE);
+    memcpy(&rom[0x104], &biosArray[0xA8], 0x30);
+
+    gb_init(&gb);
+    gb_load_rom(&gb, rom, ROM_SIZE);
+    mmu_load_bios(&gb.mmu, biosArray, bios_size);
+    gb.cpu.PC = 0x0000;
+    runahead_init(&ra, &gb, 2);
+
+    double start = now_seconds();
+    for (uint64_t n = 0; n < frames; n++) {
+        sink += runahead_run_frame(&ra)->framebuffer[72][80];
+    }
+    double elapsed = now_seconds() - start;
+
+    record("frames_runahead2", "frames/s", frames, elapsed);
+    runahead_free(&ra);
+    gb_free(&gb);
+}
+
+// ===== New instances: init + cartridge + post-boot state =====
+static void bench_boot(uint64_t instances) {
+    static uint8_t rom[ROM_SIZE];
+    static GameBoy gb;
+
+    if (!selected("boot_fast")) return;
+
+    memset(rom, 0, ROM_SIZE);
+    gb_init(&gb);
+    gb_load_rom(&gb, rom, ROM_SIZE);
+    gb_boot(&gb); // the post-boot state is computed by the first call, not measured
+    gb_free(&gb);
+
+    double start = now_seconds();
+    for (uint64_t n = 0; n < instances; n++) {
+        gb_init(&gb);
+        gb_load_rom(&gb, rom, ROM_SIZE);
+        gb_boot(&gb);
+        sink += gb.mmu.vram[0x10];
+        gb_free(&gb);
+    }
+    double elapsed = now_seconds() - start;
+
+    record("boot_fast", "boots/s", instances, elapsed);
+}
+
+// ===== Copy-on-write forks (run-ahead / search style) =====
+// The parent dirties one WRAM page between forks: that page is all a fork copies
+static void bench_fork(uint64_t forks) {
+    static uint8_t rom[ROM_SIZE];
+    static GameBoy gb, child;
+
+    if (!selected("fork")) return;
+
+    memset(rom, 0, ROM_SIZE);
+    gb_init(&gb);
+    gb_load_rom(&gb, rom, ROM_SIZE);
+    gb_boot(&gb);
+
+    double start = now_seconds();
+    for (uint64_t n = 0; n < forks; n++) {
+        gb_fork(&child, &gb);
+        sink += mmu_read(&child.mmu, 0xC000);
+        gb_free(&child);
+        mmu_write(&gb.mmu, 0xC000 + (n & 0x1FFF), (uint8_t)n);
+    }
+    double elapsed = now_seconds() - start;
+
+    record("fork", "forks/s", forks, elapsed);
+    gb_free(&gb);
+}
+
+// Same bank-switching loop on a DMG and a CGB cartridge: the CGB frame should cost the same
+static void bench_frames_mode(const char *name, uint8_t cgb_flag, uint64_t frames) {
+    static uint8_t rom[ROM_SIZE];
+    static GameBoy gb;
+    static const uint8_t loop[] = {
+        0x3E, 0x01, 0xE0, 0x4F,     // LD A,1 ; LDH (VBK),A
+        0x3E, 0x03, 0xE0, 0x70,     // LD A,3 ; LDH (SVBK),A
+        0xEA, 0x00, 0xD0,           // LD (D000),A
+        0x22,                       // LD (HL+),A
+        0xAF, 0xE0, 0x4F,           // XOR A ; LDH (VBK),A
+        0x3E, 0x01, 0xE0, 0x70,     // LD A,1 ; LDH (SVBK),A
+        0xFA, 0x00, 0xD0,           // LD A,(D000)
+        0xCB, 0x74,                 // BIT 6,H
+        0x28, 0x03,                 // JR Z,+3
+        0x21, 0x00, 0x80,           // LD HL,8000
+        0x18, 0xE1,                 // JR loop
+    };
+
+    if (!selected(name)) return;
+
+    memset(rom, 0, ROM_SIZE);
+    memcpy(&rom[0x100], loop, sizeof(loop));
+    rom[0x143] = cgb_flag;
+
+    gb_init(&gb);
+    gb_load_rom(&gb, rom, ROM_SIZE);
+    gb.cpu.H = 0x80;
+    gb.cpu.L = 0x00;
+
+    double start = now_seconds();
+    for (uint64_t n = 0; n < frames; n++) {
+        gb_run_frame(&gb);
+    }
+    double elapsed = now_seconds() - start;
+
+    record(name, "frames/s", frames, elapsed);
+    gb_free(&gb);
+}
+
+// ===== Many consoles on one ROM: lockstep batch or one after the other =====
+// Register arithmetic with a store per iteration. The input decides a branch:
+// consoles given the same input stay on the same PC, different ones drift apart
+// (16 inputs: groups too small, the batch falls back to one console after the other)
+#define BENCH_BATCH_CONSOLES 64
+
+static void bench_batch(const char *name, int lockstep, uint8_t inputs, uint64_t frames) {
+    static uint8_t rom[ROM_SIZE];
+    static const uint8_t loop[] = {
+        0xF0, 0x00,                 // LDH A,(P1)
+        0x47, 0x81, 0x8A, 0x93,     // LD B,A ; ADD A,C ; ADC A,D ; SUB E
+        0xA8, 0xB1, 0x0C, 0x15,     // XOR B ; OR C ; INC C ; DEC D
+        0x03, 0x1B, 0x19, 0x2F,     // INC BC ; DEC DE ; ADD HL,DE ; CPL
+        0xC6, 0x37, 0xFE, 0x80,     // ADD A,37 ; CP 80
+        0x38, 0x01, 0x3C,           // JR C,+1 ; INC A
+        0xEA, 0x00, 0xC0,           // LD (C000),A
+        0x18, 0xE6,                 // JR loop
+    };
+    Batch batch;
+
+    if (!selected(name)) return;
+
+    memset(rom, 0, ROM_SIZE);
+    memcpy(&rom[0x100], loop, sizeof(loop));
+    if (batch_init(&batch, BENCH_BATCH_CONSOLES, rom, ROM_SIZE) != 0) return;
+    for (uint32_t i = 0; i < batch.count; i++) mmu_set_joypad(&batch.gb[i].mmu, (uint8_t)(i % inputs));
+
+    double start = now_seconds();
+    for (uint64_t n = 0; n < frames; n++) {
+        if (lockstep) batch_run_frame(&batch);
+        else for (uint32_t i = 0; i < batch.count; i++) gb_run_frame(&batch.gb[i]);
+    }
+    double elapsed = now_seconds() - start;
+
+    record(name, "frames/s", frames * batch.count, elapsed);
+    batch_free(&batch);
+}
+
+static int write_json(FILE *out) {
+    fprintf(out, "{\n  \"benchmarks\": [");
+    for (int i = 0; i < result_count; i++) {
+        const BenchResult *r = &results[i];
+        fprintf(out, "%s\n    {\"name\": \"%s\", \"unit\": \"%s\", \"value\": %.*f, \"iterations\": %llu, \"seconds\": %.6f}",
+            i ? "," : "", r->name, r->unit, r->decimals, r->value, (unsigned long long)r->iterations, r->seconds);
+    }
+    fprintf(out, "\n  ]\n}\n");
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    const char *json_filename = NULL;
+    uint64_t scale = 10; // --quick -> 1
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+            json_filename = argv[++i];
+        } else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            filter = argv[++i];
+        } else if (strcmp(argv[i], "--quick") == 0) {
+            scale = 1;
+        } else {
+            printf("Usage: %s [--json file] [--filter name] [--quick]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    fprintf(stderr, "⏱️  CuneGameBoy benchmarks (%s kernels)\n", video_simd_name());
+    bench_cpu(scale * 2000000);
+    bench_mmu(scale * 2000000);
+    bench_ppu("ppu_lines", 1, scale * 15400);
+    bench_ppu("ppu_lines_cached", 0, scale * 15400);
+    bench_video(scale * 100);
+    bench_ghosting(scale * 2000);
+    bench_frames("frames_bios", 0, GB_ACCURACY_FAST, 0, scale * 60);
+    bench_frames("frames_bios_skip3", 3, GB_ACCURACY_FAST, 0, scale * 60);
+    bench_frames("frames_bios_accurate", 0, GB_ACCURACY_CYCLE, 0, scale * 60);
+    bench_frames("frames_bios_ppu_thread", 0, GB_ACCURACY_FAST, 1, scale * 60);
+    bench_runahead(scale * 60);
+    bench_boot(scale * 1000);
+    bench_fork(scale * 10000);
+    bench_frames_mode("frames_dmg", 0x00, scale * 60);
+    bench_frames_mode("frames_cgb", 0x80, scale * 60);
+    bench_batch("frames_batch", 1, 16, scale * 6);
+    bench_batch("frames_batch_scalar", 0, 16, scale * 6);
+    bench_batch("frames_batch_4inputs", 1, 4, scale * 6);
+    bench_batch("frames_batch_4inputs_scalar", 0, 4, scale * 6);
+    record_ratio("frames_batch_speedup", "frames_batch", "frames_batch_scalar");
+    record_ratio("frames_batch_4inputs_speedup", "frames_batch_4inputs", "frames_batch_4inputs_scalar");
+
+    if (json_filename) {
+        FILE *f = fopen(json_filename, "w");
+        if (!f) {
+            printf("Erreur: impossible d'écrire '%s'\n", json_filename);
+            return 1;
+        }
+        write_json(f);
+        fclose(f);
+    } else {
+        write_json(stdout);
+    }
+    return 0;
+}
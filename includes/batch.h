@@ -0,0 +1,70 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "gb.h"
+
+// Many consoles running the same ROM (one read-only copy shared by all),
+// stepped together one instruction at a time.
+//
+// During batch_run_frame the CPU registers live in struct-of-arrays form, one
+// array entry per console ("lane"). At each step the consoles that sit on the
+// same PC of the same ROM bank with nothing special going on (no interrupt,
+// HALT, EI delay) form a group, and when the instruction only touches
+// registers the whole group runs it in one loop across the lanes, written so
+// the compiler turns it into SIMD. Everything else (memory accesses, calls,
+// lone consoles) goes through cpu_step as usual. At the end of the frame the
+// registers are written back to each GameBoy, so between frames every console
+// can be read, saved or given input on its own.
+//
+// Lockstep only pays when most instructions run in groups, and in groups big
+// enough to make up for the lane loops: below BATCH_MIN_LOCKSTEP percent, or
+// fewer than BATCH_MIN_GROUP consoles per group on average, the next
+// BATCH_RETRY_FRAMES frames run one console after the other (gb_run_frame),
+// then lockstep is tried again.
+
+#define BATCH_BLOCK  16 // lanes per vector loop, the arrays are padded to a multiple
+#define BATCH_GROUPS 32 // different PCs run in lockstep per step at most (group ids are uint8_t)
+#define BATCH_SCALAR_RUN 16 // instructions a console outside the groups runs in a row at most
+#define BATCH_MIN_LOCKSTEP 75
+#define BATCH_MIN_GROUP 10
+#define BATCH_RETRY_FRAMES 15
+
+typedef struct {
+    uint32_t count;       // consoles
+    uint32_t lanes;       // count rounded up to BATCH_BLOCK (padding lanes never join a group)
+    GameBoy *gb;
+
+    // === Struct of arrays, [lanes] each ===
+    const uint8_t **fetch; // ROM page of the next instruction, NULL = can't join a group (see batch_fetch)
+    uint32_t *ppuPending; // PPU cycles not given to ppu_step yet (lockstep lanes)
+    uint32_t *ppuBudget;  // ppu_next_event() at the last real step
+    uint8_t *reg[8];      // B C D E H L F A: r8 operand order, F in the (HL) slot
+    uint16_t *SP;
+    uint16_t *PC;
+    uint8_t *group;       // 1..BATCH_GROUPS = runs that group's instruction this step, 0 = cpu_step
+    uint8_t *cycles;      // cycles of the lockstep instruction (conditional jumps differ per lane)
+    uint8_t *operand;     // ALU A, d8 / A op A / ADD HL, HL or SP low byte (a row can't be its own source)
+    uint8_t *operandHigh; // ADD HL, HL or SP high byte
+    uint8_t *fetchPage;   // PC page fetch was read for
+    uint8_t *speed;       // double speed: PPU cycles = CPU cycles >> speed
+    uint8_t *done;        // frame finished
+    uint8_t *attention;   // lanes_account(): 0 = nothing to do, 1 = cpu_step, 2 = PPU event or new page
+    void *memory;         // one block for all the arrays
+
+    uint32_t scalarFrames;  // frames left to run without lockstep
+
+    // === Stats ===
+    uint64_t lockstepSteps; // instructions run by the lane loops (one per console)
+    uint64_t lockstepGroups; // lane loops run: lockstepSteps / lockstepGroups consoles per group
+    uint64_t scalarSteps;   // instructions run by cpu_step in lockstep frames
+    uint64_t lockstepFrames;
+} Batch;
+
+// === Functions ===
+int batch_init(Batch *batch, uint32_t count, const uint8_t *rom, size_t size);
+void batch_free(Batch *batch);
+void batch_run_frame(Batch *batch);
+
+#endif
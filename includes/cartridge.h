@@ -48,6 +48,33 @@ typedef struct {
 
 } Cartridge;
 
+// ===== Header (0x0100-0x014F) =====
+#define CARTRIDGE_HEADER_END 0x0150
+
+typedef struct {
+    char title[17];          // 0x0134-0x0143, NUL terminated, trailing zeros/spaces removed
+    uint8_t cgbFlag;         // 0x0143: 0x80 = CGB enhanced, 0xC0 = CGB only
+    uint8_t sgbFlag;         // 0x0146: 0x03 = SGB functions
+    uint8_t cartType;        // 0x0147
+    uint8_t romSizeCode;     // 0x0148
+    uint8_t ramSizeCode;     // 0x0149
+    uint8_t licensee;        // 0x014B (0x33 = new licensee code in 0x0144-0x0145)
+    uint8_t version;         // 0x014C
+    uint8_t headerChecksum;  // 0x014D
+    uint8_t headerValid;     // 1 = 0x014D matches 0x0134-0x014C (the boot ROM checks it)
+    uint8_t globalValid;     // 1 = 0x014E-0x014F matches the sum of the whole ROM
+    uint8_t hasRam, hasBattery, hasRtc;
+    MBCType mbcType;
+    uint16_t globalChecksum; // 0x014E-0x014F, big endian
+    uint32_t romSize;        // bytes, from romSizeCode
+    uint32_t ramSize;        // bytes, from ramSizeCode (MBC2: 512 built in)
+    uint32_t crc32;          // whole file
+} CartridgeHeader;
+
 // === Functions ===
+MBCType cartridge_mbc_type(uint8_t cartType);
+const char *cartridge_mbc_name(MBCType type);
+int cartridge_parse_header(const uint8_t *data, size_t size, CartridgeHeader *header);
+uint32_t cartridge_crc32(uint32_t crc, const uint8_t *data, size_t size);
 
 #endif
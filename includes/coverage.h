@@ -0,0 +1,58 @@
+#ifndef COVERAGE_H
+#define COVERAGE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include "mmu.h"
+
+// ROM coverage: one bit per ROM byte executed (opcode and operand fetches) and
+// one per byte read as data (mmu_read), indexed by offset in the ROM file.
+// Only compiled in with `make COVERAGE=1` (-DGB_COVERAGE); without it the
+// COVERAGE_* macros expand to nothing.
+//
+// File (.gbcov), shared by parallel runs of the same ROM: coverage_merge_file
+// ORs our bits into it under an exclusive flock.
+//   "GBCOV1\0\0", u32 ROM size, u32 ROM CRC32, exec bitmap, read bitmap
+//   (ROM size / 8 bytes each, bit n of byte i = ROM offset i * 8 + n)
+
+#define COVERAGE_MAGIC "GBCOV1\0\0"
+
+typedef struct Coverage {
+    uint32_t romSize;
+    uint32_t crc;      // cartridge_crc32 of the ROM, files of another ROM are refused
+    uint8_t *exec;
+    uint8_t *read;
+} Coverage;
+
+#ifdef GB_COVERAGE
+
+// Bank 0 is at its own offset, 0x4000-0x7FFF at the selected bank (same
+// decoding as mmu_peek); the BIOS overlay is not ROM
+static inline void coverage_mark(uint8_t *bits, const MMU *mmu, uint16_t addr) {
+    if (addr >= 0x8000 || (addr < 0x100 && mmu->bios_active)) return;
+    size_t offset = addr < 0x4000 ? addr : (size_t)mmu->rom_bank_low * 0x4000 + (addr - 0x4000);
+    if (offset < mmu->coverage->romSize) bits[offset >> 3] |= (uint8_t)(1 << (offset & 7));
+}
+
+#define COVERAGE_ON(mmu)         ((mmu)->coverage != NULL)
+#define COVERAGE_EXEC(mmu, addr) do { if ((mmu)->coverage) coverage_mark((mmu)->coverage->exec, (mmu), (addr)); } while (0)
+#define COVERAGE_READ(mmu, addr) do { if ((mmu)->coverage) coverage_mark((mmu)->coverage->read, (mmu), (addr)); } while (0)
+
+#else
+
+#define COVERAGE_ON(mmu)         0
+#define COVERAGE_EXEC(mmu, addr) ((void)0)
+#define COVERAGE_READ(mmu, addr) ((void)0)
+
+#endif
+
+// === Functions ===
+int coverage_enabled(void);
+int coverage_init(Coverage *cov, const uint8_t *rom, size_t size);
+void coverage_free(Coverage *cov);
+void coverage_merge(Coverage *dst, const Coverage *src);
+int coverage_merge_file(Coverage *cov, const char *filename); // cov gets the merged bits
+void coverage_report(const Coverage *cov, FILE *out);
+
+#endif
@@ -2,6 +2,7 @@
 #define CPU_H
 
 #include <stdint.h>
+#include <stddef.h>
 #include "mmu.h"
 
 // ===== Flags masks (in F register) =====
@@ -10,39 +11,28 @@
 #define FLAG_H 0x20    // Half carry
 #define FLAG_C 0x10    // Carry
 
+// ===== Register pairs =====
+// The 8-bit halves overlay the 16-bit pair in host byte order
+#if !defined(__BYTE_ORDER__) || (__BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__ && __BYTE_ORDER__ != __ORDER_BIG_ENDIAN__)
+#error "unknown byte order: the register pairs need __BYTE_ORDER__"
+#endif
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define CPU_PAIR(high, low) union { struct { uint8_t low; uint8_t high; }; uint16_t high##low; }
+#else
+#define CPU_PAIR(high, low) union { struct { uint8_t high; uint8_t low; }; uint16_t high##low; }
+#endif
+
+// Cycle-accurate core: runs the rest of the console for `cycles` CPU cycles
+typedef void (*CpuTickHook)(void *ctx, uint16_t cycles);
+
 typedef struct {
     // === Registers ===
-    union {
-        struct {
-            uint8_t A;      // Accumulator
-            uint8_t F;      // Flags: Z -> Zero, N -> Substract, H -> Half-carry, C -> Carry
-        };
-        uint16_t AF;
-    };
-
-    union {
-        struct {
-            uint8_t B;
-            uint8_t C;
-        };
-        uint16_t BC;
-    };
-
-    union {
-        struct {
-            uint8_t D;
-            uint8_t E;
-        };
-        uint16_t DE;
-    };
-
-    union {
-        struct {
-            uint8_t H;
-            uint8_t L;
-        };
-        uint16_t HL;
-    };
+    // AF = A << 8 | F (SM83 order) on the host, so the pairs are used as is
+    CPU_PAIR(A, F);     // A: Accumulator, F: Flags (Z N H C, low nibble always 0)
+    CPU_PAIR(B, C);
+    CPU_PAIR(D, E);
+    CPU_PAIR(H, L);
 
     uint16_t SP;   // Stack Pointer
     uint16_t PC;   // Program Counter / Pointer
@@ -51,10 +41,28 @@ typedef struct {
     uint8_t ime;       // Interrupt Master Enable (0 or 1)
     uint8_t halted;    // HALT state
     uint8_t stopped;   // STOP state
+    uint8_t imePending; // EI: IME set after the next instruction
+    uint8_t locked;    // illegal opcode, the CPU is hung
+
+    // === Cycle-accurate core (cpu_step_accurate) ===
+    CpuTickHook tick;       // called before each memory access with the cycles since the previous one
+    void *tickCtx;
+    uint16_t stepCycles;    // cycles of the current instruction so far
+    uint16_t tickedCycles;  // of those, already given to tick
+
+    // === Tools ===
+    struct Profiler *profiler; // NULL = not profiling
 } CPU;
 
+// The high register is the high byte of its pair on this host
+_Static_assert(offsetof(CPU, A) == offsetof(CPU, AF) + (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__), "AF byte order");
+_Static_assert(offsetof(CPU, H) == offsetof(CPU, HL) + (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__), "HL byte order");
+
 // === Functions ===
 void cpu_init(CPU *cpu);
 uint16_t cpu_step(CPU *cpu, MMU *mmu);
+uint16_t cpu_execute(CPU *cpu, MMU *mmu);
+uint16_t cpu_step_accurate(CPU *cpu, MMU *mmu);    // cpu->tick must be set
+uint16_t cpu_execute_accurate(CPU *cpu, MMU *mmu);
 
 #endif
\ No newline at end of file
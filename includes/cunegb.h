@@ -0,0 +1,79 @@
+#ifndef CUNEGB_H
+#define CUNEGB_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// libcunegb: the emulator core as a shared library (make lib -> bin/libcunegb.so).
+//
+// Only this header is public: the console is an opaque handle, so the internal
+// structs can change without breaking programs built against an older version.
+// Bump CUNEGB_ABI_VERSION (and the soname) when a declaration below changes.
+//
+// Nothing is copied out: cunegb_framebuffer() and cunegb_memory() point inside
+// the console and stay valid until cunegb_destroy(), the next step updates them
+// in place. Instances don't share anything, one thread per instance is fine.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CUNEGB_API __attribute__((visibility("default")))
+
+#define CUNEGB_ABI_VERSION 1
+
+#define CUNEGB_WIDTH  160
+#define CUNEGB_HEIGHT 144
+
+typedef struct CuneGB CuneGB;
+
+// Buttons for cunegb_step (1 = pressed)
+enum {
+    CUNEGB_RIGHT  = 0x01,
+    CUNEGB_LEFT   = 0x02,
+    CUNEGB_UP     = 0x04,
+    CUNEGB_DOWN   = 0x08,
+    CUNEGB_A      = 0x10,
+    CUNEGB_B      = 0x20,
+    CUNEGB_SELECT = 0x40,
+    CUNEGB_START  = 0x80
+};
+
+// Flags for cunegb_create
+#define CUNEGB_BORROW_ROM 0x01 // use the caller's buffer, it must outlive the instance (shared by many instances)
+
+// Regions for cunegb_memory
+typedef enum {
+    CUNEGB_WRAM = 0,  // 0xC000-0xDFFF, 8KB (CGB: 32KB, bank n at n * 4KB)
+    CUNEGB_HRAM,      // 0xFF80-0xFFFE
+    CUNEGB_VRAM,      // 0x8000-0x9FFF, 8KB (CGB: 16KB, 2 banks)
+    CUNEGB_OAM,       // 0xFE00-0xFE9F
+    CUNEGB_IO,        // 0xFF00-0xFF7F as stored (FF00 is computed on read)
+    CUNEGB_CART_RAM   // 0xA000-0xBFFF, all banks
+} CuneGBMemory;
+
+CUNEGB_API uint32_t cunegb_abi_version(void);
+
+// NULL when the ROM can't be loaded. The console starts in its post-boot state
+CUNEGB_API CuneGB *cunegb_create(const void *rom, size_t size, uint32_t flags);
+CUNEGB_API void cunegb_destroy(CuneGB *gb);
+CUNEGB_API void cunegb_reset(CuneGB *gb); // power cycle, memory views stay valid (cartridge RAM is cleared)
+
+// Run `frames` frames with `buttons` held, returns the CPU cycles run
+CUNEGB_API uint64_t cunegb_step(CuneGB *gb, uint32_t frames, uint8_t buttons);
+CUNEGB_API void cunegb_set_frameskip(CuneGB *gb, uint8_t frames);
+
+CUNEGB_API int cunegb_is_cgb(const CuneGB *gb);
+CUNEGB_API uint64_t cunegb_frame_count(const CuneGB *gb);
+CUNEGB_API int cunegb_frame_unchanged(const CuneGB *gb); // last frame identical to the one before
+
+// 160x144, row major. DMG: shades 0 (white) to 3 (black). CGB: RGB555, NULL on DMG
+CUNEGB_API const uint8_t *cunegb_framebuffer(const CuneGB *gb);
+CUNEGB_API const uint16_t *cunegb_color_framebuffer(const CuneGB *gb);
+CUNEGB_API const uint8_t *cunegb_memory(const CuneGB *gb, CuneGBMemory region, size_t *size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
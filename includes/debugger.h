@@ -0,0 +1,86 @@
+#ifndef DEBUGGER_H
+#define DEBUGGER_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "cpu.h"
+#include "mmu.h"
+
+// PC breakpoints are a 64K-bit bitmap tested by the tools frame loop,
+// watchpoints put their pages on the MMU slow path (trap_read / trap_write).
+// With nothing set the debugger is detached and the normal loop / fast paths run.
+
+#define DEBUGGER_MAX_BREAKPOINTS 64
+#define DEBUGGER_MAX_WATCHPOINTS 32
+#define DEBUGGER_MAX_EXPR        64
+
+#define WATCH_READ   0x01
+#define WATCH_WRITE  0x02
+#define WATCH_ACCESS (WATCH_READ | WATCH_WRITE)
+
+typedef enum {
+    STOP_NONE = 0,
+    STOP_BREAKPOINT,
+    STOP_WATCHPOINT,
+    STOP_STEP,
+    STOP_INTERRUPT, // asked by the user (Ctrl-C in gdb)
+} StopReason;
+
+// Condition compiled to RPN, ex: "A == 0x10 && [HL] != 0"
+typedef struct {
+    uint16_t ops[DEBUGGER_MAX_EXPR];
+    int32_t values[DEBUGGER_MAX_EXPR];
+    int count;
+} DebugExpr;
+
+typedef struct {
+    uint16_t addr;
+    uint8_t hasCondition;
+    DebugExpr condition;
+} Breakpoint;
+
+typedef struct {
+    uint16_t addr;
+    uint16_t length;
+    uint8_t type;           // WATCH_READ / WATCH_WRITE / WATCH_ACCESS
+    uint8_t hasCondition;
+    DebugExpr condition;    // `value` = byte read or written
+} Watchpoint;
+
+typedef struct Debugger {
+    CPU *cpu;
+    MMU *mmu;
+
+    uint8_t bitmap[0x10000 / 8];    // 1 bit per PC with a breakpoint
+    Breakpoint breakpoints[DEBUGGER_MAX_BREAKPOINTS];
+    int breakpointCount;
+    Watchpoint watchpoints[DEBUGGER_MAX_WATCHPOINTS];
+    int watchpointCount;
+
+    // == Stop state ==
+    StopReason stopReason;          // STOP_NONE while running
+    uint16_t stopAddr;              // PC (breakpoint) or accessed address (watchpoint)
+    uint8_t stopAccess;             // WATCH_READ / WATCH_WRITE for watchpoints
+    uint8_t skipBreakpoint;         // resume from a breakpoint without hitting it again
+    uint8_t singleStep;             // stop after the next instruction
+} Debugger;
+
+#define DEBUGGER_HAS_BREAKPOINT(dbg, pc) ((dbg)->bitmap[(pc) >> 3] & (1 << ((pc) & 7)))
+
+// === Functions ===
+void debugger_init(Debugger *dbg, CPU *cpu, MMU *mmu);
+void debugger_detach(Debugger *dbg);
+int debugger_parse_expr(DebugExpr *expr, const char *text);
+int32_t debugger_eval(Debugger *dbg, const DebugExpr *expr, int32_t value);
+int debugger_add_breakpoint(Debugger *dbg, uint16_t addr, const char *condition);
+int debugger_remove_breakpoint(Debugger *dbg, uint16_t addr);
+int debugger_add_watchpoint(Debugger *dbg, uint16_t addr, uint16_t length, uint8_t type, const char *condition);
+int debugger_remove_watchpoint(Debugger *dbg, uint16_t addr, uint16_t length, uint8_t type);
+int debugger_add_breakpoint_spec(Debugger *dbg, const char *spec);
+int debugger_add_watchpoint_spec(Debugger *dbg, const char *spec);
+int debugger_check_breakpoint(Debugger *dbg);
+int debugger_active(const Debugger *dbg);
+void debugger_resume(Debugger *dbg);
+void debugger_print_state(Debugger *dbg, FILE *out);
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef GB_H
+#define GB_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "cpu.h"
+#include "mmu.h"
+#include "ppu.h"
+
+// ===== Accuracy =====
+// Both cores are in every build; each console picks one when it is created
+typedef enum {
+    GB_ACCURACY_FAST = 0, // whole instructions, the PPU catches up after each one
+    GB_ACCURACY_CYCLE     // M-cycles: the PPU runs up to every memory access (cpu_step_accurate)
+} GBAccuracy;
+
+// ===== Whole console =====
+typedef struct {
+    CPU cpu;
+    MMU mmu;
+    PPU ppu;
+
+    uint64_t frames;   // frames emulated since init
+    uint8_t accuracy;  // GBAccuracy
+
+    // === Tools ===
+    struct Debugger *debugger; // NULL = normal frame loop
+    struct Tracer *tracer;     // binary execution trace (trace.h), NULL = off
+} GameBoy;
+
+// === Functions ===
+void gb_init(GameBoy *gb);
+void gb_init_accuracy(GameBoy *gb, GBAccuracy accuracy);
+int gb_load_rom(GameBoy *gb, const uint8_t *data, size_t size);
+int gb_attach_rom(GameBoy *gb, const uint8_t *data, size_t size);
+void gb_free(GameBoy *gb);
+int gb_boot(GameBoy *gb);
+int gb_fork(GameBoy *child, GameBoy *parent);
+uint16_t gb_step(GameBoy *gb);
+uint32_t gb_run_frame(GameBoy *gb);
+
+#endif
@@ -0,0 +1,14 @@
+#ifndef GDBSTUB_H
+#define GDBSTUB_H
+
+#include "gb.h"
+#include "debugger.h"
+
+// Minimal GDB remote serial protocol stub on a local Unix socket.
+// Registers ('g' packet) are AF, BC, DE, HL, SP, PC as 16-bit little endian values.
+// Supported: ? g G p P m M c s Z0-Z4 z0-z4 k D qSupported qAttached, Ctrl-C to break.
+
+// === Functions ===
+int gdbstub_serve(GameBoy *gb, Debugger *dbg, const char *socket_path);
+
+#endif
@@ -0,0 +1,81 @@
+#ifndef JOYPAD_H
+#define JOYPAD_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include "gb.h"
+
+// Host input for FF00 (P1). The buttons are sampled when the game reads FF00
+// (mmu->joypad_poll) instead of once per frame: a press that comes in while
+// a frame is being emulated reaches the game at its next read, often in the
+// same frame. They are also sampled before each frame, so a game that only
+// waits for the joypad interrupt (HALT, STOP) still gets it.
+//
+// Sources: a callback (front end with a window: keyboard / pad state), or an
+// input file, the stand-in for headless runs:
+//   # comment
+//   FRAME BUTTONS        "120 A+RIGHT", "130.5 -" (nothing held)
+// held until the next line. FRAME is the emulated frame, counted from the
+// VBlank that ends the previous one; the fraction is later in it (0.5 = around
+// LY 67). Lines in increasing order, buttons RIGHT LEFT UP DOWN A B SELECT START.
+//
+// Latency: for each change of the buttons, the time until the end of the first
+// frame with new pixels that was drawn after the game read FF00
+// (input-to-photon), in frames. Pixels are compared with the last frame shown
+// (the PPU's frameUnchanged only says no line was redrawn). A change from the
+// callback is dated when it is first sampled: only the input file knows when
+// it really happened.
+
+typedef uint8_t (*JoypadSource)(void *ctx); // JOYPAD_* held now
+
+typedef enum {
+    JOYPAD_POLL_READ = 0, // at every FF00 read, and before each frame
+    JOYPAD_POLL_FRAME     // only before each frame (the usual front end loop, for comparison)
+} JoypadPollMode;
+
+typedef struct {
+    uint64_t time;       // PPU cycles since frame 0
+    uint8_t buttons;
+} JoypadEvent;
+
+typedef struct Joypad {
+    GameBoy *gb;
+    JoypadPollMode mode;
+    uint8_t buttons;     // last sample
+
+    // === Source ===
+    JoypadSource source; // NULL = events
+    void *sourceCtx;
+    JoypadEvent *events; // input file
+    size_t eventCount;
+    size_t nextEvent;
+
+    // === Latency ===
+    uint8_t waiting;     // 1 = change not read by the game yet, 2 = read, waiting for a new frame
+    uint64_t changeTime;
+    uint64_t readTime;
+    uint8_t shown[SCREEN_HEIGHT][SCREEN_WIDTH];       // last frame shown
+    uint16_t shownColor[SCREEN_HEIGHT][SCREEN_WIDTH]; // (CGB)
+
+    // === Counters ===
+    uint64_t polls;      // samples taken at FF00 reads
+    uint64_t changes;
+    uint64_t measured;   // changes that reached the screen before the next one
+    uint64_t readDelay;  // sum over `measured`, PPU cycles: change -> first read
+    uint64_t latency;    // change -> end of the frame showing it
+    uint64_t latencyMax;
+} Joypad;
+
+// === Functions ===
+int joypad_parse_buttons(const char *text, uint8_t *buttons);
+void joypad_init(Joypad *pad, GameBoy *gb, JoypadPollMode mode);
+void joypad_set_source(Joypad *pad, JoypadSource source, void *ctx);
+int joypad_load_file(Joypad *pad, const char *filename);
+void joypad_free(Joypad *pad);
+
+void joypad_begin_frame(Joypad *pad); // before gb_run_frame
+void joypad_end_frame(Joypad *pad, const PPU *shown); // after a completed frame
+void joypad_report(const Joypad *pad, FILE *out);
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef LINK_H
+#define LINK_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include "gb.h"
+
+// Link cable between two consoles, either two instances in this process (one
+// thread each) or one instance on each side of a Unix socket.
+//
+// Both sides run in lockstep by quanta of `quantum` CPU cycles. At the end of
+// each quantum they swap a LinkState and apply the transfers that completed:
+// the side whose internal clock transfer is due receives the other's SB, the
+// other side receives the master's SB (and its interrupt if it was waiting
+// with SC bit 7 set). Everything happens at quantum boundaries, so the result
+// doesn't depend on how the threads are scheduled.
+
+#define LINK_QUANTUM_DEFAULT 1024 // 1/4 of a byte at 8192 Hz
+
+// What one side shows the other at a sync point
+typedef struct {
+    uint8_t sb;
+    uint8_t sc;
+    uint8_t due;   // internal clock transfer finished, waiting for the byte
+    uint8_t stop;  // this side is leaving, the other one sees an unplugged cable
+} LinkState;
+
+typedef enum {
+    LINK_THREADS = 0, // both instances in this process
+    LINK_SOCKET       // one instance here, the other one in another process
+} LinkMode;
+
+struct Link;
+
+typedef struct {
+    struct Link *link;
+    GameBoy *gb;
+    int side;              // 0 or 1
+    uint8_t connected;     // 0 once the other side left
+    uint64_t cycles;       // CPU cycles run since connected
+    uint64_t nextSync;
+    uint64_t syncs;
+    uint64_t transfers;    // bytes sent as master
+} LinkEnd;
+
+typedef struct Link {
+    LinkMode mode;
+    uint32_t quantum;
+    LinkEnd ends[2];       // socket mode: only ends[0] is used
+
+    // === LINK_THREADS ===
+    pthread_barrier_t barrier;
+    LinkState published[2][2]; // [sync parity][side], double buffered so one barrier per sync is enough
+    pthread_t thread;          // runs ends[1]
+    uint8_t threadRunning;
+
+    // === LINK_SOCKET ===
+    int fd;
+} Link;
+
+// === Functions ===
+int link_connect(Link *link, GameBoy *a, GameBoy *b, uint32_t quantum);
+int link_start_thread(Link *link);
+int link_host(Link *link, GameBoy *gb, const char *path, uint32_t quantum);
+int link_join(Link *link, GameBoy *gb, const char *path);
+uint32_t link_run_frame(LinkEnd *end);
+void link_close(Link *link);
+
+#endif
@@ -4,9 +4,45 @@
 #include <stdint.h>
 #include <stddef.h>
 
+#define MMU_PAGE_SHIFT 12
+#define MMU_PAGE_SIZE  0x1000
+#define MMU_PAGES      16
+
+// ===== RAM pages (copy-on-write, see mmu_fork) =====
+// VRAM, WRAM and cartridge RAM are reached through ram_page[], one slot per 4KB
+#define MMU_SLOT_VRAM  0   // 4 pages: bank 0, then bank 1
+#define MMU_VRAM_BLOCK 32  // bytes per bit of vram_dirty
+#define MMU_SLOT_WRAM  4   // 8 pages
+#define MMU_SLOT_ERAM  12  // up to 8 pages (eram_size)
+#define MMU_RAM_PAGES  20
+
+// ===== Joypad buttons (1 = pressed) =====
+#define JOYPAD_RIGHT  0x01
+#define JOYPAD_LEFT   0x02
+#define JOYPAD_UP     0x04
+#define JOYPAD_DOWN   0x08
+#define JOYPAD_A      0x10
+#define JOYPAD_B      0x20
+#define JOYPAD_SELECT 0x40
+#define JOYPAD_START  0x80
+
+// 4KB shared by forked consoles, read only while refs > 0; freed by the last one
+typedef struct {
+    uint32_t refs;
+    uint8_t data[MMU_PAGE_SIZE];
+} MmuPage;
+
+// Called on accesses that went through the slow path (see trap_read / trap_write)
+typedef void (*MmuAccessHook)(void *ctx, uint16_t addr, uint8_t val, uint8_t write);
+
+// Asked for the buttons held (JOYPAD_*) when the game reads FF00 (joypad.h)
+typedef uint8_t (*MmuJoypadPoll)(void *ctx);
+
 typedef struct {
     uint8_t *rom;
     size_t rom_size;
+    uint8_t rom_borrowed;   // 1 = the caller owns rom (mmu_attach_rom), never written nor freed
+    uint32_t *rom_refs;     // our copy: consoles forked from each other share it, the last one frees it
 
     uint8_t rom_bank_low;   // bank number (1..)
     uint8_t ram_enabled;
@@ -16,8 +52,8 @@ typedef struct {
     size_t eram_size;
 
     // Internal memory areas
-    uint8_t vram[0x2000];   // 0x8000-0x9FFF
-    uint8_t wram[0x2000];   // 0xC000-0xDFFF
+    uint8_t vram[0x4000];   // 0x8000-0x9FFF, 2 banks of 8KB (bank 1 = CGB only)
+    uint8_t wram[0x8000];   // 0xC000-0xDFFF, 8 banks of 4KB (0xD000 switchable on CGB)
     uint8_t oam[0xA0];      // 0xFE00-0xFE9F
     uint8_t io[0x80];       // 0xFF00-0xFF7F
     uint8_t hram[0x7F];     // 0xFF80-0xFFFE
@@ -29,15 +65,103 @@ typedef struct {
 
     // simple MBC type detection (0 = no MBC, 1 = MBC1-like)
     uint8_t mbc_type;
+
+    // ===== Game Boy Color =====
+    uint8_t cgb;            // 1 = CGB mode (header 0x0143 bit 7)
+    uint8_t vram_bank;      // VBK (0-1)
+    uint8_t wram_bank;      // SVBK (1-7)
+    uint8_t double_speed;   // KEY1 bit 7
+    uint8_t bg_palette[64]; // BCPD: 8 palettes x 4 colors, RGB555 little endian
+    uint8_t obj_palette[64];// OCPD
+
+    // HDMA (FF51-FF55): the source/destination advance 16 bytes per block
+    uint16_t hdma_src;
+    uint16_t hdma_dst;
+    uint8_t hdma_blocks;    // blocks left in the HBlank transfer
+    uint8_t hdma_active;    // 1 = one block copied at each HBlank
+
+    // ===== Serial (FF01 SB / FF02 SC) =====
+    // Internal clock transfers take 8 bits at 8192 Hz (CGB fast clock: 262144 Hz)
+    uint8_t serial_active;  // internal clock transfer running (mmu_serial_tick needed)
+    uint8_t serial_due;     // linked: 8 bits clocked, waiting for the partner's byte
+    uint8_t serial_linked;  // 1 = a link cable decides the received bytes (link.c)
+    int32_t serial_cycles;  // cycles left in the running transfer
+
+    // ===== Joypad (FF00 P1) =====
+    uint8_t joypad;         // JOYPAD_* pressed; FF00 is built from it and the select bits
+    MmuJoypadPoll joypad_poll; // host input sampled at every FF00 read, NULL = only mmu_set_joypad
+    void *joypad_ctx;
+
+    // Memory map: one pointer per 4KB page, NULL = slow path (IO, MBC registers, traps...)
+    // Rebuilt by mmu_update_map() every time banking or a trap changes
+    uint8_t *read_map[MMU_PAGES];
+    uint8_t *write_map[MMU_PAGES];
+
+    // Pages forced on the slow path (1 bit per page) so access_hook sees every access
+    uint16_t trap_read;
+    uint16_t trap_write;
+    MmuAccessHook access_hook;
+    void *access_ctx;
+
+    struct Coverage *coverage; // ROM coverage bitmaps (coverage.h, make COVERAGE=1), NULL = off
+
+    // Change tracking for the PPU line cache: the first VRAM write after
+    // mmu_watch_vram() takes the slow path and bumps vram_version, later ones are fast again
+    uint8_t vram_watch;
+    uint32_t vram_version;
+    uint32_t oam_version;     // OAM is always on the slow path (DMA included)
+    uint32_t palette_version; // CGB palette RAM
+
+    // VRAM write log for the PPU render thread (mmu_log_vram): every VRAM write
+    // takes the slow path and marks its block, bit n = vram[n * 32 .. n * 32 + 31]
+    uint8_t vram_log;
+    uint64_t vram_dirty[0x4000 / MMU_VRAM_BLOCK / 64];
+
+    // Flat 64KB address space (CPU test vectors): every page maps here, no IO;
+    // trapped pages still take the slow path, for access_hook
+    uint8_t *flat;
+
+    // ===== Copy-on-write pages =====
+    // Each slot points at its page in vram / wram / eram, or into ram_shared[slot]
+    // once mmu_fork() gave the page away. A shared page is never written: it is
+    // kept off write_map, and the first write copies it back to our own array
+    uint8_t *ram_page[MMU_RAM_PAGES];
+    MmuPage *ram_shared[MMU_RAM_PAGES];
 } MMU;
 
+// Byte of VRAM (0x0000-0x3FFF, bank 1 at 0x2000) wherever its page is
+static inline uint8_t mmu_vram(const MMU *mmu, uint16_t offset) {
+    return mmu->ram_page[MMU_SLOT_VRAM + (offset >> MMU_PAGE_SHIFT)][offset & (MMU_PAGE_SIZE - 1)];
+}
+
 // == Function ==
 void mmu_init(MMU *mmu);
 int mmu_load_bios_file(MMU *mmu, const char *filename);
 int mmu_load_bios(MMU *mmu, const uint8_t *bios_data, size_t size);
 int mmu_load_rom(MMU *mmu, const uint8_t *data, size_t size);
+int mmu_attach_rom(MMU *mmu, const uint8_t *data, size_t size);
 void mmu_free_rom(MMU *mmu);
+void mmu_adopt_eram(MMU *mmu, uint8_t *eram);
+int mmu_fork(MMU *child, MMU *parent);
+void mmu_unshare(MMU *mmu);
+void mmu_select_mbc(MMU *mmu, uint8_t cart_type);
+void mmu_update_map(MMU *mmu);
+void mmu_map_flat(MMU *mmu, uint8_t *memory);
+void mmu_watch_vram(MMU *mmu);
+void mmu_log_vram(MMU *mmu, int on);
+uint8_t mmu_peek(MMU *mmu, uint16_t addr);
+void mmu_hdma_hblank(MMU *mmu);
+void mmu_serial_tick(MMU *mmu, uint32_t cycles);
+void mmu_serial_complete(MMU *mmu, uint8_t received);
+void mmu_set_joypad(MMU *mmu, uint8_t buttons);
+uint8_t mmu_joypad_lines(const MMU *mmu); // P1 bits 0-3 as the game sees them (0 = pressed and selected)
+int mmu_joypad_wake(MMU *mmu);           // STOP: 1 once a selected button is held
 uint8_t mmu_read(MMU *mmu, uint16_t addr);
+uint8_t mmu_fetch(MMU *mmu, uint16_t addr); // mmu_read for opcode and operand bytes
 void mmu_write(MMU *mmu, uint16_t addr, uint8_t val);
+uint16_t mmu_read16(MMU *mmu, uint16_t addr);   // little endian, one load when both bytes share a mapped page
+uint16_t mmu_fetch16(MMU *mmu, uint16_t addr);
+void mmu_write16(MMU *mmu, uint16_t addr, uint16_t val);    // stack order: high byte first when split
+void mmu_write16_le(MMU *mmu, uint16_t addr, uint16_t val); // low byte first when split (LD (a16),SP)
 
 #endif
\ No newline at end of file
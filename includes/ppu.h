@@ -7,6 +7,24 @@
 #define SCREEN_WIDTH 160
 #define SCREEN_HEIGHT 144
 
+// ===== Timings (in CPU cycles) =====
+#define PPU_OAM_CYCLES      80   // mode 2
+#define PPU_TRANSFER_CYCLES 172  // mode 3
+#define PPU_HBLANK_CYCLES   204  // mode 0
+#define PPU_LINE_CYCLES     456
+#define PPU_LINES           154
+#define PPU_FRAME_CYCLES    (PPU_LINE_CYCLES * PPU_LINES)
+
+// Everything a scanline's pixels depend on: when it matches, the line is left as is
+typedef struct {
+    uint8_t valid;
+    uint8_t LCDC, SCY, SCX, BGP, OBP0, OBP1, WY, WX;
+    uint8_t windowLine;
+    uint32_t vramVersion, oamVersion, paletteVersion;
+} PPULineKey;
+
+struct PPUWorker;
+
 typedef struct {
 
     // ===== Registers (hardware mapped) =====
@@ -23,18 +41,47 @@ typedef struct {
     uint8_t WX;      // FF4B - Window X
 
     // ===== Internal state =====
-    uint16_t modeClock;   // mode timing counter
+    uint32_t modeClock;   // mode timing counter
     uint8_t mode;         // current PPU mode (0-3)
     uint8_t spriteHeight; // 8 or 16
     uint8_t frameComplete;
+    uint8_t windowLine;   // internal window line counter
+    uint8_t frameUnchanged; // set with frameComplete: no pixel differs from the previous frame
+    uint16_t linesChanged;  // lines rendered since the last completed frame
+
+    // ===== Frameskip =====
+    // Timing, STAT and interrupts are the same, only the pixels of skipped frames are not drawn
+    uint8_t frameskip;      // frames skipped after each drawn one (0 = draw all)
+    uint8_t skipCounter;
+    uint8_t skipFrame;      // current frame is not drawn
+    uint8_t frameSkipped;   // set with frameComplete: the framebuffer still holds an older frame
+
+    // ===== Render thread =====
+    // Lines drawn on a thread of their own (ppu_start_worker), NULL = by ppu_step itself
+    struct PPUWorker *worker;
 
     // ===== Framebuffer =====
     // Each pixel = uint8_t (0..3 after palette mapping)
+    // CGB: palette entry instead (BG 0..31, OBJ 32..63 = palette * 4 + color)
     uint8_t framebuffer[SCREEN_HEIGHT][SCREEN_WIDTH];
 
+    // CGB only: RGB555 of each pixel, resolved with the palette RAM of its line
+    uint16_t colorFramebuffer[SCREEN_HEIGHT][SCREEN_WIDTH];
+
+    // ===== Line cache =====
+    PPULineKey lineKeys[SCREEN_HEIGHT];
+
 } PPU;
 
 // === Functions ===
 void ppu_init(PPU *ppu);
+void ppu_step(PPU *ppu, MMU *mmu, uint16_t cycles);
+uint32_t ppu_next_event(const PPU *ppu, const MMU *mmu);
+uint32_t ppu_frame_position(const PPU *ppu);
+void ppu_invalidate(PPU *ppu);
+void ppu_set_frameskip(PPU *ppu, uint8_t frames);
+int ppu_start_worker(PPU *ppu, MMU *mmu);
+void ppu_sync(PPU *ppu); // wait for the lines queued on the render thread
+void ppu_stop_worker(PPU *ppu);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,78 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "mmu.h"
+
+// Sampling profiler for guest code: every `interval` emulated cycles we record
+// PC + ROM bank and the current call stack (tracked from CALL/RST/RET in cpu_step)
+
+#define PROFILER_MAX_DEPTH 64
+
+typedef struct {
+    uint16_t target;  // called address
+    uint8_t bank;     // ROM bank of the target
+    uint16_t sp;      // SP right after the return address was pushed
+} ProfilerFrame;
+
+typedef struct {
+    char *stack;      // "frame;frame;leaf"
+    uint64_t count;
+} ProfilerStack;
+
+typedef struct {
+    uint16_t addr;
+    uint8_t bank;
+    char *name;
+} ProfilerSymbol;
+
+typedef struct Profiler {
+    uint32_t interval;   // cycles between two samples
+    uint32_t counter;    // cycles since the last sample
+    uint64_t samples;
+
+    // == Shadow call stack ==
+    ProfilerFrame frames[PROFILER_MAX_DEPTH];
+    int depth;           // may be > PROFILER_MAX_DEPTH, extra frames are not stored
+
+    // == Histogram of (bank << 16 | PC) ==
+    uint32_t *pcKeys;
+    uint64_t *pcCounts;
+    size_t pcCapacity;
+    size_t pcUsed;
+
+    // == Collapsed stacks ==
+    ProfilerStack *stacks;
+    size_t stackCapacity;
+    size_t stackUsed;
+
+    // == Symbols (.sym file), sorted by bank then address ==
+    ProfilerSymbol *symbols;
+    size_t symbolCount;
+} Profiler;
+
+// Called from the run loop
+#define PROFILER_TICK(p, cpu, mmu, cycles) do { \
+    (p)->counter += (cycles); \
+    if ((p)->counter >= (p)->interval) { \
+        (p)->counter -= (p)->interval; \
+        profiler_sample((p), (cpu)->PC, (mmu)); \
+    } \
+} while (0)
+
+// Called from cpu_step (only when a profiler is attached)
+#define PROFILER_CALL(cpu, mmu) do { if ((cpu)->profiler) profiler_call((cpu)->profiler, (cpu)->PC, (cpu)->SP, (mmu)); } while (0)
+#define PROFILER_RET(cpu)       do { if ((cpu)->profiler) profiler_ret((cpu)->profiler, (cpu)->SP); } while (0)
+
+// === Functions ===
+Profiler *profiler_create(uint32_t interval);
+void profiler_free(Profiler *p);
+int profiler_load_symbols(Profiler *p, const char *filename);
+void profiler_call(Profiler *p, uint16_t target, uint16_t sp, const MMU *mmu);
+void profiler_ret(Profiler *p, uint16_t sp);
+void profiler_sample(Profiler *p, uint16_t pc, const MMU *mmu);
+void profiler_report(Profiler *p, FILE *out, int top);
+int profiler_write_collapsed(Profiler *p, const char *filename);
+
+#endif
@@ -0,0 +1,79 @@
+#ifndef RECORD_H
+#define RECORD_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <pthread.h>
+#include "ppu.h"
+
+// Gameplay capture: frames go through a bounded queue to a writer thread.
+// The emulation never waits: when the queue is full the frame is dropped (and counted).
+//
+// Formats (chosen from the file extension):
+//  - .y4m: YUV4MPEG2 C444 video + a .wav next to it (44100 Hz, 16-bit stereo)
+//  - anything else: raw stream, header "GBRAW1" + u16 width + u16 height,
+//    then one tag per frame: 'F' + palette indexes (DMG), 'C' + RGB555 (CGB),
+//    'R' = same picture as the previous frame
+
+#define RECORD_QUEUE_SIZE  32
+#define RECORD_SAMPLE_RATE 44100
+#define RECORD_CLOCK       4194304 // CPU cycles per second (frame = PPU_FRAME_CYCLES)
+
+typedef enum {
+    RECORD_Y4M = 0,
+    RECORD_RAW
+} RecordFormat;
+
+// Duplicate (and dropped) frames don't take a slot: they are folded into the
+// `repeats` of the next one, written as copies of the previous picture
+typedef struct {
+    uint32_t repeats;    // previous picture repeated this many times first
+    uint8_t hasPicture;  // 0 = only repeats (last slot at close)
+    uint8_t cgb;
+    uint32_t samples;    // audio samples covered by the repeats + this frame
+    uint8_t framebuffer[SCREEN_HEIGHT][SCREEN_WIDTH];
+    uint16_t colorFramebuffer[SCREEN_HEIGHT][SCREEN_WIDTH];
+} RecordSlot;
+
+typedef struct Recorder {
+    RecordFormat format;
+    FILE *video;
+    FILE *audio;          // Y4M only
+    uint64_t audioBytes;
+
+    // === Producer side (emulation thread) ===
+    uint8_t haveLast;
+    uint8_t lastCgb;
+    uint8_t droppedSinceLast; // frameUnchanged then compares with a dropped frame, not the last one
+    uint8_t lastFramebuffer[SCREEN_HEIGHT][SCREEN_WIDTH];
+    uint16_t lastColorFramebuffer[SCREEN_HEIGHT][SCREEN_WIDTH];
+    uint64_t sampleClock;  // audio samples due since the start
+    uint32_t pendingRepeats;
+    uint32_t pendingSamples;
+
+    // === Queue ===
+    RecordSlot *slots;
+    int head, tail, count;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t notEmpty;
+    pthread_cond_t notFull;  // only waited on by record_close
+    uint8_t quit;
+    int error;             // set by the writer on an I/O error
+
+    // === Writer side ===
+    uint8_t yuv[3][SCREEN_HEIGHT][SCREEN_WIDTH]; // last picture (Y4M repeats it)
+    uint64_t written;      // frames written, repeats included
+
+    // === Counters ===
+    uint64_t frames;       // frames pushed
+    uint64_t duplicates;   // frames written as repeats
+    uint64_t dropped;      // frames lost because the queue was full
+} Recorder;
+
+// === Functions ===
+int record_open(Recorder *rec, const char *filename);
+void record_frame(Recorder *rec, const PPU *ppu, uint8_t cgb);
+int record_close(Recorder *rec);
+
+#endif
@@ -0,0 +1,62 @@
+#ifndef ROMINDEX_H
+#define ROMINDEX_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "cartridge.h"
+
+// ROM library index: a directory tree is scanned once (files parsed in parallel),
+// the headers are saved in one file that is mmap'ed back for lookups.
+//
+// File layout (native endianness, rebuilt when the version changes):
+//   RomIndexFileHeader
+//   RomIndexEntry[count]   sorted by pathHash
+//   char strings[]         NUL terminated absolute paths
+
+#define ROMINDEX_MAGIC   "GBROMIDX"
+#define ROMINDEX_VERSION 1
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t entrySize;      // sizeof(RomIndexEntry), catches layout changes
+    uint32_t count;
+    uint32_t reserved;
+    uint64_t stringsOffset;
+    uint64_t stringsSize;
+} RomIndexFileHeader;
+
+typedef struct {
+    uint64_t pathHash;       // FNV-1a of the absolute path
+    uint64_t pathOffset;     // in the string table
+    uint64_t fileSize;
+    int64_t mtime;           // seconds, the entry is stale when the file changed
+    CartridgeHeader header;
+} RomIndexEntry;
+
+typedef struct {
+    void *map;
+    size_t mapSize;
+    const RomIndexFileHeader *header;
+    const RomIndexEntry *entries;
+    const char *strings;
+} RomIndex;
+
+typedef struct {
+    uint32_t files;          // candidates found (.gb, .gbc, .sgb)
+    uint32_t indexed;
+    uint32_t failed;         // unreadable or too short for a header
+    uint64_t bytes;          // ROM bytes read
+} RomIndexStats;
+
+// === Functions ===
+int romindex_build(const char *root, const char *filename, int jobs, RomIndexStats *stats);
+
+int romindex_open(RomIndex *index, const char *filename);
+void romindex_close(RomIndex *index);
+const RomIndexEntry *romindex_find_path(const RomIndex *index, const char *path);
+const RomIndexEntry *romindex_find_crc(const RomIndex *index, uint32_t crc);
+const char *romindex_path(const RomIndex *index, const RomIndexEntry *entry);
+int romindex_entry_fresh(const RomIndexEntry *entry, const char *path);
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef RUNAHEAD_H
+#define RUNAHEAD_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "gb.h"
+
+// Run-ahead: hides the frames of input lag a game adds itself. After each
+// real frame the console is forked (gb_fork, copy-on-write) and the fork runs
+// `frames` more frames with the buttons held now, only the last one drawn.
+// That frame is the one shown, then the fork is dropped: the real console
+// never left its timeline, so there is nothing to restore.
+//
+// Nobody sees the real console's frames, they are not drawn either: a frame
+// costs 1 + `frames` frames of CPU but one frame of pixels.
+//
+// Each frame is timed against `budgetNs` (one 59.7 Hz frame by default). When
+// the average goes over it, `frames` is lowered by one, down to 0 (plain run).
+
+#define RUNAHEAD_MAX_FRAMES 8
+#define RUNAHEAD_BUDGET_NS  16742706ull // 1 / 59.73 s
+
+typedef struct {
+    GameBoy *gb;
+    GameBoy ahead;       // fork of the last frame
+    uint8_t forked;
+    uint8_t frames;      // frames run ahead (0 = off)
+    uint64_t budgetNs;
+
+    // === Counters ===
+    uint64_t runs;
+    uint64_t costNs;     // whole frames (real + ahead)
+    uint64_t costMaxNs;
+    uint64_t averageNs;  // moving average, compared with the budget
+    uint64_t overBudget; // frames that took longer than budgetNs
+    uint64_t lowered;    // times `frames` was lowered
+} RunAhead;
+
+// === Functions ===
+int runahead_init(RunAhead *ra, GameBoy *gb, uint8_t frames);
+const PPU *runahead_run_frame(RunAhead *ra); // the frame to show
+void runahead_report(const RunAhead *ra, FILE *out);
+void runahead_free(RunAhead *ra);
+
+#endif
@@ -0,0 +1,95 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+// Performance counters, only compiled in with `make STATS=1` (-DGB_STATS).
+// Without it every STATS_* macro expands to nothing, so the core pays nothing.
+
+// ===== Memory regions =====
+typedef enum {
+    REGION_ROM0 = 0, // 0x0000-0x3FFF
+    REGION_ROMX,     // 0x4000-0x7FFF
+    REGION_VRAM,     // 0x8000-0x9FFF
+    REGION_ERAM,     // 0xA000-0xBFFF
+    REGION_WRAM,     // 0xC000-0xDFFF
+    REGION_ECHO,     // 0xE000-0xFDFF
+    REGION_OAM,      // 0xFE00-0xFE9F
+    REGION_UNUSABLE, // 0xFEA0-0xFEFF
+    REGION_IO,       // 0xFF00-0xFF7F
+    REGION_HRAM,     // 0xFF80-0xFFFE
+    REGION_IE,       // 0xFFFF
+    REGION_COUNT
+} MemRegion;
+
+static inline MemRegion stats_region(uint16_t addr) {
+    if (addr <= 0x3FFF) return REGION_ROM0;
+    if (addr <= 0x7FFF) return REGION_ROMX;
+    if (addr <= 0x9FFF) return REGION_VRAM;
+    if (addr <= 0xBFFF) return REGION_ERAM;
+    if (addr <= 0xDFFF) return REGION_WRAM;
+    if (addr <= 0xFDFF) return REGION_ECHO;
+    if (addr <= 0xFE9F) return REGION_OAM;
+    if (addr <= 0xFEFF) return REGION_UNUSABLE;
+    if (addr <= 0xFF7F) return REGION_IO;
+    if (addr <= 0xFFFE) return REGION_HRAM;
+    return REGION_IE;
+}
+
+#ifdef GB_STATS
+
+typedef struct {
+    // == CPU ==
+    uint64_t opcodeCount[256];
+    uint64_t opcodeCycles[256];
+    uint64_t cbCount[256];
+
+    // == MMU ==
+    uint64_t reads[REGION_COUNT];
+    uint64_t writes[REGION_COUNT];
+
+    // == PPU ==
+    uint64_t linesRendered;
+    uint64_t linesCached;   // lines reused from the previous frame
+
+    // == Frames (host time) ==
+    uint64_t frames;
+    uint64_t frameNsTotal;
+    uint64_t frameNsMin;
+    uint64_t frameNsMax;
+} Stats;
+
+extern Stats gb_stats;
+
+uint64_t stats_now_ns(void);
+void stats_frame_end(uint64_t start_ns);
+
+#define STATS_OPCODE(op, cycles) do { gb_stats.opcodeCount[(op)]++; gb_stats.opcodeCycles[(op)] += (cycles); } while (0)
+#define STATS_CB_OPCODE(op)      (gb_stats.cbCount[(op)]++)
+#define STATS_READ(addr)         (gb_stats.reads[stats_region(addr)]++)
+#define STATS_WRITE(addr)        (gb_stats.writes[stats_region(addr)]++)
+#define STATS_PPU_LINE()         (gb_stats.linesRendered++)
+#define STATS_PPU_LINE_CACHED()  (gb_stats.linesCached++)
+#define STATS_FRAME_BEGIN(var)   uint64_t var = stats_now_ns()
+#define STATS_FRAME_END(var)     stats_frame_end(var)
+
+#else
+
+#define STATS_OPCODE(op, cycles) ((void)0)
+#define STATS_CB_OPCODE(op)      ((void)0)
+#define STATS_READ(addr)         ((void)0)
+#define STATS_WRITE(addr)        ((void)0)
+#define STATS_PPU_LINE()         ((void)0)
+#define STATS_PPU_LINE_CACHED()  ((void)0)
+#define STATS_FRAME_BEGIN(var)   ((void)0)
+#define STATS_FRAME_END(var)     ((void)0)
+
+#endif
+
+// === Functions ===
+int stats_enabled(void);
+void stats_report(FILE *out);
+int stats_write_json(const char *filename);
+
+#endif
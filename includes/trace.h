@@ -0,0 +1,150 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <pthread.h>
+#include "cpu.h"
+#include "mmu.h"
+
+// Binary execution trace: one record per instruction (or interrupt dispatch)
+// with its PC, opcode, the registers it changed, its memory accesses and a
+// cycle stamp. Steps spent in HALT/STOP don't get a record, their cycles go
+// into the next stamp.
+//
+// Records are delta + varint encoded into blocks of TRACE_BLOCK_SIZE bytes; full
+// blocks are queued to a writer thread that compresses them (LZ77, LZ4-like
+// sequences) and writes them out. The emulation only waits when the queue is
+// full: nothing is ever dropped, the waits are counted in `stalls`.
+//
+// File: "GBTRACE1" + u32 flags (bit 0 = CGB), then blocks. Each block header
+// holds the full CPU state before its first record, so a block can be decoded
+// on its own:
+//   u32 raw size, u32 stored size (== raw size: not compressed),
+//   u64 first record index, u64 cycle stamp, A F B C D E H L, u16 SP, u16 PC,
+//   u16 last access address, u16 reserved
+// Record:
+//   u8 flags (TRACE_F_*), zigzag varint PC - previous PC, varint cycles since
+//   the previous stamp, [opcode [CB opcode]], [u8 mask of A F B C D E H L + new
+//   values], [zigzag varint SP delta], [varint count + accesses: zigzag varint
+//   (address delta << 1 | write), value]
+//
+// Memory accesses come from the MMU access hook with every page trapped (the
+// way watchpoints work), opcode and operand fetches left out; tools/gb_tracedump.c
+// reads the files back (trace_reader_*).
+
+#define TRACE_MAGIC        "GBTRACE1"
+#define TRACE_BLOCK_SIZE   (64 * 1024)
+#define TRACE_QUEUE_SIZE   8
+#define TRACE_MAX_ACCESSES 192 // per record (an OAM DMA start reads 160 bytes)
+
+// Record flags
+#define TRACE_F_INTERRUPT 0x01 // interrupt dispatch, no opcode
+#define TRACE_F_CB        0x02 // CB prefix: second opcode byte follows
+#define TRACE_F_REGS      0x04
+#define TRACE_F_SP        0x08
+#define TRACE_F_MEMORY    0x10
+
+// 8-bit registers in record order
+enum { TRACE_REG_A, TRACE_REG_F, TRACE_REG_B, TRACE_REG_C, TRACE_REG_D, TRACE_REG_E, TRACE_REG_H, TRACE_REG_L };
+
+typedef struct {
+    uint16_t addr;
+    uint8_t value;
+    uint8_t write;
+} TraceAccess;
+
+// One decoded record; regs and SP are the values after it
+typedef struct {
+    uint64_t index;      // record number since the start of the trace
+    uint64_t cycle;      // CPU cycles since the start of the trace when it began
+    uint16_t PC;
+    uint8_t flags;       // TRACE_F_*
+    uint8_t opcode;
+    uint8_t cbOpcode;
+    uint8_t regs[8];     // TRACE_REG_A..TRACE_REG_L
+    uint16_t SP;
+    uint16_t accessCount;
+    TraceAccess accesses[TRACE_MAX_ACCESSES];
+} TraceEvent;
+
+// CPU state the deltas are taken against (same on both sides)
+typedef struct {
+    uint8_t regs[8];
+    uint16_t SP;
+    uint16_t PC;
+    uint16_t addr;       // last memory access (access addresses are deltas from it)
+    uint64_t index;
+    uint64_t cycle;
+} TraceState;
+
+typedef struct {
+    uint32_t used;       // bytes of records
+    TraceState start;    // state before the first record
+    uint8_t data[TRACE_BLOCK_SIZE];
+} TraceBlock;
+
+typedef struct Tracer {
+    FILE *file;
+    CPU *cpu;
+    MMU *mmu;
+
+    // === Producer side (emulation thread) ===
+    TraceBlock *block;   // being filled
+    TraceState state;
+    uint64_t cycles;     // CPU cycles since the start
+    uint8_t inStep;      // between trace_begin_step and trace_end_step
+    uint8_t stepFlags;
+    uint16_t stepPC;
+    uint8_t stepOpcode, stepCb;
+    uint16_t accessCount;
+    TraceAccess accesses[TRACE_MAX_ACCESSES];
+    MmuAccessHook chainedHook;  // hook that was there before (watchpoints), still called
+    void *chainedCtx;
+
+    // === Queue ===
+    TraceBlock *slots[TRACE_QUEUE_SIZE];
+    TraceBlock *spare[TRACE_QUEUE_SIZE + 1]; // free blocks
+    int spareCount;
+    int head, tail, count;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t notEmpty;
+    pthread_cond_t notFull;
+    uint8_t quit;
+    int error;           // set by the writer on an I/O error
+
+    // === Writer side ===
+    uint8_t *packed;     // compression output
+
+    // === Counters ===
+    uint64_t records;
+    uint64_t rawBytes;   // records before compression
+    uint64_t fileBytes;
+    uint64_t stalls;     // times the emulation waited for the writer
+    uint64_t accessesLost; // accesses over TRACE_MAX_ACCESSES in one record
+} Tracer;
+
+typedef struct {
+    FILE *file;
+    uint32_t flags;      // file flags (bit 0 = CGB)
+    uint8_t *raw;        // current block
+    uint8_t *packed;
+    uint32_t used, pos;
+    TraceState state;
+} TraceReader;
+
+// === Functions ===
+int trace_open(Tracer *tracer, const char *filename, CPU *cpu, MMU *mmu);
+void trace_begin_step(Tracer *tracer);
+void trace_end_step(Tracer *tracer, uint16_t cycles);
+int trace_close(Tracer *tracer);
+
+int trace_reader_open(TraceReader *reader, const char *filename);
+int trace_reader_next(TraceReader *reader, TraceEvent *event); // 1 = event, 0 = end, -1 = corrupt
+void trace_reader_close(TraceReader *reader);
+
+size_t trace_compress(const uint8_t *src, size_t size, uint8_t *dst, size_t capacity);
+long trace_decompress(const uint8_t *src, size_t size, uint8_t *dst, size_t capacity);
+
+#endif
@@ -0,0 +1,87 @@
+#ifndef VIDEO_H
+#define VIDEO_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <pthread.h>
+#include "ppu.h"
+
+// Output stage: framebuffer -> RGBA -> upscaled image
+// Pixels are uint32_t with R in the low byte (R, G, B, A in memory on little endian)
+
+#define VIDEO_MAX_SCALE 8
+#define VIDEO_RGBA(r, g, b) ((uint32_t)(r) | ((uint32_t)(g) << 8) | ((uint32_t)(b) << 16) | 0xFF000000u)
+
+// LCD ghosting: each output pixel keeps `ghosting`/256 of the previous picture
+// (exponential decay, an old frame fades by that factor every frame), so
+// sprites flickered on alternate frames show up half transparent like on the LCD
+#define VIDEO_MAX_GHOSTING 90 // percent
+
+// Source copied with a 2 pixel border (edge replicated) so the kernels never test bounds
+#define VIDEO_BORDER     2
+#define VIDEO_SRC_STRIDE (SCREEN_WIDTH + 2 * VIDEO_BORDER)
+#define VIDEO_SRC_HEIGHT (SCREEN_HEIGHT + 2 * VIDEO_BORDER)
+
+typedef enum {
+    VIDEO_FILTER_NEAREST = 0,
+    VIDEO_FILTER_SCALE2X,
+    VIDEO_FILTER_SCALE3X,
+    VIDEO_FILTER_XBR,      // 2xBR-style edge blending
+    VIDEO_FILTER_COUNT
+} VideoFilter;
+
+typedef struct Video {
+    int scale;             // total scale factor (1..VIDEO_MAX_SCALE)
+    VideoFilter filter;
+    int width, height;     // output size
+    uint32_t dmgPalette[4];
+    uint16_t ghosting;     // weight of the previous picture out of 256, 0 = off (the worker's, once started)
+
+    // Frame being converted (copied on submit so the emulation can go on)
+    uint8_t cgb;
+    uint8_t framebuffer[SCREEN_HEIGHT][SCREEN_WIDTH];
+    uint16_t colorFramebuffer[SCREEN_HEIGHT][SCREEN_WIDTH];
+
+    uint32_t *source;      // VIDEO_SRC_STRIDE x VIDEO_SRC_HEIGHT RGBA
+    uint32_t *filtered;    // filter output before the nearest stage (NULL when not needed)
+    uint32_t *output;      // width x height RGBA
+    int16_t *xbrPlanes;    // xBR only: Y, U, V and neighbour distance planes of source
+    uint32_t *ghost;       // ghosting only: last blended picture (SCREEN_WIDTH x SCREEN_HEIGHT RGBA)
+    uint8_t ghostValid;    // 0 = the next frame is taken as is
+
+    // === Worker thread ===
+    uint8_t threaded;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_cond_t done;
+    uint8_t pending, busy, quit;
+    uint8_t pendingCgb;
+    uint16_t pendingGhosting; // video_set_ghosting with a worker, taken with the next frame
+    uint8_t ghostingChanged;
+    uint8_t pendingFramebuffer[SCREEN_HEIGHT][SCREEN_WIDTH];
+    uint16_t pendingColorFramebuffer[SCREEN_HEIGHT][SCREEN_WIDTH];
+    uint64_t frames;       // frames converted
+} Video;
+
+// === Functions ===
+int video_parse_filter(const char *name, VideoFilter *filter);
+const char *video_filter_name(VideoFilter filter);
+int video_filter_factor(VideoFilter filter);
+const char *video_simd_name(void);
+
+int video_init(Video *video, int scale, VideoFilter filter);
+int video_set_ghosting(Video *video, int percent); // any time, from the emulation thread
+void video_free(Video *video);
+
+// Synchronous: convert + scale now (result in video->output)
+void video_render(Video *video, const PPU *ppu, uint8_t cgb);
+
+// Worker thread: submit copies the frame and returns, the latest frame wins
+int video_start_worker(Video *video);
+void video_submit(Video *video, const PPU *ppu, uint8_t cgb);
+void video_wait(Video *video);
+
+int video_write_ppm(const Video *video, const char *filename);
+
+#endif
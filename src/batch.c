@@ -0,0 +1,639 @@
+#include <stdlib.h>
+#include <string.h>
+#include "../includes/batch.h"
+#include "../includes/coverage.h"
+
+// reg[] rows, in the order of the r8 operand field (6 is (HL), a memory operand: F goes there)
+#define R_B 0
+#define R_C 1
+#define R_D 2
+#define R_E 3
+#define R_H 4
+#define R_L 5
+#define R_F 6
+#define R_A 7
+
+// LCD off, the next event is a whole frame away: ppuPending stops short of it,
+// ppu_step takes 16-bit cycles
+#define BATCH_PPU_BUDGET 0x8000
+
+// Only the blocks between the first and the last lane of the group go through
+// the loop, the lanes outside the group keep their value. The mask (a no-op,
+// from and to are multiples of BATCH_BLOCK) tells the compiler the count is a
+// multiple of the vector size, which is what -O2 needs to vectorize
+#define LANES(from, to, i) \
+    for (uint32_t i = (from); i < (from) + (((to) - (from)) & ~(uint32_t)(BATCH_BLOCK - 1)); i++)
+
+// ===== Which instructions run in lockstep =====
+// Registers only: length in bytes, 0 = cpu_step
+static uint8_t batch_length(uint8_t op) {
+    if (op >= 0x40 && op <= 0x7F) return (op == 0x76 || (op & 7) == 6 || ((op >> 3) & 7) == 6) ? 0 : 1;
+    if (op >= 0x80 && op <= 0xBF) return (op & 7) == 6 ? 0 : 1;
+
+    switch (op) {
+        case 0x00: case 0x2F: case 0x37: case 0x3F:               // NOP CPL SCF CCF
+        case 0x03: case 0x13: case 0x23: case 0x33:               // INC rr
+        case 0x0B: case 0x1B: case 0x2B: case 0x3B:               // DEC rr
+        case 0x09: case 0x19: case 0x29: case 0x39:               // ADD HL, rr
+        case 0x04: case 0x0C: case 0x14: case 0x1C: case 0x24: case 0x2C: case 0x3C: // INC r
+        case 0x05: case 0x0D: case 0x15: case 0x1D: case 0x25: case 0x2D: case 0x3D: // DEC r
+            return 1;
+
+        case 0x06: case 0x0E: case 0x16: case 0x1E: case 0x26: case 0x2E: case 0x3E: // LD r, d8
+        case 0xC6: case 0xCE: case 0xD6: case 0xDE: case 0xE6: case 0xEE: case 0xF6: case 0xFE: // ALU A, d8
+        case 0x18: case 0x20: case 0x28: case 0x30: case 0x38:   // JR
+            return 2;
+
+        case 0x01: case 0x11: case 0x21: case 0x31:               // LD rr, d16
+        case 0xC3: case 0xC2: case 0xCA: case 0xD2: case 0xDA:   // JP
+            return 3;
+
+        default:
+            return 0;
+    }
+}
+
+// Cycles of a lockstep instruction, the jumps get theirs from lanes_jump
+static uint8_t batch_cycles(uint8_t op) {
+    if ((op & 0xC7) == 0x03 || (op & 0xCF) == 0x09) return 8; // INC rr, DEC rr, ADD HL, rr
+    return batch_length(op) * 4;
+}
+
+// ROM page the lane's next instruction comes from, NULL when it can't be part
+// of a group: not in ROM (RAM is per console), too close to the end of the
+// page for the operands, cpu_step would do something else first (interrupt,
+// HALT, EI delay), a serial transfer needs the cycles or the fetches have to
+// be counted (ROM coverage)
+static inline const uint8_t *batch_fetch(const GameBoy *gb, uint16_t pc) {
+    const CPU *cpu = &gb->cpu;
+
+    if (pc >= 0x8000 || (pc & (MMU_PAGE_SIZE - 1)) > MMU_PAGE_SIZE - 3) return NULL;
+    if (cpu->halted | cpu->stopped | cpu->locked | cpu->imePending | gb->mmu.serial_active) return NULL;
+    if (cpu->ime && (gb->mmu.interrupt_enable & gb->mmu.io[0x0F] & 0x1F)) return NULL;
+    if (COVERAGE_ON(&gb->mmu)) return NULL;
+    return gb->mmu.read_map[pc >> MMU_PAGE_SHIFT];
+}
+
+// The console's next instruction can run in a group
+static inline int batch_joinable(const GameBoy *gb) {
+    const uint8_t *page = batch_fetch(gb, gb->cpu.PC);
+    return page && batch_length(page[gb->cpu.PC & (MMU_PAGE_SIZE - 1)]);
+}
+
+// ===== Lane kernels =====
+// Branch free: m is all ones for the lanes of the group, flags are built with
+// masks (SSE2 has no 8-bit shifts), so every loop is one straight SIMD body
+#define LANE_MASK(group, id, i) ((uint8_t)-((group)[i] == (id)))
+#define BLEND(m, new, old)      ((uint8_t)(((new) & (m)) | ((old) & ~(m))))
+#define FLAG_IF(cond, flag)     ((uint8_t)(-(uint8_t)(cond) & (flag)))
+
+// -O2 only vectorizes loops its "very cheap" cost model accepts, these need the full one
+#define LANE_KERNEL static __attribute__((optimize("-fvect-cost-model=dynamic")))
+
+LANE_KERNEL void lanes_set(const uint8_t *restrict group, uint8_t id, uint32_t from, uint32_t to,
+                           uint8_t *restrict dst, uint8_t v) {
+    LANES(from, to, i) {
+        uint8_t m = LANE_MASK(group, id, i);
+        dst[i] = BLEND(m, v, dst[i]);
+    }
+}
+
+LANE_KERNEL void lanes_set16(const uint8_t *restrict group, uint8_t id, uint32_t from, uint32_t to,
+                             uint16_t *restrict dst, uint16_t v) {
+    LANES(from, to, i) {
+        uint16_t m = (uint16_t)-(group[i] == id);
+        dst[i] = (uint16_t)((v & m) | (dst[i] & ~m));
+    }
+}
+
+LANE_KERNEL void lanes_copy(const uint8_t *restrict group, uint8_t id, uint32_t from, uint32_t to,
+                       uint8_t *restrict dst, const uint8_t *restrict src) {
+    LANES(from, to, i) {
+        uint8_t m = LANE_MASK(group, id, i);
+        dst[i] = BLEND(m, src[i], dst[i]);
+    }
+}
+
+// op = (opcode >> 3) & 7: ADD ADC SUB SBC AND XOR OR CP, flags as in cpu.c alu()
+LANE_KERNEL void lanes_alu(const uint8_t *restrict group, uint8_t id, uint32_t from, uint32_t to, uint8_t op,
+                      uint8_t *restrict A, uint8_t *restrict F, const uint8_t *restrict v) {
+    uint8_t carryIn = (op == 1 || op == 3) ? FLAG_C : 0;
+    uint8_t writeA = op == 7 ? 0x00 : 0xFF;
+
+    switch (op) {
+        case 0: case 1:
+            LANES(from, to, i) {
+                uint8_t m = LANE_MASK(group, id, i), a = A[i], x = v[i];
+                uint8_t c = (F[i] & carryIn) != 0;
+                uint8_t s = a + x, r = s + c;
+                uint8_t f = FLAG_IF(r == 0, FLAG_Z) | FLAG_IF((a & 0x0F) + (x & 0x0F) + c > 0x0F, FLAG_H) |
+                            FLAG_IF((s < a) | (r < s), FLAG_C);
+                A[i] = BLEND(m, r, a);
+                F[i] = BLEND(m, f, F[i]);
+            }
+            break;
+        case 2: case 3: case 7:
+            LANES(from, to, i) {
+                uint8_t m = LANE_MASK(group, id, i), a = A[i], x = v[i];
+                uint8_t c = (F[i] & carryIn) != 0;
+                uint8_t d = a - x, r = d - c;
+                uint8_t f = FLAG_IF(r == 0, FLAG_Z) | FLAG_N | FLAG_IF((a & 0x0F) < (x & 0x0F) + c, FLAG_H) |
+                            FLAG_IF((a < x) | (d < c), FLAG_C);
+                A[i] = BLEND(m & writeA, r, a);
+                F[i] = BLEND(m, f, F[i]);
+            }
+            break;
+        case 4:
+            LANES(from, to, i) {
+                uint8_t m = LANE_MASK(group, id, i), r = A[i] & v[i];
+                F[i] = BLEND(m, FLAG_IF(r == 0, FLAG_Z) | FLAG_H, F[i]);
+                A[i] = BLEND(m, r, A[i]);
+            }
+            break;
+        case 5:
+            LANES(from, to, i) {
+                uint8_t m = LANE_MASK(group, id, i), r = A[i] ^ v[i];
+                F[i] = BLEND(m, FLAG_IF(r == 0, FLAG_Z), F[i]);
+                A[i] = BLEND(m, r, A[i]);
+            }
+            break;
+        default:
+            LANES(from, to, i) {
+                uint8_t m = LANE_MASK(group, id, i), r = A[i] | v[i];
+                F[i] = BLEND(m, FLAG_IF(r == 0, FLAG_Z), F[i]);
+                A[i] = BLEND(m, r, A[i]);
+            }
+            break;
+    }
+}
+
+LANE_KERNEL void lanes_inc(const uint8_t *restrict group, uint8_t id, uint32_t from, uint32_t to,
+                           uint8_t *restrict r, uint8_t *restrict F) {
+    LANES(from, to, i) {
+        uint8_t m = LANE_MASK(group, id, i), x = r[i], y = x + 1;
+        uint8_t f = (F[i] & FLAG_C) | FLAG_IF(y == 0, FLAG_Z) | FLAG_IF((x & 0x0F) == 0x0F, FLAG_H);
+        r[i] = BLEND(m, y, x);
+        F[i] = BLEND(m, f, F[i]);
+    }
+}
+
+LANE_KERNEL void lanes_dec(const uint8_t *restrict group, uint8_t id, uint32_t from, uint32_t to,
+                           uint8_t *restrict r, uint8_t *restrict F) {
+    LANES(from, to, i) {
+        uint8_t m = LANE_MASK(group, id, i), x = r[i], y = x - 1;
+        uint8_t f = (F[i] & FLAG_C) | FLAG_N | FLAG_IF(y == 0, FLAG_Z) | FLAG_IF((x & 0x0F) == 0x00, FLAG_H);
+        r[i] = BLEND(m, y, x);
+        F[i] = BLEND(m, f, F[i]);
+    }
+}
+
+// INC rr / DEC rr on a pair of rows: the high byte takes the carry out of the low one
+LANE_KERNEL void lanes_add_pair(const uint8_t *restrict group, uint8_t id, uint32_t from, uint32_t to,
+                           uint8_t *restrict hi, uint8_t *restrict lo, uint8_t dec) {
+    uint8_t step = dec ? 0xFF : 0x01, wrap = dec ? 0xFF : 0x00;
+
+    LANES(from, to, i) {
+        uint8_t m = LANE_MASK(group, id, i), l = lo[i] + step;
+        hi[i] = BLEND(m, hi[i] + (uint8_t)(-(uint8_t)(l == wrap) & step), hi[i]);
+        lo[i] = BLEND(m, l, lo[i]);
+    }
+}
+
+LANE_KERNEL void lanes_add16(const uint8_t *restrict group, uint8_t id, uint32_t from, uint32_t to,
+                             uint16_t *restrict r, uint16_t delta) {
+    LANES(from, to, i) {
+        uint16_t m = (uint16_t)-(group[i] == id);
+        r[i] = (uint16_t)(r[i] + (delta & m));
+    }
+}
+
+// ADD HL, rr with rr split in two rows
+LANE_KERNEL void lanes_add_hl(const uint8_t *restrict group, uint8_t id, uint32_t from, uint32_t to,
+                              uint8_t *restrict H, uint8_t *restrict L,
+                         uint8_t *restrict F, const uint8_t *restrict vh, const uint8_t *restrict vl) {
+    LANES(from, to, i) {
+        uint8_t m = LANE_MASK(group, id, i), h = H[i], l = L[i], xh = vh[i], xl = vl[i];
+        uint8_t lo = l + xl, c = lo < l;
+        uint8_t s = h + xh, hi = s + c;
+        uint8_t f = (F[i] & FLAG_Z) | FLAG_IF((h & 0x0F) + (xh & 0x0F) + c > 0x0F, FLAG_H) |
+                    FLAG_IF((s < h) | (hi < s), FLAG_C);
+        H[i] = BLEND(m, hi, h);
+        L[i] = BLEND(m, lo, l);
+        F[i] = BLEND(m, f, F[i]);
+    }
+}
+
+// SCF / CCF: F = (F & keep) ^ flip
+LANE_KERNEL void lanes_flags(const uint8_t *restrict group, uint8_t id, uint32_t from, uint32_t to, uint8_t *restrict F,
+                             uint8_t keep, uint8_t flip) {
+    LANES(from, to, i) {
+        uint8_t m = LANE_MASK(group, id, i);
+        F[i] = BLEND(m, (F[i] & keep) ^ flip, F[i]);
+    }
+}
+
+LANE_KERNEL void lanes_cpl(const uint8_t *restrict group, uint8_t id, uint32_t from, uint32_t to,
+                           uint8_t *restrict A, uint8_t *restrict F) {
+    LANES(from, to, i) {
+        uint8_t m = LANE_MASK(group, id, i);
+        A[i] = BLEND(m, ~A[i], A[i]);
+        F[i] = BLEND(m, F[i] | FLAG_N | FLAG_H, F[i]);
+    }
+}
+
+// cc = NZ Z NC C, 4 = always
+LANE_KERNEL void lanes_jump(const uint8_t *restrict group, uint8_t id, uint32_t from, uint32_t to, uint16_t *restrict PC,
+                       uint8_t *restrict cycles, const uint8_t *restrict F, uint8_t cc, uint16_t target,
+                       uint16_t next, uint8_t takenCycles, uint8_t notTakenCycles) {
+    uint8_t flag = cc == 4 ? 0 : (cc < 2 ? FLAG_Z : FLAG_C);
+    uint8_t want = (cc & 1) ? flag : 0;
+
+    LANES(from, to, i) {
+        uint8_t m = LANE_MASK(group, id, i), t = (uint8_t)-((F[i] & flag) == want);
+        uint16_t m16 = (int8_t)m, t16 = (int8_t)t;
+        PC[i] = (uint16_t)((((target & t16) | (next & ~t16)) & m16) | (PC[i] & ~m16));
+        cycles[i] = BLEND(m, (takenCycles & t) | (notTakenCycles & ~t), cycles[i]);
+    }
+}
+
+// The step's bookkeeping, every lane at once: the lanes of the groups add their
+// instruction's cycles to ppuPending (speed is 0 or 1: no per-lane shift in
+// SSE2), and attention keeps the lanes the scalar loop still has to visit:
+// 1 = not in a group (cpu_step), 2 = in a group but with a PPU event due or a
+// PC out of its fetch page. The groups are cleared for the next step
+LANE_KERNEL void lanes_account(uint32_t lanes, uint8_t *restrict group, const uint8_t *restrict done,
+                               const uint8_t *restrict cycles, const uint8_t *restrict speed,
+                               const uint16_t *restrict PC, const uint8_t *restrict fetchPage,
+                               const uint32_t *restrict ppuBudget, uint32_t *restrict ppuPending,
+                               uint8_t *restrict attention) {
+    LANES(0, lanes, i) {
+        uint8_t joined = group[i] != 0;
+        uint32_t c = cycles[i], half = -(uint32_t)speed[i];
+        uint32_t pending = ppuPending[i] + ((((c >> 1) & half) | (c & ~half)) & -(uint32_t)joined);
+        uint16_t pc = PC[i];
+        uint8_t leave = (pending >= ppuBudget[i]) | ((pc >> MMU_PAGE_SHIFT) != fetchPage[i]) |
+                        ((pc & (MMU_PAGE_SIZE - 1)) > MMU_PAGE_SIZE - 3);
+        ppuPending[i] = pending;
+        attention[i] = FLAG_IF((done[i] == 0) & ((joined == 0) | leave), 1 + joined);
+        group[i] = 0;
+    }
+}
+
+// ===== One instruction for every lane of a group =====
+// code points in the shared ROM, all the lanes are on it, and they all sit in
+// the blocks [from, to)
+static void batch_execute(Batch *b, uint8_t id, uint32_t from, uint32_t to, const uint8_t *code, uint16_t pc) {
+    const uint8_t *g = b->group;
+    uint8_t **reg = b->reg;
+    uint8_t op = code[0];
+    uint16_t imm16 = code[1] | (code[2] << 8); // groups never start in the last 2 bytes of a page
+
+    if (op >= 0x40 && op <= 0x7F) { // LD r, r'
+        uint8_t dst = (op >> 3) & 7, src = op & 7;
+        if (dst != src) lanes_copy(g, id, from, to, reg[dst], reg[src]);
+    } else if (op >= 0x80 && op <= 0xBF) { // ALU A, r
+        const uint8_t *src = reg[op & 7];
+        if ((op & 7) == R_A) { // A op A: the source row is the one being written
+            memcpy(b->operand + from, src + from, to - from);
+            src = b->operand;
+        }
+        lanes_alu(g, id, from, to, (op >> 3) & 7, reg[R_A], reg[R_F], src);
+    } else {
+        switch (op) {
+            case 0x00: break;
+
+            case 0x2F: // CPL
+                lanes_cpl(g, id, from, to, reg[R_A], reg[R_F]);
+                break;
+            case 0x37: // SCF
+                lanes_flags(g, id, from, to, reg[R_F], FLAG_Z, FLAG_C);
+                break;
+            case 0x3F: // CCF
+                lanes_flags(g, id, from, to, reg[R_F], FLAG_Z | FLAG_C, FLAG_C);
+                break;
+
+            case 0x03: case 0x13: case 0x23: case 0x33: // INC rr
+            case 0x0B: case 0x1B: case 0x2B: case 0x3B: { // DEC rr
+                uint8_t rr = (op >> 4) & 3, dec = (op & 0x08) != 0;
+                if (rr == 3) lanes_add16(g, id, from, to, b->SP, dec ? 0xFFFF : 1);
+                else lanes_add_pair(g, id, from, to, reg[rr * 2], reg[rr * 2 + 1], dec);
+                break;
+            }
+
+            case 0x09: case 0x19: case 0x29: case 0x39: { // ADD HL, rr
+                uint8_t rr = (op >> 4) & 3;
+                const uint8_t *high = b->operandHigh, *low = b->operand;
+                if (rr == 3) {
+                    LANES(from, to, i) b->operandHigh[i] = b->SP[i] >> 8;
+                    LANES(from, to, i) b->operand[i] = b->SP[i] & 0xFF;
+                } else if (rr == 2) { // ADD HL, HL: copies, the source rows are the ones being written
+                    memcpy(b->operandHigh + from, reg[R_H] + from, to - from);
+                    memcpy(b->operand + from, reg[R_L] + from, to - from);
+                } else {
+                    high = reg[rr * 2];
+                    low = reg[rr * 2 + 1];
+                }
+                lanes_add_hl(g, id, from, to, reg[R_H], reg[R_L], reg[R_F], high, low);
+                break;
+            }
+
+            case 0x04: case 0x0C: case 0x14: case 0x1C: case 0x24: case 0x2C: case 0x3C: // INC r
+                lanes_inc(g, id, from, to, reg[(op >> 3) & 7], reg[R_F]);
+                break;
+            case 0x05: case 0x0D: case 0x15: case 0x1D: case 0x25: case 0x2D: case 0x3D: // DEC r
+                lanes_dec(g, id, from, to, reg[(op >> 3) & 7], reg[R_F]);
+                break;
+
+            case 0x06: case 0x0E: case 0x16: case 0x1E: case 0x26: case 0x2E: case 0x3E: // LD r, d8
+                lanes_set(g, id, from, to, reg[(op >> 3) & 7], code[1]);
+                break;
+
+            case 0xC6: case 0xCE: case 0xD6: case 0xDE: case 0xE6: case 0xEE: case 0xF6: case 0xFE: // ALU A, d8
+                memset(b->operand + from, code[1], to - from);
+                lanes_alu(g, id, from, to, (op >> 3) & 7, reg[R_A], reg[R_F], b->operand);
+                break;
+
+            case 0x01: case 0x11: case 0x21: case 0x31: { // LD rr, d16
+                uint8_t rr = (op >> 4) & 3;
+                if (rr == 3) {
+                    lanes_set16(g, id, from, to, b->SP, imm16);
+                } else {
+                    lanes_set(g, id, from, to, reg[rr * 2], imm16 >> 8);
+                    lanes_set(g, id, from, to, reg[rr * 2 + 1], imm16 & 0xFF);
+                }
+                break;
+            }
+
+            case 0x18: case 0x20: case 0x28: case 0x30: case 0x38: { // JR (cc), r8
+                uint16_t next = pc + 2;
+                lanes_jump(g, id, from, to, b->PC, b->cycles, reg[R_F], op == 0x18 ? 4 : (op >> 3) & 3,
+                           (uint16_t)(next + (int8_t)code[1]), next, 12, 8);
+                break;
+            }
+
+            case 0xC3: case 0xC2: case 0xCA: case 0xD2: case 0xDA: // JP (cc), a16
+                lanes_jump(g, id, from, to, b->PC, b->cycles, reg[R_F], op == 0xC3 ? 4 : (op >> 3) & 3,
+                           imm16, pc + 3, 16, 12);
+                break;
+        }
+    }
+}
+
+// ===== Registers in and out of the arrays =====
+static void batch_load(Batch *b, uint32_t i) {
+    const CPU *cpu = &b->gb[i].cpu;
+
+    b->reg[R_B][i] = cpu->B;
+    b->reg[R_C][i] = cpu->C;
+    b->reg[R_D][i] = cpu->D;
+    b->reg[R_E][i] = cpu->E;
+    b->reg[R_H][i] = cpu->H;
+    b->reg[R_L][i] = cpu->L;
+    b->reg[R_F][i] = cpu->F;
+    b->reg[R_A][i] = cpu->A;
+    b->SP[i] = cpu->SP;
+    b->PC[i] = cpu->PC;
+}
+
+static void batch_store(Batch *b, uint32_t i) {
+    CPU *cpu = &b->gb[i].cpu;
+
+    cpu->B = b->reg[R_B][i];
+    cpu->C = b->reg[R_C][i];
+    cpu->D = b->reg[R_D][i];
+    cpu->E = b->reg[R_E][i];
+    cpu->H = b->reg[R_H][i];
+    cpu->L = b->reg[R_L][i];
+    cpu->F = b->reg[R_F][i];
+    cpu->A = b->reg[R_A][i];
+    cpu->SP = b->SP[i];
+    cpu->PC = b->PC[i];
+}
+
+// ===== Grouping =====
+// One pass over the lanes: a lane that can join looks its PC and ROM page up
+// in a small hash table (consecutive PCs get consecutive slots) unless it is on
+// the previous lane's, the first lane on a new PC opens its group. PC and
+// cycles are written on the way, the lane loops only do the registers and only
+// go through the blocks their group spans; lanes_account clears b->group
+#define BATCH_SLOTS (2 * BATCH_GROUPS) // power of two, never more than half full
+
+typedef struct {
+    const uint8_t *page;
+    uint16_t pc;
+    uint8_t id;       // b->group value, slot + 1
+    uint8_t length;   // batch_length(), 0 = its lanes go through cpu_step
+    uint8_t cycles;
+    uint32_t first;   // lowest and highest lane of the group
+    uint32_t last;
+    uint32_t members;
+} BatchGroup;
+
+static void batch_lockstep(Batch *b) {
+    BatchGroup groups[BATCH_GROUPS], *g = NULL;
+    uint8_t slots[BATCH_SLOTS] = {0}; // group id, 0 = free
+    uint32_t count = 0;
+
+    for (uint32_t i = 0; i < b->count; i++) {
+        const uint8_t *page = b->fetch[i];
+        uint16_t pc = b->PC[i];
+        if (!page) continue;
+
+        if (!g || g->pc != pc || g->page != page) {
+            uint32_t slot = pc & (BATCH_SLOTS - 1);
+            for (g = NULL; slots[slot]; slot = (slot + 1) & (BATCH_SLOTS - 1)) {
+                g = &groups[slots[slot] - 1];
+                if (g->pc == pc && g->page == page) break;
+                g = NULL;
+            }
+            if (!g) {
+                if (count == BATCH_GROUPS) continue; // too many PCs: this one goes through cpu_step
+                g = &groups[count++];
+                slots[slot] = g->id = count;
+                g->page = page;
+                g->pc = pc;
+                g->length = batch_length(page[pc & (MMU_PAGE_SIZE - 1)]);
+                g->cycles = batch_cycles(page[pc & (MMU_PAGE_SIZE - 1)]);
+                g->first = i;
+                g->members = 0;
+            }
+        }
+        if (!g->length) continue;
+
+        b->group[i] = g->id;
+        b->PC[i] = pc + g->length; // jumps: lanes_jump writes both again
+        b->cycles[i] = g->cycles;
+        g->last = i;
+        g->members++;
+    }
+
+    for (uint32_t k = 0; k < count; k++) {
+        g = &groups[k];
+        if (!g->length) continue;
+        if (g->members < 2) { // alone: cpu_step is just as fast
+            b->group[g->first] = 0;
+            b->PC[g->first] = g->pc;
+            continue;
+        }
+
+        uint32_t from = g->first & ~(uint32_t)(BATCH_BLOCK - 1), to = (g->last | (BATCH_BLOCK - 1)) + 1;
+        batch_execute(b, g->id, from, to, g->page + (g->pc & (MMU_PAGE_SIZE - 1)), g->pc);
+        b->lockstepSteps += g->members;
+        b->lockstepGroups++;
+    }
+}
+
+// What the lockstep path needs to know about a console, read after each real step
+static void batch_refresh(Batch *b, uint32_t i) {
+    const GameBoy *gb = &b->gb[i];
+
+    b->fetch[i] = batch_fetch(gb, b->PC[i]);
+    b->fetchPage[i] = b->PC[i] >> MMU_PAGE_SHIFT;
+    b->ppuBudget[i] = ppu_next_event(&gb->ppu, &gb->mmu);
+    if (b->ppuBudget[i] > BATCH_PPU_BUDGET) b->ppuBudget[i] = BATCH_PPU_BUDGET;
+    b->speed[i] = gb->mmu.double_speed;
+}
+
+// ===== Frame =====
+// Every console runs until its own frame is complete, like gb_run_frame.
+// A lane that ran a lockstep instruction only touches its console when the PPU
+// has something to do: until then its cycles pile up in ppuPending, and no
+// instruction in between could have seen the difference (registers only)
+void batch_run_frame(Batch *b) {
+    uint32_t running = b->count;
+    uint64_t lockstep = b->lockstepSteps, scalar = b->scalarSteps, groups = b->lockstepGroups;
+
+    if (b->scalarFrames) {
+        b->scalarFrames--;
+        for (uint32_t i = 0; i < b->count; i++) gb_run_frame(&b->gb[i]);
+        return;
+    }
+
+    for (uint32_t i = 0; i < b->count; i++) {
+        batch_load(b, i);
+        batch_refresh(b, i);
+        b->done[i] = 0;
+        b->ppuPending[i] = 0;
+        b->gb[i].ppu.frameComplete = 0;
+    }
+
+    while (running) {
+        batch_lockstep(b);
+        lanes_account(b->lanes, b->group, b->done, b->cycles, b->speed, b->PC, b->fetchPage,
+                      b->ppuBudget, b->ppuPending, b->attention);
+
+        for (uint32_t i = 0; i < b->count; i++) {
+            if (!b->attention[i]) continue;
+            GameBoy *gb = &b->gb[i];
+
+            if (b->attention[i] == 2 && b->ppuPending[i] < b->ppuBudget[i]) { // new page only
+                b->fetch[i] = batch_fetch(gb, b->PC[i]);
+                b->fetchPage[i] = b->PC[i] >> MMU_PAGE_SHIFT;
+                continue;
+            }
+
+            // A lockstep lane's event is due, a lone one's pending cycles don't reach
+            // one (this call only counts them)
+            if (b->ppuPending[i]) ppu_step(&gb->ppu, &gb->mmu, b->ppuPending[i]);
+            b->ppuPending[i] = 0;
+
+            if (b->attention[i] == 1) {
+                // Once its state is in cache the console keeps going on its own up to the
+                // next instruction that can join a group (BATCH_SCALAR_RUN at most), a
+                // halted one until it wakes up: it has nothing to share
+                uint32_t steps = 0;
+                batch_store(b, i);
+                do {
+                    uint16_t cycles = cpu_step(&gb->cpu, &gb->mmu);
+                    ppu_step(&gb->ppu, &gb->mmu, cycles >> gb->mmu.double_speed);
+                    if (gb->mmu.serial_active) mmu_serial_tick(&gb->mmu, cycles);
+                    b->scalarSteps++;
+                } while (!gb->ppu.frameComplete &&
+                         (gb->cpu.halted || (++steps < BATCH_SCALAR_RUN && !batch_joinable(gb))));
+                batch_load(b, i);
+            }
+
+            if (gb->ppu.frameComplete) {
+                b->done[i] = 1;
+                b->fetch[i] = NULL;
+                gb->frames++;
+                running--;
+            } else {
+                batch_refresh(b, i);
+            }
+        }
+    }
+
+    for (uint32_t i = 0; i < b->count; i++) batch_store(b, i);
+    b->lockstepFrames++;
+
+    // Consoles too far apart: interleaving them costs more than the groups save
+    lockstep = b->lockstepSteps - lockstep;
+    scalar = b->scalarSteps - scalar;
+    groups = b->lockstepGroups - groups;
+    if (lockstep * 100 < (lockstep + scalar) * BATCH_MIN_LOCKSTEP || lockstep < groups * BATCH_MIN_GROUP)
+        b->scalarFrames = BATCH_RETRY_FRAMES;
+}
+
+// ===== Setup =====
+// Next array of the block (the widest types come first, everything stays aligned)
+static void *batch_carve(uint8_t **next, uint32_t lanes, size_t size) {
+    void *array = *next;
+    *next += (size_t)lanes * size;
+    return array;
+}
+
+// Every console is booted (fast boot) on the same ROM, which must outlive the batch
+int batch_init(Batch *b, uint32_t count, const uint8_t *rom, size_t size) {
+    memset(b, 0, sizeof(Batch));
+    if (count == 0) return -1;
+
+    uint32_t lanes = (count + BATCH_BLOCK - 1) / BATCH_BLOCK * BATCH_BLOCK;
+    size_t bytes = (size_t)lanes * (sizeof(uint8_t *) + 2 * sizeof(uint32_t) + 2 * sizeof(uint16_t) + 16);
+    uint8_t *memory = aligned_alloc(64, (bytes + 63) & ~(size_t)63);
+    GameBoy *gb = calloc(count, sizeof(GameBoy));
+    if (!memory || !gb) {
+        free(memory);
+        free(gb);
+        return -1;
+    }
+    memset(memory, 0, bytes);
+
+    b->lanes = lanes;
+    b->memory = memory;
+    b->gb = gb;
+    uint8_t *next = memory;
+    b->fetch = batch_carve(&next, lanes, sizeof(uint8_t *));
+    b->ppuPending = batch_carve(&next, lanes, sizeof(uint32_t));
+    b->ppuBudget = batch_carve(&next, lanes, sizeof(uint32_t));
+    b->SP = batch_carve(&next, lanes, sizeof(uint16_t));
+    b->PC = batch_carve(&next, lanes, sizeof(uint16_t));
+    for (int r = 0; r < 8; r++) b->reg[r] = batch_carve(&next, lanes, 1);
+    b->group = batch_carve(&next, lanes, 1);
+    b->cycles = batch_carve(&next, lanes, 1);
+    b->operand = batch_carve(&next, lanes, 1);
+    b->operandHigh = batch_carve(&next, lanes, 1);
+    b->fetchPage = batch_carve(&next, lanes, 1);
+    b->speed = batch_carve(&next, lanes, 1);
+    b->done = batch_carve(&next, lanes, 1);
+    b->attention = batch_carve(&next, lanes, 1);
+    memset(b->done, 1, lanes); // padding lanes are never run
+
+    for (; b->count < count; b->count++) {
+        GameBoy *console = &gb[b->count];
+        gb_init(console);
+        if (gb_attach_rom(console, rom, size) != 0) {
+            batch_free(b);
+            return -1;
+        }
+        gb_boot(console);
+    }
+    return 0;
+}
+
+void batch_free(Batch *b) {
+    for (uint32_t i = 0; i < b->count; i++) gb_free(&b->gb[i]);
+    free(b->gb);
+    free(b->memory);
+    memset(b, 0, sizeof(Batch));
+}
@@ -1 +1,138 @@
-#include <stdio.h>
\ No newline at end of file
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include "../includes/cartridge.h"
+
+// ===== MBC =====
+MBCType cartridge_mbc_type(uint8_t cartType) {
+    switch (cartType) {
+        case 0x00: case 0x08: case 0x09:
+            return MBC_NONE;
+        case 0x01: case 0x02: case 0x03:
+            return MBC1;
+        case 0x05: case 0x06:
+            return MBC2;
+        case 0x0F: case 0x10: case 0x11: case 0x12: case 0x13:
+            return MBC3;
+        case 0x19: case 0x1A: case 0x1B: case 0x1C: case 0x1D: case 0x1E:
+            return MBC5;
+        default:
+            return MBC_UNKNOWN;
+    }
+}
+
+const char *cartridge_mbc_name(MBCType type) {
+    switch (type) {
+        case MBC_NONE: return "ROM";
+        case MBC1:     return "MBC1";
+        case MBC2:     return "MBC2";
+        case MBC3:     return "MBC3";
+        case MBC5:     return "MBC5";
+        default:       return "unknown";
+    }
+}
+
+// ===== Header =====
+// -1 when the data is too short to hold a header
+int cartridge_parse_header(const uint8_t *data, size_t size, CartridgeHeader *header) {
+    static const uint32_t ramSizes[6] = { 0, 0x800, 0x2000, 0x8000, 0x20000, 0x10000 };
+
+    memset(header, 0, sizeof(CartridgeHeader));
+    if (!data || size < CARTRIDGE_HEADER_END) return -1;
+
+    // Title: 16 bytes on the first cartridges, 15 or 11 once 0x0143 became the CGB flag
+    size_t titleLen = (data[0x0143] & 0x80) ? 15 : 16;
+    memcpy(header->title, &data[0x0134], titleLen);
+    header->title[titleLen] = '\0';
+    for (size_t i = 0; i < titleLen; i++) {
+        if (header->title[i] == '\0') break;
+        if ((uint8_t)header->title[i] < 0x20 || (uint8_t)header->title[i] > 0x7E) header->title[i] = '?';
+    }
+    for (size_t len = strlen(header->title); len > 0 && header->title[len - 1] == ' '; len--) {
+        header->title[len - 1] = '\0';
+    }
+
+    header->cgbFlag = data[0x0143];
+    header->sgbFlag = data[0x0146];
+    header->cartType = data[0x0147];
+    header->romSizeCode = data[0x0148];
+    header->ramSizeCode = data[0x0149];
+    header->licensee = data[0x014B];
+    header->version = data[0x014C];
+    header->headerChecksum = data[0x014D];
+    header->globalChecksum = (uint16_t)((data[0x014E] << 8) | data[0x014F]);
+
+    header->mbcType = cartridge_mbc_type(header->cartType);
+    header->romSize = header->romSizeCode <= 8 ? (0x8000u << header->romSizeCode) : 0;
+    header->ramSize = header->ramSizeCode < 6 ? ramSizes[header->ramSizeCode] : 0;
+    if (header->mbcType == MBC2) header->ramSize = 512;
+
+    switch (header->cartType) {
+        case 0x02: case 0x08: case 0x12: case 0x1A: case 0x1D:
+            header->hasRam = 1;
+            break;
+        case 0x03: case 0x09: case 0x13: case 0x1B: case 0x1E:
+            header->hasRam = header->hasBattery = 1;
+            break;
+        case 0x06:
+            header->hasRam = header->hasBattery = 1; // MBC2 built-in RAM
+            break;
+        case 0x0F:
+            header->hasBattery = header->hasRtc = 1;
+            break;
+        case 0x10:
+            header->hasRam = header->hasBattery = header->hasRtc = 1;
+            break;
+    }
+
+    uint8_t x = 0;
+    for (int i = 0x0134; i <= 0x014C; i++) x = x - data[i] - 1;
+    header->headerValid = x == header->headerChecksum;
+
+    // Global checksum: every byte but the checksum itself (not checked by the hardware)
+    uint16_t sum = 0;
+    for (size_t i = 0; i < size; i++) sum += data[i];
+    sum -= data[0x014E] + data[0x014F];
+    header->globalValid = sum == header->globalChecksum;
+
+    header->crc32 = cartridge_crc32(0, data, size);
+    return 0;
+}
+
+// ===== CRC32 (IEEE 802.3, same as zip/PNG) =====
+// Slicing-by-8: 8 bytes per step with 8 tables, built once
+static uint32_t crc_tables[8][256];
+static pthread_once_t crc_once = PTHREAD_ONCE_INIT;
+
+static void crc_setup(void) {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        crc_tables[0][i] = c;
+    }
+    for (uint32_t i = 0; i < 256; i++) {
+        for (int t = 1; t < 8; t++) {
+            uint32_t prev = crc_tables[t - 1][i];
+            crc_tables[t][i] = (prev >> 8) ^ crc_tables[0][prev & 0xFF];
+        }
+    }
+}
+
+// Pass the previous result as `crc` to continue over several buffers (0 to start)
+uint32_t cartridge_crc32(uint32_t crc, const uint8_t *data, size_t size) {
+    pthread_once(&crc_once, crc_setup);
+    crc = ~crc;
+
+    while (size >= 8) {
+        uint32_t lo = crc ^ ((uint32_t)data[0] | (uint32_t)data[1] << 8 | (uint32_t)data[2] << 16 | (uint32_t)data[3] << 24);
+        crc = crc_tables[7][lo & 0xFF] ^ crc_tables[6][(lo >> 8) & 0xFF] ^
+              crc_tables[5][(lo >> 16) & 0xFF] ^ crc_tables[4][lo >> 24] ^
+              crc_tables[3][data[4]] ^ crc_tables[2][data[5]] ^
+              crc_tables[1][data[6]] ^ crc_tables[0][data[7]];
+        data += 8;
+        size -= 8;
+    }
+    while (size--) crc = (crc >> 8) ^ crc_tables[0][(crc ^ *data++) & 0xFF];
+
+    return ~crc;
+}
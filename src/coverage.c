@@ -0,0 +1,154 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include "../includes/coverage.h"
+#include "../includes/cartridge.h"
+
+#define COVERAGE_HEADER 16
+
+static const char *kind_names[4] = { "", "exec", "read", "exec+read" };
+
+static void put_le32(uint8_t *p, uint32_t v) {
+    p[0] = v & 0xFF;
+    p[1] = (v >> 8) & 0xFF;
+    p[2] = (v >> 16) & 0xFF;
+    p[3] = v >> 24;
+}
+
+static uint32_t get_le32(const uint8_t *p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static size_t bitmap_bytes(const Coverage *cov) {
+    return (cov->romSize + 7) / 8;
+}
+
+// 1 = executed, 2 = read as data
+static int byte_kind(const Coverage *cov, size_t offset) {
+    int bit = 1 << (offset & 7);
+    return ((cov->exec[offset >> 3] & bit) ? 1 : 0) | ((cov->read[offset >> 3] & bit) ? 2 : 0);
+}
+
+// bank:address the way a debugger shows it (banks 1+ at 0x4000-0x7FFF)
+static void print_location(FILE *out, size_t offset) {
+    size_t bank = offset / 0x4000;
+    fprintf(out, "%02zX:%04zX", bank, (bank ? 0x4000 : 0) + offset % 0x4000);
+}
+
+int coverage_enabled(void) {
+#ifdef GB_COVERAGE
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+int coverage_init(Coverage *cov, const uint8_t *rom, size_t size) {
+    memset(cov, 0, sizeof(*cov));
+    if (!rom || size == 0 || size > UINT32_MAX) return -1;
+
+    cov->romSize = (uint32_t)size;
+    cov->crc = cartridge_crc32(0, rom, size);
+    cov->exec = calloc(2, bitmap_bytes(cov));
+    if (!cov->exec) return -1;
+    cov->read = cov->exec + bitmap_bytes(cov);
+    return 0;
+}
+
+void coverage_free(Coverage *cov) {
+    free(cov->exec);
+    cov->exec = cov->read = NULL;
+}
+
+// Same ROM on both sides (consoles of one batch, or runs in threads)
+void coverage_merge(Coverage *dst, const Coverage *src) {
+    if (dst->romSize != src->romSize || dst->crc != src->crc) return;
+    for (size_t i = 0; i < bitmap_bytes(dst); i++) {
+        dst->exec[i] |= src->exec[i];
+        dst->read[i] |= src->read[i];
+    }
+}
+
+// ===== File =====
+// The whole read-OR-write runs under the lock, so runs finishing together
+// never lose each other's bits
+int coverage_merge_file(Coverage *cov, const char *filename) {
+    size_t bytes = bitmap_bytes(cov);
+    size_t fileSize = COVERAGE_HEADER + 2 * bytes;
+    uint8_t *data = malloc(fileSize);
+    if (!data) return -1;
+
+    int fd = open(filename, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        free(data);
+        return -1;
+    }
+    int res = -1;
+    if (flock(fd, LOCK_EX) != 0) goto done;
+
+    ssize_t got = pread(fd, data, fileSize, 0);
+    if (got < 0) goto done;
+    if (got > 0) {
+        // Existing file: only the coverage of this exact ROM can be merged
+        if ((size_t)got != fileSize || memcmp(data, COVERAGE_MAGIC, 8) != 0 ||
+            get_le32(data + 8) != cov->romSize || get_le32(data + 12) != cov->crc) goto done;
+        const uint8_t *exec = data + COVERAGE_HEADER, *read = exec + bytes;
+        for (size_t i = 0; i < bytes; i++) {
+            cov->exec[i] |= exec[i];
+            cov->read[i] |= read[i];
+        }
+    }
+
+    memcpy(data, COVERAGE_MAGIC, 8);
+    put_le32(data + 8, cov->romSize);
+    put_le32(data + 12, cov->crc);
+    memcpy(data + COVERAGE_HEADER, cov->exec, bytes);
+    memcpy(data + COVERAGE_HEADER + bytes, cov->read, bytes);
+    if (pwrite(fd, data, fileSize, 0) == (ssize_t)fileSize && ftruncate(fd, fileSize) == 0) res = 0;
+
+done:
+    close(fd); // drops the lock
+    free(data);
+    return res;
+}
+
+// ===== Report =====
+// Totals, then one line per 16KB bank, then every run of bytes with the same
+// use (never across a bank)
+void coverage_report(const Coverage *cov, FILE *out) {
+    size_t execTotal = 0, readTotal = 0;
+    size_t banks = (cov->romSize + 0x3FFF) / 0x4000;
+
+    fprintf(out, "ROM coverage: %u bytes, CRC32 %08X\n", cov->romSize, cov->crc);
+    fprintf(out, "Bank      exec      read\n");
+    for (size_t bank = 0; bank < banks; bank++) {
+        size_t start = bank * 0x4000, end = start + 0x4000, exec = 0, read = 0;
+        if (end > cov->romSize) end = cov->romSize;
+        for (size_t offset = start; offset < end; offset++) {
+            int kind = byte_kind(cov, offset);
+            exec += kind & 1;
+            read += kind >> 1;
+        }
+        fprintf(out, "  %02zX  %6.2f%%  %6.2f%%\n", bank, 100.0 * exec / (end - start), 100.0 * read / (end - start));
+        execTotal += exec;
+        readTotal += read;
+    }
+    fprintf(out, "Total %6.2f%%  %6.2f%%  (%zu bytes executed, %zu read)\n",
+            100.0 * execTotal / cov->romSize, 100.0 * readTotal / cov->romSize, execTotal, readTotal);
+
+    fprintf(out, "\nRanges (bank:address):\n");
+    size_t offset = 0;
+    while (offset < cov->romSize) {
+        int kind = byte_kind(cov, offset);
+        size_t end = offset + 1;
+        while (end < cov->romSize && end % 0x4000 != 0 && byte_kind(cov, end) == kind) end++;
+        if (kind) {
+            print_location(out, offset);
+            fprintf(out, "-%04zX %s\n", ((end - 1) / 0x4000 ? 0x4000 : 0) + (end - 1) % 0x4000, kind_names[kind]);
+        }
+        offset = end;
+    }
+}
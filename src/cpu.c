@@ -3,6 +3,14 @@
 #include "../includes/cpu.h"
 #include "../includes/mmu.h"
 #include "../includes/main.h"
+#include "../includes/stats.h"
+#include "../includes/profiler.h"
+
+// Operand order used by the opcode table: r = (opcode >> 3) & 7 or opcode & 7
+static const char *r8_names[8] = { "B", "C", "D", "E", "H", "L", "(HL)", "A" };
+static const char *alu_names[8] = { "ADD A,", "ADC A,", "SUB", "SBC A,", "AND", "XOR", "OR", "CP" };
+static const char *cb_names[8] = { "RLC", "RRC", "RL", "RR", "SLA", "SRA", "SWAP", "SRL" };
+static const char *cond_names[4] = { "NZ", "Z", "NC", "C" };
 
 void cpu_init(CPU *cpu) {
     // == Flags ==
@@ -23,782 +31,170 @@ void cpu_init(CPU *cpu) {
     cpu->ime = 1;       // Interrupt Master Enable (0 or 1)
     cpu->halted = 0;    // HALT state
     cpu->stopped = 0;   // STOP state
-}
-
-void cpu_execute_cb(CPU *cpu, uint8_t op) {
-    switch(op) {
+    cpu->imePending = 0;
+    cpu->locked = 0;
 
-        case 0x11: { // RL C
-            uint8_t carry_in = (cpu->F & FLAG_C) ? 1 : 0;
-            uint8_t new_carry = (cpu->C & 0x80) ? 1 : 0;
+    cpu->tick = NULL;
+    cpu->tickCtx = NULL;
+    cpu->stepCycles = 0;
+    cpu->tickedCycles = 0;
 
-            cpu->C = (cpu->C << 1) | carry_in;
-
-            // Update flags
-            cpu->F &= 0x1F; // Clear Z N H C
-            if (cpu->C == 0) {
-                cpu->F |= FLAG_Z; // Set Z flag
-            }
-            if (new_carry) {
-                cpu->F |= FLAG_C; // Set C flag
-            }
-
-            if (DEBUG_MODE >= 2) {
-                printf("CB RL C -> C=0x%02X, F=0x%02X\n", cpu->C, cpu->F);
-            }
-            break;
-        }
+    cpu->profiler = NULL;
+}
 
-        case 0x7C: { // BIT 7, H
-            uint8_t bit = (cpu->H >> 7) & 1;
+// ===== 16-bit pairs =====
+// AF BC DE HL SP follow each other in CPU: an operand field picks its pair with
+// an offset, no switch
+_Static_assert(offsetof(CPU, BC) == offsetof(CPU, AF) + 2 && offsetof(CPU, DE) == offsetof(CPU, AF) + 4 &&
+               offsetof(CPU, HL) == offsetof(CPU, AF) + 6 && offsetof(CPU, SP) == offsetof(CPU, AF) + 8,
+               "register pairs out of order");
 
-            cpu->F &= ~(FLAG_Z | FLAG_N);
-            cpu->F |= FLAG_H; // H flag always set
+// rr = (opcode >> 4) & 3 -> BC, DE, HL, SP
+static inline uint16_t *rr_pair(CPU *cpu, uint8_t rr) {
+    return (uint16_t *)((char *)cpu + offsetof(CPU, BC) + rr * 2);
+}
 
-            if (bit == 0) cpu->F |= FLAG_Z;
-            if (DEBUG_MODE >= 2) {
-                printf("CB BIT 7, H -> H=0x%02X, F=0x%02X\n", cpu->H, cpu->F);
-            }
-            break;
-        }
+// PUSH / POP: BC, DE, HL, AF
+static inline uint16_t *stack_pair(CPU *cpu, uint8_t rr) {
+    return (uint16_t *)((char *)cpu + offsetof(CPU, AF) + ((rr + 1) & 3) * 2);
+}
 
-        default:
-            printf("Unknown CB opcode: 0x%02X\n", op);
-            exit(1);
-            break;
+static inline int condition(const CPU *cpu, uint8_t cc) {
+    switch (cc) {
+        case 0: return !(cpu->F & FLAG_Z);
+        case 1: return (cpu->F & FLAG_Z) != 0;
+        case 2: return !(cpu->F & FLAG_C);
+        default: return (cpu->F & FLAG_C) != 0;
     }
 }
 
-uint16_t cpu_step(CPU *cpu, MMU *mmu) {
-    uint16_t cycles = 0;
-
-    uint8_t opcode = mmu_read(mmu, cpu->PC++); // - Fetch opcode -
-    switch (opcode) {
-        case 0x00: // NOP
-            cycles = 4;
-            if (DEBUG_MODE >= 2) {
-                printf("NOP\n");
-            }
-            break;
-
-        case 0x04: { // INC B
-            cycles = 4;
-            uint8_t old = cpu->B;
-
-            cpu->B += 1;
-
-            // Clear Z, N, H but keep C flag
-            cpu->F &= 0x10;
-
-            // Set Z flag
-            if (cpu->B == 0)
-                cpu->F |= FLAG_Z;
-
-            // H flag is set if lower nibble overflowed
-            if ((old & 0x0F) == 0x0F)
-                cpu->F |= FLAG_H;
-
-            if (DEBUG_MODE >= 2) {
-                printf("INC B -> B=0x%02X, F=0x%02X\n", cpu->B, cpu->F);
-            }
-            break;
-        }
-
-        case 0x05: { // DEC B
-            cycles = 4;
-            uint8_t old = cpu->B;
-            cpu->B--;
-
-            cpu->F &= FLAG_C;
-            cpu->F |= FLAG_N;
-            if(cpu->B == 0)
-                cpu->F |= FLAG_Z;
-            if((old & 0x0F) == 0x00)
-                cpu->F |= FLAG_H;
-            if (DEBUG_MODE >= 2) {
-                printf("DEC B -> B=0x%02X, F=0x%02X\n", cpu->B, cpu->F);
-            }
-            break;
-        }
-
-        case 0x06: { // LD B, d8
-            cycles = 8;
-            cpu->B = mmu_read(mmu, cpu->PC++);
-
-            if (DEBUG_MODE >= 2) {
-                printf("LD B, 0x%02X\n", cpu->B);
-            }
-            break;
-        }
-
-        case 0x08: { // LD (a16), SP
-            cycles = 12;
-            uint8_t low  = mmu_read(mmu, cpu->PC++);
-            uint8_t high = mmu_read(mmu, cpu->PC++);
-            uint16_t addr = (high << 8) | low;
-
-            mmu_write(mmu, addr + 1, (cpu->SP >> 8) & 0xFF); // High byte
-            mmu_write(mmu, addr, cpu->SP & 0xFF);        // Low byte
-
-            if (DEBUG_MODE >= 2) {
-                printf("LD (0x%04X), SP -> [0x%04X]=0x%04X\n", addr, addr, cpu->SP);
-            }
-            break;
-        }
-
-        case 0x0C: { // INC C
-            cycles = 4;
-            uint8_t old = cpu->C;
-
-            cpu->C += 1;
-
-            // Clear Z, N, H but keep C flag
-            cpu->F &= 0x10;
-
-            // Set Z flag
-            if (cpu->C == 0)
-                cpu->F |= FLAG_Z;
-
-            // H flag is set if lower nibble overflowed
-            if ((old & 0x0F) == 0x0F)
-                cpu->F |= FLAG_H;
-
-            if (DEBUG_MODE >= 2) {
-                printf("INC C -> C=0x%02X, F=0x%02X\n", cpu->C, cpu->F);
-            }
-            break;
-        }
-
-        case 0x0D: { // DEC C
-            cycles = 4;
-            uint8_t old = cpu->C;
-            cpu->C--;
-
-            cpu->F &= FLAG_C;
-            cpu->F |= FLAG_N;
-            if(cpu->C == 0)
-                cpu->F |= FLAG_Z;
-            if((old & 0x0F) == 0x00)
-                cpu->F |= FLAG_H;
-            if (DEBUG_MODE >= 2) {
-                printf("DEC C -> C=0x%02X, F=0x%02X\n", cpu->C, cpu->F);
-            }
-            break;
-        }
-
-        case 0x0E: { // LD C, d8
-            cycles = 8;
-            cpu->C = mmu_read(mmu, cpu->PC++);
-
-            if (DEBUG_MODE >= 2) {
-                printf("LD C, 0x%02X\n", cpu->C);
-            }
-            break;
-        }
-
-        case 0x11: { // LD DE, d16
-            cycles = 12;
-            uint8_t low  = mmu_read(mmu, cpu->PC++);
-            uint8_t high = mmu_read(mmu, cpu->PC++);
-            cpu->DE = (high << 8) | low;
-
-            if (DEBUG_MODE >= 2) {
-                printf("LD DE, 0x%04X\n", cpu->DE);
-            }
-            break;
-        }
-
-        case 0x13: { // INC DE
-            cycles = 8;
-            cpu->DE++;
-            if (DEBUG_MODE >= 2) {
-                printf("INC DE -> DE=0x%04X\n", cpu->DE);
-            }
-            break;
-        }
-
-        case 0x17: { // RLA
-            cycles = 4;
-            uint8_t carry_in = (cpu->F & FLAG_C) ? 1 : 0;
-            uint8_t new_carry = (cpu->A & 0x80) ? 1 : 0;
-
-            cpu->A = (cpu->A << 1) | carry_in;
-
-            // Update flags
-            cpu->F &= 0x1F; // Clear Z N H C
-            if (new_carry) {
-                cpu->F |= FLAG_C; // Set C flag
-            }
-
-            if (DEBUG_MODE >= 2) {
-                printf("RLA -> A=0x%02X, F=0x%02X\n", cpu->A, cpu->F);
-            }
-            break;
-        }
-
-        case 0x18: { // JR r8
-            cycles = 12;
-            int8_t offset = (int8_t) mmu_read(mmu, cpu->PC++);
-            cpu->PC += offset;
-
-            if (DEBUG_MODE >= 2) {
-                printf("JR %d -> PC=0x%04X\n", offset, cpu->PC);
-            }
-            break;
-        }
-
-        case 0x1A: { // LD A, (DE)
-            cycles = 8;
-            cpu->A = mmu_read(mmu, cpu->DE);
-
-            if (DEBUG_MODE >= 2) {
-                printf("LD A, (DE) -> A=0x%02X from [0x%04X]\n", cpu->A, cpu->DE);
-            }
-            break;
-        }
-
-        case 0x1E: { // LD E, d8
-            cycles = 8;
-            cpu->E = mmu_read(mmu, cpu->PC++);
-
-            if (DEBUG_MODE >= 2) {
-                printf("LD E, 0x%02X\n", cpu->E);
-            }
-            break;
-        }
-
-        case 0x20: { // JR NZ, r8
-            int8_t offset = (int8_t) mmu_read(mmu, cpu->PC++);
-            cycles = 8;
-            if (!(cpu->F & FLAG_Z)) { // if Z == 0
-                cpu->PC += offset;
-                cycles = 12;
-            }
-
-            if (DEBUG_MODE >= 2) {
-                printf("JR NZ, %d -> PC=0x%04X\n", offset, cpu->PC);
-            }
-            break;
-        }
-
-        case 0x21: { // LD HL, d16
-            cycles = 12;
-            uint8_t low  = mmu_read(mmu, cpu->PC++);
-            uint8_t high = mmu_read(mmu, cpu->PC++);
-            cpu->HL = (high << 8) | low;
-
-            if(DEBUG_MODE >= 2) {
-                printf("LD HL, 0x%04X\n", cpu->HL);
-            }
-            break;
-        }
-
-        case 0x22: { // LD (HL+), A
-            cycles = 8;
-            mmu_write(mmu, cpu->HL, cpu->A);
-            cpu->HL++;
-
-            if(DEBUG_MODE >= 2) {
-                printf("LD (HL+), A -> [0x%04X]=0x%02X, HL=0x%04X\n", cpu->HL + 1, cpu->A, cpu->HL);
-            }
-            break;
-        }
-
-        case 0x23: { // INC HL
-            cpu->HL++;
-            cycles = 8;
-
-            if (DEBUG_MODE >= 2) {
-                printf("INC HL -> HL=0x%04X\n", cpu->HL);
-            }
-            break;
-        }
-
-        case 0x28: { // JR Z, r8
-            cycles = 8;
-            int8_t offset = (int8_t) mmu_read(mmu, cpu->PC++);
-            if (cpu->F & FLAG_Z) { // if Z == 1
-                cpu->PC += offset;
-                cycles = 12;
-            }
-
-            if (DEBUG_MODE >= 2) {
-                printf("JR Z, %d -> PC=0x%04X\n", offset, cpu->PC);
-            }
-            break;
-        }
-
-        case 0x2E: { // LD L, d8
-            cycles = 8;
-            cpu->L = mmu_read(mmu, cpu->PC++);
-
-            if (DEBUG_MODE >= 2) {
-                printf("LD L, 0x%02X\n", cpu->L);
-            }
-            break;
-        }
-
-        case 0x2F: { // CPL
-            cycles = 4;
-            cpu->A = ~cpu->A;
-
-            // Set flags
-            cpu->F |= FLAG_N | FLAG_H; // N = 1, H = 1
-            cpu->F &= ~FLAG_Z; // Z = 0
-            if (DEBUG_MODE >= 2) {
-                printf("CPL -> A=0x%02X, F=0x%02X\n", cpu->A, cpu->F);
-            }
-            break;
-        }
-
-        case 0x30: { // JR NC, r8
-            cycles = 8;
-            int8_t offset = (int8_t) mmu_read(mmu, cpu->PC++);
-            if (!(cpu->F & FLAG_C)) { // if C == 0
-                cpu->PC += offset;
-                cycles = 12;
-            }
-
-            if (DEBUG_MODE >= 2) {
-                printf("JR NC, %d -> PC=0x%04X\n", offset, cpu->PC);
-            }
-            break;
-        }
-
-        case 0x31: { // LD SP, d16
-            cycles = 12;
-            uint8_t low  = mmu_read(mmu, cpu->PC++);
-            uint8_t high = mmu_read(mmu, cpu->PC++);
-            cpu->SP = (high << 8) | low;
-
-            if(DEBUG_MODE >= 2) {
-                printf("LD SP, 0x%04X\n", cpu->SP);
-            }
-            break;
-        }
-
-        case 0x32: { // LD (HL-), A
-            cycles = 8;
-            mmu_write(mmu, cpu->HL, cpu->A);
-            cpu->HL--;
-
-            if(DEBUG_MODE >= 2) {
-                printf("LD (HL-), A -> [0x%04X]=0x%02X, HL=0x%04X\n", cpu->HL + 1, cpu->A, cpu->HL);
-            }
-            break;
-        }
-
-        case 0x38: { // JR C, r8
-            cycles = 8;
-            int8_t offset = (int8_t) mmu_read(mmu, cpu->PC++);
-            if (cpu->F & FLAG_C) { // if C == 1
-                cpu->PC += offset;
-                cycles = 12;
-            }
-
-            if (DEBUG_MODE >= 2) {
-                printf("JR C, %d -> PC=0x%04X\n", offset, cpu->PC);
-            }
-            break;
-        }
+// ===== ALU =====
+static uint8_t inc8(CPU *cpu, uint8_t v) {
+    uint8_t result = v + 1;
 
-        case 0x3D: { // DEC A
-            cycles = 4;
-            uint8_t old = cpu->A;
-            cpu->A--;
-
-            cpu->F &= FLAG_C;
-            cpu->F |= FLAG_N;
-            if(cpu->A == 0)
-                cpu->F |= FLAG_Z;
-            if((old & 0x0F) == 0x00)
-                cpu->F |= FLAG_H;
-            if (DEBUG_MODE >= 2) {
-                printf("DEC A -> A=0x%02X, F=0x%02X\n", cpu->A, cpu->F);
-            }
-            break;
-        }
-
-        case 0x3E: { // LD A, d8
-            cycles = 8;
-            cpu->A = mmu_read(mmu, cpu->PC++);
-
-            if (DEBUG_MODE >= 2) {
-                printf("LD A, 0x%02X\n", cpu->A);
-            }
-            break;
-        }
-
-        case 0x41: { // LD B, C
-            cycles = 4;
-            cpu->B = cpu->C;
-
-            if (DEBUG_MODE >= 2) {
-                printf("LD B, C -> B=0x%02X\n", cpu->B);
-            }
-            break;
-        }
-
-        case 0x4C: { // LD C, B
-            cycles = 4;
-            cpu->C = cpu->B;
-            if (DEBUG_MODE >= 2) {
-                printf("LD C, B -> C=0x%02X\n", cpu->C);
-            }
-            break;
-        }
-
-        case 0x4F: { // LD C, A
-            cycles = 4;
-            cpu->C = cpu->A;
-            if (DEBUG_MODE >= 2) {
-                printf("LD C, A -> C=0x%02X\n", cpu->C);
-            }
-            break;
-        }
-
-        case 0x51: { // LD D, C
-            cycles = 4;
-            cpu->D = cpu->C;
-
-            if(DEBUG_MODE >= 2) {
-                printf("LD D, C -> D=0x%02X\n", cpu->D);
-            }
-            break;
-        }
-
-        case 0x57: { // LD D, A
-            cycles = 4;
-            cpu->D = cpu->A;
-
-            if(DEBUG_MODE >= 2) {
-                printf("LD D, A -> D=0x%02X\n", cpu->D);
-            }
-            break;
-        }
-
-        case 0x5C: { // LD E, H
-            cycles = 4;
-            cpu->E = cpu->H;
-            if (DEBUG_MODE >= 2) {
-                printf("LD E, H -> E=0x%02X\n", cpu->E);
-            }
-            break;
-        }
-
-        case 0x60: { // LD H, B
-            cycles = 4;
-            cpu->H = cpu->B;
-
-            if(DEBUG_MODE >= 2) {
-                printf("LD H, B -> H=0x%02X\n", cpu->H);
-            }
-            break;
-        }
-
-        case 0x67: { // LD H, A
-            cycles = 4;
-            cpu->H = cpu->A;
-
-            if(DEBUG_MODE >= 2) {
-                printf("LD H, A -> H=0x%02X\n", cpu->H);
-            }
-            break;
-        }
-
-        case 0x77: { // LD (HL), A
-            cycles = 8;
-            mmu_write(mmu, cpu->HL, cpu->A);
-
-            if(DEBUG_MODE >= 2) {
-                printf("LD (HL), A -> [0x%04X]=0x%02X\n", cpu->HL, cpu->A);
-            }
-            break;
-        }
-
-        case 0x7A: { // LD A, D
-            cycles = 4;
-            cpu->A = cpu->D;
-
-            if(DEBUG_MODE >= 2) {
-                printf("LD A, D -> A=0x%02X\n", cpu->A);
-            }
-            break;
-        }
-
-        case 0x7B: { // LD A, E
-            cycles = 4;
-            cpu->A = cpu->E;
-
-            if(DEBUG_MODE >= 2) {
-                printf("LD A, E -> A=0x%02X\n", cpu->A);
-            }
-            break;
-        }
-
-        case 0x87: { // ADD A, A
-            cycles = 4;
-            uint16_t result = cpu->A + cpu->A;
-
-            // Set flags
-            cpu->F = 0; // Clear all flags
-            if (result & 0xFF00) {
-                cpu->F |= FLAG_C; // Set Carry flag if overflow
-            }
-            cpu->A = result & 0xFF; // Keep only lower byte
-
-            if (cpu->A == 0) {
-                cpu->F |= FLAG_Z; // Set Zero flag if result is zero
-            }
-            if ((cpu->A & 0x0F) < (cpu->A & 0x0F)) {
-                cpu->F |= FLAG_H; // Set Half-carry flag if lower nibble overflowed
-            }
-
-            if (DEBUG_MODE >= 2) {
-                printf("ADD A, A -> A=0x%02X, F=0x%02X\n", cpu->A, cpu->F);
-            }
-            break;
-        }
-
-        case 0xAF: // XOR A
-            cycles = 4;
-            cpu->A ^= cpu->A;
-            // Set flags
-            cpu->F = FLAG_Z; // Set Zero flag
-            if(DEBUG_MODE >= 2) {
-                printf("XOR A -> A=0x%02X, F=0x%02X\n", cpu->A, cpu->F);
-            }
-            break;
-
-        case 0xB1: { // OR C
-            cycles = 4;
-            cpu->A |= cpu->C;
-            // Set flags
-            cpu->F = 0; // Clear all flags
-            if (cpu->A == 0) {
-                cpu->F |= FLAG_Z; // Set Zero flag
-            }
-            if (DEBUG_MODE >= 2) {
-                printf("OR C -> A=0x%02X, F=0x%02X\n", cpu->A, cpu->F);
-            }
-            break;
-        }
-
-        case 0xC1: { // POP BC
-            cycles = 12;
-            uint8_t low  = mmu_read(mmu, cpu->SP++);
-            uint8_t high = mmu_read(mmu, cpu->SP++);
-            cpu->BC = (high << 8) | low;
-
-            if (DEBUG_MODE >= 2) {
-                printf("POP BC -> BC=0x%04X, SP=0x%04X\n", cpu->BC, cpu->SP);
-            }
-            break;
-        }
-
-        case 0xC3: { // JP a16
-            cycles = 16;
-            uint8_t low  = mmu_read(mmu, cpu->PC++);
-            uint8_t high = mmu_read(mmu, cpu->PC++);
-            uint16_t addr = (high << 8) | low;
-            cpu->PC = addr;
-
-            if (DEBUG_MODE >= 2) {
-                printf("JP 0x%04X -> PC=0x%04X\n", addr, cpu->PC);
-            }
-            break;
-        }
-
-        case 0xC5: { // PUSH BC
-            cycles = 16;
-            cpu->SP -= 2;
-            mmu_write(mmu, cpu->SP, cpu->BC & 0xFF);            // Low byte
-            mmu_write(mmu, cpu->SP + 1, (cpu->BC >> 8) & 0xFF); // High byte
-
-
-            if (DEBUG_MODE >= 2) {
-                printf("PUSH BC -> BC=0x%04X, SP=0x%04X\n", cpu->BC, cpu->SP);
-            }
-            break;
-        }
-
-        case 0xC9: { // RET
-            cycles = 16;
-            uint8_t low  = mmu_read(mmu, cpu->SP++);
-            uint8_t high = mmu_read(mmu, cpu->SP++);
-            cpu->PC = (high << 8) | low;
-
-            if (DEBUG_MODE >= 2) {
-                printf("RET -> PC=0x%04X, SP=0x%04X\n", cpu->PC, cpu->SP);
-            }
-            break;
-        }
-
-        case 0xCB: { // Prefix CB
-            cycles = 4;
-            if (DEBUG_MODE >= 2){
-                printf("Switched to CB\n");
-            }
-            cpu_execute_cb(cpu, mmu_read(mmu, cpu->PC++));
-            break;
-        }
-
-        case 0xCD: { // CALL a16
-            cycles = 24;
-            uint8_t low  = mmu_read(mmu, cpu->PC++);
-            uint8_t high = mmu_read(mmu, cpu->PC++);
-            uint16_t addr = (high << 8) | low;
-
-            // Push return address (PC) on stack
-            cpu->SP -= 2;
-            mmu_write(mmu, cpu->SP, cpu->PC & 0xFF);        // low
-            mmu_write(mmu, cpu->SP + 1, (cpu->PC >> 8));    // high
-
-            cpu->PC = addr;
-
-            if (DEBUG_MODE >= 2) {
-                printf("CALL 0x%04X -> PC=0x%04X, SP=0x%04X\n",
-                    addr, cpu->PC, cpu->SP);
-            }
-            break;
-        }
-
-        case 0xD0: { // RET NC
-            cycles = 8;
-            if (!(cpu->F & FLAG_C)) { // if C == 0
-                uint8_t low  = mmu_read(mmu, cpu->SP++);
-                uint8_t high = mmu_read(mmu, cpu->SP++);
-                cpu->PC = (high << 8) | low;
-
-                cycles = 20;
-
-                if (DEBUG_MODE >= 2) {
-                    printf("RET NC -> PC=0x%04X, SP=0x%04X\n", cpu->PC, cpu->SP);
-                }
-            } else {
-                if (DEBUG_MODE >= 2) {
-                    printf("RET NC skipped\n");
-                }
-            }
-            break;
-        }
-
-        case 0xE0: { // LDH (a8), A
-            cycles = 12;
-            uint8_t addr = mmu_read(mmu, cpu->PC++);
-            uint16_t full_addr = 0xFF00 + addr;
-            mmu_write(mmu, full_addr, cpu->A);
-
-            if (DEBUG_MODE >= 2) {
-                printf("LDH (0x%02X), A -> [0x%04X]=0x%02X\n", addr, full_addr, cpu->A);
-            }
-            break;
-        }
-
-        case 0xE2: { // LD (0xFF00 + C), A
-            cycles = 8;
-            uint16_t addr = 0xFF00 + cpu->C;
-            mmu_write(mmu, addr, cpu->A);
-
-            if (DEBUG_MODE >= 2) {
-                printf("LD (0xFF00 + C), A -> [0x%04X]=0x%02X\n", addr, cpu->A);
-            }
-            break;
-        }
-
-        case 0xE9: { // JP (HL)
-            cycles = 4;
-            cpu->PC = cpu->HL;
-
-            if (DEBUG_MODE >= 2) {
-                printf("JP (HL) -> PC=0x%04X\n", cpu->PC);
-            }
-            break;
-        }
-
-        case 0xEA: { // LD (a16), A
-            cycles = 16;
-            uint8_t low  = mmu_read(mmu, cpu->PC++);
-            uint8_t high = mmu_read(mmu, cpu->PC++);
-            uint16_t addr = (high << 8) | low;
-
-            mmu_write(mmu, addr, cpu->A);
+    cpu->F &= FLAG_C; // keep C
+    if (result == 0) cpu->F |= FLAG_Z;
+    if ((v & 0x0F) == 0x0F) cpu->F |= FLAG_H;
+    return result;
+}
 
-            if (DEBUG_MODE >= 2) {
-                printf("LD (0x%04X), A -> [0x%04X]=0x%02X\n", addr, addr, cpu->A);
-            }
-            break;
-        }
+static uint8_t dec8(CPU *cpu, uint8_t v) {
+    uint8_t result = v - 1;
 
-        case 0xF0: { // LDH A, (a8)
-            cycles = 12;
-            uint8_t addr = mmu_read(mmu, cpu->PC++);
-            uint16_t full_addr = 0xFF00 + addr;
-            cpu->A = mmu_read(mmu, full_addr);
+    cpu->F &= FLAG_C; // keep C
+    cpu->F |= FLAG_N;
+    if (result == 0) cpu->F |= FLAG_Z;
+    if ((v & 0x0F) == 0x00) cpu->F |= FLAG_H;
+    return result;
+}
 
-            if (DEBUG_MODE >= 2) {
-                printf("LDH A, (0x%02X) -> A=0x%02X from [0x%04X]\n", addr, cpu->A, full_addr);
-            }
+// op = (opcode >> 3) & 7: ADD ADC SUB SBC AND XOR OR CP
+static void alu(CPU *cpu, uint8_t op, uint8_t v) {
+    uint8_t a = cpu->A;
+    uint8_t carry = (cpu->F & FLAG_C) ? 1 : 0;
+    uint16_t result;
+    uint8_t f = 0;
+
+    switch (op) {
+        case 0: // ADD
+            carry = 0;
+            // fallthrough
+        case 1: // ADC
+            result = a + v + carry;
+            if (((a & 0x0F) + (v & 0x0F) + carry) > 0x0F) f |= FLAG_H;
+            if (result > 0xFF) f |= FLAG_C;
+            break;
+        case 2: // SUB
+        case 7: // CP
+            carry = 0;
+            // fallthrough
+        case 3: // SBC
+            result = a - v - carry;
+            f |= FLAG_N;
+            if ((a & 0x0F) < (v & 0x0F) + carry) f |= FLAG_H;
+            if (a < v + carry) f |= FLAG_C;
+            break;
+        case 4: // AND
+            result = a & v;
+            f |= FLAG_H;
+            break;
+        case 5: // XOR
+            result = a ^ v;
+            break;
+        default: // OR
+            result = a | v;
             break;
-        }
-
-        case 0xF3: { // DI - Disable interrupts
-            cycles = 4;
-            cpu->ime = 0;
+    }
 
-            if (DEBUG_MODE >= 2) {
-                printf("DI -> IME=0\n");
-            }
-            break;
-        }
+    if ((result & 0xFF) == 0) f |= FLAG_Z;
+    cpu->F = f;
+    if (op != 7) cpu->A = result & 0xFF;
+}
 
-        case 0xFE: { // CP d8
-            cycles = 8;
-            uint8_t value = mmu_read(mmu, cpu->PC++);
-            uint8_t result = cpu->A - value;
+static inline void add_hl(CPU *cpu, uint16_t v) {
+    uint16_t hl = cpu->HL;
+    uint32_t result = hl + v;
 
-            // Set flags
-            cpu->F &= 0x10; // Clear Z H C but keep N
-            cpu->F |= FLAG_N; // Set N flag
+    cpu->F &= FLAG_Z; // keep Z
+    if (((hl & 0x0FFF) + (v & 0x0FFF)) > 0x0FFF) cpu->F |= FLAG_H;
+    if (result > 0xFFFF) cpu->F |= FLAG_C;
+    cpu->HL = (uint16_t)result;
+}
 
-            if (result == 0) {
-                cpu->F |= FLAG_Z; // Set Z flag
-            }
-            if (cpu->A < value) {
-                cpu->F |= FLAG_C; // Set C flag
-            }
-            if ((cpu->A & 0x0F) < (value & 0x0F)) {
-                cpu->F |= FLAG_H; // Set H flag
-            }
+// SP + signed offset, flags from the low byte (ADD SP,r8 and LD HL,SP+r8)
+static uint16_t sp_offset(CPU *cpu, int8_t offset) {
+    uint8_t e = (uint8_t)offset;
 
-            if (DEBUG_MODE >= 2) {
-                printf("CP 0x%02X -> A=0x%02X, F=0x%02X\n", value, cpu->A, cpu->F);
-            }
-            break;
-        }
+    cpu->F = 0;
+    if (((cpu->SP & 0x0F) + (e & 0x0F)) > 0x0F) cpu->F |= FLAG_H;
+    if (((cpu->SP & 0xFF) + e) > 0xFF) cpu->F |= FLAG_C;
+    return cpu->SP + offset;
+}
 
-        case 0xFF: { // RST 38H
-            cycles = 16;
-            cpu->SP -= 2;
-            mmu_write(mmu, cpu->SP, cpu->PC & 0xFF);            // Low byte
-            mmu_write(mmu, cpu->SP + 1, (cpu->PC >> 8) & 0xFF); // High byte
+static inline void daa(CPU *cpu) {
+    uint8_t a = cpu->A;
+    uint8_t f = cpu->F & (FLAG_N | FLAG_C);
 
-            cpu->PC = 0x0038;
+    if (!(cpu->F & FLAG_N)) {
+        if ((cpu->F & FLAG_C) || a > 0x99) { a += 0x60; f |= FLAG_C; }
+        if ((cpu->F & FLAG_H) || (a & 0x0F) > 0x09) a += 0x06;
+    } else {
+        if (cpu->F & FLAG_C) a -= 0x60;
+        if (cpu->F & FLAG_H) a -= 0x06;
+    }
 
-            if (DEBUG_MODE >= 2) {
-                printf("RST 38H -> PC=0x%04X, SP=0x%04X\n", cpu->PC, cpu->SP);
-            }
-            break;
-        }
+    if (a == 0) f |= FLAG_Z;
+    cpu->A = a;
+    cpu->F = f;
+}
 
-        default:
-            if (DEBUG_MODE >= 2) {
-                printf("Unknown opcode: 0x%02X at PC=0x%04X\n", opcode, cpu->PC - 1);
-            }
-            exit(1);
-            break;
+// ===== Cores =====
+// cpu_core.inc is compiled twice:
+//  - cpu_step / cpu_execute: whole instructions, the caller runs the rest of
+//    the console for the cycles returned afterwards
+//  - cpu_step_accurate / cpu_execute_accurate: cpu->tick runs the console up
+//    to each memory access (one M-cycle each), then for the rest of the
+//    instruction before returning, so a read of STAT or LY, or a write to a
+//    PPU register, happens on its cycle within the instruction
+// The choice is made per console (gb_init_accuracy), never per instruction
+
+// Give tick the cycles run since its last call
+static inline void cpu_sync(CPU *cpu) {
+    uint16_t due = cpu->stepCycles - cpu->tickedCycles;
+    if (due) {
+        cpu->tick(cpu->tickCtx, due);
+        cpu->tickedCycles = cpu->stepCycles;
     }
-    mmu->io[0x44] = (mmu->io[0x44] + 1) % 154;
+}
 
-    return cycles;
-}
\ No newline at end of file
+#define CORE_FN(name) name
+#define CORE_ACCURATE 0
+#include "cpu_core.inc"
+#undef CORE_FN
+#undef CORE_ACCURATE
+
+#define CORE_FN(name) name##_accurate
+#define CORE_ACCURATE 1
+#include "cpu_core.inc"
+#undef CORE_FN
+#undef CORE_ACCURATE
@@ -0,0 +1,123 @@
+#include <stdlib.h>
+#include <string.h>
+#include "../includes/cunegb.h"
+#include "../includes/gb.h"
+
+int DEBUG_MODE = 0; // hidden like the rest of the core (-fvisibility=hidden)
+
+struct CuneGB {
+    GameBoy gb;
+    const uint8_t *rom;  // attached to gb.mmu, the same buffer is used again by cunegb_reset
+    size_t romSize;
+    uint8_t ownsRom;     // 1 = our copy, freed with the instance
+};
+
+// The console always borrows the ROM, only its owner changes
+static int cunegb_start(CuneGB *h) {
+    uint8_t frameskip = h->gb.ppu.frameskip;
+
+    gb_init(&h->gb);
+    if (gb_attach_rom(&h->gb, h->rom, h->romSize) != 0) return -1;
+    ppu_set_frameskip(&h->gb.ppu, frameskip);
+    gb_boot(&h->gb);
+    return 0;
+}
+
+uint32_t cunegb_abi_version(void) {
+    return CUNEGB_ABI_VERSION;
+}
+
+CuneGB *cunegb_create(const void *rom, size_t size, uint32_t flags) {
+    if (!rom || size == 0) return NULL;
+
+    CuneGB *h = calloc(1, sizeof(CuneGB));
+    if (!h) return NULL;
+
+    if (flags & CUNEGB_BORROW_ROM) {
+        h->rom = rom;
+    } else {
+        uint8_t *copy = malloc(size);
+        if (!copy) {
+            free(h);
+            return NULL;
+        }
+        memcpy(copy, rom, size);
+        h->rom = copy;
+        h->ownsRom = 1;
+    }
+    h->romSize = size;
+
+    if (cunegb_start(h) != 0) {
+        cunegb_destroy(h);
+        return NULL;
+    }
+    return h;
+}
+
+void cunegb_destroy(CuneGB *h) {
+    if (!h) return;
+    gb_free(&h->gb);
+    if (h->ownsRom) free((void *)h->rom);
+    free(h);
+}
+
+// Power cycle: cartridge RAM is cleared in place, so every view stays valid
+void cunegb_reset(CuneGB *h) {
+    uint8_t *eram = h->gb.mmu.eram;
+
+    h->gb.mmu.eram = NULL; // not freed by gb_free, the new console takes it back
+    gb_free(&h->gb);
+    if (cunegb_start(h) == 0 && eram && h->gb.mmu.eram) mmu_adopt_eram(&h->gb.mmu, eram);
+    else free(eram);
+}
+
+uint64_t cunegb_step(CuneGB *h, uint32_t frames, uint8_t buttons) {
+    uint64_t cycles = 0;
+
+    mmu_set_joypad(&h->gb.mmu, buttons);
+    while (frames--) cycles += gb_run_frame(&h->gb);
+    return cycles;
+}
+
+void cunegb_set_frameskip(CuneGB *h, uint8_t frames) {
+    ppu_set_frameskip(&h->gb.ppu, frames);
+}
+
+int cunegb_is_cgb(const CuneGB *h) {
+    return h->gb.mmu.cgb;
+}
+
+uint64_t cunegb_frame_count(const CuneGB *h) {
+    return h->gb.frames;
+}
+
+int cunegb_frame_unchanged(const CuneGB *h) {
+    return h->gb.ppu.frameUnchanged;
+}
+
+// ===== Zero-copy views =====
+// Instances are never forked: their RAM stays in the MMU arrays (see mmu_fork)
+const uint8_t *cunegb_framebuffer(const CuneGB *h) {
+    return &h->gb.ppu.framebuffer[0][0];
+}
+
+const uint16_t *cunegb_color_framebuffer(const CuneGB *h) {
+    return h->gb.mmu.cgb ? &h->gb.ppu.colorFramebuffer[0][0] : NULL;
+}
+
+const uint8_t *cunegb_memory(const CuneGB *h, CuneGBMemory region, size_t *size) {
+    const MMU *mmu = &h->gb.mmu;
+    const uint8_t *data = NULL;
+    size_t len = 0;
+
+    switch (region) {
+        case CUNEGB_WRAM:     data = mmu->wram; len = mmu->cgb ? sizeof(mmu->wram) : 0x2000; break;
+        case CUNEGB_HRAM:     data = mmu->hram; len = sizeof(mmu->hram); break;
+        case CUNEGB_VRAM:     data = mmu->vram; len = mmu->cgb ? sizeof(mmu->vram) : 0x2000; break;
+        case CUNEGB_OAM:      data = mmu->oam;  len = sizeof(mmu->oam); break;
+        case CUNEGB_IO:       data = mmu->io;   len = sizeof(mmu->io); break;
+        case CUNEGB_CART_RAM: data = mmu->eram; len = mmu->eram ? mmu->eram_size : 0; break;
+    }
+    if (size) *size = len;
+    return data;
+}
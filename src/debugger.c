@@ -0,0 +1,427 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "../includes/debugger.h"
+
+// ===== Expressions =====
+enum {
+    OP_NUM, OP_REG, OP_VALUE, OP_MEM,
+    OP_NEG, OP_NOT, OP_BNOT,
+    OP_MUL, OP_DIV, OP_MOD, OP_ADD, OP_SUB, OP_SHL, OP_SHR,
+    OP_LT, OP_LE, OP_GT, OP_GE, OP_EQ, OP_NE,
+    OP_BAND, OP_BXOR, OP_BOR, OP_AND, OP_OR
+};
+
+enum { REG_A, REG_F, REG_B, REG_C, REG_D, REG_E, REG_H, REG_L, REG_AF, REG_BC, REG_DE, REG_HL, REG_SP, REG_PC };
+
+static const char *register_names[] = { "A", "F", "B", "C", "D", "E", "H", "L", "AF", "BC", "DE", "HL", "SP", "PC" };
+
+typedef struct {
+    const char *p;
+    DebugExpr *expr;
+    int error;
+} Parser;
+
+static void emit(Parser *ps, uint16_t op, int32_t value) {
+    if (ps->expr->count >= DEBUGGER_MAX_EXPR) {
+        ps->error = 1;
+        return;
+    }
+    ps->expr->ops[ps->expr->count] = op;
+    ps->expr->values[ps->expr->count] = value;
+    ps->expr->count++;
+}
+
+static void skip_spaces(Parser *ps) {
+    while (isspace((unsigned char)*ps->p)) ps->p++;
+}
+
+static int accept(Parser *ps, const char *token) {
+    skip_spaces(ps);
+    size_t len = strlen(token);
+    if (strncmp(ps->p, token, len) != 0) return 0;
+    // don't take "<" from "<<" or "<=", "&" from "&&"...
+    if (len == 1 && (ps->p[1] == '=' || ps->p[1] == token[0]) && strchr("<>&|=!", token[0])) return 0;
+    ps->p += len;
+    return 1;
+}
+
+static void parse_or(Parser *ps);
+
+static void parse_primary(Parser *ps) {
+    skip_spaces(ps);
+
+    if (accept(ps, "(")) {
+        parse_or(ps);
+        if (!accept(ps, ")")) ps->error = 1;
+        return;
+    }
+    if (accept(ps, "[")) {
+        parse_or(ps);
+        if (!accept(ps, "]")) ps->error = 1;
+        emit(ps, OP_MEM, 0);
+        return;
+    }
+
+    if (*ps->p == '$' || isdigit((unsigned char)*ps->p)) {
+        char *end;
+        long v = (*ps->p == '$') ? strtol(ps->p + 1, &end, 16) : strtol(ps->p, &end, 0);
+        ps->p = end;
+        emit(ps, OP_NUM, (int32_t)v);
+        return;
+    }
+
+    if (isalpha((unsigned char)*ps->p)) {
+        char word[8];
+        int n = 0;
+        while (isalnum((unsigned char)*ps->p) && n < 7) word[n++] = toupper((unsigned char)*ps->p++);
+        word[n] = '\0';
+
+        if (strcmp(word, "VALUE") == 0) {
+            emit(ps, OP_VALUE, 0);
+            return;
+        }
+        for (int r = 0; r < (int)(sizeof(register_names) / sizeof(register_names[0])); r++) {
+            if (strcmp(word, register_names[r]) == 0) {
+                emit(ps, OP_REG, r);
+                return;
+            }
+        }
+    }
+    ps->error = 1;
+}
+
+static void parse_unary(Parser *ps) {
+    if (accept(ps, "-")) { parse_unary(ps); emit(ps, OP_NEG, 0); return; }
+    if (accept(ps, "!")) { parse_unary(ps); emit(ps, OP_NOT, 0); return; }
+    if (accept(ps, "~")) { parse_unary(ps); emit(ps, OP_BNOT, 0); return; }
+    parse_primary(ps);
+}
+
+// Binary operators from the highest to the lowest precedence
+typedef struct {
+    const char *token;
+    uint16_t op;
+} BinaryOp;
+
+static const BinaryOp levels[][5] = {
+    { { "*", OP_MUL }, { "/", OP_DIV }, { "%", OP_MOD } },
+    { { "+", OP_ADD }, { "-", OP_SUB } },
+    { { "<<", OP_SHL }, { ">>", OP_SHR } },
+    { { "<=", OP_LE }, { ">=", OP_GE }, { "<", OP_LT }, { ">", OP_GT } },
+    { { "==", OP_EQ }, { "!=", OP_NE } },
+    { { "&", OP_BAND } },
+    { { "^", OP_BXOR } },
+    { { "|", OP_BOR } },
+    { { "&&", OP_AND } },
+    { { "||", OP_OR } },
+};
+
+static void parse_level(Parser *ps, int level) {
+    if (level < 0) {
+        parse_unary(ps);
+        return;
+    }
+
+    parse_level(ps, level - 1);
+    while (!ps->error) {
+        const BinaryOp *found = NULL;
+        for (int i = 0; i < 5 && levels[level][i].token; i++) {
+            if (accept(ps, levels[level][i].token)) {
+                found = &levels[level][i];
+                break;
+            }
+        }
+        if (!found) return;
+        parse_level(ps, level - 1);
+        emit(ps, found->op, 0);
+    }
+}
+
+static void parse_or(Parser *ps) {
+    parse_level(ps, (int)(sizeof(levels) / sizeof(levels[0])) - 1);
+}
+
+int debugger_parse_expr(DebugExpr *expr, const char *text) {
+    Parser ps = { text, expr, 0 };
+
+    expr->count = 0;
+    parse_or(&ps);
+    skip_spaces(&ps);
+    if (ps.error || *ps.p != '\0' || expr->count == 0) return -1;
+    return 0;
+}
+
+static int32_t read_register(const CPU *cpu, int reg) {
+    switch (reg) {
+        case REG_A: return cpu->A;
+        case REG_F: return cpu->F;
+        case REG_B: return cpu->B;
+        case REG_C: return cpu->C;
+        case REG_D: return cpu->D;
+        case REG_E: return cpu->E;
+        case REG_H: return cpu->H;
+        case REG_L: return cpu->L;
+        case REG_AF: return (cpu->A << 8) | cpu->F;
+        case REG_BC: return (cpu->B << 8) | cpu->C;
+        case REG_DE: return (cpu->D << 8) | cpu->E;
+        case REG_HL: return (cpu->H << 8) | cpu->L;
+        case REG_SP: return cpu->SP;
+        case REG_PC: return cpu->PC;
+    }
+    return 0;
+}
+
+int32_t debugger_eval(Debugger *dbg, const DebugExpr *expr, int32_t value) {
+    int32_t stack[DEBUGGER_MAX_EXPR];
+    int sp = 0;
+
+    for (int i = 0; i < expr->count; i++) {
+        uint16_t op = expr->ops[i];
+        int32_t a, b;
+
+        switch (op) {
+            case OP_NUM:   stack[sp++] = expr->values[i]; continue;
+            case OP_REG:   stack[sp++] = read_register(dbg->cpu, expr->values[i]); continue;
+            case OP_VALUE: stack[sp++] = value; continue;
+            case OP_MEM:   stack[sp - 1] = mmu_peek(dbg->mmu, (uint16_t)stack[sp - 1]); continue;
+            case OP_NEG:   stack[sp - 1] = -stack[sp - 1]; continue;
+            case OP_NOT:   stack[sp - 1] = !stack[sp - 1]; continue;
+            case OP_BNOT:  stack[sp - 1] = ~stack[sp - 1]; continue;
+        }
+
+        b = stack[--sp];
+        a = stack[sp - 1];
+        switch (op) {
+            case OP_MUL:  a = a * b; break;
+            case OP_DIV:  a = b ? a / b : 0; break;
+            case OP_MOD:  a = b ? a % b : 0; break;
+            case OP_ADD:  a = a + b; break;
+            case OP_SUB:  a = a - b; break;
+            case OP_SHL:  a = a << (b & 31); break;
+            case OP_SHR:  a = a >> (b & 31); break;
+            case OP_LT:   a = a < b; break;
+            case OP_LE:   a = a <= b; break;
+            case OP_GT:   a = a > b; break;
+            case OP_GE:   a = a >= b; break;
+            case OP_EQ:   a = a == b; break;
+            case OP_NE:   a = a != b; break;
+            case OP_BAND: a = a & b; break;
+            case OP_BXOR: a = a ^ b; break;
+            case OP_BOR:  a = a | b; break;
+            case OP_AND:  a = a && b; break;
+            case OP_OR:   a = a || b; break;
+        }
+        stack[sp - 1] = a;
+    }
+    return sp ? stack[sp - 1] : 0;
+}
+
+// ===== Watchpoints (MMU slow path hook) =====
+static void debugger_on_access(void *ctx, uint16_t addr, uint8_t val, uint8_t write) {
+    Debugger *dbg = ctx;
+    uint8_t type = write ? WATCH_WRITE : WATCH_READ;
+
+    if (dbg->stopReason != STOP_NONE) return;
+
+    for (int i = 0; i < dbg->watchpointCount; i++) {
+        const Watchpoint *w = &dbg->watchpoints[i];
+        if (!(w->type & type)) continue;
+        if (addr < w->addr || addr >= (uint32_t)w->addr + w->length) continue;
+        if (w->hasCondition && !debugger_eval(dbg, &w->condition, val)) continue;
+
+        dbg->stopReason = STOP_WATCHPOINT;
+        dbg->stopAddr = addr;
+        dbg->stopAccess = type;
+        return;
+    }
+}
+
+// Put every watched page on the slow path, give the others back to the fast path
+static void debugger_update_traps(Debugger *dbg) {
+    MMU *mmu = dbg->mmu;
+
+    mmu->trap_read = 0;
+    mmu->trap_write = 0;
+    for (int i = 0; i < dbg->watchpointCount; i++) {
+        const Watchpoint *w = &dbg->watchpoints[i];
+        uint32_t last = (uint32_t)w->addr + w->length - 1;
+        if (last > 0xFFFF) last = 0xFFFF;
+        for (uint32_t page = w->addr >> MMU_PAGE_SHIFT; page <= (last >> MMU_PAGE_SHIFT); page++) {
+            if (w->type & WATCH_READ) mmu->trap_read |= 1 << page;
+            if (w->type & WATCH_WRITE) mmu->trap_write |= 1 << page;
+        }
+    }
+
+    mmu->access_hook = dbg->watchpointCount ? debugger_on_access : NULL;
+    mmu->access_ctx = dbg->watchpointCount ? dbg : NULL;
+    mmu_update_map(mmu);
+}
+
+// ===== API =====
+void debugger_init(Debugger *dbg, CPU *cpu, MMU *mmu) {
+    memset(dbg, 0, sizeof(Debugger));
+    dbg->cpu = cpu;
+    dbg->mmu = mmu;
+}
+
+// Remove every trap from the MMU
+void debugger_detach(Debugger *dbg) {
+    dbg->watchpointCount = 0;
+    debugger_update_traps(dbg);
+}
+
+int debugger_add_breakpoint(Debugger *dbg, uint16_t addr, const char *condition) {
+    if (dbg->breakpointCount >= DEBUGGER_MAX_BREAKPOINTS) return -1;
+
+    Breakpoint *bp = &dbg->breakpoints[dbg->breakpointCount];
+    bp->addr = addr;
+    bp->hasCondition = condition && *condition;
+    if (bp->hasCondition && debugger_parse_expr(&bp->condition, condition) != 0) return -1;
+
+    dbg->breakpointCount++;
+    dbg->bitmap[addr >> 3] |= 1 << (addr & 7);
+    return 0;
+}
+
+int debugger_remove_breakpoint(Debugger *dbg, uint16_t addr) {
+    int removed = -1;
+
+    for (int i = 0; i < dbg->breakpointCount; ) {
+        if (dbg->breakpoints[i].addr == addr) {
+            dbg->breakpoints[i] = dbg->breakpoints[--dbg->breakpointCount];
+            removed = 0;
+        } else {
+            i++;
+        }
+    }
+    if (removed == 0) dbg->bitmap[addr >> 3] &= ~(1 << (addr & 7));
+    return removed;
+}
+
+int debugger_add_watchpoint(Debugger *dbg, uint16_t addr, uint16_t length, uint8_t type, const char *condition) {
+    if (dbg->watchpointCount >= DEBUGGER_MAX_WATCHPOINTS || length == 0 || !(type & WATCH_ACCESS)) return -1;
+
+    Watchpoint *w = &dbg->watchpoints[dbg->watchpointCount];
+    w->addr = addr;
+    w->length = length;
+    w->type = type;
+    w->hasCondition = condition && *condition;
+    if (w->hasCondition && debugger_parse_expr(&w->condition, condition) != 0) return -1;
+
+    dbg->watchpointCount++;
+    debugger_update_traps(dbg);
+    return 0;
+}
+
+int debugger_remove_watchpoint(Debugger *dbg, uint16_t addr, uint16_t length, uint8_t type) {
+    int removed = -1;
+
+    for (int i = 0; i < dbg->watchpointCount; ) {
+        const Watchpoint *w = &dbg->watchpoints[i];
+        if (w->addr == addr && w->length == length && w->type == type) {
+            dbg->watchpoints[i] = dbg->watchpoints[--dbg->watchpointCount];
+            removed = 0;
+        } else {
+            i++;
+        }
+    }
+    debugger_update_traps(dbg);
+    return removed;
+}
+
+// PC has its bit set in the bitmap: check the breakpoint(s) and their condition
+int debugger_check_breakpoint(Debugger *dbg) {
+    uint16_t pc = dbg->cpu->PC;
+
+    if (dbg->skipBreakpoint) {
+        dbg->skipBreakpoint = 0;
+        return 0;
+    }
+
+    for (int i = 0; i < dbg->breakpointCount; i++) {
+        const Breakpoint *bp = &dbg->breakpoints[i];
+        if (bp->addr != pc) continue;
+        if (bp->hasCondition && !debugger_eval(dbg, &bp->condition, 0)) continue;
+
+        dbg->stopReason = STOP_BREAKPOINT;
+        dbg->stopAddr = pc;
+        return 1;
+    }
+    return 0;
+}
+
+int debugger_active(const Debugger *dbg) {
+    return dbg->breakpointCount || dbg->watchpointCount || dbg->singleStep;
+}
+
+void debugger_resume(Debugger *dbg) {
+    if (dbg->stopReason == STOP_BREAKPOINT) dbg->skipBreakpoint = 1;
+    dbg->stopReason = STOP_NONE;
+}
+
+void debugger_print_state(Debugger *dbg, FILE *out) {
+    const CPU *cpu = dbg->cpu;
+
+    switch (dbg->stopReason) {
+        case STOP_BREAKPOINT:
+            fprintf(out, "🛑 Breakpoint at 0x%04X\n", dbg->stopAddr);
+            break;
+        case STOP_WATCHPOINT:
+            fprintf(out, "👀 Watchpoint: %s 0x%04X = 0x%02X (PC=0x%04X)\n",
+                dbg->stopAccess == WATCH_WRITE ? "write" : "read", dbg->stopAddr,
+                mmu_peek(dbg->mmu, dbg->stopAddr), cpu->PC);
+            break;
+        default:
+            break;
+    }
+    fprintf(out, "   A=%02X F=%02X B=%02X C=%02X D=%02X E=%02X H=%02X L=%02X SP=%04X PC=%04X\n",
+        cpu->A, cpu->F, cpu->B, cpu->C, cpu->D, cpu->E, cpu->H, cpu->L, cpu->SP, cpu->PC);
+}
+
+// ===== Command line specs =====
+static const char *parse_address(const char *text, unsigned *out) {
+    char *end;
+    while (isspace((unsigned char)*text)) text++;
+    *out = (*text == '$') ? (unsigned)strtoul(text + 1, &end, 16) : (unsigned)strtoul(text, &end, 0);
+    return end == text ? NULL : end;
+}
+
+static const char *parse_condition(const char *text) {
+    while (isspace((unsigned char)*text)) text++;
+    if (*text == '\0') return NULL;
+    if (strncmp(text, "if ", 3) == 0) return text + 3;
+    return text;
+}
+
+// "ADDR [if COND]", ex: "0x0150 if A == 0x11"
+int debugger_add_breakpoint_spec(Debugger *dbg, const char *spec) {
+    unsigned addr;
+    const char *rest = parse_address(spec, &addr);
+    if (!rest || addr > 0xFFFF) return -1;
+    return debugger_add_breakpoint(dbg, (uint16_t)addr, parse_condition(rest));
+}
+
+// "ADDR[:LEN] [r|w|rw] [if COND]", ex: "0xC000:16 w if value > 3"
+int debugger_add_watchpoint_spec(Debugger *dbg, const char *spec) {
+    unsigned addr, length = 1;
+    uint8_t type = WATCH_WRITE;
+    const char *rest = parse_address(spec, &addr);
+    if (!rest || addr > 0xFFFF) return -1;
+
+    if (*rest == ':') {
+        rest = parse_address(rest + 1, &length);
+        if (!rest || length == 0 || length > 0x10000) return -1;
+    }
+    while (isspace((unsigned char)*rest)) rest++;
+
+    if (strncmp(rest, "rw", 2) == 0 && (rest[2] == '\0' || isspace((unsigned char)rest[2]))) {
+        type = WATCH_ACCESS;
+        rest += 2;
+    } else if ((*rest == 'r' || *rest == 'w') && (rest[1] == '\0' || isspace((unsigned char)rest[1]))) {
+        type = *rest == 'r' ? WATCH_READ : WATCH_WRITE;
+        rest += 1;
+    }
+    return debugger_add_watchpoint(dbg, (uint16_t)addr, (uint16_t)length, type, parse_condition(rest));
+}
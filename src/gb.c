@@ -0,0 +1,283 @@
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include "../includes/gb.h"
+#include "../includes/bios.h"
+#include "../includes/stats.h"
+#include "../includes/profiler.h"
+#include "../includes/debugger.h"
+#include "../includes/trace.h"
+
+// Everything but the CPU, for `cycles` CPU cycles (in double speed the PPU sees half)
+static inline void gb_tick(GameBoy *gb, uint16_t cycles) {
+    ppu_step(&gb->ppu, &gb->mmu, cycles >> gb->mmu.double_speed);
+    if (gb->mmu.serial_active) mmu_serial_tick(&gb->mmu, cycles);
+}
+
+// Cycle-accurate core: called by the CPU before its memory accesses
+static void gb_tick_hook(void *ctx, uint16_t cycles) {
+    gb_tick(ctx, cycles);
+}
+
+void gb_init(GameBoy *gb) {
+    gb_init_accuracy(gb, GB_ACCURACY_FAST);
+}
+
+// The console must stay where it is: the accurate core keeps a pointer to it
+void gb_init_accuracy(GameBoy *gb, GBAccuracy accuracy) {
+    cpu_init(&gb->cpu);
+    mmu_init(&gb->mmu);
+    ppu_init(&gb->ppu);
+    gb->frames = 0;
+    gb->accuracy = accuracy;
+    gb->debugger = NULL;
+    gb->tracer = NULL;
+    if (accuracy == GB_ACCURACY_CYCLE) {
+        gb->cpu.tick = gb_tick_hook;
+        gb->cpu.tickCtx = gb;
+    }
+}
+
+static void gb_rom_loaded(GameBoy *gb) {
+    ppu_invalidate(&gb->ppu); // DMG and CGB lines don't hold the same thing
+
+    // A = 0x11 after boot is how games detect a CGB
+    if (gb->mmu.cgb) gb->cpu.A = 0x11;
+}
+
+int gb_load_rom(GameBoy *gb, const uint8_t *data, size_t size) {
+    if (mmu_load_rom(&gb->mmu, data, size) != 0) return -1;
+    gb_rom_loaded(gb);
+    return 0;
+}
+
+// No copy: data is shared (read only) and must outlive the console
+int gb_attach_rom(GameBoy *gb, const uint8_t *data, size_t size) {
+    if (mmu_attach_rom(&gb->mmu, data, size) != 0) return -1;
+    gb_rom_loaded(gb);
+    return 0;
+}
+
+void gb_free(GameBoy *gb) {
+    ppu_stop_worker(&gb->ppu);
+    mmu_free_rom(&gb->mmu);
+}
+
+// ===== Fast boot =====
+// State of the console when the boot ROM hands over at 0x0100, computed once
+// per process by running biosArray on a cartridge with a valid header
+static CPU boot_cpu;
+static MMU boot_mmu;
+static PPU boot_ppu;
+static uint8_t boot_ready; // 0 = the boot ROM never reached 0x0100, there is no state to apply
+static pthread_once_t boot_once = PTHREAD_ONCE_INIT;
+
+#define GB_BOOT_MAX_CYCLES (PPU_FRAME_CYCLES * 600) // the boot ROM needs ~23.4M cycles (~334 frames)
+
+static void gb_boot_setup(void) {
+    static uint8_t rom[0x8000];
+    static GameBoy gb;
+    uint32_t cycles = 0;
+
+    // Logo (the copy inside the boot ROM) + header checksum, or the boot ROM locks up
+    memcpy(&rom[0x104], &biosArray[0xA8], 0x30);
+    uint8_t x = 0;
+    for (int i = 0x134; i <= 0x14C; i++) x = x - rom[i] - 1;
+    rom[0x14D] = x;
+
+    gb_init(&gb);
+    gb_load_rom(&gb, rom, sizeof(rom));
+    mmu_load_bios(&gb.mmu, biosArray, bios_size);
+    gb.cpu.PC = 0x0000;
+    while ((gb.cpu.PC != 0x0100 || gb.mmu.bios_active) && !gb.cpu.locked && cycles < GB_BOOT_MAX_CYCLES) {
+        cycles += gb_step(&gb);
+    }
+
+    // Locked up or out of time: whatever state it got to is not the post-boot one
+    boot_ready = gb.cpu.PC == 0x0100 && !gb.mmu.bios_active && !gb.cpu.locked;
+    boot_cpu = gb.cpu;
+    boot_mmu = gb.mmu;
+    boot_ppu = gb.ppu;
+    gb_free(&gb);
+}
+
+// Skip the boot ROM: put the console in its post-boot state without running it.
+// Call after gb_load_rom; the cartridge (ROM, RAM, MBC) is kept as loaded.
+// Return -1 when that state could not be computed: the console then starts
+// the boot ROM from 0x0000 instead, like --bios
+int gb_boot(GameBoy *gb) {
+    MMU *mmu = &gb->mmu;
+    CPU cpu = gb->cpu;
+    uint8_t frameskip = gb->ppu.frameskip;
+    struct PPUWorker *worker = gb->ppu.worker;
+
+    pthread_once(&boot_once, gb_boot_setup);
+    if (!boot_ready) {
+        mmu_load_bios(mmu, biosArray, bios_size);
+        gb->cpu.PC = 0x0000;
+        return -1;
+    }
+
+    ppu_sync(&gb->ppu); // its lines go to the framebuffer replaced here
+    gb->cpu = boot_cpu;
+    gb->ppu = boot_ppu;
+    gb->ppu.worker = worker;
+    gb->cpu.tick = cpu.tick;
+    gb->cpu.tickCtx = cpu.tickCtx;
+    gb->cpu.profiler = cpu.profiler;
+    ppu_set_frameskip(&gb->ppu, frameskip);
+
+    // vram .. interrupt_enable are contiguous: one copy for all the console memory
+    mmu_unshare(mmu);
+    memcpy(mmu->vram, boot_mmu.vram, offsetof(MMU, bios_active) - offsetof(MMU, vram));
+    mmu->bios_active = 0;
+    mmu->vram_bank = 0;
+    mmu->wram_bank = 1;
+    memset(mmu->vram_dirty, 0xFF, sizeof(mmu->vram_dirty)); // all of it written, for mmu_log_vram
+    mmu->vram_version++;
+    mmu->oam_version++;
+    ppu_invalidate(&gb->ppu);
+
+    // The last thing the boot ROM does is adding the header checksum: Z, H and C come from it
+    if (mmu->rom && mmu->rom_size > 0x14D) {
+        uint8_t a = 0x19;
+        for (int i = 0x134; i <= 0x14C; i++) a += mmu->rom[i];
+        uint8_t v = mmu->rom[0x14D];
+        gb->cpu.F = (uint8_t)(((uint8_t)(a + v) == 0 ? FLAG_Z : 0) |
+                              (((a & 0x0F) + (v & 0x0F)) > 0x0F ? FLAG_H : 0) |
+                              (a + v > 0xFF ? FLAG_C : 0));
+    }
+    if (mmu->cgb) {
+        gb->cpu.A = 0x11;
+        mmu->io[0x4F] = 0xFE;
+        mmu->io[0x70] = 0xF9;
+        mmu->io[0x55] = 0xFF;
+
+        // The CGB boot ROM sets every BG color to white (0x7FFF) and leaves the OBJ palettes alone
+        for (size_t i = 0; i < sizeof(mmu->bg_palette); i += 2) {
+            mmu->bg_palette[i] = 0xFF;
+            mmu->bg_palette[i + 1] = 0x7F;
+        }
+        mmu->palette_version++;
+    }
+    mmu_update_map(mmu);
+    return 0;
+}
+
+// ===== Fork =====
+// child continues from parent's exact state; the RAM is shared copy-on-write
+// (see mmu_fork) so a fork costs about the pages written since the previous one.
+// The framebuffers aren't copied: the child draws its next frame in full.
+// A console already in child must be gb_free()d first; the child is then freed or forked like any other
+int gb_fork(GameBoy *child, GameBoy *parent) {
+    if (mmu_fork(&child->mmu, &parent->mmu) != 0) return -1;
+
+    child->cpu = parent->cpu;
+    child->cpu.profiler = NULL;
+    if (child->cpu.tick) child->cpu.tickCtx = child;
+    memcpy(&child->ppu, &parent->ppu, offsetof(PPU, framebuffer));
+    child->ppu.worker = NULL; // the render thread stays with the parent
+    ppu_invalidate(&child->ppu);
+    child->frames = parent->frames;
+    child->accuracy = parent->accuracy;
+    child->debugger = NULL;
+    child->tracer = NULL;
+    return 0;
+}
+
+// Execute one instruction (the accurate core runs the rest of the console itself)
+uint16_t gb_step(GameBoy *gb) {
+    uint16_t cycles;
+    if (gb->accuracy == GB_ACCURACY_CYCLE) {
+        cycles = cpu_step_accurate(&gb->cpu, &gb->mmu);
+    } else {
+        cycles = cpu_step(&gb->cpu, &gb->mmu);
+        gb_tick(gb, cycles);
+    }
+    if (gb->ppu.frameComplete) {
+        gb->ppu.frameComplete = 0;
+        gb->frames++;
+    }
+    return cycles;
+}
+
+// Same loop with the tools hooks, kept apart so the normal loop stays as small as possible
+// Can return before the end of the frame when the debugger stops
+static uint32_t gb_run_frame_tools(GameBoy *gb) {
+    Profiler *profiler = gb->cpu.profiler;
+    Debugger *dbg = gb->debugger;
+    Tracer *tracer = gb->tracer;
+    uint32_t total = 0;
+    STATS_FRAME_BEGIN(start);
+
+    gb->ppu.frameComplete = 0;
+    while (!gb->ppu.frameComplete) {
+        if (dbg && DEBUGGER_HAS_BREAKPOINT(dbg, gb->cpu.PC) && debugger_check_breakpoint(dbg)) {
+            ppu_sync(&gb->ppu);
+            return total;
+        }
+
+        if (tracer) trace_begin_step(tracer);
+        uint16_t cycles;
+        if (gb->accuracy == GB_ACCURACY_CYCLE) {
+            cycles = cpu_step_accurate(&gb->cpu, &gb->mmu);
+        } else {
+            cycles = cpu_step(&gb->cpu, &gb->mmu);
+            gb_tick(gb, cycles);
+        }
+        if (tracer) trace_end_step(tracer, cycles);
+        total += cycles;
+
+        if (profiler) PROFILER_TICK(profiler, &gb->cpu, &gb->mmu, cycles);
+
+        if (dbg) {
+            dbg->skipBreakpoint = 0;
+            if (dbg->singleStep && dbg->stopReason == STOP_NONE) {
+                dbg->singleStep = 0;
+                dbg->stopReason = STOP_STEP;
+            }
+            if (dbg->stopReason != STOP_NONE) break;
+        }
+    }
+    if (gb->ppu.frameComplete) gb->frames++;
+    else ppu_sync(&gb->ppu); // stopped mid-frame: the lines so far are in the framebuffer
+
+    STATS_FRAME_END(start);
+    return total;
+}
+
+// Cycle-accurate core: the PPU is run from inside cpu_step_accurate
+static uint32_t gb_run_frame_accurate(GameBoy *gb) {
+    uint32_t total = 0;
+    STATS_FRAME_BEGIN(start);
+
+    gb->ppu.frameComplete = 0;
+    while (!gb->ppu.frameComplete) {
+        total += cpu_step_accurate(&gb->cpu, &gb->mmu);
+    }
+    gb->frames++;
+
+    STATS_FRAME_END(start);
+    return total;
+}
+
+// Run the CPU and the PPU until the PPU has finished a frame (VBlank)
+// Return the number of cycles executed
+uint32_t gb_run_frame(GameBoy *gb) {
+    if (gb->cpu.profiler || gb->debugger || gb->tracer) return gb_run_frame_tools(gb);
+    if (gb->accuracy == GB_ACCURACY_CYCLE) return gb_run_frame_accurate(gb);
+
+    uint32_t total = 0;
+    STATS_FRAME_BEGIN(start);
+
+    gb->ppu.frameComplete = 0;
+    while (!gb->ppu.frameComplete) {
+        uint16_t cycles = cpu_step(&gb->cpu, &gb->mmu);
+        gb_tick(gb, cycles);
+        total += cycles;
+    }
+    gb->frames++;
+
+    STATS_FRAME_END(start);
+    return total;
+}
@@ -0,0 +1,332 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "../includes/gdbstub.h"
+
+#define PACKET_SIZE 4096
+
+typedef struct {
+    int fd;
+    GameBoy *gb;
+    Debugger *dbg;
+    uint8_t running;
+} GdbStub;
+
+static const char hex_digits[] = "0123456789abcdef";
+
+static int hex_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// ===== Packets =====
+static int send_packet(GdbStub *stub, const char *data) {
+    char buffer[PACKET_SIZE + 8];
+    uint8_t checksum = 0;
+    size_t len = strlen(data);
+
+    if (len > PACKET_SIZE) return -1;
+    for (size_t i = 0; i < len; i++) checksum += (uint8_t)data[i];
+
+    int n = snprintf(buffer, sizeof(buffer), "$%s#%c%c", data, hex_digits[checksum >> 4], hex_digits[checksum & 0xF]);
+    return write(stub->fd, buffer, n) == n ? 0 : -1;
+}
+
+// Read one packet into `out`, return its length, -1 when the client is gone
+// A lone 0x03 (Ctrl-C) is returned as the packet "\x03"
+static int read_packet(GdbStub *stub, char *out) {
+    char c;
+    int len;
+
+    for (;;) {
+        if (read(stub->fd, &c, 1) != 1) return -1;
+        if (c == 0x03) {
+            out[0] = 0x03;
+            out[1] = '\0';
+            return 1;
+        }
+        if (c != '$') continue; // acks '+' / '-'
+
+        len = 0;
+        uint8_t checksum = 0;
+        for (;;) {
+            if (read(stub->fd, &c, 1) != 1) return -1;
+            if (c == '#') break;
+            if (len < PACKET_SIZE) out[len++] = c;
+            checksum += (uint8_t)c;
+        }
+        char sum[2];
+        if (read(stub->fd, sum, 2) != 2) return -1;
+        out[len] = '\0';
+
+        if (hex_value(sum[0]) * 16 + hex_value(sum[1]) == checksum) {
+            if (write(stub->fd, "+", 1) != 1) return -1;
+            return len;
+        }
+        if (write(stub->fd, "-", 1) != 1) return -1;
+    }
+}
+
+// ===== Registers =====
+static uint16_t get_register(const CPU *cpu, int reg) {
+    switch (reg) {
+        case 0: return (cpu->A << 8) | cpu->F;
+        case 1: return (cpu->B << 8) | cpu->C;
+        case 2: return (cpu->D << 8) | cpu->E;
+        case 3: return (cpu->H << 8) | cpu->L;
+        case 4: return cpu->SP;
+        case 5: return cpu->PC;
+    }
+    return 0;
+}
+
+static void set_register(CPU *cpu, int reg, uint16_t value) {
+    switch (reg) {
+        case 0: cpu->A = value >> 8; cpu->F = value & 0xF0; break;
+        case 1: cpu->B = value >> 8; cpu->C = value & 0xFF; break;
+        case 2: cpu->D = value >> 8; cpu->E = value & 0xFF; break;
+        case 3: cpu->H = value >> 8; cpu->L = value & 0xFF; break;
+        case 4: cpu->SP = value; break;
+        case 5: cpu->PC = value; break;
+    }
+}
+
+static void put_hex16(char *out, uint16_t v) {
+    out[0] = hex_digits[(v >> 4) & 0xF];
+    out[1] = hex_digits[v & 0xF];
+    out[2] = hex_digits[(v >> 12) & 0xF];
+    out[3] = hex_digits[(v >> 8) & 0xF];
+}
+
+static uint16_t get_hex16(const char *in) {
+    return (uint16_t)((hex_value(in[0]) << 4) | hex_value(in[1]) | (hex_value(in[2]) << 12) | (hex_value(in[3]) << 8));
+}
+
+// ===== Stop replies =====
+static void send_stop(GdbStub *stub) {
+    char reply[64];
+    const Debugger *dbg = stub->dbg;
+
+    if (dbg->stopReason == STOP_WATCHPOINT) {
+        const char *kind = dbg->stopAccess == WATCH_WRITE ? "watch" : "rwatch";
+        snprintf(reply, sizeof(reply), "T05%s:%04x;", kind, dbg->stopAddr);
+    } else if (dbg->stopReason == STOP_INTERRUPT) {
+        snprintf(reply, sizeof(reply), "S02");
+    } else {
+        snprintf(reply, sizeof(reply), "S05");
+    }
+    send_packet(stub, reply);
+}
+
+// Run until the debugger stops or the client sends Ctrl-C
+static void run(GdbStub *stub) {
+    Debugger *dbg = stub->dbg;
+    struct pollfd pfd = { stub->fd, POLLIN, 0 };
+
+    debugger_resume(dbg);
+    while (dbg->stopReason == STOP_NONE) {
+        gb_run_frame(stub->gb);
+
+        if (poll(&pfd, 1, 0) > 0) {
+            char c;
+            if (recv(stub->fd, &c, 1, MSG_PEEK) == 1 && c == 0x03) {
+                if (read(stub->fd, &c, 1) != 1) break;
+                dbg->stopReason = STOP_INTERRUPT;
+            } else if (pfd.revents & (POLLHUP | POLLERR)) {
+                stub->running = 0;
+                return;
+            }
+        }
+    }
+    send_stop(stub);
+}
+
+// Z/z packets: "Z0,addr,kind"
+static void handle_point(GdbStub *stub, const char *packet) {
+    int insert = packet[0] == 'Z';
+    int type = packet[1] - '0';
+    unsigned addr, length;
+
+    if (sscanf(packet + 2, ",%x,%x", &addr, &length) != 2) {
+        send_packet(stub, "E01");
+        return;
+    }
+
+    int result;
+    if (type == 0 || type == 1) {
+        result = insert ? debugger_add_breakpoint(stub->dbg, (uint16_t)addr, NULL)
+                        : debugger_remove_breakpoint(stub->dbg, (uint16_t)addr);
+    } else if (type >= 2 && type <= 4) {
+        uint8_t kind = type == 2 ? WATCH_WRITE : type == 3 ? WATCH_READ : WATCH_ACCESS;
+        result = insert ? debugger_add_watchpoint(stub->dbg, (uint16_t)addr, (uint16_t)length, kind, NULL)
+                        : debugger_remove_watchpoint(stub->dbg, (uint16_t)addr, (uint16_t)length, kind);
+    } else {
+        send_packet(stub, "");
+        return;
+    }
+    send_packet(stub, result == 0 ? "OK" : "E01");
+}
+
+static void handle_packet(GdbStub *stub, char *packet) {
+    char reply[PACKET_SIZE + 1];
+    CPU *cpu = &stub->gb->cpu;
+    MMU *mmu = &stub->gb->mmu;
+    unsigned addr, length;
+
+    switch (packet[0]) {
+        case 0x03:
+            stub->dbg->stopReason = STOP_INTERRUPT;
+            send_stop(stub);
+            break;
+
+        case '?':
+            send_stop(stub);
+            break;
+
+        case 'g':
+            for (int r = 0; r < 6; r++) put_hex16(reply + r * 4, get_register(cpu, r));
+            reply[24] = '\0';
+            send_packet(stub, reply);
+            break;
+
+        case 'G':
+            if (strlen(packet + 1) < 24) {
+                send_packet(stub, "E01");
+                break;
+            }
+            for (int r = 0; r < 6; r++) set_register(cpu, r, get_hex16(packet + 1 + r * 4));
+            send_packet(stub, "OK");
+            break;
+
+        case 'p': {
+            int reg = (int)strtol(packet + 1, NULL, 16);
+            put_hex16(reply, get_register(cpu, reg));
+            reply[4] = '\0';
+            send_packet(stub, reg < 6 ? reply : "E01");
+            break;
+        }
+
+        case 'P': {
+            char *eq = strchr(packet, '=');
+            int reg = (int)strtol(packet + 1, NULL, 16);
+            if (!eq || reg >= 6 || strlen(eq + 1) < 4) {
+                send_packet(stub, "E01");
+                break;
+            }
+            set_register(cpu, reg, get_hex16(eq + 1));
+            send_packet(stub, "OK");
+            break;
+        }
+
+        case 'm':
+            if (sscanf(packet + 1, "%x,%x", &addr, &length) != 2 || length > PACKET_SIZE / 2) {
+                send_packet(stub, "E01");
+                break;
+            }
+            for (unsigned i = 0; i < length; i++) {
+                uint8_t v = mmu_peek(mmu, (uint16_t)(addr + i));
+                reply[i * 2] = hex_digits[v >> 4];
+                reply[i * 2 + 1] = hex_digits[v & 0xF];
+            }
+            reply[length * 2] = '\0';
+            send_packet(stub, reply);
+            break;
+
+        case 'M': {
+            char *data = strchr(packet, ':');
+            if (!data || sscanf(packet + 1, "%x,%x", &addr, &length) != 2 || strlen(data + 1) < length * 2) {
+                send_packet(stub, "E01");
+                break;
+            }
+            for (unsigned i = 0; i < length; i++) {
+                uint8_t v = (uint8_t)(hex_value(data[1 + i * 2]) * 16 + hex_value(data[2 + i * 2]));
+                mmu_write(mmu, (uint16_t)(addr + i), v);
+            }
+            send_packet(stub, "OK");
+            break;
+        }
+
+        case 'c':
+            if (packet[1]) cpu->PC = (uint16_t)strtol(packet + 1, NULL, 16);
+            run(stub);
+            break;
+
+        case 's':
+            if (packet[1]) cpu->PC = (uint16_t)strtol(packet + 1, NULL, 16);
+            stub->dbg->singleStep = 1;
+            run(stub);
+            break;
+
+        case 'Z':
+        case 'z':
+            handle_point(stub, packet);
+            break;
+
+        case 'k':
+            stub->running = 0;
+            break;
+
+        case 'D':
+            send_packet(stub, "OK");
+            stub->running = 0;
+            break;
+
+        case 'q':
+            if (strncmp(packet, "qSupported", 10) == 0) {
+                snprintf(reply, sizeof(reply), "PacketSize=%x", PACKET_SIZE);
+                send_packet(stub, reply);
+            } else if (strcmp(packet, "qAttached") == 0) {
+                send_packet(stub, "1");
+            } else {
+                send_packet(stub, "");
+            }
+            break;
+
+        default:
+            send_packet(stub, ""); // not supported
+            break;
+    }
+}
+
+// Listen on `socket_path`, serve one client until it detaches or kills the target
+int gdbstub_serve(GameBoy *gb, Debugger *dbg, const char *socket_path) {
+    struct sockaddr_un addr;
+    int server = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (server < 0) return -1;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", socket_path);
+    unlink(socket_path);
+
+    if (bind(server, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(server, 1) != 0) {
+        close(server);
+        return -1;
+    }
+
+    printf("🐞 GDB stub waiting on %s\n", socket_path);
+    fflush(stdout);
+
+    GdbStub stub = { accept(server, NULL, NULL), gb, dbg, 1 };
+    close(server);
+    unlink(socket_path);
+    if (stub.fd < 0) return -1;
+
+    // The target starts stopped, the tools loop is used from now on
+    gb->debugger = dbg;
+    dbg->stopReason = STOP_INTERRUPT;
+
+    char packet[PACKET_SIZE + 1];
+    while (stub.running && read_packet(&stub, packet) >= 0) {
+        handle_packet(&stub, packet);
+    }
+
+    close(stub.fd);
+    return 0;
+}
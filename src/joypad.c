@@ -0,0 +1,192 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include "../includes/joypad.h"
+
+static const char *button_names[8] = { "RIGHT", "LEFT", "UP", "DOWN", "A", "B", "SELECT", "START" };
+
+// PPU cycles since frame 0 (the PPU is caught up at every memory access)
+static uint64_t joypad_now(const Joypad *pad) {
+    return pad->gb->frames * PPU_FRAME_CYCLES + ppu_frame_position(&pad->gb->ppu);
+}
+
+// "A+RIGHT", "-" = nothing
+int joypad_parse_buttons(const char *text, uint8_t *buttons) {
+    char name[16];
+    uint8_t result = 0;
+
+    if (strcmp(text, "-") == 0) {
+        *buttons = 0;
+        return 0;
+    }
+    while (*text) {
+        size_t len = strcspn(text, "+");
+        if (len == 0 || len >= sizeof(name)) return -1;
+        memcpy(name, text, len);
+        name[len] = '\0';
+
+        int found = -1;
+        for (int i = 0; i < 8; i++) {
+            if (strcasecmp(name, button_names[i]) == 0) found = i;
+        }
+        if (found < 0) return -1;
+        result |= 1 << found;
+
+        text += len;
+        if (*text == '+') text++;
+    }
+    *buttons = result;
+    return 0;
+}
+
+// Buttons now: the callback, or the last input file line that is due. A
+// change is dated when it happened (file) or when we noticed it (callback)
+static void joypad_sample(Joypad *pad, uint64_t now) {
+    uint8_t buttons = pad->buttons;
+    uint64_t when = now;
+
+    if (pad->source) {
+        buttons = pad->source(pad->sourceCtx);
+    } else {
+        while (pad->nextEvent < pad->eventCount && pad->events[pad->nextEvent].time <= now) {
+            buttons = pad->events[pad->nextEvent].buttons;
+            when = pad->events[pad->nextEvent].time;
+            pad->nextEvent++;
+        }
+    }
+    if (buttons == pad->buttons) return;
+
+    // A change not shown yet is replaced by this one, it is not measured
+    pad->buttons = buttons;
+    pad->changes++;
+    pad->changeTime = when;
+    pad->waiting = 1;
+}
+
+// mmu->joypad_poll: FF00 read (or STOP waiting for a button)
+static uint8_t joypad_poll(void *ctx) {
+    Joypad *pad = ctx;
+    uint64_t now = joypad_now(pad);
+
+    if (pad->mode == JOYPAD_POLL_READ) {
+        joypad_sample(pad, now);
+        pad->polls++;
+    }
+    if (pad->waiting == 1) {
+        pad->waiting = 2;
+        pad->readTime = now;
+    }
+    return pad->buttons;
+}
+
+void joypad_init(Joypad *pad, GameBoy *gb, JoypadPollMode mode) {
+    memset(pad, 0, sizeof(Joypad));
+    pad->gb = gb;
+    pad->mode = mode;
+    gb->mmu.joypad_poll = joypad_poll;
+    gb->mmu.joypad_ctx = pad;
+}
+
+void joypad_set_source(Joypad *pad, JoypadSource source, void *ctx) {
+    pad->source = source;
+    pad->sourceCtx = ctx;
+}
+
+int joypad_load_file(Joypad *pad, const char *filename) {
+    FILE *f = fopen(filename, "r");
+    if (!f) return -1;
+
+    char line[256];
+    size_t capacity = 0;
+    uint64_t last = 0;
+    int res = 0;
+    while (fgets(line, sizeof(line), f)) {
+        char text[128];
+        double frame;
+        char *hash = strchr(line, '#');
+        if (hash) *hash = '\0';
+        if (strspn(line, " \t\r\n") == strlen(line)) continue;
+
+        JoypadEvent event;
+        if (sscanf(line, "%lf %127s", &frame, text) != 2 || frame < 0 ||
+            joypad_parse_buttons(text, &event.buttons) != 0) {
+            res = -1;
+            break;
+        }
+        event.time = (uint64_t)(frame * PPU_FRAME_CYCLES);
+        if (event.time < last) {
+            res = -1;
+            break;
+        }
+        last = event.time;
+
+        if (pad->eventCount == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            JoypadEvent *events = realloc(pad->events, capacity * sizeof(JoypadEvent));
+            if (!events) {
+                res = -1;
+                break;
+            }
+            pad->events = events;
+        }
+        pad->events[pad->eventCount++] = event;
+    }
+    fclose(f);
+    return res;
+}
+
+void joypad_free(Joypad *pad) {
+    if (pad->gb && pad->gb->mmu.joypad_ctx == pad) {
+        pad->gb->mmu.joypad_poll = NULL;
+        pad->gb->mmu.joypad_ctx = NULL;
+    }
+    free(pad->events);
+    pad->events = NULL;
+    pad->eventCount = 0;
+}
+
+// ===== Frame loop =====
+// Edges raise the joypad interrupt here too: HALT and STOP wake up within a frame
+void joypad_begin_frame(Joypad *pad) {
+    joypad_sample(pad, joypad_now(pad));
+    mmu_set_joypad(&pad->gb->mmu, pad->buttons);
+}
+
+// Skipped frames and frames identical to the previous one don't reach the
+// screen. A run-ahead fork (shown != gb->ppu) had the buttons from its start
+void joypad_end_frame(Joypad *pad, const PPU *ppu) {
+    if (ppu != &pad->gb->ppu && pad->waiting == 1) {
+        pad->waiting = 2;
+        pad->readTime = pad->gb->frames * PPU_FRAME_CYCLES;
+    }
+    if (ppu->frameUnchanged || ppu->frameSkipped) return;
+
+    int changed;
+    if (pad->gb->mmu.cgb) {
+        changed = memcmp(pad->shownColor, ppu->colorFramebuffer, sizeof(pad->shownColor)) != 0;
+        if (changed) memcpy(pad->shownColor, ppu->colorFramebuffer, sizeof(pad->shownColor));
+    } else {
+        changed = memcmp(pad->shown, ppu->framebuffer, sizeof(pad->shown)) != 0;
+        if (changed) memcpy(pad->shown, ppu->framebuffer, sizeof(pad->shown));
+    }
+    if (pad->waiting != 2 || !changed) return;
+
+    uint64_t latency = pad->gb->frames * PPU_FRAME_CYCLES - pad->changeTime;
+    pad->measured++;
+    pad->readDelay += pad->readTime - pad->changeTime;
+    pad->latency += latency;
+    if (latency > pad->latencyMax) pad->latencyMax = latency;
+    pad->waiting = 0;
+}
+
+void joypad_report(const Joypad *pad, FILE *out) {
+    fprintf(out, "Input (%s polling): %llu changes, %llu shown, %llu FF00 samples\n",
+            pad->mode == JOYPAD_POLL_READ ? "FF00" : "frame", (unsigned long long)pad->changes,
+            (unsigned long long)pad->measured, (unsigned long long)pad->polls);
+    if (!pad->measured) return;
+    fprintf(out, "  input-to-photon %.2f frames avg, %.2f max (read by the game after %.2f frames avg)\n",
+            (double)pad->latency / pad->measured / PPU_FRAME_CYCLES,
+            (double)pad->latencyMax / PPU_FRAME_CYCLES,
+            (double)pad->readDelay / pad->measured / PPU_FRAME_CYCLES);
+}
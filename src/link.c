@@ -0,0 +1,232 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "../includes/link.h"
+
+#define LINK_HELLO "GBLK"
+
+static void link_end_init(Link *link, int side, GameBoy *gb) {
+    LinkEnd *end = &link->ends[side];
+
+    memset(end, 0, sizeof(LinkEnd));
+    end->link = link;
+    end->gb = gb;
+    end->side = side;
+    end->connected = 1;
+    end->nextSync = link->quantum;
+    gb->mmu.serial_linked = 1;
+}
+
+// Cable gone: behave like an unplugged console (a due transfer gets 0xFF)
+static void link_disconnect(LinkEnd *end) {
+    MMU *mmu = &end->gb->mmu;
+
+    end->connected = 0;
+    mmu->serial_linked = 0;
+    if (mmu->serial_due) mmu_serial_complete(mmu, 0xFF);
+}
+
+static LinkState link_state(const LinkEnd *end, uint8_t stop) {
+    const MMU *mmu = &end->gb->mmu;
+    LinkState state = { mmu->io[0x01], mmu->io[0x02], mmu->serial_due, stop };
+    return state;
+}
+
+// Same rules on both sides, each one only updates its own console
+static void link_apply(LinkEnd *end, LinkState other) {
+    MMU *mmu = &end->gb->mmu;
+
+    if (mmu->serial_due) {
+        // We clocked the transfer (if both did, each one gets the other's byte)
+        mmu_serial_complete(mmu, other.sb);
+        end->transfers++;
+    } else if (other.due) {
+        // Clocked by the other side: SB shifts even when we weren't waiting
+        if ((mmu->io[0x02] & 0x81) == 0x80) mmu_serial_complete(mmu, other.sb);
+        else mmu->io[0x01] = other.sb;
+    }
+}
+
+// ===== Sync point =====
+static int write_all(int fd, const void *data, size_t size) {
+    const uint8_t *p = data;
+    while (size > 0) {
+        ssize_t n = send(fd, p, size, MSG_NOSIGNAL); // other process gone: error, not SIGPIPE
+        if (n <= 0) return -1;
+        p += n;
+        size -= (size_t)n;
+    }
+    return 0;
+}
+
+static int read_all(int fd, void *data, size_t size) {
+    uint8_t *p = data;
+    while (size > 0) {
+        ssize_t n = read(fd, p, size);
+        if (n <= 0) return -1;
+        p += n;
+        size -= (size_t)n;
+    }
+    return 0;
+}
+
+// Publish our state, wait for the other side's, apply the transfers
+static void link_sync(LinkEnd *end, uint8_t stop) {
+    Link *link = end->link;
+    LinkState mine = link_state(end, stop), other;
+
+    if (link->mode == LINK_THREADS) {
+        int parity = end->syncs & 1;
+        link->published[parity][end->side] = mine;
+        pthread_barrier_wait(&link->barrier);
+        other = link->published[parity][!end->side];
+    } else if (write_all(link->fd, &mine, sizeof(mine)) != 0 || read_all(link->fd, &other, sizeof(other)) != 0) {
+        link_disconnect(end);
+        return;
+    }
+    end->syncs++;
+
+    if (stop) return;
+    if (other.stop) {
+        link_disconnect(end);
+        return;
+    }
+    link_apply(end, other);
+}
+
+// Run one frame, stopping at every quantum boundary for the exchange
+uint32_t link_run_frame(LinkEnd *end) {
+    GameBoy *gb = end->gb;
+    uint64_t frames = gb->frames;
+    uint32_t total = 0;
+
+    while (gb->frames == frames) {
+        uint16_t cycles = gb_step(gb);
+        total += cycles;
+        if (!end->connected) continue;
+
+        end->cycles += cycles;
+        if (end->cycles >= end->nextSync) {
+            end->nextSync += end->link->quantum;
+            link_sync(end, 0);
+        }
+    }
+    return total;
+}
+
+// ===== Two instances in this process =====
+int link_connect(Link *link, GameBoy *a, GameBoy *b, uint32_t quantum) {
+    memset(link, 0, sizeof(Link));
+    link->mode = LINK_THREADS;
+    link->quantum = quantum ? quantum : LINK_QUANTUM_DEFAULT;
+    link->fd = -1;
+    if (pthread_barrier_init(&link->barrier, NULL, 2) != 0) return -1;
+
+    link_end_init(link, 0, a);
+    link_end_init(link, 1, b);
+    return 0;
+}
+
+static void *link_thread(void *arg) {
+    LinkEnd *end = arg;
+
+    while (end->connected) link_run_frame(end);
+    return NULL;
+}
+
+// ends[1] runs on its own thread until link_close, ends[0] is run by the caller
+int link_start_thread(Link *link) {
+    if (link->mode != LINK_THREADS) return -1;
+    if (pthread_create(&link->thread, NULL, link_thread, &link->ends[1]) != 0) return -1;
+    link->threadRunning = 1;
+    return 0;
+}
+
+// ===== Unix socket =====
+static int link_socket_address(struct sockaddr_un *addr, const char *path) {
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr->sun_path)) return -1;
+    strcpy(addr->sun_path, path);
+    return 0;
+}
+
+static void link_socket_init(Link *link, GameBoy *gb, int fd, uint32_t quantum) {
+    memset(link, 0, sizeof(Link));
+    link->mode = LINK_SOCKET;
+    link->quantum = quantum;
+    link->fd = fd;
+    link_end_init(link, 0, gb);
+}
+
+// Wait for the other process on `path`; the quantum is sent to it
+int link_host(Link *link, GameBoy *gb, const char *path, uint32_t quantum) {
+    struct sockaddr_un addr;
+    if (link_socket_address(&addr, path) != 0) return -1;
+    if (!quantum) quantum = LINK_QUANTUM_DEFAULT;
+
+    int server = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (server < 0) return -1;
+    unlink(path);
+    if (bind(server, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(server, 1) != 0) {
+        close(server);
+        return -1;
+    }
+    int fd = accept(server, NULL, NULL);
+    close(server);
+    unlink(path);
+    if (fd < 0) return -1;
+
+    uint8_t hello[8];
+    memcpy(hello, LINK_HELLO, 4);
+    memcpy(hello + 4, &quantum, 4);
+    if (write_all(fd, hello, sizeof(hello)) != 0) {
+        close(fd);
+        return -1;
+    }
+    link_socket_init(link, gb, fd, quantum);
+    return 0;
+}
+
+int link_join(Link *link, GameBoy *gb, const char *path) {
+    struct sockaddr_un addr;
+    if (link_socket_address(&addr, path) != 0) return -1;
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    uint8_t hello[8];
+    uint32_t quantum;
+    if (read_all(fd, hello, sizeof(hello)) != 0 || memcmp(hello, LINK_HELLO, 4) != 0) {
+        close(fd);
+        return -1;
+    }
+    memcpy(&quantum, hello + 4, 4);
+    link_socket_init(link, gb, fd, quantum);
+    return 0;
+}
+
+// Tell the other side we leave (at our next sync point), then release everything
+void link_close(Link *link) {
+    LinkEnd *end = &link->ends[0];
+
+    // (no thread on the other end: nobody to meet at the barrier)
+    if (end->connected && (link->mode == LINK_SOCKET || link->threadRunning)) link_sync(end, 1);
+    if (end->connected) link_disconnect(end);
+
+    if (link->mode == LINK_THREADS) {
+        if (link->threadRunning) pthread_join(link->thread, NULL);
+        link->threadRunning = 0;
+        pthread_barrier_destroy(&link->barrier);
+        link->ends[1].gb->mmu.serial_linked = 0;
+    } else if (link->fd >= 0) {
+        close(link->fd);
+        link->fd = -1;
+    }
+}
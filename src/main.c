@@ -1,23 +1,150 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include "../includes/cpu.h"
-#include "../includes/mmu.h"
-#include "../includes/ppu.h"
+#include <signal.h>
+#include "../includes/gb.h"
 #include "../includes/main.h"
 #include "../includes/bios.h"
+#include "../includes/stats.h"
+#include "../includes/profiler.h"
+#include "../includes/debugger.h"
+#include "../includes/gdbstub.h"
+#include "../includes/video.h"
+#include "../includes/record.h"
+#include "../includes/romindex.h"
+#include "../includes/link.h"
+#include "../includes/trace.h"
+#include "../includes/coverage.h"
+#include "../includes/joypad.h"
+#include "../includes/runahead.h"
 
 int DEBUG_MODE = 0;
 
+static volatile sig_atomic_t running = 1;
+static const char *stats_filename = NULL; // NULL = --stats not asked
+static const char *profile_filename = NULL; // NULL = --profile not asked
+static Profiler *profiler = NULL;
+static Debugger debugger;
+static const char *coverage_filename = NULL; // NULL = --coverage not asked
+static const char *coverage_report_filename = NULL;
+static Coverage coverage;
+
+static void on_signal(int sig) {
+    (void)sig;
+    running = 0;
+}
+
+// Called at exit (even after an unknown opcode) to dump the profile
+static void dump_profile(void) {
+    if (!profiler) return;
+
+    profiler_report(profiler, stderr, 20);
+    if (profiler_write_collapsed(profiler, profile_filename) != 0) {
+        printf("Erreur: impossible d'écrire le profil dans '%s'\n", profile_filename);
+    } else {
+        fprintf(stderr, "Collapsed stacks written to %s\n", profile_filename);
+    }
+}
+
+// Called at exit (even after an unknown opcode) to dump the counters
+static void dump_stats(void) {
+    if (!stats_filename) return;
+
+    stats_report(stderr);
+    if (stats_enabled()) {
+        if (stats_write_json(stats_filename) != 0) {
+            printf("Erreur: impossible d'écrire les stats dans '%s'\n", stats_filename);
+        } else {
+            fprintf(stderr, "Stats written to %s\n", stats_filename);
+        }
+    }
+}
+
+// Called at exit (even after an unknown opcode): our bits go into the shared
+// file, the report covers everything merged there so far
+static void dump_coverage(void) {
+    if (!coverage_filename) return;
+
+    if (coverage_merge_file(&coverage, coverage_filename) != 0) {
+        printf("Erreur: impossible de fusionner la couverture dans '%s'\n", coverage_filename);
+        return;
+    }
+    fprintf(stderr, "Coverage merged into %s\n", coverage_filename);
+    if (coverage_report_filename) {
+        FILE *out = fopen(coverage_report_filename, "w");
+        if (!out) {
+            printf("Erreur: impossible d'écrire le rapport de couverture '%s'\n", coverage_report_filename);
+            return;
+        }
+        coverage_report(&coverage, out);
+        fclose(out);
+    }
+}
+
+// Second console on the link cable (--link-rom): fast boot, nothing displayed
+static int load_link_partner(GameBoy *partner, const char *filename) {
+    FILE *f = fopen(filename, "rb");
+    if (!f) return -1;
+    fseek(f, 0, SEEK_END);
+    size_t size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    uint8_t *data = malloc(size);
+    if (!data || fread(data, 1, size, f) != size) {
+        free(data);
+        fclose(f);
+        return -1;
+    }
+    fclose(f);
+
+    gb_init(partner);
+    int res = gb_load_rom(partner, data, size);
+    free(data);
+    if (res != 0) return -1;
+    gb_boot(partner);
+    ppu_set_frameskip(&partner->ppu, 255); // same timing, (almost) no pixels
+    return 0;
+}
+
 int main(int argc, char *argv[]) {
     if (argc < 2) {
-        printf("Usage: %s <rom_file> [--debug N]\n", argv[0]);
+        printf("Usage: %s <rom_file> [--debug N] [--frames N] [--stats [file.json]]\n", argv[0]);
+        printf("       [--profile file.folded] [--profile-interval N] [--sym file.sym]\n");
+        printf("       [--break \"ADDR [if COND]\"] [--watch \"ADDR[:LEN] [r|w|rw] [if COND]\"] [--gdb socket]\n");
+        printf("       [--scale N] [--filter nearest|scale2x|scale3x|xbr] [--ghosting PERCENT] [--screenshot file.ppm]\n");
+        printf("       [--record file.y4m|file.gbraw] [--frameskip N] [--bios] [--index file.idx] [--accuracy fast|cycle]\n");
+        printf("       [--link-rom file.gb | --link-host socket | --link-join socket] [--link-quantum N]\n");
+        printf("       [--trace file.gbtrace] [--coverage file.gbcov [--coverage-report file.txt]]\n");
+        printf("       [--input file.txt] [--input-poll read|frame] [--runahead N] [--ppu-thread]\n");
         return 1;
     }
 
     const char *rom_filename = argv[1];
+    const char *sym_filename = NULL;
+    long max_frames = -1; // -1 = run forever
+    uint32_t profile_interval = 1024;
+    const char *breaks[DEBUGGER_MAX_BREAKPOINTS];
+    const char *watches[DEBUGGER_MAX_WATCHPOINTS];
+    int break_count = 0, watch_count = 0;
+    const char *gdb_socket = NULL;
+    int scale = 0; // 0 = no output stage
+    VideoFilter filter = VIDEO_FILTER_NEAREST;
+    const char *screenshot_filename = NULL;
+    int ghosting = 0; // percent of the previous picture kept
+    const char *record_filename = NULL;
+    const char *trace_filename = NULL;
+    const char *input_filename = NULL;
+    JoypadPollMode input_poll = JOYPAD_POLL_READ;
+    int runahead_frames = 0;
+    int ppu_thread = 0; // 1 = scanlines drawn on a thread of their own
+    int frameskip = 0;
+    int run_bios = 0; // 0 = fast boot (post-boot state applied directly)
+    GBAccuracy accuracy = GB_ACCURACY_FAST;
+    const char *index_filename = NULL;
+    const char *link_rom = NULL, *link_host_path = NULL, *link_join_path = NULL;
+    uint32_t link_quantum = LINK_QUANTUM_DEFAULT;
 
-    // Parse debug option
+    // Parse options
     for (int i = 2; i < argc; i++) {
         if (strcmp(argv[i], "--debug") == 0) {
             if (i + 1 < argc) {
@@ -26,21 +153,106 @@ int main(int argc, char *argv[]) {
             } else {
                 DEBUG_MODE = 3;
             }
+        } else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            max_frames = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            if (i + 1 < argc && strncmp(argv[i + 1], "--", 2) != 0) {
+                stats_filename = argv[++i];
+            } else {
+                stats_filename = "stats.json";
+            }
+        } else if (strcmp(argv[i], "--profile") == 0 && i + 1 < argc) {
+            profile_filename = argv[++i];
+        } else if (strcmp(argv[i], "--profile-interval") == 0 && i + 1 < argc) {
+            profile_interval = (uint32_t)atol(argv[++i]);
+        } else if (strcmp(argv[i], "--sym") == 0 && i + 1 < argc) {
+            sym_filename = argv[++i];
+        } else if (strcmp(argv[i], "--break") == 0 && i + 1 < argc && break_count < DEBUGGER_MAX_BREAKPOINTS) {
+            breaks[break_count++] = argv[++i];
+        } else if (strcmp(argv[i], "--watch") == 0 && i + 1 < argc && watch_count < DEBUGGER_MAX_WATCHPOINTS) {
+            watches[watch_count++] = argv[++i];
+        } else if (strcmp(argv[i], "--gdb") == 0 && i + 1 < argc) {
+            gdb_socket = argv[++i];
+        } else if (strcmp(argv[i], "--scale") == 0 && i + 1 < argc) {
+            scale = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            if (video_parse_filter(argv[++i], &filter) != 0) {
+                printf("Erreur: filtre inconnu '%s'\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--ghosting") == 0 && i + 1 < argc) {
+            ghosting = atoi(argv[++i]);
+            if (ghosting < 0 || ghosting > VIDEO_MAX_GHOSTING) {
+                printf("Erreur: ghosting %d%% invalide (0..%d)\n", ghosting, VIDEO_MAX_GHOSTING);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--screenshot") == 0 && i + 1 < argc) {
+            screenshot_filename = argv[++i];
+        } else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            record_filename = argv[++i];
+        } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            trace_filename = argv[++i];
+        } else if (strcmp(argv[i], "--coverage") == 0 && i + 1 < argc) {
+            coverage_filename = argv[++i];
+        } else if (strcmp(argv[i], "--coverage-report") == 0 && i + 1 < argc) {
+            coverage_report_filename = argv[++i];
+        } else if (strcmp(argv[i], "--input") == 0 && i + 1 < argc) {
+            input_filename = argv[++i];
+        } else if (strcmp(argv[i], "--input-poll") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "read") == 0) input_poll = JOYPAD_POLL_READ;
+            else if (strcmp(argv[i], "frame") == 0) input_poll = JOYPAD_POLL_FRAME;
+            else {
+                printf("Erreur: mode de lecture du joypad inconnu '%s' (read|frame)\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--runahead") == 0 && i + 1 < argc) {
+            runahead_frames = atoi(argv[++i]);
+            if (runahead_frames < 0 || runahead_frames > RUNAHEAD_MAX_FRAMES) {
+                printf("Erreur: run-ahead %d invalide (0..%d)\n", runahead_frames, RUNAHEAD_MAX_FRAMES);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--ppu-thread") == 0) {
+            ppu_thread = 1;
+        } else if (strcmp(argv[i], "--link-rom") == 0 && i + 1 < argc) {
+            link_rom = argv[++i];
+        } else if (strcmp(argv[i], "--link-host") == 0 && i + 1 < argc) {
+            link_host_path = argv[++i];
+        } else if (strcmp(argv[i], "--link-join") == 0 && i + 1 < argc) {
+            link_join_path = argv[++i];
+        } else if (strcmp(argv[i], "--link-quantum") == 0 && i + 1 < argc) {
+            link_quantum = (uint32_t)strtoul(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "--index") == 0 && i + 1 < argc) {
+            index_filename = argv[++i];
+        } else if (strcmp(argv[i], "--bios") == 0) {
+            run_bios = 1;
+        } else if (strcmp(argv[i], "--accuracy") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "fast") == 0) accuracy = GB_ACCURACY_FAST;
+            else if (strcmp(argv[i], "cycle") == 0) accuracy = GB_ACCURACY_CYCLE;
+            else {
+                printf("Erreur: précision inconnue '%s' (fast|cycle)\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--frameskip") == 0 && i + 1 < argc) {
+            frameskip = atoi(argv[++i]);
+            if (frameskip < 0 || frameskip > 255) {
+                printf("Erreur: frameskip %d invalide (0..255)\n", frameskip);
+                return 1;
+            }
         }
     }
 
-    CPU cpu;
-    MMU mmu;
-    PPU ppu;
+    static GameBoy gb;
+    MMU *mmu = &gb.mmu;
 
     // Init CPU, MMU & PPU
-    cpu_init(&cpu);
-    mmu_init(&mmu);
-    ppu_init(&ppu);
+    gb_init_accuracy(&gb, accuracy);
+    ppu_set_frameskip(&gb.ppu, (uint8_t)frameskip);
 
     // Load BIOS from array
-    if (mmu.bios_active == 1) {
-        if (mmu_load_bios(&mmu, biosArray, bios_size) != 0) {
+    if (run_bios) {
+        if (mmu_load_bios(mmu, biosArray, bios_size) != 0) {
             printf("Erreur: impossible de charger le BIOS depuis l'array\n");
             return 1;
         } else if (DEBUG_MODE >= 1) {
@@ -69,7 +281,7 @@ int main(int argc, char *argv[]) {
     fread(rom_data, 1, rom_size, f);
     fclose(f);
 
-    if (mmu_load_rom(&mmu, rom_data, rom_size) != 0) {
+    if (gb_load_rom(&gb, rom_data, rom_size) != 0) {
         printf("Erreur: impossible de charger la ROM\n");
         free(rom_data);
         return 1;
@@ -80,10 +292,269 @@ int main(int argc, char *argv[]) {
         printf("ROM '%s' chargée (%zu bytes)\n", rom_filename, rom_size);
     }
 
-    // Main CPU loop
-    while (1) {
-        uint16_t cycles = cpu_step(&cpu, &mmu);
+    // ROM library index (gb-romindex): mapper from the indexed header
+    if (index_filename) {
+        RomIndex index;
+        if (romindex_open(&index, index_filename) != 0) {
+            printf("Erreur: index de ROMs '%s' illisible\n", index_filename);
+            return 1;
+        }
+        const RomIndexEntry *entry = romindex_find_path(&index, rom_filename);
+        if (entry && romindex_entry_fresh(entry, rom_filename)) {
+            mmu_select_mbc(mmu, entry->header.cartType);
+            if (DEBUG_MODE >= 1) {
+                printf("Cartouche indexée: %s (%s, CRC32 %08X)\n", entry->header.title,
+                       cartridge_mbc_name(entry->header.mbcType), entry->header.crc32);
+            }
+        } else if (DEBUG_MODE >= 1) {
+            printf("ROM absente de l'index ou modifiée depuis, en-tête lu dans la ROM\n");
+        }
+        romindex_close(&index);
+    }
+
+    // Boot: run the boot ROM from 0x0000, or start at 0x0100 in the state it leaves
+    if (run_bios) gb.cpu.PC = 0x0000;
+    else if (gb_boot(&gb) != 0 && DEBUG_MODE >= 1) printf("État post-boot indisponible, démarrage par le BIOS\n");
+
+    if (profile_filename) {
+        profiler = profiler_create(profile_interval);
+        if (!profiler) {
+            printf("Erreur: impossible de créer le profiler\n");
+            return 1;
+        }
+
+        // Default symbols: same name as the ROM with .sym
+        char default_sym[1024];
+        if (!sym_filename) {
+            const char *dot = strrchr(rom_filename, '.');
+            int base = dot ? (int)(dot - rom_filename) : (int)strlen(rom_filename);
+            snprintf(default_sym, sizeof(default_sym), "%.*s.sym", base, rom_filename);
+            if (profiler_load_symbols(profiler, default_sym) == 0 && DEBUG_MODE >= 1) {
+                printf("Symboles chargés depuis '%s'\n", default_sym);
+            }
+        } else if (profiler_load_symbols(profiler, sym_filename) != 0) {
+            printf("Erreur: impossible de lire les symboles '%s'\n", sym_filename);
+            return 1;
+        }
+
+        gb.cpu.profiler = profiler;
+        atexit(dump_profile);
+    }
+
+    // Debugger: only attached when something is set, the normal loop is used otherwise
+    debugger_init(&debugger, &gb.cpu, mmu);
+    for (int i = 0; i < break_count; i++) {
+        if (debugger_add_breakpoint_spec(&debugger, breaks[i]) != 0) {
+            printf("Erreur: breakpoint invalide '%s'\n", breaks[i]);
+            return 1;
+        }
+    }
+    for (int i = 0; i < watch_count; i++) {
+        if (debugger_add_watchpoint_spec(&debugger, watches[i]) != 0) {
+            printf("Erreur: watchpoint invalide '%s'\n", watches[i]);
+            return 1;
+        }
+    }
+    if (debugger_active(&debugger)) gb.debugger = &debugger;
+
+    atexit(dump_stats);
+
+    // ROM coverage: every fetch and ROM read sets its bit
+    if (coverage_report_filename && !coverage_filename) {
+        printf("Erreur: --coverage-report demande --coverage\n");
+        return 1;
+    }
+    if (coverage_filename) {
+        if (!coverage_enabled()) {
+            printf("Erreur: couverture non compilée, recompilez avec `make rebuild COVERAGE=1`\n");
+            return 1;
+        }
+        if (coverage_init(&coverage, mmu->rom, mmu->rom_size) != 0) {
+            printf("Erreur: impossible d'allouer la couverture\n");
+            return 1;
+        }
+        mmu->coverage = &coverage;
+        atexit(dump_coverage);
+    }
+    signal(SIGINT, on_signal);
+
+    if (gdb_socket) {
+        if (gdbstub_serve(&gb, &debugger, gdb_socket) != 0) {
+            printf("Erreur: impossible d'ouvrir le socket GDB '%s'\n", gdb_socket);
+            return 1;
+        }
+        gb_free(&gb);
+        return 0;
+    }
+
+    // Output stage: converted/upscaled on a worker thread while the next frame runs
+    static Video video;
+    int video_enabled = scale > 0 || screenshot_filename;
+    if (video_enabled) {
+        if (scale == 0) scale = video_filter_factor(filter);
+        if (video_init(&video, scale, filter) != 0) {
+            printf("Erreur: échelle %d invalide pour le filtre %s\n", scale, video_filter_name(filter));
+            return 1;
+        }
+        if (video_set_ghosting(&video, ghosting) != 0) {
+            printf("Erreur: impossible d'allouer le tampon de ghosting\n");
+            return 1;
+        }
+        if (video_start_worker(&video) != 0) {
+            printf("Erreur: impossible de démarrer le thread vidéo\n");
+            return 1;
+        }
+        if (DEBUG_MODE >= 1) {
+            printf("Sortie %dx%d, filtre %s (%s)\n", video.width, video.height,
+                   video_filter_name(filter), video_simd_name());
+        }
+    }
+
+    // Capture: frames are queued to a writer thread
+    static Recorder recorder;
+    if (record_filename && record_open(&recorder, record_filename) != 0) {
+        printf("Erreur: impossible d'enregistrer dans '%s'\n", record_filename);
+        return 1;
+    }
+
+    // Execution trace (read back with gb-tracedump): runs in the tools frame loop,
+    // the link cable steps the console on its own
+    static Tracer tracer;
+    if (trace_filename) {
+        if (link_rom || link_host_path || link_join_path) {
+            printf("Erreur: --trace ne fonctionne pas avec le câble link\n");
+            return 1;
+        }
+        if (trace_open(&tracer, trace_filename, &gb.cpu, mmu) != 0) {
+            printf("Erreur: impossible d'écrire la trace '%s'\n", trace_filename);
+            return 1;
+        }
+        gb.tracer = &tracer;
+    }
+
+    // Joypad: the buttons of the input file are sampled when the game reads FF00
+    static Joypad joypad;
+    if (input_filename) {
+        joypad_init(&joypad, &gb, input_poll);
+        if (joypad_load_file(&joypad, input_filename) != 0) {
+            printf("Erreur: fichier d'entrées '%s' illisible ou invalide\n", input_filename);
+            return 1;
+        }
+    }
+
+    // Run-ahead: the frame shown comes from a fork run N frames further
+    static RunAhead runahead;
+    if (runahead_frames) {
+        if (link_rom || link_host_path || link_join_path) {
+            printf("Erreur: --runahead ne fonctionne pas avec le câble link\n");
+            return 1;
+        }
+        runahead_init(&runahead, &gb, (uint8_t)runahead_frames);
+    }
+
+    // Render thread: a line is drawn there while the CPU runs the next ones
+    if (ppu_thread && ppu_start_worker(&gb.ppu, mmu) != 0) {
+        printf("Erreur: impossible de démarrer le thread de rendu\n");
+        return 1;
+    }
+
+    // Link cable: the other console is run by a thread of ours or by another process
+    static Link link;
+    static GameBoy partner;
+    int linked = 0;
+    if (link_rom) {
+        if (load_link_partner(&partner, link_rom) != 0) {
+            printf("Erreur: impossible de charger la ROM du partenaire '%s'\n", link_rom);
+            return 1;
+        }
+        if (link_connect(&link, &gb, &partner, link_quantum) != 0 || link_start_thread(&link) != 0) {
+            printf("Erreur: impossible de démarrer le câble link\n");
+            return 1;
+        }
+        linked = 1;
+    } else if (link_host_path || link_join_path) {
+        if (DEBUG_MODE >= 1) printf("Câble link: en attente sur '%s'...\n", link_host_path ? link_host_path : link_join_path);
+        int res = link_host_path ? link_host(&link, &gb, link_host_path, link_quantum)
+                                 : link_join(&link, &gb, link_join_path);
+        if (res != 0) {
+            printf("Erreur: connexion link impossible sur '%s'\n", link_host_path ? link_host_path : link_join_path);
+            return 1;
+        }
+        linked = 1;
+    }
+
+    // Main loop, one frame at a time
+    while (running && (max_frames < 0 || (long)gb.frames < max_frames)) {
+        uint64_t frames = gb.frames;
+        if (input_filename) joypad_begin_frame(&joypad);
+        const PPU *shown = &gb.ppu;
+        if (linked) link_run_frame(&link.ends[0]);
+        else if (runahead_frames) shown = runahead_run_frame(&runahead);
+        else gb_run_frame(&gb);
+        if (gb.frames != frames) {
+            // Unchanged frame: the output stage already has these pixels (unless
+            // the ghosting is still fading towards them)
+            if (video_enabled && (!shown->frameUnchanged || ghosting)) video_submit(&video, shown, mmu->cgb);
+            if (record_filename) record_frame(&recorder, shown, mmu->cgb);
+            if (input_filename) joypad_end_frame(&joypad, shown);
+        }
+
+        // Without GDB a stop only prints the state, then we keep going
+        if (gb.debugger && debugger.stopReason != STOP_NONE) {
+            debugger_print_state(&debugger, stdout);
+            debugger_resume(&debugger);
+        }
+    }
+
+    if (linked) {
+        link_close(&link);
+        if (DEBUG_MODE >= 1) {
+            printf("Câble link: %llu octets échangés en maître\n", (unsigned long long)link.ends[0].transfers);
+        }
+        if (link_rom) gb_free(&partner);
+    }
+
+    if (record_filename) {
+        if (record_close(&recorder) != 0) {
+            printf("Erreur: l'enregistrement '%s' est incomplet\n", record_filename);
+        }
+        fprintf(stderr, "Recorded %llu frames to %s (%llu duplicates, %llu dropped)\n",
+                (unsigned long long)recorder.frames, record_filename,
+                (unsigned long long)recorder.duplicates, (unsigned long long)recorder.dropped);
+    }
+
+    if (runahead_frames) {
+        runahead_report(&runahead, stderr);
+        runahead_free(&runahead);
+    }
+
+    if (input_filename) {
+        joypad_report(&joypad, stderr);
+        joypad_free(&joypad);
+    }
+
+    if (trace_filename) {
+        gb.tracer = NULL;
+        if (trace_close(&tracer) != 0) {
+            printf("Erreur: la trace '%s' est incomplète\n", trace_filename);
+        }
+        fprintf(stderr, "Traced %llu instructions to %s (%llu -> %llu bytes, %llu stalls)\n",
+                (unsigned long long)tracer.records, trace_filename, (unsigned long long)tracer.rawBytes,
+                (unsigned long long)tracer.fileBytes, (unsigned long long)tracer.stalls);
+    }
+
+    if (video_enabled) {
+        video_wait(&video);
+        if (screenshot_filename) {
+            if (video_write_ppm(&video, screenshot_filename) != 0) {
+                printf("Erreur: impossible d'écrire la capture '%s'\n", screenshot_filename);
+            } else if (DEBUG_MODE >= 1) {
+                printf("Capture écrite dans '%s'\n", screenshot_filename);
+            }
+        }
+        video_free(&video);
     }
 
+    gb_free(&gb);
     return 0;
 }
@@ -1,18 +1,78 @@
 #include "../includes/mmu.h"
+#include "../includes/stats.h"
+#include "../includes/coverage.h"
+#include "../includes/cartridge.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-static uint8_t detect_mbc_type(const uint8_t *rom, size_t size) {
-    if (!rom || size < 0x0148) return 0;
-    uint8_t type = rom[0x0147];
-    if (type == 0x00) return 0;
-    if (type == 0x01 || type == 0x02 || type == 0x03) return 1; // MBC1-like
-    return 0;
+// Mapper from the cartridge type (0x0147): only the MBC1-like banking is emulated
+void mmu_select_mbc(MMU *mmu, uint8_t cart_type) {
+    mmu->mbc_type = cartridge_mbc_type(cart_type) == MBC1 ? 1 : 0;
+}
+
+// ===== RAM pages =====
+// Our own memory behind a slot (NULL for cartridge RAM that isn't allocated)
+static uint8_t *mmu_own_memory(MMU *mmu, int slot) {
+    if (slot < MMU_SLOT_WRAM) return mmu->vram + (slot - MMU_SLOT_VRAM) * MMU_PAGE_SIZE;
+    if (slot < MMU_SLOT_ERAM) return mmu->wram + (slot - MMU_SLOT_WRAM) * MMU_PAGE_SIZE;
+    return mmu->eram ? mmu->eram + (size_t)(slot - MMU_SLOT_ERAM) * MMU_PAGE_SIZE : NULL;
+}
+
+// Slots in use: VRAM, WRAM and the allocated cartridge RAM
+static int mmu_ram_slots(const MMU *mmu) {
+    size_t eram_pages = mmu->eram ? mmu->eram_size / MMU_PAGE_SIZE : 0;
+    if (eram_pages > MMU_RAM_PAGES - MMU_SLOT_ERAM) eram_pages = MMU_RAM_PAGES - MMU_SLOT_ERAM;
+    return MMU_SLOT_ERAM + (int)eram_pages;
+}
+
+static void mmu_page_release(MmuPage *page) {
+    if (__atomic_sub_fetch(&page->refs, 1, __ATOMIC_ACQ_REL) == 0) free(page);
+}
+
+// Copy a shared page back to our own memory and drop our reference
+static void mmu_take_page(MMU *mmu, int slot) {
+    MmuPage *page = mmu->ram_shared[slot];
+    uint8_t *own = mmu_own_memory(mmu, slot);
+
+    memcpy(own, page->data, MMU_PAGE_SIZE);
+    mmu->ram_page[slot] = own;
+    mmu->ram_shared[slot] = NULL;
+    mmu_page_release(page);
+}
+
+// Drop the shared pages without copying them, every slot back to our own memory
+static void mmu_release_pages(MMU *mmu) {
+    for (int slot = 0; slot < MMU_RAM_PAGES; slot++) {
+        if (mmu->ram_shared[slot]) mmu_page_release(mmu->ram_shared[slot]);
+        mmu->ram_shared[slot] = NULL;
+        mmu->ram_page[slot] = mmu_own_memory(mmu, slot);
+    }
+}
+
+// Byte at offset in the area starting at slot
+static inline uint8_t *mmu_ram(const MMU *mmu, int slot, size_t offset) {
+    return mmu->ram_page[slot + (offset >> MMU_PAGE_SHIFT)] + (offset & (MMU_PAGE_SIZE - 1));
+}
+
+// Same for a write: a shared page is taken back first
+static inline uint8_t *mmu_ram_writable(MMU *mmu, int slot, size_t offset) {
+    slot += (int)(offset >> MMU_PAGE_SHIFT);
+    if (mmu->ram_shared[slot]) {
+        mmu_take_page(mmu, slot);
+        mmu_update_map(mmu);
+    }
+    return mmu->ram_page[slot] + (offset & (MMU_PAGE_SIZE - 1));
+}
+
+// write_map entry of a slot: shared pages stay on the slow path
+static inline uint8_t *mmu_ram_write_page(const MMU *mmu, int slot) {
+    return mmu->ram_shared[slot] ? NULL : mmu->ram_page[slot];
 }
 
 void mmu_init(MMU *mmu) {
     memset(mmu, 0, sizeof(MMU));
+    mmu_release_pages(mmu);
     mmu->rom = NULL;
     mmu->eram = NULL;
     mmu->rom_size = 0;
@@ -20,6 +80,9 @@ void mmu_init(MMU *mmu) {
     mmu->rom_bank_low = 1;
     mmu->ram_enabled = 0;
     mmu->mbc_type = 0;
+    mmu->cgb = 0;
+    mmu->vram_bank = 0;
+    mmu->wram_bank = 1;
     mmu->interrupt_enable = 0;
     mmu->bios_active = 0;
     mmu->io[0x05] = 0x00;
@@ -49,6 +112,90 @@ void mmu_init(MMU *mmu) {
     mmu->io[0x49] = 0xFF;
     mmu->io[0x4A] = 0x00;
     mmu->io[0x4B] = 0x00;
+
+    mmu_update_map(mmu);
+}
+
+// Point every page to its backing memory, or NULL when the slow path has to decide
+void mmu_update_map(MMU *mmu) {
+    for (int page = 0; page < MMU_PAGES; page++) {
+        mmu->read_map[page] = NULL;
+        mmu->write_map[page] = NULL;
+    }
+
+    if (mmu->flat) {
+        for (int page = 0; page < MMU_PAGES; page++) {
+            uint8_t *memory = mmu->flat + page * MMU_PAGE_SIZE;
+            mmu->read_map[page] = (mmu->trap_read & (1 << page)) ? NULL : memory;
+            mmu->write_map[page] = (mmu->trap_write & (1 << page)) ? NULL : memory;
+        }
+        return;
+    }
+
+    // ROM bank 0 (the first page is shadowed by the BIOS while it runs)
+    for (int page = 0x0; page <= 0x3; page++) {
+        if ((size_t)(page + 1) * MMU_PAGE_SIZE > mmu->rom_size) break;
+        if (page == 0 && mmu->bios_active) continue;
+        mmu->read_map[page] = mmu->rom + page * MMU_PAGE_SIZE;
+    }
+
+    // ROM bankée (writes are MBC registers: slow path)
+    size_t bank = (size_t)mmu->rom_bank_low * 0x4000;
+    if (mmu->rom && bank + 0x4000 <= mmu->rom_size) {
+        for (int page = 0; page < 4; page++) {
+            mmu->read_map[0x4 + page] = mmu->rom + bank + page * MMU_PAGE_SIZE;
+        }
+    }
+
+    // RAM pages: VRAM (current VBK bank), external RAM, WRAM + Echo RAM
+    // (0xF000 page is shared with OAM/IO/HRAM: slow path)
+    int slots[MMU_PAGES];
+    for (int page = 0; page < MMU_PAGES; page++) slots[page] = -1;
+    slots[0x8] = MMU_SLOT_VRAM + mmu->vram_bank * 2;
+    slots[0x9] = slots[0x8] + 1;
+    if (mmu->ram_enabled && mmu->eram && mmu->eram_size >= 0x2000) {
+        slots[0xA] = MMU_SLOT_ERAM;
+        slots[0xB] = MMU_SLOT_ERAM + 1;
+    }
+    slots[0xC] = MMU_SLOT_WRAM;
+    slots[0xD] = MMU_SLOT_WRAM + mmu->wram_bank;
+    slots[0xE] = MMU_SLOT_WRAM;
+
+    for (int page = 0x8; page <= 0xE; page++) {
+        if (slots[page] < 0) continue;
+        mmu->read_map[page] = mmu->ram_page[slots[page]];
+        mmu->write_map[page] = mmu_ram_write_page(mmu, slots[page]);
+    }
+
+    for (int page = 0; page < MMU_PAGES; page++) {
+        if (mmu->trap_read & (1 << page)) mmu->read_map[page] = NULL;
+        if (mmu->trap_write & (1 << page)) mmu->write_map[page] = NULL;
+    }
+    if (mmu->vram_watch || mmu->vram_log) mmu->write_map[0x8] = mmu->write_map[0x9] = NULL;
+}
+
+// Arm the VRAM write watch (no-op when already armed)
+void mmu_watch_vram(MMU *mmu) {
+    if (mmu->vram_watch || mmu->flat) return;
+    mmu->vram_watch = 1;
+    mmu->write_map[0x8] = mmu->write_map[0x9] = NULL;
+}
+
+// Start (clean log) or stop logging the VRAM writes in vram_dirty
+void mmu_log_vram(MMU *mmu, int on) {
+    mmu->vram_log = on ? 1 : 0;
+    memset(mmu->vram_dirty, 0, sizeof(mmu->vram_dirty));
+    mmu_update_map(mmu);
+}
+
+static inline void mmu_vram_written(MMU *mmu, uint16_t offset) {
+    mmu->vram_dirty[offset / MMU_VRAM_BLOCK / 64] |= 1ull << (offset / MMU_VRAM_BLOCK % 64);
+}
+
+// memory must hold 0x10000 bytes, NULL restores the normal map
+void mmu_map_flat(MMU *mmu, uint8_t *memory) {
+    mmu->flat = memory;
+    mmu_update_map(mmu);
 }
 
 int mmu_load_bios_file(MMU *mmu, const char *filename) {
@@ -62,6 +209,7 @@ int mmu_load_bios_file(MMU *mmu, const char *filename) {
 
     if (n != 0x100) return -1; // incorrect size
     mmu->bios_active = 1;
+    mmu_update_map(mmu);
     return 0;
 }
 
@@ -69,40 +217,166 @@ int mmu_load_bios(MMU *mmu, const uint8_t *bios_data, size_t size) {
     if (size > sizeof(mmu->bios)) return -1;
     memcpy(mmu->bios, bios_data, size);
     mmu->bios_active = 1;
+    mmu_update_map(mmu);
     return 0;
 }
 
 
-int mmu_load_rom(MMU *mmu, const uint8_t *data, size_t size) {
-    if (!mmu || !data || size == 0) return -1;
-    mmu->rom = malloc(size);
-    if (!mmu->rom) return -1;
-    memcpy(mmu->rom, data, size);
-    mmu->rom_size = size;
-
-    mmu->mbc_type = detect_mbc_type(mmu->rom, mmu->rom_size);
+// Header decoding and cartridge RAM, once mmu->rom is set
+static int mmu_setup_rom(MMU *mmu, size_t size) {
+    mmu_select_mbc(mmu, size > 0x0147 ? mmu->rom[0x0147] : 0x00);
+    mmu->cgb = (size > 0x0143 && (mmu->rom[0x0143] & 0x80)) ? 1 : 0;
+    if (mmu->cgb) {
+        mmu->io[0x4F] = 0xFE;
+        mmu->io[0x70] = 0xF9;
+        mmu->io[0x55] = 0xFF;
+    }
 
     // allocate external RAM if needed
     mmu->eram = malloc(mmu->eram_size);
+    for (int slot = MMU_SLOT_ERAM; slot < MMU_RAM_PAGES; slot++) mmu->ram_page[slot] = mmu_own_memory(mmu, slot);
     if (!mmu->eram) {
-        free(mmu->rom);
+        if (!mmu->rom_borrowed) free(mmu->rom);
         mmu->rom = NULL;
         mmu->rom_size = 0;
+        mmu->rom_borrowed = 0;
         return -1;
     }
     memset(mmu->eram, 0, mmu->eram_size);
+
+    mmu_update_map(mmu);
     return 0;
 }
 
+int mmu_load_rom(MMU *mmu, const uint8_t *data, size_t size) {
+    if (!mmu || !data || size == 0) return -1;
+    mmu->rom = malloc(size);
+    if (!mmu->rom) return -1;
+    memcpy(mmu->rom, data, size);
+    mmu->rom_size = size;
+    mmu->rom_borrowed = 0;
+    return mmu_setup_rom(mmu, size);
+}
+
+// Same without the copy: data must outlive the MMU (one ROM can back many instances)
+int mmu_attach_rom(MMU *mmu, const uint8_t *data, size_t size) {
+    if (!mmu || !data || size == 0) return -1;
+    mmu->rom = (uint8_t *)data; // only read, ROM writes are MBC registers
+    mmu->rom_size = size;
+    mmu->rom_borrowed = 1;
+    return mmu_setup_rom(mmu, size);
+}
+
 void mmu_free_rom(MMU *mmu) {
     if (!mmu) return;
-    if (mmu->rom) { free(mmu->rom); mmu->rom = NULL; }
+    if (mmu->rom && !mmu->rom_borrowed) {
+        // Shared with forks: only the last one frees it
+        if (!mmu->rom_refs) {
+            free(mmu->rom);
+        } else if (__atomic_sub_fetch(mmu->rom_refs, 1, __ATOMIC_ACQ_REL) == 0) {
+            free(mmu->rom);
+            free(mmu->rom_refs);
+        }
+    }
+    mmu->rom = NULL;
+    mmu->rom_refs = NULL;
+    mmu->rom_borrowed = 0;
     if (mmu->eram) { free(mmu->eram); mmu->eram = NULL; }
     mmu->rom_size = 0;
+    mmu_release_pages(mmu);
+    mmu_update_map(mmu);
 }
 
-uint8_t mmu_read(MMU *mmu, uint16_t addr) {
+// Cartridge RAM back in a buffer of eram_size bytes the caller kept from an
+// earlier load of the same ROM, cleared (power cycle with stable pointers)
+void mmu_adopt_eram(MMU *mmu, uint8_t *eram) {
+    free(mmu->eram);
+    mmu->eram = eram;
+    memset(eram, 0, mmu->eram_size);
+    for (int slot = MMU_SLOT_ERAM; slot < MMU_RAM_PAGES; slot++) mmu->ram_page[slot] = mmu_own_memory(mmu, slot);
+    mmu_update_map(mmu);
+}
+
+// ===== Fork =====
+// child becomes a copy of parent sharing all of its RAM: each side copies a page
+// back to its own memory on its first write to it. The first fork moves the
+// parent's pages out of its arrays (one copy each), the next ones only count
+// references, so forking costs the pages written since the last fork.
+// The ROM is shared too; tools (traps, access hook, ROM coverage) and the link
+// cable stay with the parent. child must not hold a console (mmu_free_rom it
+// first); parent can't run during the call, afterwards both can run on different threads.
+int mmu_fork(MMU *child, MMU *parent) {
+    if (!child || !parent || child == parent || parent->flat) return -1;
+    int slots = mmu_ram_slots(parent);
+
+    uint8_t *eram = NULL;
+    if (parent->eram && !(eram = malloc(parent->eram_size))) return -1;
+
+    for (int slot = 0; slot < slots; slot++) {
+        if (parent->ram_shared[slot]) continue;
+        MmuPage *page = malloc(sizeof(MmuPage));
+        if (!page) {
+            // The pages moved so far are just not shared with anyone
+            free(eram);
+            mmu_update_map(parent);
+            return -1;
+        }
+        memcpy(page->data, parent->ram_page[slot], MMU_PAGE_SIZE);
+        page->refs = 1;
+        parent->ram_shared[slot] = page;
+        parent->ram_page[slot] = page->data;
+    }
+    if (parent->rom && !parent->rom_borrowed && !parent->rom_refs) {
+        parent->rom_refs = malloc(sizeof(uint32_t));
+        if (!parent->rom_refs) {
+            free(eram);
+            mmu_update_map(parent);
+            return -1;
+        }
+        *parent->rom_refs = 1;
+    }
+    mmu_update_map(parent);
+
+    // Everything but the arrays the pages came from
+    memcpy(child, parent, offsetof(MMU, vram));
+    memcpy(&child->oam, &parent->oam, sizeof(MMU) - offsetof(MMU, oam));
+    child->eram = eram;
+    for (int slot = 0; slot < slots; slot++) {
+        __atomic_add_fetch(&child->ram_shared[slot]->refs, 1, __ATOMIC_RELAXED);
+    }
+    if (child->rom_refs) __atomic_add_fetch(child->rom_refs, 1, __ATOMIC_RELAXED);
+
+    child->trap_read = child->trap_write = 0;
+    child->access_hook = NULL;
+    child->access_ctx = NULL;
+    child->joypad_poll = NULL; // keeps the buttons held at the fork
+    child->joypad_ctx = NULL;
+    child->coverage = NULL; // a fork counts into its own Coverage, coverage_merge() it back
+    child->serial_linked = 0;
+    child->serial_due = 0;
+    child->vram_log = 0;
+    mmu_update_map(child);
+    return 0;
+}
+
+// Take back every shared page (before writing to vram / wram / eram directly)
+void mmu_unshare(MMU *mmu) {
+    for (int slot = 0; slot < MMU_RAM_PAGES; slot++) {
+        if (mmu->ram_shared[slot]) mmu_take_page(mmu, slot);
+    }
+    mmu_update_map(mmu);
+}
+
+// Offset in wram[] of an address in 0xC000-0xDFFF (0xD000-0xDFFF follows SVBK)
+static inline size_t wram_offset(const MMU *mmu, uint16_t addr) {
+    if (addr < 0xD000) return addr - 0xC000;
+    return mmu->wram_bank * MMU_PAGE_SIZE + (addr - 0xD000);
+}
+
+// Full address decoding, no side effect (used by the slow path and by tools)
+uint8_t mmu_peek(MMU *mmu, uint16_t addr) {
     if (!mmu) return 0xFF;
+    if (mmu->flat) return mmu->flat[addr];
 
     // BIOS actif
     if (mmu->bios_active && addr < 0x0100) {
@@ -125,28 +399,38 @@ uint8_t mmu_read(MMU *mmu, uint16_t addr) {
 
     // VRAM
     if (addr >= 0x8000 && addr <= 0x9FFF)
-        return mmu->vram[addr - 0x8000];
+        return mmu_vram(mmu, mmu->vram_bank * 0x2000 + (addr - 0x8000));
 
     // External RAM
     if (addr >= 0xA000 && addr <= 0xBFFF) {
         if (!mmu->ram_enabled) return 0xFF;
         size_t offset = addr - 0xA000;
-        if (offset < mmu->eram_size) return mmu->eram[offset];
+        if (mmu->eram && offset < mmu->eram_size) return *mmu_ram(mmu, MMU_SLOT_ERAM, offset);
         return 0xFF;
     }
 
     // WRAM
     if (addr >= 0xC000 && addr <= 0xDFFF)
-        return mmu->wram[addr - 0xC000];
+        return *mmu_ram(mmu, MMU_SLOT_WRAM, wram_offset(mmu, addr));
 
     // Echo RAM
     if (addr >= 0xE000 && addr <= 0xFDFF)
-        return mmu->wram[addr - 0xE000];
+        return *mmu_ram(mmu, MMU_SLOT_WRAM, wram_offset(mmu, addr - 0x2000));
 
     // OAM
     if (addr >= 0xFE00 && addr <= 0xFE9F)
         return mmu->oam[addr - 0xFE00];
 
+    // CGB palette data
+    if (mmu->cgb && addr == 0xFF69)
+        return mmu->bg_palette[mmu->io[0x68] & 0x3F];
+    if (mmu->cgb && addr == 0xFF6B)
+        return mmu->obj_palette[mmu->io[0x6A] & 0x3F];
+
+    // Joypad (no host polling here, see mmu_load)
+    if (addr == 0xFF00)
+        return 0xC0 | (mmu->io[0x00] & 0x30) | mmu_joypad_lines(mmu);
+
     // IO
     if (addr >= 0xFF00 && addr <= 0xFF7F)
         return mmu->io[addr - 0xFF00];
@@ -162,14 +446,262 @@ uint8_t mmu_read(MMU *mmu, uint16_t addr) {
     return 0xFF;
 }
 
+static inline uint8_t mmu_load(MMU *mmu, uint16_t addr) {
+    const uint8_t *page = mmu->read_map[addr >> MMU_PAGE_SHIFT];
+    if (page) return page[addr & (MMU_PAGE_SIZE - 1)];
 
-void mmu_write(MMU *mmu, uint16_t addr, uint8_t val) {
-    if (!mmu) return;
+    // The host input is sampled at the last moment, when the game looks at it
+    if (addr == 0xFF00 && mmu->joypad_poll) mmu_set_joypad(mmu, mmu->joypad_poll(mmu->joypad_ctx));
+
+    uint8_t val = mmu_peek(mmu, addr);
+    if (mmu->access_hook) mmu->access_hook(mmu->access_ctx, addr, val, 0);
+    return val;
+}
+
+uint8_t mmu_read(MMU *mmu, uint16_t addr) {
+    if (!mmu) return 0xFF;
+    STATS_READ(addr);
+    COVERAGE_READ(mmu, addr);
+    return mmu_load(mmu, addr);
+}
+
+// Same read, only the coverage tells code from data
+uint8_t mmu_fetch(MMU *mmu, uint16_t addr) {
+    if (!mmu) return 0xFF;
+    STATS_READ(addr);
+    COVERAGE_EXEC(mmu, addr);
+    return mmu_load(mmu, addr);
+}
+
+// ===== 16-bit accesses =====
+// Little endian, low byte at addr. One unaligned load / store when both bytes
+// are in the same mapped page or in HRAM (on the IO page, but where most
+// stacks live), the byte path otherwise: page crossing, IO, access hook...
+static inline uint16_t mmu_load16(const uint8_t *p) {
+    uint16_t v;
+    memcpy(&v, p, 2);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    v = __builtin_bswap16(v);
+#endif
+    return v;
+}
+
+static inline void mmu_store16(uint8_t *p, uint16_t v) {
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    v = __builtin_bswap16(v);
+#endif
+    memcpy(p, &v, 2);
+}
+
+uint16_t mmu_read16(MMU *mmu, uint16_t addr) {
+    if (!mmu) return 0xFFFF;
+    const uint8_t *page = mmu->read_map[addr >> MMU_PAGE_SHIFT];
+    uint16_t offset = addr & (MMU_PAGE_SIZE - 1);
+
+    if (page && offset != MMU_PAGE_SIZE - 1) {
+        STATS_READ(addr);
+        STATS_READ(addr + 1);
+        COVERAGE_READ(mmu, addr);
+        COVERAGE_READ(mmu, addr + 1);
+        return mmu_load16(page + offset);
+    }
+    if (addr >= 0xFF80 && addr <= 0xFFFD && !mmu->access_hook) {
+        STATS_READ(addr);
+        STATS_READ(addr + 1);
+        return mmu_load16(&mmu->hram[addr - 0xFF80]);
+    }
+    uint8_t low = mmu_read(mmu, addr);
+    return (mmu_read(mmu, addr + 1) << 8) | low;
+}
+
+// Immediate operands (counted as executed by the coverage)
+uint16_t mmu_fetch16(MMU *mmu, uint16_t addr) {
+    if (!mmu) return 0xFFFF;
+    const uint8_t *page = mmu->read_map[addr >> MMU_PAGE_SHIFT];
+    uint16_t offset = addr & (MMU_PAGE_SIZE - 1);
+
+    if (page && offset != MMU_PAGE_SIZE - 1) {
+        STATS_READ(addr);
+        STATS_READ(addr + 1);
+        COVERAGE_EXEC(mmu, addr);
+        COVERAGE_EXEC(mmu, addr + 1);
+        return mmu_load16(page + offset);
+    }
+    uint8_t low = mmu_fetch(mmu, addr);
+    return (mmu_fetch(mmu, addr + 1) << 8) | low;
+}
+
+// Both bytes in one store, 0 when the byte path is needed
+static inline int mmu_store16_mapped(MMU *mmu, uint16_t addr, uint16_t val) {
+    uint8_t *page = mmu->write_map[addr >> MMU_PAGE_SHIFT];
+    uint16_t offset = addr & (MMU_PAGE_SIZE - 1);
+
+    if (page && offset != MMU_PAGE_SIZE - 1) {
+        STATS_WRITE(addr);
+        STATS_WRITE(addr + 1);
+        mmu_store16(page + offset, val);
+        return 1;
+    }
+    if (addr >= 0xFF80 && addr <= 0xFFFD && !mmu->access_hook) {
+        STATS_WRITE(addr);
+        STATS_WRITE(addr + 1);
+        mmu_store16(&mmu->hram[addr - 0xFF80], val);
+        return 1;
+    }
+    return 0;
+}
+
+// Stack order: the byte path writes the high byte first (PUSH, CALL, RST, interrupts)
+void mmu_write16(MMU *mmu, uint16_t addr, uint16_t val) {
+    if (!mmu || mmu_store16_mapped(mmu, addr, val)) return;
+    mmu_write(mmu, addr + 1, val >> 8);
+    mmu_write(mmu, addr, val & 0xFF);
+}
+
+// Low byte first, like LD (a16),SP on the real CPU
+void mmu_write16_le(MMU *mmu, uint16_t addr, uint16_t val) {
+    if (!mmu || mmu_store16_mapped(mmu, addr, val)) return;
+    mmu_write(mmu, addr, val & 0xFF);
+    mmu_write(mmu, addr + 1, val >> 8);
+}
+
+// ===== CGB HDMA =====
+// Copy 16-byte blocks to the current VRAM bank; a block never crosses a 4KB page
+static void mmu_hdma_copy(MMU *mmu, unsigned blocks) {
+    for (; blocks > 0; blocks--) {
+        const uint8_t *src = mmu->read_map[mmu->hdma_src >> MMU_PAGE_SHIFT];
+        uint16_t offset = mmu->vram_bank * 0x2000 + (mmu->hdma_dst & 0x1FF0);
+        uint8_t *dst = mmu_ram_writable(mmu, MMU_SLOT_VRAM, offset);
+        if (mmu->vram_log) mmu_vram_written(mmu, offset);
+
+        if (src) {
+            memcpy(dst, src + (mmu->hdma_src & (MMU_PAGE_SIZE - 1)), 16);
+        } else {
+            for (int i = 0; i < 16; i++) dst[i] = mmu_peek(mmu, mmu->hdma_src + i);
+        }
+        mmu->hdma_src += 16;
+        mmu->hdma_dst = (mmu->hdma_dst + 16) & 0x1FF0;
+    }
+    mmu->vram_version++;
+}
+
+// Called by the PPU when it enters HBlank
+void mmu_hdma_hblank(MMU *mmu) {
+    if (!mmu->hdma_active) return;
+
+    mmu_hdma_copy(mmu, 1);
+    mmu->hdma_blocks--;
+    if (mmu->hdma_blocks == 0) {
+        mmu->hdma_active = 0;
+        mmu->io[0x55] = 0xFF;
+    } else {
+        mmu->io[0x55] = mmu->hdma_blocks - 1;
+    }
+}
+
+// Repoint one RAM page after a bank switch (traps and flat mode keep their mapping)
+static inline void mmu_map_ram_page(MMU *mmu, int page, int slot) {
+    uint16_t no_write = mmu->trap_write | ((mmu->vram_watch || mmu->vram_log) ? 0x0300 : 0);
+
+    if (mmu->flat) return;
+    if (!(mmu->trap_read & (1 << page))) mmu->read_map[page] = mmu->ram_page[slot];
+    if (!(no_write & (1 << page))) mmu->write_map[page] = mmu_ram_write_page(mmu, slot);
+}
+
+// CGB-only registers, return 0 when addr is not one of them
+static int mmu_write_cgb(MMU *mmu, uint16_t addr, uint8_t val) {
+    switch (addr) {
+        case 0xFF4D: // KEY1: speed switch armed, done by STOP
+            mmu->io[0x4D] = (mmu->io[0x4D] & 0x80) | (val & 0x01);
+            return 1;
+
+        case 0xFF4F: // VBK
+            mmu->vram_bank = val & 0x01;
+            mmu->io[0x4F] = 0xFE | mmu->vram_bank;
+            mmu_map_ram_page(mmu, 0x8, MMU_SLOT_VRAM + mmu->vram_bank * 2);
+            mmu_map_ram_page(mmu, 0x9, MMU_SLOT_VRAM + mmu->vram_bank * 2 + 1);
+            return 1;
+
+        case 0xFF51: case 0xFF52: case 0xFF53: case 0xFF54: // HDMA source / destination
+            mmu->io[addr - 0xFF00] = val;
+            mmu->hdma_src = ((mmu->io[0x51] << 8) | mmu->io[0x52]) & 0xFFF0;
+            mmu->hdma_dst = ((mmu->io[0x53] << 8) | mmu->io[0x54]) & 0x1FF0;
+            return 1;
+
+        case 0xFF55: // HDMA start
+            if (mmu->hdma_active && !(val & 0x80)) {
+                // Stop the HBlank transfer
+                mmu->hdma_active = 0;
+                mmu->io[0x55] = 0x80 | (mmu->hdma_blocks - 1);
+            } else if (val & 0x80) {
+                mmu->hdma_blocks = (val & 0x7F) + 1;
+                mmu->hdma_active = 1;
+                mmu->io[0x55] = val & 0x7F;
+            } else {
+                // General purpose DMA: everything at once
+                mmu_hdma_copy(mmu, (val & 0x7F) + 1);
+                mmu->io[0x55] = 0xFF;
+            }
+            return 1;
+
+        case 0xFF69: // BCPD
+        case 0xFF6B: { // OCPD
+            uint8_t *spec = &mmu->io[addr - 0xFF00 - 1];
+            uint8_t *palette = (addr == 0xFF69) ? mmu->bg_palette : mmu->obj_palette;
+            palette[*spec & 0x3F] = val;
+            mmu->palette_version++;
+            if (*spec & 0x80) *spec = 0x80 | ((*spec + 1) & 0x3F); // auto increment
+            return 1;
+        }
+
+        case 0xFF70: // SVBK
+            mmu->wram_bank = (val & 0x07) ? (val & 0x07) : 1;
+            mmu->io[0x70] = 0xF8 | (val & 0x07);
+            mmu_map_ram_page(mmu, 0xD, MMU_SLOT_WRAM + mmu->wram_bank);
+            return 1;
+    }
+    return 0;
+}
+
+// ===== Joypad =====
+// A select bit at 0 connects its 4 buttons to the lines, pressed = 0
+uint8_t mmu_joypad_lines(const MMU *mmu) {
+    uint8_t select = mmu->io[0x00] & 0x30, lines = 0x0F;
+    if (!(select & 0x10)) lines &= ~(mmu->joypad & 0x0F);
+    if (!(select & 0x20)) lines &= ~(mmu->joypad >> 4);
+    return lines;
+}
+
+// The joypad interrupt is a line going low: a press in a group that isn't
+// selected raises nothing (until the game selects it with the button held)
+static void mmu_joypad_changed(MMU *mmu, uint8_t before) {
+    if (before & ~mmu_joypad_lines(mmu)) mmu->io[0x0F] |= 0x10;
+}
+
+void mmu_set_joypad(MMU *mmu, uint8_t buttons) {
+    uint8_t before = mmu_joypad_lines(mmu);
+    mmu->joypad = buttons;
+    mmu_joypad_changed(mmu, before);
+}
+
+// Checked every step while the CPU is in STOP, so the host input is polled too
+int mmu_joypad_wake(MMU *mmu) {
+    if (mmu->joypad_poll) mmu_set_joypad(mmu, mmu->joypad_poll(mmu->joypad_ctx));
+    return mmu_joypad_lines(mmu) != 0x0F;
+}
+
+static void mmu_write_slow(MMU *mmu, uint16_t addr, uint8_t val) {
+    if (mmu->flat) {
+        mmu->flat[addr] = val;
+        return;
+    }
+    if (mmu->cgb && addr >= 0xFF4D && addr <= 0xFF70 && mmu_write_cgb(mmu, addr, val)) return;
 
     if (addr <= 0x1FFF) {
         // RAM enable (cartridge)
         if (mmu->mbc_type) {
             mmu->ram_enabled = ((val & 0x0F) == 0x0A) ? 1 : 0;
+            mmu_update_map(mmu);
         }
         // sans MBC on ignore
     } else if (addr >= 0x2000 && addr <= 0x3FFF) {
@@ -178,6 +710,7 @@ void mmu_write(MMU *mmu, uint16_t addr, uint8_t val) {
             uint8_t bank = val & 0x1F;
             if (bank == 0) bank = 1;
             mmu->rom_bank_low = bank;
+            mmu_update_map(mmu);
         }
     } else if (addr >= 0x4000 && addr <= 0x5FFF) {
         // pour MBC1: banque haute ou mode - non implémenté dans ce starter
@@ -185,27 +718,99 @@ void mmu_write(MMU *mmu, uint16_t addr, uint8_t val) {
     } else if (addr >= 0x6000 && addr <= 0x7FFF) {
         // mode select pour MBC1 - non implémenté
     } else if (addr >= 0x8000 && addr <= 0x9FFF) {
-        mmu->vram[addr - 0x8000] = val;
+        uint16_t offset = mmu->vram_bank * 0x2000 + (addr - 0x8000);
+        *mmu_ram_writable(mmu, MMU_SLOT_VRAM, offset) = val;
+        if (mmu->vram_log) mmu_vram_written(mmu, offset);
+        if (mmu->vram_watch) {
+            // First write since the watch was armed: back to the fast path (unless logged)
+            mmu->vram_watch = 0;
+            mmu->vram_version++;
+            mmu_map_ram_page(mmu, 0x8, MMU_SLOT_VRAM + mmu->vram_bank * 2);
+            mmu_map_ram_page(mmu, 0x9, MMU_SLOT_VRAM + mmu->vram_bank * 2 + 1);
+        }
     } else if (addr >= 0xA000 && addr <= 0xBFFF) {
         if (mmu->ram_enabled) {
             size_t offset = addr - 0xA000;
-            if (offset < mmu->eram_size) mmu->eram[offset] = val;
+            if (mmu->eram && offset < mmu->eram_size) *mmu_ram_writable(mmu, MMU_SLOT_ERAM, offset) = val;
         }
     } else if (addr >= 0xC000 && addr <= 0xDFFF) {
-        mmu->wram[addr - 0xC000] = val;
+        *mmu_ram_writable(mmu, MMU_SLOT_WRAM, wram_offset(mmu, addr)) = val;
     } else if (addr >= 0xE000 && addr <= 0xFDFF) {
         // Echo RAM mirror
-        mmu->wram[addr - 0xE000] = val;
+        *mmu_ram_writable(mmu, MMU_SLOT_WRAM, wram_offset(mmu, addr - 0x2000)) = val;
     } else if (addr >= 0xFE00 && addr <= 0xFE9F) {
         mmu->oam[addr - 0xFE00] = val;
+        mmu->oam_version++;
+    } else if (addr == 0xFF46) {
+        // OAM DMA: copy 160 bytes from XX00 to OAM
+        // Like HDMA this bypasses mmu_read, so no stats and no access hooks
+        uint16_t base = val << 8;
+        const uint8_t *src = mmu->read_map[base >> MMU_PAGE_SHIFT];
+        mmu->io[0x46] = val;
+        if (src) {
+            memcpy(mmu->oam, src + (base & (MMU_PAGE_SIZE - 1)), sizeof(mmu->oam));
+        } else {
+            for (uint16_t i = 0; i < sizeof(mmu->oam); i++) {
+                mmu->oam[i] = mmu_peek(mmu, base | i);
+            }
+        }
+        mmu->oam_version++;
+    } else if (addr == 0xFF00) {
+        uint8_t before = mmu_joypad_lines(mmu);
+        mmu->io[0x00] = (mmu->io[0x00] & 0xCF) | (val & 0x30); // only the select bits are writable
+        mmu_joypad_changed(mmu, before);
+    } else if (addr == 0xFF02) {
+        mmu->io[0x02] = val;
+        mmu->serial_due = 0;
+        mmu->serial_active = (val & 0x81) == 0x81; // external clock: the partner drives it
+        if (mmu->serial_active) mmu->serial_cycles = (mmu->cgb && (val & 0x02)) ? 128 : 4096;
+    } else if (addr == 0xFF50) {
+        // Checked before the IO range, otherwise the boot ROM never goes away
+        mmu->io[0x50] = val;
+        if (mmu->bios_active) {
+            mmu->bios_active = 0; // Disabling BIOS
+            mmu_update_map(mmu);
+        }
     } else if (addr >= 0xFF00 && addr <= 0xFF7F) {
         mmu->io[addr - 0xFF00] = val;
-    } else if (addr == 0xFF50) {
-        mmu->bios_active = 0; // Disabling BIOS
-        printf("BIOS désactivé !\n");
     } else if (addr >= 0xFF80 && addr <= 0xFFFE) {
         mmu->hram[addr - 0xFF80] = val;
     } else if (addr == 0xFFFF) {
         mmu->interrupt_enable = val;
     }
 }
+
+// ===== Serial =====
+// Byte shifted in, SC bit 7 cleared, serial interrupt
+void mmu_serial_complete(MMU *mmu, uint8_t received) {
+    mmu->io[0x01] = received;
+    mmu->io[0x02] &= 0x7F;
+    mmu->io[0x0F] |= 0x08;
+    mmu->serial_active = 0;
+    mmu->serial_due = 0;
+}
+
+// Called with the CPU cycles while serial_active; without a cable the line
+// stays high and the byte received is 0xFF
+void mmu_serial_tick(MMU *mmu, uint32_t cycles) {
+    if (mmu->serial_due) return;
+    mmu->serial_cycles -= (int32_t)cycles;
+    if (mmu->serial_cycles > 0) return;
+
+    if (mmu->serial_linked) mmu->serial_due = 1;
+    else mmu_serial_complete(mmu, 0xFF);
+}
+
+void mmu_write(MMU *mmu, uint16_t addr, uint8_t val) {
+    if (!mmu) return;
+    STATS_WRITE(addr);
+
+    uint8_t *page = mmu->write_map[addr >> MMU_PAGE_SHIFT];
+    if (page) {
+        page[addr & (MMU_PAGE_SIZE - 1)] = val;
+        return;
+    }
+
+    mmu_write_slow(mmu, addr, val);
+    if (mmu->access_hook) mmu->access_hook(mmu->access_ctx, addr, val, 1);
+}
@@ -1,7 +1,10 @@
 #include <string.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
 #include "../includes/ppu.h"
 #include "../includes/mmu.h"
+#include "../includes/stats.h"
 
 void ppu_init(PPU *ppu) {
     memset(ppu, 0, sizeof(PPU));
@@ -29,4 +32,670 @@ void ppu_init(PPU *ppu) {
             ppu->framebuffer[y][x] = 0;
         }
     }
-}
\ No newline at end of file
+}
+
+// ===== Registers sync =====
+// The registers live in mmu->io, we copy them at each line so mid-frame changes are visible
+static void ppu_sync_registers(PPU *ppu, MMU *mmu) {
+    ppu->LCDC = mmu->io[0x40];
+    ppu->SCY  = mmu->io[0x42];
+    ppu->SCX  = mmu->io[0x43];
+    ppu->LYC  = mmu->io[0x45];
+    ppu->BGP  = mmu->io[0x47];
+    ppu->OBP0 = mmu->io[0x48];
+    ppu->OBP1 = mmu->io[0x49];
+    ppu->WY   = mmu->io[0x4A];
+    ppu->WX   = mmu->io[0x4B];
+    ppu->spriteHeight = (ppu->LCDC & 0x04) ? 16 : 8;
+}
+
+static void ppu_request_interrupt(MMU *mmu, uint8_t bit) {
+    mmu->io[0x0F] |= bit; // IF
+}
+
+static void ppu_write_status(PPU *ppu, MMU *mmu) {
+    ppu->STAT = (mmu->io[0x41] & 0x78) | ppu->mode;
+    if (ppu->LY == mmu->io[0x45]) ppu->STAT |= 0x04; // LY == LYC
+    mmu->io[0x41] = ppu->STAT;
+    mmu->io[0x44] = ppu->LY;
+}
+
+// First window column on line ly, SCREEN_WIDTH when the window is off
+static inline int ppu_window_start(const PPULineKey *regs, uint8_t ly) {
+    uint8_t windowVisible = (regs->LCDC & 0x20) && regs->WY <= ly && regs->WX <= 166;
+    return windowVisible ? regs->WX - 7 : SCREEN_WIDTH;
+}
+
+static inline uint8_t ppu_shade(uint8_t palette, uint8_t color) {
+    return (palette >> (color * 2)) & 0x03;
+}
+
+// Memory a line is drawn from: the MMU's (VRAM pages, see mmu_fork), or the
+// render thread's copy. Taken once per line: the pixel stores would otherwise
+// make the compiler read the pointers again at each access
+typedef struct {
+    const uint8_t *page[4];
+    const uint8_t *oam;
+    const uint8_t *bgPalette;
+    const uint8_t *objPalette;
+} PPUVram;
+
+static inline PPUVram ppu_vram_pages(const MMU *mmu) {
+    PPUVram vram;
+    for (int i = 0; i < 4; i++) vram.page[i] = mmu->ram_page[MMU_SLOT_VRAM + i];
+    vram.oam = mmu->oam;
+    vram.bgPalette = mmu->bg_palette;
+    vram.objPalette = mmu->obj_palette;
+    return vram;
+}
+
+static inline uint8_t ppu_vram(const PPUVram *vram, uint16_t offset) {
+    return vram->page[offset >> MMU_PAGE_SHIFT][offset & (MMU_PAGE_SIZE - 1)];
+}
+
+// ===== Scanline renderer =====
+// Pixels of line ly from its registers (regs) only: the window counter is moved by the caller
+static void ppu_render_line(const PPULineKey *regs, uint8_t ly, const PPUVram *vram, uint8_t *line) {
+    uint8_t bgColor[SCREEN_WIDTH]; // raw color index (0..3) used for sprite priority
+    uint8_t spriteHeight = (regs->LCDC & 0x04) ? 16 : 8;
+
+    memset(bgColor, 0, sizeof(bgColor));
+
+    // == Background & Window ==
+    if (regs->LCDC & 0x01) {
+        uint16_t bgMap  = (regs->LCDC & 0x08) ? 0x1C00 : 0x1800;
+        uint16_t winMap = (regs->LCDC & 0x40) ? 0x1C00 : 0x1800;
+        uint8_t unsignedTiles = (regs->LCDC & 0x10) ? 1 : 0;
+        int windowStart = ppu_window_start(regs, ly);
+
+        for (int x = 0; x < SCREEN_WIDTH; x++) {
+            uint16_t map;
+            uint8_t px, py;
+
+            if (x >= windowStart) {
+                map = winMap;
+                px = (uint8_t)(x - windowStart);
+                py = regs->windowLine;
+            } else {
+                map = bgMap;
+                px = (uint8_t)(x + regs->SCX);
+                py = (uint8_t)(ly + regs->SCY);
+            }
+
+            uint8_t tile = ppu_vram(vram, map + (py / 8) * 32 + (px / 8));
+            uint16_t tileAddr = unsignedTiles ? tile * 16 : 0x1000 + (int8_t)tile * 16;
+            uint8_t low  = ppu_vram(vram, tileAddr + (py % 8) * 2);
+            uint8_t high = ppu_vram(vram, tileAddr + (py % 8) * 2 + 1);
+            uint8_t bit = 7 - (px % 8);
+            uint8_t color = (((high >> bit) & 1) << 1) | ((low >> bit) & 1);
+
+            bgColor[x] = color;
+            line[x] = ppu_shade(regs->BGP, color);
+        }
+    } else {
+        memset(line, 0, SCREEN_WIDTH);
+    }
+
+    // == Sprites ==
+    if (regs->LCDC & 0x02) {
+        uint8_t visible[10];
+        int count = 0;
+
+        // OAM scan: first 10 sprites on this line
+        for (int i = 0; i < 40 && count < 10; i++) {
+            int y = vram->oam[i * 4] - 16;
+            if (ly >= y && ly < y + spriteHeight) {
+                visible[count++] = i;
+            }
+        }
+
+        // Lower X wins, then lower OAM index: draw in reverse priority order
+        for (int i = 1; i < count; i++) {
+            uint8_t s = visible[i];
+            int j = i - 1;
+            while (j >= 0 && vram->oam[visible[j] * 4 + 1] > vram->oam[s * 4 + 1]) {
+                visible[j + 1] = visible[j];
+                j--;
+            }
+            visible[j + 1] = s;
+        }
+
+        for (int i = count - 1; i >= 0; i--) {
+            const uint8_t *sprite = &vram->oam[visible[i] * 4];
+            int y = sprite[0] - 16;
+            int x = sprite[1] - 8;
+            uint8_t tile = sprite[2];
+            uint8_t attr = sprite[3];
+            uint8_t row = ly - y;
+
+            if (spriteHeight == 16) tile &= 0xFE;
+            if (attr & 0x40) row = spriteHeight - 1 - row; // Y flip
+
+            uint8_t low  = ppu_vram(vram, tile * 16 + row * 2);
+            uint8_t high = ppu_vram(vram, tile * 16 + row * 2 + 1);
+            uint8_t palette = (attr & 0x10) ? regs->OBP1 : regs->OBP0;
+
+            for (int p = 0; p < 8; p++) {
+                int sx = x + p;
+                if (sx < 0 || sx >= SCREEN_WIDTH) continue;
+
+                uint8_t bit = (attr & 0x20) ? p : 7 - p; // X flip
+                uint8_t color = (((high >> bit) & 1) << 1) | ((low >> bit) & 1);
+                if (color == 0) continue; // transparent
+                if ((attr & 0x80) && bgColor[sx] != 0) continue; // behind BG
+
+                line[sx] = ppu_shade(palette, color);
+            }
+        }
+    }
+}
+
+static inline uint16_t ppu_cgb_color(const uint8_t *paletteRam, uint8_t entry) {
+    return (paletteRam[entry * 2] | (paletteRam[entry * 2 + 1] << 8)) & 0x7FFF;
+}
+
+// ===== CGB scanline renderer =====
+// BG attributes come from VRAM bank 1, sprite priority is the OAM order,
+// LCDC bit 0 only removes the BG priority
+
+// Pixels x..end-1 of the BG or window, starting at map pixel (px, py). One
+// tile at a time: its attributes, bit planes and 4 colors are looked up once
+static void ppu_cgb_bg_span(const PPUVram *vram, uint16_t map, uint8_t unsignedTiles,
+                            uint8_t px, uint8_t py, int x, int end, uint8_t *line, uint16_t *colors,
+                            uint8_t *bgColor, uint8_t *bgPriority) {
+    while (x < end) {
+        uint16_t mapAddr = map + (py / 8) * 32 + (px / 8);
+        uint8_t tile = ppu_vram(vram, mapAddr);
+        uint8_t attr = ppu_vram(vram, 0x2000 + mapAddr);
+        uint8_t row = (attr & 0x40) ? 7 - (py % 8) : (py % 8);                 // Y flip
+        uint16_t tileAddr = (attr & 0x08) ? 0x2000 : 0;                        // tile bank
+        tileAddr += unsignedTiles ? tile * 16 : 0x1000 + (int8_t)tile * 16;
+        uint8_t low  = ppu_vram(vram, tileAddr + row * 2);
+        uint8_t high = ppu_vram(vram, tileAddr + row * 2 + 1);
+        uint8_t base = (attr & 0x07) * 4;
+        uint16_t palette[4];
+        for (int c = 0; c < 4; c++) palette[c] = ppu_cgb_color(vram->bgPalette, base + c);
+
+        for (uint8_t p = px % 8; p < 8 && x < end; p++, x++, px++) {
+            uint8_t bit = (attr & 0x20) ? p : 7 - p;                            // X flip
+            uint8_t color = (((high >> bit) & 1) << 1) | ((low >> bit) & 1);
+
+            bgColor[x] = color;
+            bgPriority[x] = attr & 0x80;
+            line[x] = base + color;
+            colors[x] = palette[color];
+        }
+    }
+}
+
+static void ppu_render_line_cgb(const PPULineKey *regs, uint8_t ly, const PPUVram *vram,
+                                uint8_t *line, uint16_t *colors) {
+    uint8_t bgColor[SCREEN_WIDTH];    // raw color index (0..3) used for sprite priority
+    uint8_t bgPriority[SCREEN_WIDTH]; // BG attribute bit 7
+    uint8_t masterPriority = regs->LCDC & 0x01;
+    uint8_t spriteHeight = (regs->LCDC & 0x04) ? 16 : 8;
+
+    // == Background & Window ==
+    uint16_t bgMap  = (regs->LCDC & 0x08) ? 0x1C00 : 0x1800;
+    uint16_t winMap = (regs->LCDC & 0x40) ? 0x1C00 : 0x1800;
+    uint8_t unsignedTiles = (regs->LCDC & 0x10) ? 1 : 0;
+    int windowStart = ppu_window_start(regs, ly);
+    int windowX = windowStart < 0 ? 0 : windowStart; // WX < 7 cuts the window's left edge
+
+    ppu_cgb_bg_span(vram, bgMap, unsignedTiles, regs->SCX, (uint8_t)(ly + regs->SCY),
+                    0, windowX, line, colors, bgColor, bgPriority);
+    ppu_cgb_bg_span(vram, winMap, unsignedTiles, (uint8_t)(windowX - windowStart), regs->windowLine,
+                    windowX, SCREEN_WIDTH, line, colors, bgColor, bgPriority);
+
+    // == Sprites ==
+    if (regs->LCDC & 0x02) {
+        uint8_t visible[10];
+        int count = 0;
+
+        // OAM scan: first 10 sprites on this line
+        for (int i = 0; i < 40 && count < 10; i++) {
+            int y = vram->oam[i * 4] - 16;
+            if (ly >= y && ly < y + spriteHeight) {
+                visible[count++] = i;
+            }
+        }
+
+        // Lower OAM index wins: draw in reverse order
+        for (int i = count - 1; i >= 0; i--) {
+            const uint8_t *sprite = &vram->oam[visible[i] * 4];
+            int y = sprite[0] - 16;
+            int x = sprite[1] - 8;
+            uint8_t tile = sprite[2];
+            uint8_t attr = sprite[3];
+            uint8_t row = ly - y;
+
+            if (spriteHeight == 16) tile &= 0xFE;
+            if (attr & 0x40) row = spriteHeight - 1 - row; // Y flip
+
+            uint16_t tileAddr = ((attr & 0x08) ? 0x2000 : 0) + tile * 16 + row * 2;
+            uint8_t low  = ppu_vram(vram, tileAddr);
+            uint8_t high = ppu_vram(vram, tileAddr + 1);
+
+            for (int p = 0; p < 8; p++) {
+                int sx = x + p;
+                if (sx < 0 || sx >= SCREEN_WIDTH) continue;
+
+                uint8_t bit = (attr & 0x20) ? p : 7 - p; // X flip
+                uint8_t color = (((high >> bit) & 1) << 1) | ((low >> bit) & 1);
+                if (color == 0) continue; // transparent
+                if (masterPriority && bgColor[sx] != 0 && ((attr & 0x80) || bgPriority[sx])) continue;
+
+                uint8_t entry = (attr & 0x07) * 4 + color;
+                line[sx] = 32 + entry;
+                colors[sx] = ppu_cgb_color(vram->objPalette, entry);
+            }
+        }
+    }
+}
+
+static void ppu_render(PPU *ppu, const PPULineKey *regs, uint8_t ly, uint8_t cgb, const PPUVram *vram) {
+    if (cgb) ppu_render_line_cgb(regs, ly, vram, ppu->framebuffer[ly], ppu->colorFramebuffer[ly]);
+    else ppu_render_line(regs, ly, vram, ppu->framebuffer[ly]);
+}
+
+// ===== Render thread =====
+// With ppu_start_worker() the lines are drawn by a thread of their own while
+// the CPU goes on: at the end of mode 3 ppu_draw_line only queues a job, the
+// registers of the line (its PPULineKey) and how far the change log goes.
+// The log holds the 32-byte blocks of VRAM written since the previous job
+// (the MMU marks them, see mmu_log_vram), and OAM or palette RAM when their
+// version moved. The thread applies it to its own copy up to the job, so each
+// line is drawn from the memory of its own HBlank: raster effects and VRAM
+// written mid-frame come out as they do when the line is drawn in place.
+// ppu_sync() waits for the queued lines; ppu_end_frame calls it, so a
+// completed frame is always whole in the framebuffer.
+
+#define PPU_LOG_BLOCK     MMU_VRAM_BLOCK
+#define PPU_LOG_SIZE      2048 // blocks, more than a whole PPUMemory
+#define PPU_WORKER_BATCH  16   // lines queued before a sleeping thread is woken
+
+typedef struct {
+    uint8_t vram[0x4000];
+    uint8_t oam[0xA0];
+    uint8_t bgPalette[64];
+    uint8_t objPalette[64];
+} PPUMemory;
+
+#define PPU_MEMORY_BLOCKS (sizeof(PPUMemory) / PPU_LOG_BLOCK)
+
+typedef struct {
+    uint16_t offset; // in PPUMemory
+    uint8_t data[PPU_LOG_BLOCK];
+} PPULogBlock;
+
+typedef struct {
+    PPULineKey regs;
+    uint8_t LY;
+    uint8_t cgb;
+    uint32_t logEnd; // log blocks to apply before drawing the line
+} PPULineJob;
+
+struct PPUWorker {
+    PPU *ppu;
+    MMU *mmu;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_cond_t done;
+    uint8_t sleeping, quit;
+
+    // Jobs: ring of one frame, queued and drawn only go up
+    PPULineJob jobs[SCREEN_HEIGHT];
+    uint32_t queued, drawn;
+
+    // Change log: written up to logWritten, free up to logApplied
+    PPULogBlock log[PPU_LOG_SIZE];
+    uint32_t logWritten, logApplied;
+    uint32_t oamVersion, paletteVersion; // last sent
+
+    // Render thread: memory of the line being drawn
+    PPUMemory shadow;
+};
+
+static void *ppu_worker_main(void *arg) {
+    struct PPUWorker *w = arg;
+    PPUVram vram;
+    for (int i = 0; i < 4; i++) vram.page[i] = w->shadow.vram + i * MMU_PAGE_SIZE;
+    vram.oam = w->shadow.oam;
+    vram.bgPalette = w->shadow.bgPalette;
+    vram.objPalette = w->shadow.objPalette;
+
+    pthread_mutex_lock(&w->lock);
+    for (;;) {
+        while (w->drawn == w->queued && !w->quit) {
+            w->sleeping = 1;
+            pthread_cond_wait(&w->wake, &w->lock);
+            w->sleeping = 0;
+        }
+        if (w->drawn == w->queued) break; // quit, nothing left
+        PPULineJob job = w->jobs[w->drawn % SCREEN_HEIGHT];
+        uint32_t block = w->logApplied;
+        pthread_mutex_unlock(&w->lock);
+
+        for (; block != job.logEnd; block++) {
+            const PPULogBlock *change = &w->log[block % PPU_LOG_SIZE];
+            memcpy((uint8_t *)&w->shadow + change->offset, change->data, PPU_LOG_BLOCK);
+        }
+        ppu_render(w->ppu, &job.regs, job.LY, job.cgb, &vram);
+
+        pthread_mutex_lock(&w->lock);
+        w->drawn++;
+        w->logApplied = job.logEnd;
+        if (w->drawn == w->queued) pthread_cond_broadcast(&w->done); // what waiters wait for
+    }
+    pthread_mutex_unlock(&w->lock);
+    return NULL;
+}
+
+// Append [offset, offset + size) of PPUMemory, taken from data, block by block
+static void ppu_log(struct PPUWorker *w, size_t offset, const uint8_t *data, size_t size) {
+    for (size_t i = 0; i < size; i += PPU_LOG_BLOCK) {
+        PPULogBlock *change = &w->log[w->logWritten++ % PPU_LOG_SIZE];
+        change->offset = (uint16_t)(offset + i);
+        memcpy(change->data, data + i, PPU_LOG_BLOCK);
+    }
+}
+
+// Wait until the queue is empty (the lock is held), waking the thread up if needed
+static void ppu_worker_wait(struct PPUWorker *w) {
+    if (w->sleeping) {
+        w->sleeping = 0;
+        pthread_cond_signal(&w->wake);
+    }
+    pthread_cond_wait(&w->done, &w->lock);
+}
+
+static void ppu_worker_queue(PPU *ppu, MMU *mmu, const PPULineKey *key) {
+    struct PPUWorker *w = ppu->worker;
+
+    pthread_mutex_lock(&w->lock);
+    // Room for a job and a whole PPUMemory of changes (LCD turned off and on
+    // mid-frame can queue more than a frame)
+    while (w->queued - w->drawn == SCREEN_HEIGHT ||
+           w->logWritten - w->logApplied > PPU_LOG_SIZE - PPU_MEMORY_BLOCKS) {
+        ppu_worker_wait(w);
+    }
+
+    for (int word = 0; word < (int)(sizeof(mmu->vram_dirty) / sizeof(uint64_t)); word++) {
+        uint64_t dirty = mmu->vram_dirty[word];
+        mmu->vram_dirty[word] = 0;
+        while (dirty) {
+            uint16_t offset = (uint16_t)((word * 64 + __builtin_ctzll(dirty)) * PPU_LOG_BLOCK);
+            const uint8_t *page = mmu->ram_page[MMU_SLOT_VRAM + (offset >> MMU_PAGE_SHIFT)];
+            ppu_log(w, offsetof(PPUMemory, vram) + offset, page + (offset & (MMU_PAGE_SIZE - 1)), PPU_LOG_BLOCK);
+            dirty &= dirty - 1;
+        }
+    }
+    if (mmu->oam_version != w->oamVersion) {
+        ppu_log(w, offsetof(PPUMemory, oam), mmu->oam, sizeof(mmu->oam));
+        w->oamVersion = mmu->oam_version;
+    }
+    if (mmu->palette_version != w->paletteVersion) {
+        ppu_log(w, offsetof(PPUMemory, bgPalette), mmu->bg_palette, sizeof(mmu->bg_palette));
+        ppu_log(w, offsetof(PPUMemory, objPalette), mmu->obj_palette, sizeof(mmu->obj_palette));
+        w->paletteVersion = mmu->palette_version;
+    }
+
+    PPULineJob *job = &w->jobs[w->queued % SCREEN_HEIGHT];
+    job->regs = *key;
+    job->LY = ppu->LY;
+    job->cgb = mmu->cgb;
+    job->logEnd = w->logWritten;
+    w->queued++;
+
+    // Woken up by batches: one wake-up per line would cost more than the line.
+    // Signaled once unlocked, it would otherwise wake up only to wait for the lock
+    int wake = w->sleeping && (w->queued - w->drawn >= PPU_WORKER_BATCH || ppu->LY == SCREEN_HEIGHT - 1);
+    if (wake) w->sleeping = 0; // until it runs: a single wake-up
+    pthread_mutex_unlock(&w->lock);
+    if (wake) pthread_cond_signal(&w->wake);
+}
+
+int ppu_start_worker(PPU *ppu, MMU *mmu) {
+    if (ppu->worker) return 0;
+    struct PPUWorker *w = calloc(1, sizeof(struct PPUWorker));
+    if (!w) return -1;
+
+    w->ppu = ppu;
+    w->mmu = mmu;
+    for (int i = 0; i < 4; i++) {
+        memcpy(w->shadow.vram + i * MMU_PAGE_SIZE, mmu->ram_page[MMU_SLOT_VRAM + i], MMU_PAGE_SIZE);
+    }
+    memcpy(w->shadow.oam, mmu->oam, sizeof(mmu->oam));
+    memcpy(w->shadow.bgPalette, mmu->bg_palette, sizeof(mmu->bg_palette));
+    memcpy(w->shadow.objPalette, mmu->obj_palette, sizeof(mmu->obj_palette));
+    w->oamVersion = mmu->oam_version;
+    w->paletteVersion = mmu->palette_version;
+
+    pthread_mutex_init(&w->lock, NULL);
+    pthread_cond_init(&w->wake, NULL);
+    pthread_cond_init(&w->done, NULL);
+    if (pthread_create(&w->thread, NULL, ppu_worker_main, w) != 0) {
+        pthread_mutex_destroy(&w->lock);
+        pthread_cond_destroy(&w->wake);
+        pthread_cond_destroy(&w->done);
+        free(w);
+        return -1;
+    }
+    mmu_log_vram(mmu, 1);
+    ppu->worker = w;
+    return 0;
+}
+
+void ppu_sync(PPU *ppu) {
+    struct PPUWorker *w = ppu->worker;
+    if (!w) return;
+
+    pthread_mutex_lock(&w->lock);
+    while (w->drawn != w->queued) ppu_worker_wait(w);
+    pthread_mutex_unlock(&w->lock);
+}
+
+// The queued lines are drawn first
+void ppu_stop_worker(PPU *ppu) {
+    struct PPUWorker *w = ppu->worker;
+    if (!w) return;
+
+    pthread_mutex_lock(&w->lock);
+    w->quit = 1;
+    pthread_cond_signal(&w->wake);
+    pthread_mutex_unlock(&w->lock);
+    pthread_join(w->thread, NULL);
+    pthread_mutex_destroy(&w->lock);
+    pthread_cond_destroy(&w->wake);
+    pthread_cond_destroy(&w->done);
+    mmu_log_vram(w->mmu, 0);
+    free(w);
+    ppu->worker = NULL;
+}
+
+// ===== Line cache =====
+// A line is only rendered again when its registers, VRAM, OAM or palettes changed
+// since it was last drawn; VRAM writes are seen through mmu_watch_vram()
+void ppu_invalidate(PPU *ppu) {
+    for (int y = 0; y < SCREEN_HEIGHT; y++) ppu->lineKeys[y].valid = 0;
+}
+
+// The window counter only moves on lines that show the window
+static inline void ppu_next_window_line(PPU *ppu, const PPULineKey *regs, uint8_t cgb) {
+    if (ppu_window_start(regs, ppu->LY) < SCREEN_WIDTH && (cgb || (regs->LCDC & 0x01))) ppu->windowLine++;
+}
+
+static void ppu_draw_line(PPU *ppu, MMU *mmu) {
+    PPULineKey key;
+    memset(&key, 0, sizeof(key)); // padding included, the keys are compared with memcmp
+    key.valid = 1;
+    key.LCDC = ppu->LCDC;
+    key.SCY = ppu->SCY;
+    key.SCX = ppu->SCX;
+    key.BGP = ppu->BGP;
+    key.OBP0 = ppu->OBP0;
+    key.OBP1 = ppu->OBP1;
+    key.WY = ppu->WY;
+    key.WX = ppu->WX;
+    key.windowLine = ppu->windowLine;
+    key.vramVersion = mmu->vram_version;
+    key.oamVersion = mmu->oam_version;
+    key.paletteVersion = mmu->palette_version;
+
+    // Skipped frame: the lines and their keys stay as they were, so they still match
+    if (ppu->skipFrame) {
+        ppu_next_window_line(ppu, &key, mmu->cgb);
+        return;
+    }
+
+    PPULineKey *cached = &ppu->lineKeys[ppu->LY];
+    if (!mmu->flat && memcmp(cached, &key, sizeof(key)) == 0) {
+        // Same pixels as last time
+        STATS_PPU_LINE_CACHED();
+    } else {
+        if (ppu->worker) {
+            ppu_worker_queue(ppu, mmu, &key);
+        } else {
+            const PPUVram vram = ppu_vram_pages(mmu);
+            ppu_render(ppu, &key, ppu->LY, mmu->cgb, &vram);
+        }
+        *cached = key;
+        ppu->linesChanged++;
+        STATS_PPU_LINE();
+    }
+    ppu_next_window_line(ppu, &key, mmu->cgb);
+    mmu_watch_vram(mmu);
+}
+
+// ===== Frameskip =====
+void ppu_set_frameskip(PPU *ppu, uint8_t frames) {
+    ppu->frameskip = frames;
+    ppu->skipCounter = 0;
+}
+
+// Frame done: report it and decide if the next one is drawn
+static void ppu_end_frame(PPU *ppu) {
+    ppu_sync(ppu);
+    ppu->frameComplete = 1;
+    ppu->frameUnchanged = ppu->linesChanged == 0;
+    ppu->frameSkipped = ppu->skipFrame;
+    ppu->linesChanged = 0;
+
+    if (++ppu->skipCounter > ppu->frameskip) ppu->skipCounter = 0;
+    ppu->skipFrame = ppu->skipCounter != 0;
+}
+
+// PPU cycles since the current frame began, at VBlank (LY 144) when the last
+// one was completed; LCD off: the frame pacing counter
+uint32_t ppu_frame_position(const PPU *ppu) {
+    if (!(ppu->LCDC & 0x80)) return ppu->modeClock;
+
+    uint32_t lines = ppu->mode == 1 ? ppu->LY - SCREEN_HEIGHT : ppu->LY + (PPU_LINES - SCREEN_HEIGHT);
+    uint32_t position = lines * PPU_LINE_CYCLES + ppu->modeClock;
+    if (ppu->mode == 3) position += PPU_OAM_CYCLES;
+    else if (ppu->mode == 0) position += PPU_OAM_CYCLES + PPU_TRANSFER_CYCLES;
+    return position;
+}
+
+// Cycles ppu_step can be given before it does more than counting them: calls
+// that add up to less can be merged into one (0 = the next call does something)
+uint32_t ppu_next_event(const PPU *ppu, const MMU *mmu) {
+    uint32_t limit;
+
+    if (!(mmu->io[0x40] & 0x80)) {
+        if (ppu->LCDC & 0x80) return 0; // LCD just turned off
+        limit = PPU_FRAME_CYCLES;
+    } else {
+        if (!(ppu->LCDC & 0x80)) return 0; // LCD just turned on
+        switch (ppu->mode) {
+            case 2:  limit = PPU_OAM_CYCLES; break;
+            case 3:  limit = PPU_TRANSFER_CYCLES; break;
+            case 0:  limit = PPU_HBLANK_CYCLES; break;
+            default: limit = PPU_LINE_CYCLES; break;
+        }
+    }
+    return ppu->modeClock < limit ? limit - ppu->modeClock : 0;
+}
+
+void ppu_step(PPU *ppu, MMU *mmu, uint16_t cycles) {
+    ppu->modeClock += cycles;
+
+    // LCD off: keep the frame pacing but don't touch LY/STAT/framebuffer
+    if (!(mmu->io[0x40] & 0x80)) {
+        ppu->LCDC = mmu->io[0x40];
+        ppu->LY = 0;
+        ppu->mode = 0;
+        mmu->io[0x44] = 0;
+        mmu->io[0x41] &= 0xFC;
+        if (ppu->modeClock >= PPU_FRAME_CYCLES) {
+            ppu->modeClock -= PPU_FRAME_CYCLES;
+            ppu_end_frame(ppu);
+        }
+        return;
+    }
+
+    // LCD just turned on: restart from line 0
+    if (!(ppu->LCDC & 0x80)) {
+        ppu->LCDC = mmu->io[0x40];
+        ppu->modeClock = cycles;
+        ppu->mode = 2;
+        ppu->windowLine = 0;
+        ppu_write_status(ppu, mmu);
+    }
+
+    for (;;) {
+        uint8_t stat = mmu->io[0x41];
+
+        switch (ppu->mode) {
+            case 2: // OAM search
+                if (ppu->modeClock < PPU_OAM_CYCLES) return;
+                ppu->modeClock -= PPU_OAM_CYCLES;
+                ppu->mode = 3;
+                break;
+
+            case 3: // Pixel transfer
+                if (ppu->modeClock < PPU_TRANSFER_CYCLES) return;
+                ppu->modeClock -= PPU_TRANSFER_CYCLES;
+                ppu_sync_registers(ppu, mmu);
+                ppu_draw_line(ppu, mmu);
+                ppu->mode = 0;
+                if (stat & 0x08) ppu_request_interrupt(mmu, 0x02);
+                if (mmu->hdma_active) mmu_hdma_hblank(mmu);
+                break;
+
+            case 0: // HBlank
+                if (ppu->modeClock < PPU_HBLANK_CYCLES) return;
+                ppu->modeClock -= PPU_HBLANK_CYCLES;
+                ppu->LY++;
+
+                if (ppu->LY == SCREEN_HEIGHT) {
+                    ppu->mode = 1;
+                    ppu_end_frame(ppu);
+                    ppu_request_interrupt(mmu, 0x01); // VBlank
+                    if (stat & 0x10) ppu_request_interrupt(mmu, 0x02);
+                } else {
+                    ppu->mode = 2;
+                    if (stat & 0x20) ppu_request_interrupt(mmu, 0x02);
+                }
+                if (ppu->LY == mmu->io[0x45] && (stat & 0x40)) ppu_request_interrupt(mmu, 0x02);
+                break;
+
+            case 1: // VBlank
+                if (ppu->modeClock < PPU_LINE_CYCLES) return;
+                ppu->modeClock -= PPU_LINE_CYCLES;
+                ppu->LY++;
+
+                if (ppu->LY == PPU_LINES) {
+                    ppu->LY = 0;
+                    ppu->windowLine = 0;
+                    ppu->mode = 2;
+                    if (stat & 0x20) ppu_request_interrupt(mmu, 0x02);
+                }
+                if (ppu->LY == mmu->io[0x45] && (stat & 0x40)) ppu_request_interrupt(mmu, 0x02);
+                break;
+        }
+
+        ppu_write_status(ppu, mmu);
+    }
+}
@@ -0,0 +1,284 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../includes/profiler.h"
+
+#define EMPTY_KEY 0xFFFFFFFFu
+
+Profiler *profiler_create(uint32_t interval) {
+    Profiler *p = calloc(1, sizeof(Profiler));
+    if (!p) return NULL;
+
+    p->interval = interval ? interval : 1;
+    p->pcCapacity = 4096;
+    p->pcKeys = malloc(p->pcCapacity * sizeof(uint32_t));
+    p->pcCounts = calloc(p->pcCapacity, sizeof(uint64_t));
+    p->stackCapacity = 1024;
+    p->stacks = calloc(p->stackCapacity, sizeof(ProfilerStack));
+
+    if (!p->pcKeys || !p->pcCounts || !p->stacks) {
+        profiler_free(p);
+        return NULL;
+    }
+    memset(p->pcKeys, 0xFF, p->pcCapacity * sizeof(uint32_t));
+    return p;
+}
+
+void profiler_free(Profiler *p) {
+    if (!p) return;
+    for (size_t i = 0; i < p->stackCapacity; i++) free(p->stacks[i].stack);
+    for (size_t i = 0; i < p->symbolCount; i++) free(p->symbols[i].name);
+    free(p->stacks);
+    free(p->symbols);
+    free(p->pcKeys);
+    free(p->pcCounts);
+    free(p);
+}
+
+// ===== Symbols =====
+static int compare_symbols(const void *a, const void *b) {
+    const ProfilerSymbol *sa = a, *sb = b;
+    if (sa->bank != sb->bank) return sa->bank - sb->bank;
+    return sa->addr - sb->addr;
+}
+
+// RGBDS / WLA style: "BB:AAAA Label", ';' starts a comment
+int profiler_load_symbols(Profiler *p, const char *filename) {
+    FILE *f = fopen(filename, "r");
+    if (!f) return -1;
+
+    char line[256];
+    size_t capacity = p->symbolCount;
+    while (fgets(line, sizeof(line), f)) {
+        unsigned bank, addr;
+        char name[200];
+
+        if (line[0] == ';') continue;
+        if (sscanf(line, "%x:%x %199s", &bank, &addr, name) != 3) continue;
+
+        if (p->symbolCount == capacity) {
+            capacity = capacity ? capacity * 2 : 256;
+            ProfilerSymbol *symbols = realloc(p->symbols, capacity * sizeof(ProfilerSymbol));
+            if (!symbols) break;
+            p->symbols = symbols;
+        }
+        ProfilerSymbol *s = &p->symbols[p->symbolCount];
+        s->bank = (uint8_t)bank;
+        s->addr = (uint16_t)addr;
+        s->name = strdup(name);
+        if (s->name) p->symbolCount++;
+    }
+    fclose(f);
+
+    qsort(p->symbols, p->symbolCount, sizeof(ProfilerSymbol), compare_symbols);
+    return 0;
+}
+
+// Nearest symbol at or before bank:addr, NULL if none
+static const char *resolve(const Profiler *p, uint8_t bank, uint16_t addr) {
+    size_t lo = 0, hi = p->symbolCount;
+    const ProfilerSymbol *found = NULL;
+
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        const ProfilerSymbol *s = &p->symbols[mid];
+        if (s->bank < bank || (s->bank == bank && s->addr <= addr)) {
+            if (s->bank == bank) found = s;
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return found ? found->name : NULL;
+}
+
+static int format_frame(const Profiler *p, char *out, size_t size, uint8_t bank, uint16_t addr) {
+    const char *name = resolve(p, bank, addr);
+    if (name) return snprintf(out, size, "%s", name);
+    return snprintf(out, size, "%02X:%04X", bank, addr);
+}
+
+// Only ROMX depends on the mapper, everything else is reported as bank 0 (like .sym files)
+static uint8_t bank_of(const MMU *mmu, uint16_t addr) {
+    if (addr >= 0x4000 && addr <= 0x7FFF) return mmu->rom_bank_low;
+    return 0;
+}
+
+// ===== Call tracking =====
+void profiler_call(Profiler *p, uint16_t target, uint16_t sp, const MMU *mmu) {
+    if (p->depth < PROFILER_MAX_DEPTH) {
+        ProfilerFrame *f = &p->frames[p->depth];
+        f->target = target;
+        f->bank = bank_of(mmu, target);
+        f->sp = sp;
+    }
+    p->depth++;
+}
+
+// Pop every frame whose return address is now above SP
+// (games sometimes drop a return address by hand, this resyncs the shadow stack)
+void profiler_ret(Profiler *p, uint16_t sp) {
+    if (p->depth > PROFILER_MAX_DEPTH) {
+        p->depth--;
+        return;
+    }
+    while (p->depth > 0 && p->frames[p->depth - 1].sp < sp) p->depth--;
+}
+
+// ===== Sampling =====
+static uint64_t hash_string(const char *s) {
+    uint64_t h = 1469598103934665603ull; // FNV-1a
+    while (*s) {
+        h ^= (uint8_t)*s++;
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+static void grow_pcs(Profiler *p) {
+    size_t capacity = p->pcCapacity * 2;
+    uint32_t *keys = malloc(capacity * sizeof(uint32_t));
+    uint64_t *counts = calloc(capacity, sizeof(uint64_t));
+    if (!keys || !counts) {
+        free(keys);
+        free(counts);
+        return;
+    }
+    memset(keys, 0xFF, capacity * sizeof(uint32_t));
+
+    for (size_t i = 0; i < p->pcCapacity; i++) {
+        if (p->pcKeys[i] == EMPTY_KEY) continue;
+        size_t j = (p->pcKeys[i] * 2654435761u) & (capacity - 1);
+        while (keys[j] != EMPTY_KEY) j = (j + 1) & (capacity - 1);
+        keys[j] = p->pcKeys[i];
+        counts[j] = p->pcCounts[i];
+    }
+    free(p->pcKeys);
+    free(p->pcCounts);
+    p->pcKeys = keys;
+    p->pcCounts = counts;
+    p->pcCapacity = capacity;
+}
+
+static void count_pc(Profiler *p, uint32_t key) {
+    if (p->pcUsed * 2 >= p->pcCapacity) grow_pcs(p);
+
+    size_t i = (key * 2654435761u) & (p->pcCapacity - 1);
+    while (p->pcKeys[i] != EMPTY_KEY && p->pcKeys[i] != key) i = (i + 1) & (p->pcCapacity - 1);
+    if (p->pcKeys[i] == EMPTY_KEY) {
+        p->pcKeys[i] = key;
+        p->pcUsed++;
+    }
+    p->pcCounts[i]++;
+}
+
+static void grow_stacks(Profiler *p) {
+    size_t capacity = p->stackCapacity * 2;
+    ProfilerStack *stacks = calloc(capacity, sizeof(ProfilerStack));
+    if (!stacks) return;
+
+    for (size_t i = 0; i < p->stackCapacity; i++) {
+        if (!p->stacks[i].stack) continue;
+        size_t j = hash_string(p->stacks[i].stack) & (capacity - 1);
+        while (stacks[j].stack) j = (j + 1) & (capacity - 1);
+        stacks[j] = p->stacks[i];
+    }
+    free(p->stacks);
+    p->stacks = stacks;
+    p->stackCapacity = capacity;
+}
+
+static void count_stack(Profiler *p, const char *stack) {
+    if (p->stackUsed * 2 >= p->stackCapacity) grow_stacks(p);
+
+    size_t i = hash_string(stack) & (p->stackCapacity - 1);
+    while (p->stacks[i].stack && strcmp(p->stacks[i].stack, stack) != 0) {
+        i = (i + 1) & (p->stackCapacity - 1);
+    }
+    if (!p->stacks[i].stack) {
+        p->stacks[i].stack = strdup(stack);
+        if (!p->stacks[i].stack) return;
+        p->stackUsed++;
+    }
+    p->stacks[i].count++;
+}
+
+void profiler_sample(Profiler *p, uint16_t pc, const MMU *mmu) {
+    char stack[4096];
+    size_t len = 0;
+    uint8_t bank = bank_of(mmu, pc);
+
+    p->samples++;
+    count_pc(p, ((uint32_t)bank << 16) | pc);
+
+    // Root, then every call target, then the leaf (truncated once the buffer is full)
+    len = snprintf(stack, sizeof(stack), "gb");
+    int depth = p->depth < PROFILER_MAX_DEPTH ? p->depth : PROFILER_MAX_DEPTH;
+    size_t top = len;
+    for (int i = 0; i < depth && sizeof(stack) - len >= 2; i++) {
+        stack[len++] = ';';
+        top = len;
+        int n = format_frame(p, stack + len, sizeof(stack) - len, p->frames[i].bank, p->frames[i].target);
+        if (n < 0 || (size_t)n >= sizeof(stack) - len) {
+            len = sizeof(stack) - 1;
+            break;
+        }
+        len += n;
+    }
+
+    // The leaf is the nearest label of PC (needs symbols), unless it is the current function itself
+    const char *leaf = resolve(p, bank, pc);
+    if (sizeof(stack) - len >= 2 && (depth == 0 || (leaf && strcmp(leaf, stack + top) != 0))) {
+        stack[len++] = ';';
+        format_frame(p, stack + len, sizeof(stack) - len, bank, pc);
+    }
+
+    count_stack(p, stack);
+}
+
+// ===== Output =====
+static const uint64_t *sort_counts;
+
+static int compare_desc(const void *a, const void *b) {
+    uint64_t ca = sort_counts[*(const size_t *)a];
+    uint64_t cb = sort_counts[*(const size_t *)b];
+    return (ca < cb) - (ca > cb);
+}
+
+void profiler_report(Profiler *p, FILE *out, int top) {
+    size_t *order = malloc(p->pcUsed * sizeof(size_t));
+    size_t n = 0;
+    char name[128];
+
+    if (!order) return;
+    for (size_t i = 0; i < p->pcCapacity; i++) {
+        if (p->pcKeys[i] != EMPTY_KEY) order[n++] = i;
+    }
+    sort_counts = p->pcCounts;
+    qsort(order, n, sizeof(size_t), compare_desc);
+
+    fprintf(out, "\n===== Profile (%llu samples, every %u cycles) =====\n",
+        (unsigned long long)p->samples, p->interval);
+    for (size_t i = 0; i < n && (int)i < top; i++) {
+        uint32_t key = p->pcKeys[order[i]];
+        uint8_t bank = key >> 16;
+        uint16_t pc = key & 0xFFFF;
+        format_frame(p, name, sizeof(name), bank, pc);
+        fprintf(out, "  %02X:%04X %6.2f%%  %s\n", bank, pc,
+            100.0 * p->pcCounts[order[i]] / (p->samples ? p->samples : 1), name);
+    }
+    free(order);
+}
+
+// Brendan Gregg's collapsed format, ready for flamegraph.pl
+int profiler_write_collapsed(Profiler *p, const char *filename) {
+    FILE *f = fopen(filename, "w");
+    if (!f) return -1;
+
+    for (size_t i = 0; i < p->stackCapacity; i++) {
+        if (!p->stacks[i].stack) continue;
+        fprintf(f, "%s %llu\n", p->stacks[i].stack, (unsigned long long)p->stacks[i].count);
+    }
+    fclose(f);
+    return 0;
+}
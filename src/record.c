@@ -0,0 +1,272 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include "../includes/record.h"
+
+// RGB -> Y'CbCr (BT.601, limited range) for every RGB555 color, built once
+static uint8_t cgb_yuv[0x8000][3];
+static uint8_t dmg_yuv[4][3];
+static pthread_once_t record_once = PTHREAD_ONCE_INIT;
+
+static void rgb_to_yuv(uint8_t r, uint8_t g, uint8_t b, uint8_t *out) {
+    out[0] = (uint8_t)(16 + ((66 * r + 129 * g + 25 * b + 128) >> 8));
+    out[1] = (uint8_t)(128 + ((-38 * r - 74 * g + 112 * b + 128) >> 8));
+    out[2] = (uint8_t)(128 + ((112 * r - 94 * g - 18 * b + 128) >> 8));
+}
+
+static void record_setup(void) {
+    static const uint8_t shades[4] = { 0xFF, 0xAA, 0x55, 0x00 };
+
+    for (int s = 0; s < 4; s++) rgb_to_yuv(shades[s], shades[s], shades[s], dmg_yuv[s]);
+    for (uint32_t c = 0; c < 0x8000; c++) {
+        uint8_t r = c & 0x1F, g = (c >> 5) & 0x1F, b = (c >> 10) & 0x1F;
+        rgb_to_yuv((r << 3) | (r >> 2), (g << 3) | (g >> 2), (b << 3) | (b >> 2), cgb_yuv[c]);
+    }
+}
+
+static void put_le16(uint8_t *p, uint16_t v) { p[0] = v & 0xFF; p[1] = v >> 8; }
+static void put_le32(uint8_t *p, uint32_t v) { put_le16(p, v & 0xFFFF); put_le16(p + 2, v >> 16); }
+
+// 44-byte WAV header, sizes fixed up by record_close
+static int write_wav_header(FILE *f, uint32_t data_bytes) {
+    uint8_t h[44];
+
+    memcpy(h, "RIFF", 4);
+    put_le32(h + 4, 36 + data_bytes);
+    memcpy(h + 8, "WAVEfmt ", 8);
+    put_le32(h + 16, 16);                      // fmt chunk size
+    put_le16(h + 20, 1);                       // PCM
+    put_le16(h + 22, 2);                       // stereo
+    put_le32(h + 24, RECORD_SAMPLE_RATE);
+    put_le32(h + 28, RECORD_SAMPLE_RATE * 4);  // byte rate
+    put_le16(h + 32, 4);                       // block align
+    put_le16(h + 34, 16);                      // bits per sample
+    memcpy(h + 36, "data", 4);
+    put_le32(h + 40, data_bytes);
+    return fwrite(h, 1, sizeof(h), f) == sizeof(h) ? 0 : -1;
+}
+
+// ===== Writer thread =====
+static void record_write_picture(Recorder *rec, const RecordSlot *slot) {
+    if (rec->format == RECORD_RAW) {
+        if (slot->cgb) {
+            fputc('C', rec->video);
+            fwrite(slot->colorFramebuffer, sizeof(slot->colorFramebuffer), 1, rec->video);
+        } else {
+            fputc('F', rec->video);
+            fwrite(slot->framebuffer, sizeof(slot->framebuffer), 1, rec->video);
+        }
+        return;
+    }
+
+    for (int y = 0; y < SCREEN_HEIGHT; y++) {
+        for (int x = 0; x < SCREEN_WIDTH; x++) {
+            const uint8_t *c = slot->cgb ? cgb_yuv[slot->colorFramebuffer[y][x] & 0x7FFF]
+                                         : dmg_yuv[slot->framebuffer[y][x] & 0x03];
+            rec->yuv[0][y][x] = c[0];
+            rec->yuv[1][y][x] = c[1];
+            rec->yuv[2][y][x] = c[2];
+        }
+    }
+    fputs("FRAME\n", rec->video);
+    fwrite(rec->yuv, sizeof(rec->yuv), 1, rec->video);
+}
+
+static void record_write_slot(Recorder *rec, const RecordSlot *slot) {
+    static const uint8_t silence[4096];
+
+    for (uint32_t i = 0; i < slot->repeats; i++) {
+        if (rec->format == RECORD_RAW) {
+            fputc('R', rec->video);
+        } else {
+            fputs("FRAME\n", rec->video);
+            fwrite(rec->yuv, sizeof(rec->yuv), 1, rec->video);
+        }
+    }
+    if (slot->hasPicture) record_write_picture(rec, slot);
+    rec->written += slot->repeats + slot->hasPicture;
+
+    // No APU yet: the audio track is silence of the right length
+    if (rec->audio) {
+        size_t bytes = (size_t)slot->samples * 4;
+        while (bytes > 0) {
+            size_t n = bytes < sizeof(silence) ? bytes : sizeof(silence);
+            fwrite(silence, 1, n, rec->audio);
+            bytes -= n;
+        }
+        rec->audioBytes += (uint64_t)slot->samples * 4;
+    }
+
+    if (ferror(rec->video) || (rec->audio && ferror(rec->audio))) rec->error = 1;
+}
+
+static void *record_writer(void *arg) {
+    Recorder *rec = arg;
+
+    pthread_mutex_lock(&rec->lock);
+    for (;;) {
+        while (rec->count == 0 && !rec->quit) pthread_cond_wait(&rec->notEmpty, &rec->lock);
+        if (rec->count == 0) break; // quit once the queue is drained
+
+        RecordSlot *slot = &rec->slots[rec->head];
+        pthread_mutex_unlock(&rec->lock);
+
+        record_write_slot(rec, slot);
+
+        pthread_mutex_lock(&rec->lock);
+        rec->head = (rec->head + 1) % RECORD_QUEUE_SIZE;
+        rec->count--;
+        pthread_cond_signal(&rec->notFull);
+    }
+    pthread_mutex_unlock(&rec->lock);
+    return NULL;
+}
+
+// ===== Producer =====
+int record_open(Recorder *rec, const char *filename) {
+    pthread_once(&record_once, record_setup);
+    memset(rec, 0, sizeof(Recorder));
+
+    size_t len = strlen(filename);
+    rec->format = (len >= 4 && strcmp(filename + len - 4, ".y4m") == 0) ? RECORD_Y4M : RECORD_RAW;
+
+    rec->slots = malloc(RECORD_QUEUE_SIZE * sizeof(RecordSlot));
+    rec->video = fopen(filename, "wb");
+    if (!rec->slots || !rec->video) goto fail;
+
+    if (rec->format == RECORD_Y4M) {
+        // Frame rate = CPU clock / cycles per frame (~59.73 fps)
+        fprintf(rec->video, "YUV4MPEG2 W%d H%d F%d:%d Ip A1:1 C444\n",
+                SCREEN_WIDTH, SCREEN_HEIGHT, RECORD_CLOCK, PPU_FRAME_CYCLES);
+
+        char *wav = malloc(len + 1);
+        if (!wav) goto fail;
+        memcpy(wav, filename, len - 4);
+        strcpy(wav + len - 4, ".wav");
+        rec->audio = fopen(wav, "wb");
+        free(wav);
+        if (!rec->audio || write_wav_header(rec->audio, 0) != 0) goto fail;
+    } else {
+        uint8_t header[10];
+        memcpy(header, "GBRAW1", 6);
+        put_le16(header + 6, SCREEN_WIDTH);
+        put_le16(header + 8, SCREEN_HEIGHT);
+        fwrite(header, 1, sizeof(header), rec->video);
+    }
+
+    pthread_mutex_init(&rec->lock, NULL);
+    pthread_cond_init(&rec->notEmpty, NULL);
+    pthread_cond_init(&rec->notFull, NULL);
+    if (pthread_create(&rec->thread, NULL, record_writer, rec) != 0) {
+        pthread_mutex_destroy(&rec->lock);
+        pthread_cond_destroy(&rec->notEmpty);
+        pthread_cond_destroy(&rec->notFull);
+        goto fail;
+    }
+    return 0;
+
+fail:
+    if (rec->video) fclose(rec->video);
+    if (rec->audio) fclose(rec->audio);
+    free(rec->slots);
+    memset(rec, 0, sizeof(Recorder));
+    return -1;
+}
+
+// Called once per completed frame, never waits for the writer
+void record_frame(Recorder *rec, const PPU *ppu, uint8_t cgb) {
+    if (!rec->slots) return;
+
+    rec->frames++;
+    uint64_t due = rec->frames * RECORD_SAMPLE_RATE * PPU_FRAME_CYCLES / RECORD_CLOCK;
+    rec->pendingSamples += (uint32_t)(due - rec->sampleClock);
+    rec->sampleClock = due;
+
+    // The PPU knows when nothing was redrawn since its previous frame, which is
+    // the last queued picture unless a frame was dropped in between: then compare
+    if (rec->haveLast && cgb == rec->lastCgb &&
+        ((ppu->frameUnchanged && !rec->droppedSinceLast) ||
+         (cgb ? memcmp(ppu->colorFramebuffer, rec->lastColorFramebuffer, sizeof(rec->lastColorFramebuffer))
+              : memcmp(ppu->framebuffer, rec->lastFramebuffer, sizeof(rec->lastFramebuffer))) == 0)) {
+        rec->duplicates++;
+        rec->pendingRepeats++;
+        return;
+    }
+
+    pthread_mutex_lock(&rec->lock);
+    int queued = rec->count;
+    RecordSlot *slot = &rec->slots[rec->tail]; // not visible to the writer until count++
+    pthread_mutex_unlock(&rec->lock);
+
+    // Writer falling behind (or sharing our core): give it the CPU, without waiting on it
+    if (queued >= RECORD_QUEUE_SIZE * 3 / 4) sched_yield();
+    int full = queued == RECORD_QUEUE_SIZE;
+
+    if (full) {
+        // Keep the timing: the frame becomes a repeat of the last picture
+        rec->dropped++;
+        rec->pendingRepeats++;
+        rec->droppedSinceLast = 1;
+        return;
+    }
+
+    slot->repeats = rec->pendingRepeats;
+    slot->samples = rec->pendingSamples;
+    slot->hasPicture = 1;
+    slot->cgb = cgb;
+    if (cgb) {
+        memcpy(slot->colorFramebuffer, ppu->colorFramebuffer, sizeof(slot->colorFramebuffer));
+        memcpy(rec->lastColorFramebuffer, ppu->colorFramebuffer, sizeof(rec->lastColorFramebuffer));
+    } else {
+        memcpy(slot->framebuffer, ppu->framebuffer, sizeof(slot->framebuffer));
+        memcpy(rec->lastFramebuffer, ppu->framebuffer, sizeof(rec->lastFramebuffer));
+    }
+    rec->lastCgb = cgb;
+    rec->haveLast = 1;
+    rec->droppedSinceLast = 0;
+    rec->pendingRepeats = 0;
+    rec->pendingSamples = 0;
+
+    pthread_mutex_lock(&rec->lock);
+    rec->tail = (rec->tail + 1) % RECORD_QUEUE_SIZE;
+    rec->count++;
+    pthread_cond_signal(&rec->notEmpty);
+    pthread_mutex_unlock(&rec->lock);
+}
+
+// Flush the queue, finish the files; -1 if anything failed to be written
+int record_close(Recorder *rec) {
+    if (!rec->slots) return -1;
+
+    pthread_mutex_lock(&rec->lock);
+    if (rec->pendingRepeats || rec->pendingSamples) {
+        while (rec->count == RECORD_QUEUE_SIZE) pthread_cond_wait(&rec->notFull, &rec->lock);
+        RecordSlot *slot = &rec->slots[rec->tail];
+        slot->repeats = rec->pendingRepeats;
+        slot->samples = rec->pendingSamples;
+        slot->hasPicture = 0;
+        rec->tail = (rec->tail + 1) % RECORD_QUEUE_SIZE;
+        rec->count++;
+    }
+    rec->quit = 1;
+    pthread_cond_signal(&rec->notEmpty);
+    pthread_mutex_unlock(&rec->lock);
+    pthread_join(rec->thread, NULL);
+
+    pthread_mutex_destroy(&rec->lock);
+    pthread_cond_destroy(&rec->notEmpty);
+    pthread_cond_destroy(&rec->notFull);
+
+    if (rec->audio) {
+        if (fseek(rec->audio, 0, SEEK_SET) != 0 || write_wav_header(rec->audio, (uint32_t)rec->audioBytes) != 0) {
+            rec->error = 1;
+        }
+        if (fclose(rec->audio) != 0) rec->error = 1;
+    }
+    if (fclose(rec->video) != 0) rec->error = 1;
+
+    free(rec->slots);
+    rec->slots = NULL;
+    return rec->error ? -1 : 0;
+}
@@ -0,0 +1,299 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <limits.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "../includes/romindex.h"
+
+static uint64_t path_hash(const char *path) {
+    uint64_t h = 0xCBF29CE484222325ull;
+    while (*path) {
+        h ^= (uint8_t)*path++;
+        h *= 0x100000001B3ull;
+    }
+    return h;
+}
+
+static int is_rom_name(const char *name) {
+    const char *dot = strrchr(name, '.');
+    if (!dot) return 0;
+    return strcasecmp(dot, ".gb") == 0 || strcasecmp(dot, ".gbc") == 0 || strcasecmp(dot, ".sgb") == 0;
+}
+
+// ===== Directory walk (one thread, it only reads directories) =====
+typedef struct {
+    char **paths;
+    uint32_t count, capacity;
+} PathList;
+
+static int path_list_add(PathList *list, const char *path) {
+    if (list->count == list->capacity) {
+        uint32_t capacity = list->capacity ? list->capacity * 2 : 1024;
+        char **paths = realloc(list->paths, capacity * sizeof(char *));
+        if (!paths) return -1;
+        list->paths = paths;
+        list->capacity = capacity;
+    }
+    list->paths[list->count] = strdup(path);
+    if (!list->paths[list->count]) return -1;
+    list->count++;
+    return 0;
+}
+
+static int walk(const char *dir, PathList *list) {
+    DIR *d = opendir(dir);
+    if (!d) return 0; // unreadable directory: skipped
+
+    struct dirent *e;
+    char path[PATH_MAX];
+    int err = 0;
+    while (!err && (e = readdir(d)) != NULL) {
+        if (e->d_name[0] == '.') continue;
+        if (snprintf(path, sizeof(path), "%s/%s", dir, e->d_name) >= (int)sizeof(path)) continue;
+
+        int isDir = e->d_type == DT_DIR, isFile = e->d_type == DT_REG;
+        if (e->d_type == DT_UNKNOWN || e->d_type == DT_LNK) {
+            struct stat st;
+            if (stat(path, &st) != 0) continue;
+            isDir = S_ISDIR(st.st_mode);
+            isFile = S_ISREG(st.st_mode);
+        }
+        if (isDir && e->d_type != DT_LNK) err = walk(path, list); // no symlinked dirs: no loops
+        else if (isFile && is_rom_name(e->d_name)) {
+            // Symlinked ROMs are stored under their target, like realpath() gives at lookup
+            char target[PATH_MAX];
+            if (e->d_type == DT_LNK && !realpath(path, target)) continue;
+            err = path_list_add(list, e->d_type == DT_LNK ? target : path);
+        }
+    }
+    closedir(d);
+    return err;
+}
+
+// ===== Parsing (worker threads) =====
+typedef struct {
+    const PathList *list;
+    RomIndexEntry *entries;
+    uint8_t *ok;
+    uint32_t next;            // shared, taken with __atomic_fetch_add
+    uint64_t bytes;           // shared
+} ScanJob;
+
+static int scan_file(const char *path, RomIndexEntry *entry) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return -1;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < CARTRIDGE_HEADER_END) {
+        close(fd);
+        return -1;
+    }
+
+    // mmap: no copy, the page cache is read as the CRC walks through it
+    void *data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) return -1;
+    madvise(data, (size_t)st.st_size, MADV_SEQUENTIAL);
+
+    int res = cartridge_parse_header(data, (size_t)st.st_size, &entry->header);
+    munmap(data, (size_t)st.st_size);
+
+    entry->pathHash = path_hash(path);
+    entry->fileSize = (uint64_t)st.st_size;
+    entry->mtime = (int64_t)st.st_mtime;
+    return res;
+}
+
+static void *scan_worker(void *arg) {
+    ScanJob *job = arg;
+
+    for (;;) {
+        uint32_t i = __atomic_fetch_add(&job->next, 1, __ATOMIC_RELAXED);
+        if (i >= job->list->count) break;
+
+        if (scan_file(job->list->paths[i], &job->entries[i]) == 0) {
+            job->ok[i] = 1;
+            __atomic_fetch_add(&job->bytes, job->entries[i].fileSize, __ATOMIC_RELAXED);
+        }
+    }
+    return NULL;
+}
+
+static int compare_entries(const void *a, const void *b) {
+    uint64_t ha = ((const RomIndexEntry *)a)->pathHash, hb = ((const RomIndexEntry *)b)->pathHash;
+    return ha < hb ? -1 : ha > hb;
+}
+
+// ===== Build =====
+// jobs <= 0: one thread per online CPU. The index is written next to `filename` then renamed over it
+int romindex_build(const char *root, const char *filename, int jobs, RomIndexStats *stats) {
+    PathList list = { 0 };
+    RomIndexEntry *entries = NULL;
+    uint8_t *ok = NULL;
+    char *strings = NULL;
+    int res = -1;
+
+    char rootPath[PATH_MAX];
+    if (!realpath(root, rootPath)) return -1;
+    if (walk(rootPath, &list) != 0) goto done;
+
+    if (jobs <= 0) jobs = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (jobs < 1) jobs = 1;
+    if ((uint32_t)jobs > list.count) jobs = list.count ? (int)list.count : 1;
+
+    entries = calloc(list.count ? list.count : 1, sizeof(RomIndexEntry));
+    ok = calloc(list.count ? list.count : 1, 1);
+    if (!entries || !ok) goto done;
+
+    ScanJob job = { .list = &list, .entries = entries, .ok = ok };
+    pthread_t threads[64];
+    int started = 0;
+    if (jobs > 64) jobs = 64;
+    for (int t = 1; t < jobs; t++) {
+        if (pthread_create(&threads[started], NULL, scan_worker, &job) == 0) started++;
+    }
+    scan_worker(&job); // the calling thread works too
+    for (int t = 0; t < started; t++) pthread_join(threads[t], NULL);
+
+    // Keep the parsed ones, paths go to the string table
+    uint32_t count = 0;
+    uint64_t stringsSize = 0;
+    for (uint32_t i = 0; i < list.count; i++) {
+        if (ok[i]) stringsSize += strlen(list.paths[i]) + 1;
+    }
+    strings = malloc(stringsSize ? stringsSize : 1);
+    if (!strings) goto done;
+
+    uint64_t offset = 0;
+    for (uint32_t i = 0; i < list.count; i++) {
+        if (!ok[i]) continue;
+        size_t len = strlen(list.paths[i]) + 1;
+        memcpy(strings + offset, list.paths[i], len);
+        entries[count] = entries[i];
+        entries[count].pathOffset = offset;
+        offset += len;
+        count++;
+    }
+    qsort(entries, count, sizeof(RomIndexEntry), compare_entries);
+
+    RomIndexFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, ROMINDEX_MAGIC, sizeof(header.magic));
+    header.version = ROMINDEX_VERSION;
+    header.entrySize = sizeof(RomIndexEntry);
+    header.count = count;
+    header.stringsOffset = sizeof(header) + (uint64_t)count * sizeof(RomIndexEntry);
+    header.stringsSize = stringsSize;
+
+    char tmp[PATH_MAX];
+    if (snprintf(tmp, sizeof(tmp), "%s.tmp", filename) >= (int)sizeof(tmp)) goto done;
+    FILE *f = fopen(tmp, "wb");
+    if (!f) goto done;
+    int err = fwrite(&header, sizeof(header), 1, f) != 1;
+    if (count) err |= fwrite(entries, sizeof(RomIndexEntry), count, f) != count;
+    if (stringsSize) err |= fwrite(strings, 1, stringsSize, f) != stringsSize;
+    err |= fclose(f) != 0;
+    if (err || rename(tmp, filename) != 0) {
+        remove(tmp);
+        goto done;
+    }
+
+    if (stats) {
+        stats->files = list.count;
+        stats->indexed = count;
+        stats->failed = list.count - count;
+        stats->bytes = job.bytes;
+    }
+    res = 0;
+
+done:
+    for (uint32_t i = 0; i < list.count; i++) free(list.paths[i]);
+    free(list.paths);
+    free(entries);
+    free(ok);
+    free(strings);
+    return res;
+}
+
+// ===== Lookup =====
+int romindex_open(RomIndex *index, const char *filename) {
+    memset(index, 0, sizeof(RomIndex));
+
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) return -1;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(RomIndexFileHeader)) {
+        close(fd);
+        return -1;
+    }
+    void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return -1;
+
+    const RomIndexFileHeader *header = map;
+    uint64_t entriesEnd = sizeof(RomIndexFileHeader) + (uint64_t)header->count * sizeof(RomIndexEntry);
+    if (memcmp(header->magic, ROMINDEX_MAGIC, sizeof(header->magic)) != 0 ||
+        header->version != ROMINDEX_VERSION || header->entrySize != sizeof(RomIndexEntry) ||
+        header->stringsOffset != entriesEnd || entriesEnd + header->stringsSize > (uint64_t)st.st_size) {
+        munmap(map, (size_t)st.st_size);
+        return -1;
+    }
+
+    index->map = map;
+    index->mapSize = (size_t)st.st_size;
+    index->header = header;
+    index->entries = (const RomIndexEntry *)(header + 1);
+    index->strings = (const char *)map + header->stringsOffset;
+    return 0;
+}
+
+void romindex_close(RomIndex *index) {
+    if (index->map) munmap(index->map, index->mapSize);
+    memset(index, 0, sizeof(RomIndex));
+}
+
+const char *romindex_path(const RomIndex *index, const RomIndexEntry *entry) {
+    if (entry->pathOffset >= index->header->stringsSize) return "";
+    return index->strings + entry->pathOffset;
+}
+
+// Binary search on the path hash (the path is resolved like at build time)
+const RomIndexEntry *romindex_find_path(const RomIndex *index, const char *path) {
+    char resolved[PATH_MAX];
+
+    if (!index->map || !realpath(path, resolved)) return NULL;
+    uint64_t hash = path_hash(resolved);
+
+    uint32_t lo = 0, hi = index->header->count;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (index->entries[mid].pathHash < hash) lo = mid + 1;
+        else hi = mid;
+    }
+    for (; lo < index->header->count && index->entries[lo].pathHash == hash; lo++) {
+        if (strcmp(romindex_path(index, &index->entries[lo]), resolved) == 0) return &index->entries[lo];
+    }
+    return NULL;
+}
+
+// Linear: the index isn't sorted by CRC (same ROM under several names is fine)
+const RomIndexEntry *romindex_find_crc(const RomIndex *index, uint32_t crc) {
+    if (!index->map) return NULL;
+    for (uint32_t i = 0; i < index->header->count; i++) {
+        if (index->entries[i].header.crc32 == crc) return &index->entries[i];
+    }
+    return NULL;
+}
+
+// 1 if the file still has the size and mtime it had when indexed
+int romindex_entry_fresh(const RomIndexEntry *entry, const char *path) {
+    struct stat st;
+    if (stat(path, &st) != 0) return 0;
+    return (uint64_t)st.st_size == entry->fileSize && (int64_t)st.st_mtime == entry->mtime;
+}
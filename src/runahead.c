@@ -0,0 +1,77 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "../includes/runahead.h"
+
+static uint64_t runahead_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+int runahead_init(RunAhead *ra, GameBoy *gb, uint8_t frames) {
+    if (frames > RUNAHEAD_MAX_FRAMES) return -1;
+    memset(ra, 0, sizeof(RunAhead));
+    ra->gb = gb;
+    ra->frames = frames;
+    ra->budgetNs = RUNAHEAD_BUDGET_NS;
+    return 0;
+}
+
+// Average over ~16 frames: one slow frame (page faults, the host) doesn't
+// lower anything, a run-ahead that doesn't fit does
+static void runahead_account(RunAhead *ra, uint64_t ns) {
+    ra->runs++;
+    ra->costNs += ns;
+    if (ns > ra->costMaxNs) ra->costMaxNs = ns;
+    if (ns > ra->budgetNs) ra->overBudget++;
+
+    ra->averageNs = ra->averageNs ? (ra->averageNs * 15 + ns) / 16 : ns;
+    if (ra->frames && ra->runs >= 16 && ra->averageNs > ra->budgetNs) {
+        ra->frames--;
+        ra->lowered++;
+        ra->averageNs = 0;
+    }
+}
+
+// The fork is kept until the next call: the PPU returned stays valid until then
+const PPU *runahead_run_frame(RunAhead *ra) {
+    GameBoy *gb = ra->gb;
+    uint64_t start = runahead_now_ns();
+    uint64_t frames = gb->frames;
+    uint8_t ahead = ra->frames;
+
+    if (ahead) gb->ppu.skipFrame = 1;
+    gb_run_frame(gb);
+
+    // Stopped by the debugger in the middle of the frame: nothing to run ahead of
+    if (!ahead || gb->frames == frames) return &gb->ppu;
+
+    if (ra->forked) gb_free(&ra->ahead);
+    ra->forked = gb_fork(&ra->ahead, gb) == 0;
+    if (!ra->forked) return &gb->ppu; // out of memory: this frame wasn't drawn, the previous one stays
+
+    for (uint8_t n = 1; n <= ahead; n++) {
+        ra->ahead.ppu.skipFrame = n < ahead;
+        gb_run_frame(&ra->ahead);
+    }
+
+    runahead_account(ra, runahead_now_ns() - start);
+    return &ra->ahead.ppu;
+}
+
+void runahead_report(const RunAhead *ra, FILE *out) {
+    fprintf(out, "Run-ahead: %u frames, %llu runs", ra->frames, (unsigned long long)ra->runs);
+    if (ra->runs) {
+        fprintf(out, ", %.2f ms avg, %.2f ms max (budget %.2f ms, %llu over)",
+                ra->costNs / 1e6 / ra->runs, ra->costMaxNs / 1e6, ra->budgetNs / 1e6,
+                (unsigned long long)ra->overBudget);
+    }
+    if (ra->lowered) fprintf(out, ", lowered %llu times", (unsigned long long)ra->lowered);
+    fputc('\n', out);
+}
+
+void runahead_free(RunAhead *ra) {
+    if (ra->forked) gb_free(&ra->ahead);
+    ra->forked = 0;
+}
@@ -0,0 +1,160 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../includes/stats.h"
+
+static const char *region_names[REGION_COUNT] = {
+    "ROM0", "ROMX", "VRAM", "ERAM", "WRAM", "ECHO", "OAM", "UNUSABLE", "IO", "HRAM", "IE"
+};
+
+#ifdef GB_STATS
+
+Stats gb_stats = { .frameNsMin = UINT64_MAX };
+
+uint64_t stats_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+void stats_frame_end(uint64_t start_ns) {
+    uint64_t ns = stats_now_ns() - start_ns;
+    gb_stats.frames++;
+    gb_stats.frameNsTotal += ns;
+    if (ns < gb_stats.frameNsMin) gb_stats.frameNsMin = ns;
+    if (ns > gb_stats.frameNsMax) gb_stats.frameNsMax = ns;
+}
+
+int stats_enabled(void) {
+    return 1;
+}
+
+// Sort opcode indexes by a counter, biggest first
+static const uint64_t *sort_key;
+
+static int compare_desc(const void *a, const void *b) {
+    uint64_t ka = sort_key[*(const uint8_t *)a];
+    uint64_t kb = sort_key[*(const uint8_t *)b];
+    return (ka < kb) - (ka > kb);
+}
+
+static int sorted_opcodes(const uint64_t *key, uint8_t order[256]) {
+    int n = 0;
+    for (int op = 0; op < 256; op++) {
+        if (key[op]) order[n++] = (uint8_t)op;
+    }
+    sort_key = key;
+    qsort(order, n, 1, compare_desc);
+    return n;
+}
+
+void stats_report(FILE *out) {
+    uint8_t order[256];
+    uint64_t totalCycles = 0, totalOps = 0;
+
+    for (int op = 0; op < 256; op++) {
+        totalCycles += gb_stats.opcodeCycles[op];
+        totalOps += gb_stats.opcodeCount[op];
+    }
+
+    fprintf(out, "\n===== Stats =====\n");
+    fprintf(out, "Instructions: %llu, cycles: %llu\n",
+        (unsigned long long)totalOps, (unsigned long long)totalCycles);
+
+    if (gb_stats.frames) {
+        double avg = (double)gb_stats.frameNsTotal / gb_stats.frames;
+        fprintf(out, "Frames: %llu, host time/frame: avg %.1f us, min %.1f us, max %.1f us (%.1f fps)\n",
+            (unsigned long long)gb_stats.frames, avg / 1000.0,
+            gb_stats.frameNsMin / 1000.0, gb_stats.frameNsMax / 1000.0, 1e9 / avg);
+    }
+    fprintf(out, "PPU lines rendered: %llu (%llu reused unchanged)\n", (unsigned long long)gb_stats.linesRendered,
+            (unsigned long long)gb_stats.linesCached);
+
+    fprintf(out, "\n-- Opcodes (by cycles) --\n");
+    fprintf(out, "  OP        count        cycles      %%\n");
+    int n = sorted_opcodes(gb_stats.opcodeCycles, order);
+    for (int i = 0; i < n; i++) {
+        uint8_t op = order[i];
+        fprintf(out, "  0x%02X %12llu %13llu  %5.2f\n", op,
+            (unsigned long long)gb_stats.opcodeCount[op],
+            (unsigned long long)gb_stats.opcodeCycles[op],
+            totalCycles ? 100.0 * gb_stats.opcodeCycles[op] / totalCycles : 0.0);
+    }
+
+    n = sorted_opcodes(gb_stats.cbCount, order);
+    if (n) {
+        fprintf(out, "\n-- CB opcodes (by count) --\n");
+        for (int i = 0; i < n; i++) {
+            fprintf(out, "  CB 0x%02X %12llu\n", order[i], (unsigned long long)gb_stats.cbCount[order[i]]);
+        }
+    }
+
+    fprintf(out, "\n-- Memory --\n");
+    fprintf(out, "  REGION          reads       writes\n");
+    for (int r = 0; r < REGION_COUNT; r++) {
+        if (!gb_stats.reads[r] && !gb_stats.writes[r]) continue;
+        fprintf(out, "  %-8s %12llu %12llu\n", region_names[r],
+            (unsigned long long)gb_stats.reads[r], (unsigned long long)gb_stats.writes[r]);
+    }
+}
+
+static void json_opcodes(FILE *f, const char *name, const uint64_t *count, const uint64_t *cycles) {
+    uint8_t order[256];
+    int n = sorted_opcodes(cycles ? cycles : count, order);
+
+    fprintf(f, "  \"%s\": [", name);
+    for (int i = 0; i < n; i++) {
+        uint8_t op = order[i];
+        fprintf(f, "%s\n    {\"op\": \"0x%02X\", \"count\": %llu", i ? "," : "", op,
+            (unsigned long long)count[op]);
+        if (cycles) fprintf(f, ", \"cycles\": %llu", (unsigned long long)cycles[op]);
+        fprintf(f, "}");
+    }
+    fprintf(f, "\n  ],\n");
+}
+
+int stats_write_json(const char *filename) {
+    FILE *f = fopen(filename, "w");
+    if (!f) return -1;
+
+    fprintf(f, "{\n");
+    fprintf(f, "  \"frames\": %llu,\n", (unsigned long long)gb_stats.frames);
+    fprintf(f, "  \"frame_ns\": {\"total\": %llu, \"avg\": %llu, \"min\": %llu, \"max\": %llu},\n",
+        (unsigned long long)gb_stats.frameNsTotal,
+        (unsigned long long)(gb_stats.frames ? gb_stats.frameNsTotal / gb_stats.frames : 0),
+        (unsigned long long)(gb_stats.frames ? gb_stats.frameNsMin : 0),
+        (unsigned long long)gb_stats.frameNsMax);
+    fprintf(f, "  \"ppu_lines\": %llu,\n", (unsigned long long)gb_stats.linesRendered);
+    fprintf(f, "  \"ppu_lines_cached\": %llu,\n", (unsigned long long)gb_stats.linesCached);
+    json_opcodes(f, "opcodes", gb_stats.opcodeCount, gb_stats.opcodeCycles);
+    json_opcodes(f, "cb_opcodes", gb_stats.cbCount, NULL);
+
+    fprintf(f, "  \"memory\": {");
+    for (int r = 0; r < REGION_COUNT; r++) {
+        fprintf(f, "%s\n    \"%s\": {\"reads\": %llu, \"writes\": %llu}", r ? "," : "", region_names[r],
+            (unsigned long long)gb_stats.reads[r], (unsigned long long)gb_stats.writes[r]);
+    }
+    fprintf(f, "\n  }\n}\n");
+
+    fclose(f);
+    return 0;
+}
+
+#else
+
+int stats_enabled(void) {
+    return 0;
+}
+
+void stats_report(FILE *out) {
+    (void)region_names;
+    fprintf(out, "Stats not compiled in, rebuild with `make rebuild STATS=1`\n");
+}
+
+int stats_write_json(const char *filename) {
+    (void)filename;
+    return -1;
+}
+
+#endif
@@ -0,0 +1,579 @@
+#include <stdlib.h>
+#include <string.h>
+#include "../includes/trace.h"
+
+#define TRACE_HEADER_SIZE 12 // magic + flags
+#define TRACE_BLOCK_HEADER 40
+#define TRACE_MAX_RECORD  (32 + TRACE_MAX_ACCESSES * 5)
+#define TRACE_PACKED_SIZE (TRACE_BLOCK_SIZE + TRACE_BLOCK_SIZE / 255 + 16)
+#define TRACE_ALL_PAGES   0xFFFF
+
+// ===== Encoding helpers =====
+static inline uint8_t *put_varint(uint8_t *p, uint64_t v) {
+    while (v >= 0x80) {
+        *p++ = (uint8_t)v | 0x80;
+        v >>= 7;
+    }
+    *p++ = (uint8_t)v;
+    return p;
+}
+
+static inline int get_varint(const uint8_t **p, const uint8_t *end, uint64_t *v) {
+    uint64_t value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (*p >= end) return -1;
+        uint8_t b = *(*p)++;
+        value |= (uint64_t)(b & 0x7F) << shift;
+        if (!(b & 0x80)) {
+            *v = value;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// 16-bit deltas wrap around: PC 0xFFFF -> 0x0000 is +1
+static inline uint64_t zigzag16(uint16_t to, uint16_t from) {
+    int32_t d = (int16_t)(uint16_t)(to - from);
+    return (uint32_t)((d << 1) ^ (d >> 31));
+}
+
+static inline uint16_t unzigzag16(uint16_t from, uint64_t z) {
+    int32_t d = (int32_t)(z >> 1) ^ -(int32_t)(z & 1);
+    return (uint16_t)(from + d);
+}
+
+static void put_le(uint8_t *p, uint64_t v, int bytes) {
+    for (int i = 0; i < bytes; i++) p[i] = (uint8_t)(v >> (i * 8));
+}
+
+static uint64_t get_le(const uint8_t *p, int bytes) {
+    uint64_t v = 0;
+    for (int i = 0; i < bytes; i++) v |= (uint64_t)p[i] << (i * 8);
+    return v;
+}
+
+static void trace_cpu_regs(const CPU *cpu, uint8_t regs[8]) {
+    regs[TRACE_REG_A] = cpu->A;
+    regs[TRACE_REG_F] = cpu->F;
+    regs[TRACE_REG_B] = cpu->B;
+    regs[TRACE_REG_C] = cpu->C;
+    regs[TRACE_REG_D] = cpu->D;
+    regs[TRACE_REG_E] = cpu->E;
+    regs[TRACE_REG_H] = cpu->H;
+    regs[TRACE_REG_L] = cpu->L;
+}
+
+// ===== Block compression =====
+// LZ77 with LZ4-style sequences: token (literal length << 4 | match length - 4,
+// 15 = more bytes follow, each 255 = keep going), literals, u16 offset. The
+// last sequence has literals only.
+#define LZ_HASH_BITS 12
+#define LZ_MIN_MATCH 4
+
+static inline uint32_t lz_read32(const uint8_t *p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+static inline uint8_t *lz_put_length(uint8_t *op, size_t len) {
+    while (len >= 255) {
+        *op++ = 255;
+        len -= 255;
+    }
+    *op++ = (uint8_t)len;
+    return op;
+}
+
+static inline uint8_t *lz_put_literals(uint8_t *op, const uint8_t *lit, size_t len, uint8_t *token) {
+    *token = (uint8_t)((len >= 15 ? 15 : len) << 4);
+    if (len >= 15) op = lz_put_length(op, len - 15);
+    memcpy(op, lit, len);
+    return op + len;
+}
+
+// Returns the compressed size, 0 when it doesn't fit in capacity
+size_t trace_compress(const uint8_t *src, size_t size, uint8_t *dst, size_t capacity) {
+    uint32_t table[1 << LZ_HASH_BITS];
+    const uint8_t *ip = src, *anchor = src, *end = src + size;
+    uint8_t *op = dst, *oend = dst + capacity;
+
+    memset(table, 0, sizeof(table));
+    while (ip + LZ_MIN_MATCH <= end) {
+        uint32_t h = (lz_read32(ip) * 2654435761u) >> (32 - LZ_HASH_BITS);
+        const uint8_t *ref = src + table[h];
+        table[h] = (uint32_t)(ip - src);
+        if (ref >= ip || ip - ref > 0xFFFF || lz_read32(ref) != lz_read32(ip)) {
+            ip++;
+            continue;
+        }
+
+        size_t match = LZ_MIN_MATCH;
+        while (ip + match < end && ref[match] == ip[match]) match++;
+        size_t lit = (size_t)(ip - anchor);
+        if ((size_t)(oend - op) < lit + lit / 255 + match / 255 + 5) return 0;
+
+        uint8_t *token = op++;
+        op = lz_put_literals(op, anchor, lit, token);
+        put_le(op, (uint64_t)(ip - ref), 2);
+        op += 2;
+        size_t extra = match - LZ_MIN_MATCH;
+        *token |= extra >= 15 ? 15 : (uint8_t)extra;
+        if (extra >= 15) op = lz_put_length(op, extra - 15);
+
+        ip += match;
+        anchor = ip;
+    }
+
+    size_t lit = (size_t)(end - anchor);
+    if ((size_t)(oend - op) < lit + lit / 255 + 2) return 0;
+    uint8_t *token = op++;
+    op = lz_put_literals(op, anchor, lit, token);
+    return (size_t)(op - dst);
+}
+
+// Returns the decompressed size, -1 on corrupt input
+long trace_decompress(const uint8_t *src, size_t size, uint8_t *dst, size_t capacity) {
+    const uint8_t *ip = src, *iend = src + size;
+    uint8_t *op = dst, *oend = dst + capacity;
+
+    while (ip < iend) {
+        uint8_t token = *ip++;
+        size_t lit = token >> 4, match = token & 0x0F;
+        uint8_t b;
+
+        if (lit == 15) {
+            do {
+                if (ip >= iend) return -1;
+                b = *ip++;
+                lit += b;
+            } while (b == 255);
+        }
+        if (lit > (size_t)(iend - ip) || lit > (size_t)(oend - op)) return -1;
+        memcpy(op, ip, lit);
+        op += lit;
+        ip += lit;
+        if (ip == iend) break; // last sequence
+
+        if (iend - ip < 2) return -1;
+        size_t offset = (size_t)get_le(ip, 2);
+        ip += 2;
+        if (offset == 0 || offset > (size_t)(op - dst)) return -1;
+        if (match == 15) {
+            do {
+                if (ip >= iend) return -1;
+                b = *ip++;
+                match += b;
+            } while (b == 255);
+        }
+        match += LZ_MIN_MATCH;
+        if (match > (size_t)(oend - op)) return -1;
+
+        const uint8_t *ref = op - offset;
+        for (size_t i = 0; i < match; i++) op[i] = ref[i]; // may overlap (repeats)
+        op += match;
+    }
+    return (long)(op - dst);
+}
+
+// ===== Writer thread =====
+static void trace_write_block(Tracer *tracer, const TraceBlock *block) {
+    uint8_t header[TRACE_BLOCK_HEADER];
+    const TraceState *s = &block->start;
+    size_t packed = trace_compress(block->data, block->used, tracer->packed, block->used - 1); // smaller or stored
+    const uint8_t *data = packed ? tracer->packed : block->data;
+    size_t stored = packed ? packed : block->used;
+
+    put_le(header, block->used, 4);
+    put_le(header + 4, stored, 4);
+    put_le(header + 8, s->index, 8);
+    put_le(header + 16, s->cycle, 8);
+    memcpy(header + 24, s->regs, 8);
+    put_le(header + 32, s->SP, 2);
+    put_le(header + 34, s->PC, 2);
+    put_le(header + 36, s->addr, 2);
+    put_le(header + 38, 0, 2);
+
+    if (fwrite(header, 1, sizeof(header), tracer->file) != sizeof(header) ||
+        fwrite(data, 1, stored, tracer->file) != stored) {
+        tracer->error = -1;
+    }
+    tracer->fileBytes += sizeof(header) + stored;
+}
+
+static void *trace_writer(void *arg) {
+    Tracer *tracer = arg;
+
+    pthread_mutex_lock(&tracer->lock);
+    for (;;) {
+        while (tracer->count == 0 && !tracer->quit) pthread_cond_wait(&tracer->notEmpty, &tracer->lock);
+        if (tracer->count == 0) break;
+
+        TraceBlock *block = tracer->slots[tracer->head];
+        tracer->head = (tracer->head + 1) % TRACE_QUEUE_SIZE;
+        tracer->count--;
+        pthread_cond_signal(&tracer->notFull);
+        pthread_mutex_unlock(&tracer->lock);
+
+        trace_write_block(tracer, block);
+
+        pthread_mutex_lock(&tracer->lock);
+        tracer->spare[tracer->spareCount++] = block;
+    }
+    pthread_mutex_unlock(&tracer->lock);
+    return NULL;
+}
+
+// Hand the current block to the writer (waits while the queue is full) and take an empty one
+static void trace_push(Tracer *tracer) {
+    tracer->rawBytes += tracer->block->used;
+
+    pthread_mutex_lock(&tracer->lock);
+    if (tracer->count == TRACE_QUEUE_SIZE) tracer->stalls++;
+    while (tracer->count == TRACE_QUEUE_SIZE) pthread_cond_wait(&tracer->notFull, &tracer->lock);
+
+    tracer->slots[tracer->tail] = tracer->block;
+    tracer->tail = (tracer->tail + 1) % TRACE_QUEUE_SIZE;
+    tracer->count++;
+    pthread_cond_signal(&tracer->notEmpty);
+    tracer->block = tracer->spare[--tracer->spareCount];
+    pthread_mutex_unlock(&tracer->lock);
+
+    tracer->block->used = 0;
+}
+
+// ===== Producer side =====
+static void trace_on_access(void *ctx, uint16_t addr, uint8_t val, uint8_t write) {
+    Tracer *tracer = ctx;
+
+    // Fetches read at PC++: PC has already moved past the byte
+    int fetch = !write && !(tracer->stepFlags & TRACE_F_INTERRUPT) && (uint16_t)(addr + 1) == tracer->cpu->PC;
+    if (tracer->inStep && !fetch) {
+        if (tracer->accessCount < TRACE_MAX_ACCESSES) {
+            TraceAccess *a = &tracer->accesses[tracer->accessCount++];
+            a->addr = addr;
+            a->value = val;
+            a->write = write;
+        } else {
+            tracer->accessesLost++;
+        }
+    }
+    if (tracer->chainedHook) tracer->chainedHook(tracer->chainedCtx, addr, val, write);
+}
+
+// Every page on the slow path so the hook sees all accesses; a hook already
+// there (watchpoints) keeps being called
+static void trace_hook(Tracer *tracer) {
+    MMU *mmu = tracer->mmu;
+
+    if (mmu->access_hook != trace_on_access) {
+        tracer->chainedHook = mmu->access_hook;
+        tracer->chainedCtx = mmu->access_ctx;
+    }
+    mmu->access_hook = trace_on_access;
+    mmu->access_ctx = tracer;
+    mmu->trap_read = TRACE_ALL_PAGES;
+    mmu->trap_write = TRACE_ALL_PAGES;
+    mmu_update_map(mmu);
+}
+
+// Before cpu_step: what the step is going to do (same tests as cpu_step)
+void trace_begin_step(Tracer *tracer) {
+    CPU *cpu = tracer->cpu;
+    MMU *mmu = tracer->mmu;
+    uint8_t pending = mmu->interrupt_enable & mmu->io[0x0F] & 0x1F;
+
+    // The debugger rebuilds the traps when its watchpoints change
+    if (mmu->access_hook != trace_on_access || mmu->trap_read != TRACE_ALL_PAGES || mmu->trap_write != TRACE_ALL_PAGES) {
+        trace_hook(tracer);
+    }
+
+    tracer->accessCount = 0;
+    tracer->stepPC = cpu->PC;
+    if (pending && cpu->ime) {
+        tracer->stepFlags = TRACE_F_INTERRUPT;
+    } else if ((cpu->halted && !pending) || (cpu->stopped && !mmu_joypad_wake(mmu)) || cpu->locked) {
+        return; // idle step: only its cycles are counted
+    } else {
+        tracer->stepFlags = 0;
+        tracer->stepOpcode = mmu_peek(mmu, cpu->PC);
+        if (tracer->stepOpcode == 0xCB) {
+            tracer->stepFlags |= TRACE_F_CB;
+            tracer->stepCb = mmu_peek(mmu, (uint16_t)(cpu->PC + 1));
+        }
+    }
+    tracer->inStep = 1;
+}
+
+static void trace_emit(Tracer *tracer) {
+    TraceBlock *block = tracer->block;
+    TraceState *s = &tracer->state;
+    uint8_t regs[8], mask = 0;
+
+    if (block->used + TRACE_MAX_RECORD > TRACE_BLOCK_SIZE) {
+        trace_push(tracer);
+        block = tracer->block;
+    }
+    if (block->used == 0) block->start = *s;
+
+    trace_cpu_regs(tracer->cpu, regs);
+    for (int i = 0; i < 8; i++) {
+        if (regs[i] != s->regs[i]) mask |= 1 << i;
+    }
+
+    uint8_t flags = tracer->stepFlags;
+    if (mask) flags |= TRACE_F_REGS;
+    if (tracer->cpu->SP != s->SP) flags |= TRACE_F_SP;
+    if (tracer->accessCount) flags |= TRACE_F_MEMORY;
+
+    uint8_t *p = block->data + block->used;
+    *p++ = flags;
+    p = put_varint(p, zigzag16(tracer->stepPC, s->PC));
+    p = put_varint(p, tracer->cycles - s->cycle);
+    if (!(flags & TRACE_F_INTERRUPT)) {
+        *p++ = tracer->stepOpcode;
+        if (flags & TRACE_F_CB) *p++ = tracer->stepCb;
+    }
+    if (mask) {
+        *p++ = mask;
+        for (int i = 0; i < 8; i++) {
+            if (mask & (1 << i)) *p++ = regs[i];
+        }
+    }
+    if (flags & TRACE_F_SP) p = put_varint(p, zigzag16(tracer->cpu->SP, s->SP));
+    if (flags & TRACE_F_MEMORY) {
+        p = put_varint(p, tracer->accessCount);
+        for (int i = 0; i < tracer->accessCount; i++) {
+            const TraceAccess *a = &tracer->accesses[i];
+            p = put_varint(p, (zigzag16(a->addr, s->addr) << 1) | a->write);
+            *p++ = a->value;
+            s->addr = a->addr;
+        }
+    }
+    block->used = (uint32_t)(p - block->data);
+
+    memcpy(s->regs, regs, 8);
+    s->SP = tracer->cpu->SP;
+    s->PC = tracer->stepPC;
+    s->cycle = tracer->cycles;
+    s->index++;
+    tracer->records++;
+}
+
+// After cpu_step, with the cycles it returned
+void trace_end_step(Tracer *tracer, uint16_t cycles) {
+    if (tracer->inStep) {
+        trace_emit(tracer);
+        tracer->inStep = 0;
+    }
+    tracer->cycles += cycles;
+}
+
+// ===== Open / close =====
+int trace_open(Tracer *tracer, const char *filename, CPU *cpu, MMU *mmu) {
+    uint8_t header[TRACE_HEADER_SIZE];
+
+    memset(tracer, 0, sizeof(Tracer));
+    tracer->cpu = cpu;
+    tracer->mmu = mmu;
+
+    tracer->file = fopen(filename, "wb");
+    if (!tracer->file) return -1;
+    memcpy(header, TRACE_MAGIC, 8);
+    put_le(header + 8, mmu->cgb ? 1 : 0, 4);
+    if (fwrite(header, 1, sizeof(header), tracer->file) != sizeof(header)) goto fail;
+
+    // Filled + queued + being written
+    for (int i = 0; i < TRACE_QUEUE_SIZE + 2; i++) {
+        TraceBlock *block = malloc(sizeof(TraceBlock));
+        if (!block) goto fail;
+        if (i == 0) tracer->block = block;
+        else tracer->spare[tracer->spareCount++] = block;
+    }
+    tracer->packed = malloc(TRACE_PACKED_SIZE);
+    if (!tracer->packed) goto fail;
+    tracer->block->used = 0;
+
+    trace_cpu_regs(cpu, tracer->state.regs);
+    tracer->state.SP = cpu->SP;
+    tracer->state.PC = cpu->PC;
+
+    pthread_mutex_init(&tracer->lock, NULL);
+    pthread_cond_init(&tracer->notEmpty, NULL);
+    pthread_cond_init(&tracer->notFull, NULL);
+    if (pthread_create(&tracer->thread, NULL, trace_writer, tracer) != 0) {
+        pthread_mutex_destroy(&tracer->lock);
+        pthread_cond_destroy(&tracer->notEmpty);
+        pthread_cond_destroy(&tracer->notFull);
+        goto fail;
+    }
+
+    trace_hook(tracer);
+    return 0;
+
+fail:
+    free(tracer->block);
+    for (int i = 0; i < tracer->spareCount; i++) free(tracer->spare[i]);
+    free(tracer->packed);
+    fclose(tracer->file);
+    memset(tracer, 0, sizeof(Tracer));
+    return -1;
+}
+
+// Flush, stop the writer and give the MMU back its previous hook
+int trace_close(Tracer *tracer) {
+    MMU *mmu = tracer->mmu;
+
+    if (!tracer->file) return -1;
+    if (tracer->block->used) trace_push(tracer);
+
+    pthread_mutex_lock(&tracer->lock);
+    tracer->quit = 1;
+    pthread_cond_signal(&tracer->notEmpty);
+    pthread_mutex_unlock(&tracer->lock);
+    pthread_join(tracer->thread, NULL);
+
+    if (mmu->access_hook == trace_on_access) {
+        mmu->access_hook = tracer->chainedHook;
+        mmu->access_ctx = tracer->chainedCtx;
+        // A chained hook keeps every page trapped: it filters the addresses itself
+        if (!tracer->chainedHook) mmu->trap_read = mmu->trap_write = 0;
+        mmu_update_map(mmu);
+    }
+
+    free(tracer->block);
+    for (int i = 0; i < tracer->spareCount; i++) free(tracer->spare[i]);
+    free(tracer->packed);
+    pthread_mutex_destroy(&tracer->lock);
+    pthread_cond_destroy(&tracer->notEmpty);
+    pthread_cond_destroy(&tracer->notFull);
+    if (fclose(tracer->file) != 0) tracer->error = -1;
+    tracer->file = NULL;
+    return tracer->error;
+}
+
+// ===== Reader =====
+int trace_reader_open(TraceReader *reader, const char *filename) {
+    uint8_t header[TRACE_HEADER_SIZE];
+
+    memset(reader, 0, sizeof(TraceReader));
+    reader->file = fopen(filename, "rb");
+    if (!reader->file) return -1;
+    if (fread(header, 1, sizeof(header), reader->file) != sizeof(header) || memcmp(header, TRACE_MAGIC, 8) != 0) {
+        fclose(reader->file);
+        return -1;
+    }
+    reader->flags = (uint32_t)get_le(header + 8, 4);
+
+    reader->raw = malloc(TRACE_BLOCK_SIZE);
+    reader->packed = malloc(TRACE_PACKED_SIZE);
+    if (!reader->raw || !reader->packed) {
+        trace_reader_close(reader);
+        return -1;
+    }
+    return 0;
+}
+
+// 1 = next block loaded, 0 = end of file, -1 = corrupt
+static int trace_reader_block(TraceReader *reader) {
+    uint8_t header[TRACE_BLOCK_HEADER];
+    size_t n = fread(header, 1, sizeof(header), reader->file);
+
+    if (n == 0) return 0;
+    if (n != sizeof(header)) return -1;
+
+    uint32_t raw = (uint32_t)get_le(header, 4), stored = (uint32_t)get_le(header + 4, 4);
+    if (raw > TRACE_BLOCK_SIZE || stored > raw) return -1;
+    if (stored == raw) {
+        if (fread(reader->raw, 1, raw, reader->file) != raw) return -1;
+    } else {
+        if (fread(reader->packed, 1, stored, reader->file) != stored) return -1;
+        if (trace_decompress(reader->packed, stored, reader->raw, TRACE_BLOCK_SIZE) != (long)raw) return -1;
+    }
+
+    TraceState *s = &reader->state;
+    s->index = get_le(header + 8, 8);
+    s->cycle = get_le(header + 16, 8);
+    memcpy(s->regs, header + 24, 8);
+    s->SP = (uint16_t)get_le(header + 32, 2);
+    s->PC = (uint16_t)get_le(header + 34, 2);
+    s->addr = (uint16_t)get_le(header + 36, 2);
+    reader->used = raw;
+    reader->pos = 0;
+    return 1;
+}
+
+int trace_reader_next(TraceReader *reader, TraceEvent *event) {
+    while (reader->pos >= reader->used) {
+        int res = trace_reader_block(reader);
+        if (res <= 0) return res;
+    }
+
+    TraceState *s = &reader->state;
+    const uint8_t *p = reader->raw + reader->pos, *end = reader->raw + reader->used;
+    uint64_t v;
+
+    event->flags = *p++;
+    if (get_varint(&p, end, &v) != 0) return -1;
+    event->PC = unzigzag16(s->PC, v);
+    if (get_varint(&p, end, &v) != 0) return -1;
+    event->cycle = s->cycle + v;
+    event->index = s->index;
+
+    event->opcode = event->cbOpcode = 0;
+    if (!(event->flags & TRACE_F_INTERRUPT)) {
+        if (p >= end) return -1;
+        event->opcode = *p++;
+        if (event->flags & TRACE_F_CB) {
+            if (p >= end) return -1;
+            event->cbOpcode = *p++;
+        }
+    }
+
+    memcpy(event->regs, s->regs, 8);
+    if (event->flags & TRACE_F_REGS) {
+        if (p >= end) return -1;
+        uint8_t mask = *p++;
+        for (int i = 0; i < 8; i++) {
+            if (!(mask & (1 << i))) continue;
+            if (p >= end) return -1;
+            event->regs[i] = *p++;
+        }
+    }
+
+    event->SP = s->SP;
+    if (event->flags & TRACE_F_SP) {
+        if (get_varint(&p, end, &v) != 0) return -1;
+        event->SP = unzigzag16(s->SP, v);
+    }
+
+    event->accessCount = 0;
+    if (event->flags & TRACE_F_MEMORY) {
+        if (get_varint(&p, end, &v) != 0 || v > TRACE_MAX_ACCESSES) return -1;
+        event->accessCount = (uint16_t)v;
+        for (int i = 0; i < event->accessCount; i++) {
+            TraceAccess *a = &event->accesses[i];
+            if (get_varint(&p, end, &v) != 0 || p >= end) return -1;
+            a->write = v & 1;
+            a->addr = unzigzag16(s->addr, v >> 1);
+            a->value = *p++;
+            s->addr = a->addr;
+        }
+    }
+
+    memcpy(s->regs, event->regs, 8);
+    s->SP = event->SP;
+    s->PC = event->PC;
+    s->cycle = event->cycle;
+    s->index++;
+    reader->pos = (uint32_t)(p - reader->raw);
+    return 1;
+}
+
+void trace_reader_close(TraceReader *reader) {
+    if (reader->file) fclose(reader->file);
+    free(reader->raw);
+    free(reader->packed);
+    memset(reader, 0, sizeof(TraceReader));
+}
@@ -0,0 +1,871 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../includes/video.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define VIDEO_X86 1
+#endif
+
+static const char *filter_names[VIDEO_FILTER_COUNT] = { "nearest", "scale2x", "scale3x", "xbr" };
+static const int filter_factors[VIDEO_FILTER_COUNT] = { 1, 2, 3, 2 };
+
+// RGB555 -> RGBA for CGB frames (128KB, built once)
+static uint32_t cgb_lut[0x8000];
+
+// ===== Kernels (scalar) =====
+static void dmg_row_scalar(uint32_t *dst, const uint8_t *src, int n, const uint32_t *palette) {
+    for (int x = 0; x < n; x++) dst[x] = palette[src[x] & 0x03];
+}
+
+static void cgb_row_scalar(uint32_t *dst, const uint16_t *src, int n) {
+    for (int x = 0; x < n; x++) dst[x] = cgb_lut[src[x] & 0x7FFF];
+}
+
+static void expand2_row_scalar(uint32_t *dst, const uint32_t *src, int n) {
+    for (int x = 0; x < n; x++) dst[2 * x] = dst[2 * x + 1] = src[x];
+}
+
+// LCD ghosting: each channel keeps w/256 of its distance to the previous
+// picture, truncated towards the new value so a still picture settles on its
+// exact colors. line gets the result, ghost keeps it for the next frame
+static void ghost_row_scalar(uint32_t *line, uint32_t *ghost, int n, uint16_t w) {
+    for (int x = 0; x < n; x++) {
+        uint32_t cur = line[x], prev = ghost[x], out = 0;
+        for (int shift = 0; shift < 32; shift += 8) {
+            uint32_t c = (cur >> shift) & 0xFF, p = (prev >> shift) & 0xFF;
+            uint32_t v = p >= c ? c + (((p - c) * w) >> 8) : c - (((c - p) * w) >> 8);
+            out |= v << shift;
+        }
+        line[x] = ghost[x] = out;
+    }
+}
+
+// Scale2x (AdvMAME2x): B above, D left, F right, H below
+static void scale2x_row_scalar(uint32_t *out0, uint32_t *out1, const uint32_t *up,
+                               const uint32_t *row, const uint32_t *down, int n) {
+    for (int x = 0; x < n; x++) {
+        uint32_t B = up[x], D = row[x - 1], E = row[x], F = row[x + 1], H = down[x];
+
+        if (B != H && D != F) {
+            out0[2 * x]     = (D == B) ? D : E;
+            out0[2 * x + 1] = (B == F) ? F : E;
+            out1[2 * x]     = (D == H) ? D : E;
+            out1[2 * x + 1] = (H == F) ? F : E;
+        } else {
+            out0[2 * x] = out0[2 * x + 1] = out1[2 * x] = out1[2 * x + 1] = E;
+        }
+    }
+}
+
+// xBR: pixels and the color distance of each one to its right, lower,
+// lower right and lower left neighbours (see video_xbr_planes), all with the
+// source stride. Every distance xBR looks at is between two such neighbours
+typedef struct {
+    const uint32_t *px;
+    const int16_t *right, *down, *downRight, *downLeft;
+} XbrPlanes;
+
+// Distance between neighbours a and b (the offsets are constants once inlined)
+static inline int xbr_distance(const XbrPlanes *p, int a, int b) {
+    int lo = a < b ? a : b, delta = a < b ? b - a : a - b;
+    if (delta == 1) return p->right[lo];
+    if (delta == VIDEO_SRC_STRIDE) return p->down[lo];
+    if (delta == VIDEO_SRC_STRIDE + 1) return p->downRight[lo];
+    return p->downLeft[lo];
+}
+
+// Color distance of n pixels to the ones delta further, weighted like xBR (48 Y, 7 U, 6 V)
+static void xbr_metric_row_scalar(int16_t *dst, const int16_t *y, const int16_t *u, const int16_t *v,
+                                  int delta, int n) {
+    for (int i = 0; i < n; i++) {
+        dst[i] = (int16_t)(48 * abs(y[i] - y[i + delta]) + 7 * abs(u[i] - u[i + delta]) +
+                           6 * abs(v[i] - v[i + delta]));
+    }
+}
+
+static inline uint32_t xbr_blend(uint32_t a, uint32_t b) {
+    return ((a & 0xFEFEFEFEu) >> 1) + ((b & 0xFEFEFEFEu) >> 1);
+}
+
+// Corner of pixel e towards (dx, dy), both as index offsets (+-1, +-stride)
+__attribute__((always_inline))
+static inline uint32_t xbr_corner(const XbrPlanes *p, int e, int dx, int dy) {
+    int f = e + dx, h = e + dy;
+    uint32_t E = p->px[e];
+
+    if (E == p->px[f] || E == p->px[h]) return E;
+
+    int i = e + dx + dy;
+    int wd1 = xbr_distance(p, e, e + dx - dy) + xbr_distance(p, e, e - dx + dy) +
+              xbr_distance(p, i, e + 2 * dx) + xbr_distance(p, i, e + 2 * dy) + 4 * xbr_distance(p, h, f);
+    int wd2 = xbr_distance(p, h, e - dx) + xbr_distance(p, h, e + dx + 2 * dy) +
+              xbr_distance(p, f, e + 2 * dx + dy) + xbr_distance(p, f, e - dy) + 4 * xbr_distance(p, e, i);
+    if (wd1 >= wd2) return E;
+
+    uint32_t edge = (xbr_distance(p, e, f) <= xbr_distance(p, e, h)) ? p->px[f] : p->px[h];
+    return xbr_blend(E, edge);
+}
+
+// The 4 corners of n source pixels from index e: out0 gets the top ones, out1 the bottom ones
+static void xbr_row_scalar(uint32_t *out0, uint32_t *out1, const XbrPlanes *p, int e, int n) {
+    const int s = VIDEO_SRC_STRIDE;
+
+    for (int x = 0; x < n; x++, e++) {
+        out0[2 * x]     = xbr_corner(p, e, -1, -s);
+        out0[2 * x + 1] = xbr_corner(p, e, +1, -s);
+        out1[2 * x]     = xbr_corner(p, e, -1, +s);
+        out1[2 * x + 1] = xbr_corner(p, e, +1, +s);
+    }
+}
+
+// ===== Kernels (SSE2 / AVX2) =====
+#ifdef VIDEO_X86
+__attribute__((target("sse2")))
+static void dmg_row_sse2(uint32_t *dst, const uint8_t *src, int n, const uint32_t *palette) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i mask = _mm_set1_epi8(0x03);
+    __m128i shade[4];
+    for (int s = 0; s < 4; s++) shade[s] = _mm_set1_epi32((int)palette[s]);
+
+    int x = 0;
+    for (; x + 16 <= n; x += 16) {
+        __m128i px = _mm_and_si128(_mm_loadu_si128((const __m128i *)(src + x)), mask);
+        __m128i half[2] = { _mm_unpacklo_epi8(px, zero), _mm_unpackhi_epi8(px, zero) };
+
+        for (int q = 0; q < 4; q++) {
+            __m128i idx = (q & 1) ? _mm_unpackhi_epi16(half[q >> 1], zero)
+                                  : _mm_unpacklo_epi16(half[q >> 1], zero);
+            __m128i out = _mm_and_si128(_mm_cmpeq_epi32(idx, _mm_set1_epi32(0)), shade[0]);
+            out = _mm_or_si128(out, _mm_and_si128(_mm_cmpeq_epi32(idx, _mm_set1_epi32(1)), shade[1]));
+            out = _mm_or_si128(out, _mm_and_si128(_mm_cmpeq_epi32(idx, _mm_set1_epi32(2)), shade[2]));
+            out = _mm_or_si128(out, _mm_and_si128(_mm_cmpeq_epi32(idx, _mm_set1_epi32(3)), shade[3]));
+            _mm_storeu_si128((__m128i *)(dst + x + q * 4), out);
+        }
+    }
+    dmg_row_scalar(dst + x, src + x, n - x, palette);
+}
+
+__attribute__((target("sse2")))
+static void expand2_row_sse2(uint32_t *dst, const uint32_t *src, int n) {
+    int x = 0;
+    for (; x + 4 <= n; x += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(src + x));
+        _mm_storeu_si128((__m128i *)(dst + 2 * x), _mm_unpacklo_epi32(v, v));
+        _mm_storeu_si128((__m128i *)(dst + 2 * x + 4), _mm_unpackhi_epi32(v, v));
+    }
+    expand2_row_scalar(dst + 2 * x, src + x, n - x);
+}
+
+// select(m, a, b) = m ? a : b, lane by lane
+// Bytes * w / 256 (w <= 256: the products fit in 16 bits)
+#define SSE_SCALE8(v, w) _mm_packus_epi16( \
+    _mm_srli_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(v, _mm_setzero_si128()), w), 8), \
+    _mm_srli_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(v, _mm_setzero_si128()), w), 8))
+
+// Same as the scalar kernel on 16 channels: the saturated differences are the
+// distance up or down (one of them is 0)
+__attribute__((target("sse2")))
+static void ghost_row_sse2(uint32_t *line, uint32_t *ghost, int n, uint16_t w) {
+    const __m128i weight = _mm_set1_epi16((short)w);
+
+    int x = 0;
+    for (; x + 4 <= n; x += 4) {
+        __m128i cur = _mm_loadu_si128((const __m128i *)(line + x));
+        __m128i prev = _mm_loadu_si128((const __m128i *)(ghost + x));
+        __m128i up = SSE_SCALE8(_mm_subs_epu8(prev, cur), weight);
+        __m128i down = SSE_SCALE8(_mm_subs_epu8(cur, prev), weight);
+        __m128i out = _mm_adds_epu8(_mm_subs_epu8(cur, down), up);
+        _mm_storeu_si128((__m128i *)(line + x), out);
+        _mm_storeu_si128((__m128i *)(ghost + x), out);
+    }
+    ghost_row_scalar(line + x, ghost + x, n - x, w);
+}
+
+#define SSE_SELECT(m, a, b) _mm_or_si128(_mm_and_si128(m, a), _mm_andnot_si128(m, b))
+
+__attribute__((target("sse2")))
+static void scale2x_row_sse2(uint32_t *out0, uint32_t *out1, const uint32_t *up,
+                             const uint32_t *row, const uint32_t *down, int n) {
+    int x = 0;
+    for (; x + 4 <= n; x += 4) {
+        __m128i B = _mm_loadu_si128((const __m128i *)(up + x));
+        __m128i D = _mm_loadu_si128((const __m128i *)(row + x - 1));
+        __m128i E = _mm_loadu_si128((const __m128i *)(row + x));
+        __m128i F = _mm_loadu_si128((const __m128i *)(row + x + 1));
+        __m128i H = _mm_loadu_si128((const __m128i *)(down + x));
+
+        __m128i db = _mm_cmpeq_epi32(D, B), bf = _mm_cmpeq_epi32(B, F);
+        __m128i dh = _mm_cmpeq_epi32(D, H), hf = _mm_cmpeq_epi32(H, F);
+
+        __m128i e0 = SSE_SELECT(_mm_andnot_si128(_mm_or_si128(bf, dh), db), D, E);
+        __m128i e1 = SSE_SELECT(_mm_andnot_si128(_mm_or_si128(db, hf), bf), F, E);
+        __m128i e2 = SSE_SELECT(_mm_andnot_si128(_mm_or_si128(db, hf), dh), D, E);
+        __m128i e3 = SSE_SELECT(_mm_andnot_si128(_mm_or_si128(dh, bf), hf), F, E);
+
+        _mm_storeu_si128((__m128i *)(out0 + 2 * x), _mm_unpacklo_epi32(e0, e1));
+        _mm_storeu_si128((__m128i *)(out0 + 2 * x + 4), _mm_unpackhi_epi32(e0, e1));
+        _mm_storeu_si128((__m128i *)(out1 + 2 * x), _mm_unpacklo_epi32(e2, e3));
+        _mm_storeu_si128((__m128i *)(out1 + 2 * x + 4), _mm_unpackhi_epi32(e2, e3));
+    }
+    scale2x_row_scalar(out0 + 2 * x, out1 + 2 * x, up + x, row + x, down + x, n - x);
+}
+
+__attribute__((target("sse2")))
+static void xbr_metric_row_sse2(int16_t *dst, const int16_t *y, const int16_t *u, const int16_t *v,
+                                int delta, int n) {
+    const __m128i zero = _mm_setzero_si128();
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i dy = _mm_sub_epi16(_mm_loadu_si128((const __m128i *)(y + i)), _mm_loadu_si128((const __m128i *)(y + i + delta)));
+        __m128i du = _mm_sub_epi16(_mm_loadu_si128((const __m128i *)(u + i)), _mm_loadu_si128((const __m128i *)(u + i + delta)));
+        __m128i dv = _mm_sub_epi16(_mm_loadu_si128((const __m128i *)(v + i)), _mm_loadu_si128((const __m128i *)(v + i + delta)));
+        dy = _mm_max_epi16(dy, _mm_sub_epi16(zero, dy));
+        du = _mm_max_epi16(du, _mm_sub_epi16(zero, du));
+        dv = _mm_max_epi16(dv, _mm_sub_epi16(zero, dv));
+        __m128i d = _mm_add_epi16(_mm_mullo_epi16(dy, _mm_set1_epi16(48)),
+                    _mm_add_epi16(_mm_mullo_epi16(du, _mm_set1_epi16(7)), _mm_mullo_epi16(dv, _mm_set1_epi16(6))));
+        _mm_storeu_si128((__m128i *)(dst + i), d);
+    }
+    xbr_metric_row_scalar(dst + i, y + i, u + i, v + i, delta, n - i);
+}
+
+// xBR on 4 pixels, the sums on 32 bits. Inlined so the offsets pick the planes at compile time
+__attribute__((target("sse2"), always_inline))
+static inline __m128i xbr_distance_sse2(const XbrPlanes *p, int a, int b) {
+    int lo = a < b ? a : b, delta = a < b ? b - a : a - b;
+    const int16_t *plane = delta == 1 ? p->right : delta == VIDEO_SRC_STRIDE ? p->down :
+                           delta == VIDEO_SRC_STRIDE + 1 ? p->downRight : p->downLeft;
+    return _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i *)(plane + lo)), _mm_setzero_si128());
+}
+
+__attribute__((target("sse2"), always_inline))
+static inline __m128i xbr_corner_sse2(const XbrPlanes *p, int e, int dx, int dy) {
+    int f = e + dx, h = e + dy, i = e + dx + dy;
+    __m128i E = _mm_loadu_si128((const __m128i *)(p->px + e));
+    __m128i F = _mm_loadu_si128((const __m128i *)(p->px + f));
+    __m128i H = _mm_loadu_si128((const __m128i *)(p->px + h));
+
+    __m128i wd1 = _mm_add_epi32(_mm_add_epi32(xbr_distance_sse2(p, e, e + dx - dy), xbr_distance_sse2(p, e, e - dx + dy)),
+                  _mm_add_epi32(_mm_add_epi32(xbr_distance_sse2(p, i, e + 2 * dx), xbr_distance_sse2(p, i, e + 2 * dy)),
+                                _mm_slli_epi32(xbr_distance_sse2(p, h, f), 2)));
+    __m128i wd2 = _mm_add_epi32(_mm_add_epi32(xbr_distance_sse2(p, h, e - dx), xbr_distance_sse2(p, h, e + dx + 2 * dy)),
+                  _mm_add_epi32(_mm_add_epi32(xbr_distance_sse2(p, f, e + 2 * dx + dy), xbr_distance_sse2(p, f, e - dy)),
+                                _mm_slli_epi32(xbr_distance_sse2(p, e, i), 2)));
+    __m128i same = _mm_or_si128(_mm_cmpeq_epi32(E, F), _mm_cmpeq_epi32(E, H));
+    __m128i blend = _mm_andnot_si128(same, _mm_cmplt_epi32(wd1, wd2));
+
+    __m128i edge = SSE_SELECT(_mm_cmpgt_epi32(xbr_distance_sse2(p, e, f), xbr_distance_sse2(p, e, h)), H, F);
+    const __m128i mask = _mm_set1_epi32((int)0xFEFEFEFE);
+    __m128i mixed = _mm_add_epi32(_mm_srli_epi32(_mm_and_si128(E, mask), 1), _mm_srli_epi32(_mm_and_si128(edge, mask), 1));
+    return SSE_SELECT(blend, mixed, E);
+}
+
+__attribute__((target("sse2")))
+static void xbr_row_sse2(uint32_t *out0, uint32_t *out1, const XbrPlanes *p, int e, int n) {
+    const int s = VIDEO_SRC_STRIDE;
+    int x = 0;
+    for (; x + 4 <= n; x += 4, e += 4) {
+        __m128i e0 = xbr_corner_sse2(p, e, -1, -s), e1 = xbr_corner_sse2(p, e, +1, -s);
+        __m128i e2 = xbr_corner_sse2(p, e, -1, +s), e3 = xbr_corner_sse2(p, e, +1, +s);
+
+        _mm_storeu_si128((__m128i *)(out0 + 2 * x), _mm_unpacklo_epi32(e0, e1));
+        _mm_storeu_si128((__m128i *)(out0 + 2 * x + 4), _mm_unpackhi_epi32(e0, e1));
+        _mm_storeu_si128((__m128i *)(out1 + 2 * x), _mm_unpacklo_epi32(e2, e3));
+        _mm_storeu_si128((__m128i *)(out1 + 2 * x + 4), _mm_unpackhi_epi32(e2, e3));
+    }
+    xbr_row_scalar(out0 + 2 * x, out1 + 2 * x, p, e, n - x);
+}
+
+__attribute__((target("avx2")))
+static void dmg_row_avx2(uint32_t *dst, const uint8_t *src, int n, const uint32_t *palette) {
+    const __m256i lut = _mm256_setr_epi32((int)palette[0], (int)palette[1], (int)palette[2], (int)palette[3],
+                                          (int)palette[0], (int)palette[1], (int)palette[2], (int)palette[3]);
+    const __m256i mask = _mm256_set1_epi32(0x03);
+
+    int x = 0;
+    for (; x + 8 <= n; x += 8) {
+        __m256i idx = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(src + x)));
+        idx = _mm256_and_si256(idx, mask);
+        _mm256_storeu_si256((__m256i *)(dst + x), _mm256_permutevar8x32_epi32(lut, idx));
+    }
+    dmg_row_scalar(dst + x, src + x, n - x, palette);
+}
+
+__attribute__((target("avx2")))
+static void cgb_row_avx2(uint32_t *dst, const uint16_t *src, int n) {
+    const __m256i mask = _mm256_set1_epi32(0x7FFF);
+
+    int x = 0;
+    for (; x + 8 <= n; x += 8) {
+        __m256i idx = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)(src + x)));
+        idx = _mm256_and_si256(idx, mask);
+        _mm256_storeu_si256((__m256i *)(dst + x), _mm256_i32gather_epi32((const int *)cgb_lut, idx, 4));
+    }
+    cgb_row_scalar(dst + x, src + x, n - x);
+}
+
+__attribute__((target("avx2")))
+static void expand2_row_avx2(uint32_t *dst, const uint32_t *src, int n) {
+    int x = 0;
+    for (; x + 8 <= n; x += 8) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(src + x));
+        __m256i lo = _mm256_unpacklo_epi32(v, v); // 0 0 1 1 | 4 4 5 5
+        __m256i hi = _mm256_unpackhi_epi32(v, v); // 2 2 3 3 | 6 6 7 7
+        _mm256_storeu_si256((__m256i *)(dst + 2 * x), _mm256_permute2x128_si256(lo, hi, 0x20));
+        _mm256_storeu_si256((__m256i *)(dst + 2 * x + 8), _mm256_permute2x128_si256(lo, hi, 0x31));
+    }
+    expand2_row_scalar(dst + 2 * x, src + x, n - x);
+}
+
+// unpack and pack both work inside 128-bit lanes: the bytes come back in place
+#define AVX_SCALE8(v, w) _mm256_packus_epi16( \
+    _mm256_srli_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(v, _mm256_setzero_si256()), w), 8), \
+    _mm256_srli_epi16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(v, _mm256_setzero_si256()), w), 8))
+
+__attribute__((target("avx2")))
+static void ghost_row_avx2(uint32_t *line, uint32_t *ghost, int n, uint16_t w) {
+    const __m256i weight = _mm256_set1_epi16((short)w);
+
+    int x = 0;
+    for (; x + 8 <= n; x += 8) {
+        __m256i cur = _mm256_loadu_si256((const __m256i *)(line + x));
+        __m256i prev = _mm256_loadu_si256((const __m256i *)(ghost + x));
+        __m256i up = AVX_SCALE8(_mm256_subs_epu8(prev, cur), weight);
+        __m256i down = AVX_SCALE8(_mm256_subs_epu8(cur, prev), weight);
+        __m256i out = _mm256_adds_epu8(_mm256_subs_epu8(cur, down), up);
+        _mm256_storeu_si256((__m256i *)(line + x), out);
+        _mm256_storeu_si256((__m256i *)(ghost + x), out);
+    }
+    ghost_row_scalar(line + x, ghost + x, n - x, w);
+}
+
+#define AVX_SELECT(m, a, b) _mm256_or_si256(_mm256_and_si256(m, a), _mm256_andnot_si256(m, b))
+
+__attribute__((target("avx2")))
+static void scale2x_row_avx2(uint32_t *out0, uint32_t *out1, const uint32_t *up,
+                             const uint32_t *row, const uint32_t *down, int n) {
+    int x = 0;
+    for (; x + 8 <= n; x += 8) {
+        __m256i B = _mm256_loadu_si256((const __m256i *)(up + x));
+        __m256i D = _mm256_loadu_si256((const __m256i *)(row + x - 1));
+        __m256i E = _mm256_loadu_si256((const __m256i *)(row + x));
+        __m256i F = _mm256_loadu_si256((const __m256i *)(row + x + 1));
+        __m256i H = _mm256_loadu_si256((const __m256i *)(down + x));
+
+        __m256i db = _mm256_cmpeq_epi32(D, B), bf = _mm256_cmpeq_epi32(B, F);
+        __m256i dh = _mm256_cmpeq_epi32(D, H), hf = _mm256_cmpeq_epi32(H, F);
+
+        __m256i e0 = AVX_SELECT(_mm256_andnot_si256(_mm256_or_si256(bf, dh), db), D, E);
+        __m256i e1 = AVX_SELECT(_mm256_andnot_si256(_mm256_or_si256(db, hf), bf), F, E);
+        __m256i e2 = AVX_SELECT(_mm256_andnot_si256(_mm256_or_si256(db, hf), dh), D, E);
+        __m256i e3 = AVX_SELECT(_mm256_andnot_si256(_mm256_or_si256(dh, bf), hf), F, E);
+
+        // unpack works per 128-bit lane: put the halves back in order
+        __m256i top_lo = _mm256_unpacklo_epi32(e0, e1), top_hi = _mm256_unpackhi_epi32(e0, e1);
+        __m256i bot_lo = _mm256_unpacklo_epi32(e2, e3), bot_hi = _mm256_unpackhi_epi32(e2, e3);
+        _mm256_storeu_si256((__m256i *)(out0 + 2 * x), _mm256_permute2x128_si256(top_lo, top_hi, 0x20));
+        _mm256_storeu_si256((__m256i *)(out0 + 2 * x + 8), _mm256_permute2x128_si256(top_lo, top_hi, 0x31));
+        _mm256_storeu_si256((__m256i *)(out1 + 2 * x), _mm256_permute2x128_si256(bot_lo, bot_hi, 0x20));
+        _mm256_storeu_si256((__m256i *)(out1 + 2 * x + 8), _mm256_permute2x128_si256(bot_lo, bot_hi, 0x31));
+    }
+    scale2x_row_scalar(out0 + 2 * x, out1 + 2 * x, up + x, row + x, down + x, n - x);
+}
+
+__attribute__((target("avx2")))
+static void xbr_metric_row_avx2(int16_t *dst, const int16_t *y, const int16_t *u, const int16_t *v,
+                                int delta, int n) {
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256i dy = _mm256_sub_epi16(_mm256_loadu_si256((const __m256i *)(y + i)), _mm256_loadu_si256((const __m256i *)(y + i + delta)));
+        __m256i du = _mm256_sub_epi16(_mm256_loadu_si256((const __m256i *)(u + i)), _mm256_loadu_si256((const __m256i *)(u + i + delta)));
+        __m256i dv = _mm256_sub_epi16(_mm256_loadu_si256((const __m256i *)(v + i)), _mm256_loadu_si256((const __m256i *)(v + i + delta)));
+        __m256i d = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_abs_epi16(dy), _mm256_set1_epi16(48)),
+                    _mm256_add_epi16(_mm256_mullo_epi16(_mm256_abs_epi16(du), _mm256_set1_epi16(7)),
+                                     _mm256_mullo_epi16(_mm256_abs_epi16(dv), _mm256_set1_epi16(6))));
+        _mm256_storeu_si256((__m256i *)(dst + i), d);
+    }
+    xbr_metric_row_scalar(dst + i, y + i, u + i, v + i, delta, n - i);
+}
+
+// xBR on 8 pixels (same as SSE2)
+__attribute__((target("avx2"), always_inline))
+static inline __m256i xbr_distance_avx2(const XbrPlanes *p, int a, int b) {
+    int lo = a < b ? a : b, delta = a < b ? b - a : a - b;
+    const int16_t *plane = delta == 1 ? p->right : delta == VIDEO_SRC_STRIDE ? p->down :
+                           delta == VIDEO_SRC_STRIDE + 1 ? p->downRight : p->downLeft;
+    return _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)(plane + lo)));
+}
+
+__attribute__((target("avx2"), always_inline))
+static inline __m256i xbr_corner_avx2(const XbrPlanes *p, int e, int dx, int dy) {
+    int f = e + dx, h = e + dy, i = e + dx + dy;
+    __m256i E = _mm256_loadu_si256((const __m256i *)(p->px + e));
+    __m256i F = _mm256_loadu_si256((const __m256i *)(p->px + f));
+    __m256i H = _mm256_loadu_si256((const __m256i *)(p->px + h));
+
+    __m256i wd1 = _mm256_add_epi32(_mm256_add_epi32(xbr_distance_avx2(p, e, e + dx - dy), xbr_distance_avx2(p, e, e - dx + dy)),
+                  _mm256_add_epi32(_mm256_add_epi32(xbr_distance_avx2(p, i, e + 2 * dx), xbr_distance_avx2(p, i, e + 2 * dy)),
+                                   _mm256_slli_epi32(xbr_distance_avx2(p, h, f), 2)));
+    __m256i wd2 = _mm256_add_epi32(_mm256_add_epi32(xbr_distance_avx2(p, h, e - dx), xbr_distance_avx2(p, h, e + dx + 2 * dy)),
+                  _mm256_add_epi32(_mm256_add_epi32(xbr_distance_avx2(p, f, e + 2 * dx + dy), xbr_distance_avx2(p, f, e - dy)),
+                                   _mm256_slli_epi32(xbr_distance_avx2(p, e, i), 2)));
+    __m256i same = _mm256_or_si256(_mm256_cmpeq_epi32(E, F), _mm256_cmpeq_epi32(E, H));
+    __m256i blend = _mm256_andnot_si256(same, _mm256_cmpgt_epi32(wd2, wd1));
+
+    __m256i edge = AVX_SELECT(_mm256_cmpgt_epi32(xbr_distance_avx2(p, e, f), xbr_distance_avx2(p, e, h)), H, F);
+    const __m256i mask = _mm256_set1_epi32((int)0xFEFEFEFE);
+    __m256i mixed = _mm256_add_epi32(_mm256_srli_epi32(_mm256_and_si256(E, mask), 1),
+                                     _mm256_srli_epi32(_mm256_and_si256(edge, mask), 1));
+    return AVX_SELECT(blend, mixed, E);
+}
+
+__attribute__((target("avx2")))
+static void xbr_row_avx2(uint32_t *out0, uint32_t *out1, const XbrPlanes *p, int e, int n) {
+    const int s = VIDEO_SRC_STRIDE;
+    int x = 0;
+    for (; x + 8 <= n; x += 8, e += 8) {
+        __m256i e0 = xbr_corner_avx2(p, e, -1, -s), e1 = xbr_corner_avx2(p, e, +1, -s);
+        __m256i e2 = xbr_corner_avx2(p, e, -1, +s), e3 = xbr_corner_avx2(p, e, +1, +s);
+
+        // unpack works per 128-bit lane: put the halves back in order
+        __m256i top_lo = _mm256_unpacklo_epi32(e0, e1), top_hi = _mm256_unpackhi_epi32(e0, e1);
+        __m256i bot_lo = _mm256_unpacklo_epi32(e2, e3), bot_hi = _mm256_unpackhi_epi32(e2, e3);
+        _mm256_storeu_si256((__m256i *)(out0 + 2 * x), _mm256_permute2x128_si256(top_lo, top_hi, 0x20));
+        _mm256_storeu_si256((__m256i *)(out0 + 2 * x + 8), _mm256_permute2x128_si256(top_lo, top_hi, 0x31));
+        _mm256_storeu_si256((__m256i *)(out1 + 2 * x), _mm256_permute2x128_si256(bot_lo, bot_hi, 0x20));
+        _mm256_storeu_si256((__m256i *)(out1 + 2 * x + 8), _mm256_permute2x128_si256(bot_lo, bot_hi, 0x31));
+    }
+    xbr_row_scalar(out0 + 2 * x, out1 + 2 * x, p, e, n - x);
+}
+#endif
+
+// ===== Dispatch =====
+static struct {
+    const char *name;
+    void (*dmg_row)(uint32_t *dst, const uint8_t *src, int n, const uint32_t *palette);
+    void (*cgb_row)(uint32_t *dst, const uint16_t *src, int n);
+    void (*expand2_row)(uint32_t *dst, const uint32_t *src, int n);
+    void (*scale2x_row)(uint32_t *out0, uint32_t *out1, const uint32_t *up,
+                        const uint32_t *row, const uint32_t *down, int n);
+    void (*ghost_row)(uint32_t *line, uint32_t *ghost, int n, uint16_t w);
+    void (*xbr_metric_row)(int16_t *dst, const int16_t *y, const int16_t *u, const int16_t *v, int delta, int n);
+    void (*xbr_row)(uint32_t *out0, uint32_t *out1, const XbrPlanes *p, int e, int n);
+} kernels = { "scalar", dmg_row_scalar, cgb_row_scalar, expand2_row_scalar, scale2x_row_scalar, ghost_row_scalar,
+              xbr_metric_row_scalar, xbr_row_scalar };
+
+static pthread_once_t video_once = PTHREAD_ONCE_INIT;
+
+static void video_setup(void) {
+    // 5-bit channels expanded to 8 bits
+    for (uint32_t c = 0; c < 0x8000; c++) {
+        uint8_t r = c & 0x1F, g = (c >> 5) & 0x1F, b = (c >> 10) & 0x1F;
+        cgb_lut[c] = VIDEO_RGBA((r << 3) | (r >> 2), (g << 3) | (g >> 2), (b << 3) | (b >> 2));
+    }
+
+#ifdef VIDEO_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        kernels.name = "avx2";
+        kernels.dmg_row = dmg_row_avx2;
+        kernels.cgb_row = cgb_row_avx2;
+        kernels.expand2_row = expand2_row_avx2;
+        kernels.scale2x_row = scale2x_row_avx2;
+        kernels.ghost_row = ghost_row_avx2;
+        kernels.xbr_metric_row = xbr_metric_row_avx2;
+        kernels.xbr_row = xbr_row_avx2;
+    } else if (__builtin_cpu_supports("sse2")) {
+        kernels.name = "sse2";
+        kernels.dmg_row = dmg_row_sse2;
+        kernels.expand2_row = expand2_row_sse2;
+        kernels.scale2x_row = scale2x_row_sse2;
+        kernels.ghost_row = ghost_row_sse2;
+        kernels.xbr_metric_row = xbr_metric_row_sse2;
+        kernels.xbr_row = xbr_row_sse2;
+    }
+#endif
+}
+
+const char *video_simd_name(void) {
+    pthread_once(&video_once, video_setup);
+    return kernels.name;
+}
+
+int video_parse_filter(const char *name, VideoFilter *filter) {
+    for (int i = 0; i < VIDEO_FILTER_COUNT; i++) {
+        if (strcmp(name, filter_names[i]) == 0) {
+            *filter = (VideoFilter)i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+const char *video_filter_name(VideoFilter filter) {
+    return filter_names[filter];
+}
+
+int video_filter_factor(VideoFilter filter) {
+    return filter_factors[filter];
+}
+
+// ===== Stages =====
+// Framebuffer -> RGBA source with its border
+static void video_convert(Video *video) {
+    uint32_t *src = video->source + VIDEO_BORDER * VIDEO_SRC_STRIDE + VIDEO_BORDER;
+
+    for (int y = 0; y < SCREEN_HEIGHT; y++) {
+        uint32_t *line = src + y * VIDEO_SRC_STRIDE;
+        if (video->cgb) kernels.cgb_row(line, video->colorFramebuffer[y], SCREEN_WIDTH);
+        else kernels.dmg_row(line, video->framebuffer[y], SCREEN_WIDTH, video->dmgPalette);
+    }
+
+    // Separate pass: reading a row right after its (unaligned) stores stalls on
+    // store forwarding, it costs several times the blend itself
+    if (video->ghosting) {
+        for (int y = 0; y < SCREEN_HEIGHT; y++) {
+            uint32_t *line = src + y * VIDEO_SRC_STRIDE, *ghost = video->ghost + y * SCREEN_WIDTH;
+            if (video->ghostValid) kernels.ghost_row(line, ghost, SCREEN_WIDTH, video->ghosting);
+            else memcpy(ghost, line, SCREEN_WIDTH * sizeof(uint32_t));
+        }
+        video->ghostValid = 1;
+    }
+
+    for (int y = 0; y < SCREEN_HEIGHT; y++) {
+        uint32_t *line = src + y * VIDEO_SRC_STRIDE;
+        for (int b = 1; b <= VIDEO_BORDER; b++) {
+            line[-b] = line[0];
+            line[SCREEN_WIDTH - 1 + b] = line[SCREEN_WIDTH - 1];
+        }
+    }
+    for (int b = 1; b <= VIDEO_BORDER; b++) {
+        memcpy(src - (b + 0) * VIDEO_SRC_STRIDE - VIDEO_BORDER, src - VIDEO_BORDER,
+               VIDEO_SRC_STRIDE * sizeof(uint32_t));
+        memcpy(src + (SCREEN_HEIGHT - 1 + b) * VIDEO_SRC_STRIDE - VIDEO_BORDER,
+               src + (SCREEN_HEIGHT - 1) * VIDEO_SRC_STRIDE - VIDEO_BORDER, VIDEO_SRC_STRIDE * sizeof(uint32_t));
+    }
+}
+
+// Integer nearest neighbour: expand each row once, then duplicate it
+static void video_nearest(const uint32_t *src, int w, int h, int stride, uint32_t *dst, int k) {
+    int dw = w * k;
+
+    for (int y = 0; y < h; y++) {
+        const uint32_t *in = src + y * stride;
+        uint32_t *line = dst + (size_t)y * k * dw;
+
+        if (k == 1) {
+            memcpy(line, in, w * sizeof(uint32_t));
+            continue;
+        } else if (k == 2) {
+            kernels.expand2_row(line, in, w);
+        } else {
+            for (int x = 0; x < w; x++) {
+                uint32_t p = in[x];
+                for (int i = 0; i < k; i++) line[x * k + i] = p;
+            }
+        }
+        for (int r = 1; r < k; r++) memcpy(line + r * dw, line, dw * sizeof(uint32_t));
+    }
+}
+
+static void video_scale2x(const uint32_t *src, uint32_t *dst) {
+    int dw = SCREEN_WIDTH * 2;
+
+    for (int y = 0; y < SCREEN_HEIGHT; y++) {
+        const uint32_t *row = src + y * VIDEO_SRC_STRIDE;
+        kernels.scale2x_row(dst + (2 * y) * dw, dst + (2 * y + 1) * dw,
+                            row - VIDEO_SRC_STRIDE, row, row + VIDEO_SRC_STRIDE, SCREEN_WIDTH);
+    }
+}
+
+// Scale3x (AdvMAME3x), scalar: flat areas take the early out
+static void video_scale3x(const uint32_t *src, uint32_t *dst) {
+    int dw = SCREEN_WIDTH * 3;
+
+    for (int y = 0; y < SCREEN_HEIGHT; y++) {
+        const uint32_t *up = src + (y - 1) * VIDEO_SRC_STRIDE;
+        const uint32_t *row = src + y * VIDEO_SRC_STRIDE;
+        const uint32_t *down = src + (y + 1) * VIDEO_SRC_STRIDE;
+        uint32_t *out0 = dst + (3 * y) * dw, *out1 = out0 + dw, *out2 = out1 + dw;
+
+        for (int x = 0; x < SCREEN_WIDTH; x++) {
+            uint32_t A = up[x - 1], B = up[x], C = up[x + 1];
+            uint32_t D = row[x - 1], E = row[x], F = row[x + 1];
+            uint32_t G = down[x - 1], H = down[x], I = down[x + 1];
+            uint32_t *o0 = out0 + 3 * x, *o1 = out1 + 3 * x, *o2 = out2 + 3 * x;
+
+            if (B != H && D != F) {
+                o0[0] = (D == B) ? D : E;
+                o0[1] = ((D == B && E != C) || (B == F && E != A)) ? B : E;
+                o0[2] = (B == F) ? F : E;
+                o1[0] = ((D == B && E != G) || (D == H && E != A)) ? D : E;
+                o1[1] = E;
+                o1[2] = ((B == F && E != I) || (H == F && E != C)) ? F : E;
+                o2[0] = (D == H) ? D : E;
+                o2[1] = ((D == H && E != I) || (H == F && E != G)) ? H : E;
+                o2[2] = (H == F) ? F : E;
+            } else {
+                o0[0] = o0[1] = o0[2] = o1[0] = o1[1] = o1[2] = o2[0] = o2[1] = o2[2] = E;
+            }
+        }
+    }
+}
+
+// ===== xBR =====
+// Y, U, V of every source pixel, then the distance planes of XbrPlanes (at
+// most 48*255 + 7*255 + 6*255, they fit 16 bits). Done once per frame: each
+// distance is used by up to 8 corners
+static void video_xbr_planes(Video *video, XbrPlanes *p) {
+    const int s = VIDEO_SRC_STRIDE;
+    size_t plane = (size_t)VIDEO_SRC_STRIDE * VIDEO_SRC_HEIGHT;
+    int16_t *py = video->xbrPlanes, *pu = py + plane, *pv = pu + plane;
+    int16_t *right = pv + plane, *down = right + plane, *downRight = down + plane, *downLeft = downRight + plane;
+
+    for (size_t i = 0; i < plane; i++) {
+        uint32_t c = video->source[i];
+        int r = c & 0xFF, g = (c >> 8) & 0xFF, b = (c >> 16) & 0xFF;
+        py[i] = (int16_t)((77 * r + 150 * g + 29 * b) >> 8);
+        pu[i] = (int16_t)((-43 * r - 85 * g + 128 * b) >> 8);
+        pv[i] = (int16_t)((128 * r - 107 * g - 21 * b) >> 8);
+    }
+
+    // Up to the last pair read: the lower row of a pair is at most the second last
+    int n = (int)plane - s - 1;
+    kernels.xbr_metric_row(right, py, pu, pv, 1, n);
+    kernels.xbr_metric_row(down, py, pu, pv, s, n);
+    kernels.xbr_metric_row(downRight, py, pu, pv, s + 1, n);
+    kernels.xbr_metric_row(downLeft + 1, py + 1, pu + 1, pv + 1, s - 1, n - 1);
+
+    p->px = video->source;
+    p->right = right;
+    p->down = down;
+    p->downRight = downRight;
+    p->downLeft = downLeft;
+}
+
+static void video_xbr(Video *video, uint32_t *dst) {
+    const int s = VIDEO_SRC_STRIDE;
+    int dw = SCREEN_WIDTH * 2;
+    XbrPlanes p;
+
+    video_xbr_planes(video, &p);
+    for (int y = 0; y < SCREEN_HEIGHT; y++) {
+        uint32_t *out0 = dst + (2 * y) * dw, *out1 = out0 + dw;
+        kernels.xbr_row(out0, out1, &p, (y + VIDEO_BORDER) * s + VIDEO_BORDER, SCREEN_WIDTH);
+    }
+}
+
+// Converted source -> output
+static void video_process(Video *video) {
+    const uint32_t *src = video->source + VIDEO_BORDER * VIDEO_SRC_STRIDE + VIDEO_BORDER;
+    int factor = filter_factors[video->filter];
+    int k = video->scale / factor;
+    uint32_t *target = (k == 1) ? video->output : video->filtered;
+
+    video_convert(video);
+
+    switch (video->filter) {
+        case VIDEO_FILTER_NEAREST:
+            video_nearest(src, SCREEN_WIDTH, SCREEN_HEIGHT, VIDEO_SRC_STRIDE, video->output, video->scale);
+            return;
+        case VIDEO_FILTER_SCALE2X: video_scale2x(src, target); break;
+        case VIDEO_FILTER_SCALE3X: video_scale3x(src, target); break;
+        default: video_xbr(video, target); break;
+    }
+
+    if (k > 1) {
+        int w = SCREEN_WIDTH * factor;
+        video_nearest(video->filtered, w, SCREEN_HEIGHT * factor, w, video->output, k);
+    }
+}
+
+// ===== Init =====
+int video_init(Video *video, int scale, VideoFilter filter) {
+    pthread_once(&video_once, video_setup);
+
+    memset(video, 0, sizeof(Video));
+    if (scale < 1 || scale > VIDEO_MAX_SCALE || filter >= VIDEO_FILTER_COUNT) return -1;
+    if (scale % filter_factors[filter] != 0) return -1;
+
+    video->scale = scale;
+    video->filter = filter;
+    video->width = SCREEN_WIDTH * scale;
+    video->height = SCREEN_HEIGHT * scale;
+
+    // Shade 0 = white ... 3 = black
+    video->dmgPalette[0] = VIDEO_RGBA(0xFF, 0xFF, 0xFF);
+    video->dmgPalette[1] = VIDEO_RGBA(0xAA, 0xAA, 0xAA);
+    video->dmgPalette[2] = VIDEO_RGBA(0x55, 0x55, 0x55);
+    video->dmgPalette[3] = VIDEO_RGBA(0x00, 0x00, 0x00);
+
+    video->source = calloc((size_t)VIDEO_SRC_STRIDE * VIDEO_SRC_HEIGHT, sizeof(uint32_t));
+    video->output = calloc((size_t)video->width * video->height, sizeof(uint32_t));
+    if (filter != VIDEO_FILTER_NEAREST && scale != filter_factors[filter]) {
+        int f = filter_factors[filter];
+        video->filtered = calloc((size_t)SCREEN_WIDTH * f * SCREEN_HEIGHT * f, sizeof(uint32_t));
+        if (!video->filtered) { video_free(video); return -1; }
+    }
+    if (filter == VIDEO_FILTER_XBR) {
+        video->xbrPlanes = calloc((size_t)7 * VIDEO_SRC_STRIDE * VIDEO_SRC_HEIGHT, sizeof(int16_t));
+        if (!video->xbrPlanes) { video_free(video); return -1; }
+    }
+    if (!video->source || !video->output) { video_free(video); return -1; }
+
+    return 0;
+}
+
+// 0 = off. The first frame after a change is shown as is; with a worker the
+// change goes with the next submitted frame (the worker takes both under the lock)
+int video_set_ghosting(Video *video, int percent) {
+    if (percent < 0 || percent > VIDEO_MAX_GHOSTING) return -1;
+    uint16_t ghosting = (uint16_t)(percent * 256 / 100);
+
+    if (video->threaded) pthread_mutex_lock(&video->lock);
+    if (percent && !video->ghost) {
+        video->ghost = malloc((size_t)SCREEN_WIDTH * SCREEN_HEIGHT * sizeof(uint32_t));
+        if (!video->ghost) {
+            if (video->threaded) pthread_mutex_unlock(&video->lock);
+            return -1;
+        }
+    }
+    if (video->threaded) {
+        video->pendingGhosting = ghosting;
+        video->ghostingChanged = 1;
+        pthread_mutex_unlock(&video->lock);
+    } else {
+        video->ghosting = ghosting;
+        video->ghostValid = 0;
+    }
+    return 0;
+}
+
+void video_free(Video *video) {
+    if (video->threaded) {
+        pthread_mutex_lock(&video->lock);
+        video->quit = 1;
+        pthread_cond_signal(&video->wake);
+        pthread_mutex_unlock(&video->lock);
+        pthread_join(video->thread, NULL);
+        pthread_mutex_destroy(&video->lock);
+        pthread_cond_destroy(&video->wake);
+        pthread_cond_destroy(&video->done);
+        video->threaded = 0;
+    }
+    free(video->source);
+    free(video->filtered);
+    free(video->output);
+    free(video->xbrPlanes);
+    free(video->ghost);
+    video->source = video->filtered = video->output = video->ghost = NULL;
+    video->xbrPlanes = NULL;
+}
+
+static void video_copy_frame(uint8_t *cgbDst, uint8_t (*fbDst)[SCREEN_WIDTH], uint16_t (*colorDst)[SCREEN_WIDTH],
+                             uint8_t cgb, const uint8_t (*fb)[SCREEN_WIDTH], const uint16_t (*color)[SCREEN_WIDTH]) {
+    *cgbDst = cgb;
+    if (cgb) memcpy(colorDst, color, sizeof(uint16_t) * SCREEN_WIDTH * SCREEN_HEIGHT);
+    else memcpy(fbDst, fb, SCREEN_WIDTH * SCREEN_HEIGHT);
+}
+
+void video_render(Video *video, const PPU *ppu, uint8_t cgb) {
+    video_copy_frame(&video->cgb, video->framebuffer, video->colorFramebuffer,
+                     cgb, ppu->framebuffer, ppu->colorFramebuffer);
+    video_process(video);
+    video->frames++;
+}
+
+// ===== Worker thread =====
+static void *video_worker(void *arg) {
+    Video *video = arg;
+
+    pthread_mutex_lock(&video->lock);
+    for (;;) {
+        while (!video->pending && !video->quit) pthread_cond_wait(&video->wake, &video->lock);
+        if (video->quit) break;
+
+        video_copy_frame(&video->cgb, video->framebuffer, video->colorFramebuffer, video->pendingCgb,
+                         (const uint8_t (*)[SCREEN_WIDTH])video->pendingFramebuffer,
+                         (const uint16_t (*)[SCREEN_WIDTH])video->pendingColorFramebuffer);
+        if (video->ghostingChanged) {
+            video->ghosting = video->pendingGhosting;
+            video->ghostValid = 0;
+            video->ghostingChanged = 0;
+        }
+        video->pending = 0;
+        video->busy = 1;
+        pthread_mutex_unlock(&video->lock);
+
+        video_process(video);
+
+        pthread_mutex_lock(&video->lock);
+        video->busy = 0;
+        video->frames++;
+        pthread_cond_broadcast(&video->done);
+    }
+    pthread_mutex_unlock(&video->lock);
+    return NULL;
+}
+
+int video_start_worker(Video *video) {
+    if (video->threaded) return 0;
+
+    pthread_mutex_init(&video->lock, NULL);
+    pthread_cond_init(&video->wake, NULL);
+    pthread_cond_init(&video->done, NULL);
+    if (pthread_create(&video->thread, NULL, video_worker, video) != 0) {
+        pthread_mutex_destroy(&video->lock);
+        pthread_cond_destroy(&video->wake);
+        pthread_cond_destroy(&video->done);
+        return -1;
+    }
+    video->threaded = 1;
+    return 0;
+}
+
+// Without a worker this renders synchronously
+void video_submit(Video *video, const PPU *ppu, uint8_t cgb) {
+    if (!video->threaded) {
+        video_render(video, ppu, cgb);
+        return;
+    }
+
+    pthread_mutex_lock(&video->lock);
+    video_copy_frame(&video->pendingCgb, video->pendingFramebuffer, video->pendingColorFramebuffer,
+                     cgb, ppu->framebuffer, ppu->colorFramebuffer);
+    video->pending = 1;
+    pthread_cond_signal(&video->wake);
+    pthread_mutex_unlock(&video->lock);
+}
+
+// Wait until the last submitted frame is in video->output
+void video_wait(Video *video) {
+    if (!video->threaded) return;
+
+    pthread_mutex_lock(&video->lock);
+    while (video->pending || video->busy) pthread_cond_wait(&video->done, &video->lock);
+    pthread_mutex_unlock(&video->lock);
+}
+
+// Binary PPM (P6)
+int video_write_ppm(const Video *video, const char *filename) {
+    FILE *f = fopen(filename, "wb");
+    if (!f) return -1;
+
+    fprintf(f, "P6\n%d %d\n255\n", video->width, video->height);
+    uint8_t *row = malloc((size_t)video->width * 3);
+    if (!row) { fclose(f); return -1; }
+
+    for (int y = 0; y < video->height; y++) {
+        const uint32_t *in = video->output + (size_t)y * video->width;
+        for (int x = 0; x < video->width; x++) {
+            row[x * 3]     = in[x] & 0xFF;
+            row[x * 3 + 1] = (in[x] >> 8) & 0xFF;
+            row[x * 3 + 2] = (in[x] >> 16) & 0xFF;
+        }
+        fwrite(row, 1, (size_t)video->width * 3, f);
+    }
+    free(row);
+    return fclose(f) == 0 ? 0 : -1;
+}
@@ -0,0 +1,103 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../includes/gb.h"
+#include "../includes/batch.h"
+
+// batch_run_frame against gb_run_frame (`make check`): the same consoles with
+// the same inputs must end every frame in the same state, lockstep or not
+
+int DEBUG_MODE = 0;
+
+static int failures = 0;
+
+#define CHECK(cond, ...) do { \
+    if (!(cond)) { \
+        printf("❌ %s:%d: ", __FILE__, __LINE__); \
+        printf(__VA_ARGS__); \
+        printf("\n"); \
+        failures++; \
+    } \
+} while (0)
+
+#define CONSOLES 40
+#define FRAMES 120
+
+static uint8_t rom[0x8000];
+
+// The frames/s batch benchmark loop, storing A in tile 0 so the input shows on screen
+static void build_rom(void) {
+    static const uint8_t loop[] = {
+        0xF0, 0x00,                 // LDH A,(P1)
+        0x47, 0x81, 0x8A, 0x93,     // LD B,A ; ADD A,C ; ADC A,D ; SUB E
+        0xA8, 0xB1, 0x0C, 0x15,     // XOR B ; OR C ; INC C ; DEC D
+        0x03, 0x1B, 0x19, 0x2F,     // INC BC ; DEC DE ; ADD HL,DE ; CPL
+        0xC6, 0x37, 0xFE, 0x80,     // ADD A,37 ; CP 80
+        0x38, 0x01, 0x3C,           // JR C,+1 ; INC A
+        0xEA, 0x00, 0x80,           // LD (8000),A
+        0x18, 0xE6,                 // JR loop
+    };
+    memcpy(&rom[0x100], loop, sizeof(loop));
+}
+
+// A few consoles per input so groups form, changing every 10 frames; a third never press anything
+static uint8_t input(uint32_t console, int frame) {
+    if (console % 3 == 0) return 0;
+    return (uint8_t)(1 << ((console + frame / 10) % 4));
+}
+
+// Same frame position (PPU cycles since the frame began) and same registers at the
+// end of every frame: both ran the same cycles
+static int same_console(GameBoy *a, GameBoy *b, int frame, uint32_t console) {
+    const char *what = NULL;
+    if (memcmp(&a->cpu, &b->cpu, sizeof(CPU)) != 0) what = "registers";
+    else if (a->frames != b->frames) what = "frame count";
+    else if (ppu_frame_position(&a->ppu) != ppu_frame_position(&b->ppu)) what = "cycles";
+    else if (memcmp(a->ppu.framebuffer, b->ppu.framebuffer, sizeof(a->ppu.framebuffer)) != 0) what = "framebuffer";
+    else if (memcmp(a->mmu.wram, b->mmu.wram, sizeof(a->mmu.wram)) != 0) what = "WRAM";
+    else if (memcmp(a->mmu.vram, b->mmu.vram, sizeof(a->mmu.vram)) != 0) what = "VRAM";
+    else if (memcmp(a->mmu.hram, b->mmu.hram, sizeof(a->mmu.hram)) != 0) what = "HRAM";
+    else if (memcmp(a->mmu.io, b->mmu.io, sizeof(a->mmu.io)) != 0) what = "IO";
+    if (!what) return 1;
+
+    CHECK(0, "frame %d console %u: %s differ (PC %04X / %04X)", frame, console, what, a->cpu.PC, b->cpu.PC);
+    return 0;
+}
+
+int main(void) {
+    static GameBoy reference[CONSOLES];
+    Batch batch;
+
+    build_rom();
+    if (batch_init(&batch, CONSOLES, rom, sizeof(rom)) != 0) {
+        printf("❌ batch_init failed\n");
+        return 1;
+    }
+    for (uint32_t i = 0; i < CONSOLES; i++) {
+        gb_init(&reference[i]);
+        gb_attach_rom(&reference[i], rom, sizeof(rom));
+        gb_boot(&reference[i]);
+    }
+
+    for (int frame = 0; frame < FRAMES && !failures; frame++) {
+        for (uint32_t i = 0; i < CONSOLES; i++) {
+            mmu_set_joypad(&batch.gb[i].mmu, input(i, frame));
+            mmu_set_joypad(&reference[i].mmu, input(i, frame));
+        }
+        batch_run_frame(&batch);
+        for (uint32_t i = 0; i < CONSOLES; i++) gb_run_frame(&reference[i]);
+
+        for (uint32_t i = 0; i < CONSOLES; i++) {
+            if (!same_console(&batch.gb[i], &reference[i], frame, i)) break;
+        }
+    }
+    CHECK(batch.lockstepSteps > 0, "no instruction ran in lockstep");
+
+    printf("%s batch: %d failures (%llu of %llu frames in lockstep, %llu lockstep steps)\n",
+           failures ? "❌" : "✅", failures, (unsigned long long)batch.lockstepFrames, (unsigned long long)FRAMES,
+           (unsigned long long)batch.lockstepSteps);
+
+    for (uint32_t i = 0; i < CONSOLES; i++) gb_free(&reference[i]);
+    batch_free(&batch);
+    return failures ? 1 : 0;
+}
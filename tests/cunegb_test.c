@@ -0,0 +1,54 @@
+#include <stdio.h>
+#include <string.h>
+#include "../includes/cunegb.h"
+
+// libcunegb views across cunegb_reset (`make check`). malloc may hand a freed
+// buffer straight back: build with -fsanitize=address to see a dangling view
+
+static int failures = 0;
+
+#define CHECK(cond, ...) do { \
+    if (!(cond)) { \
+        printf("❌ %s:%d: ", __FILE__, __LINE__); \
+        printf(__VA_ARGS__); \
+        printf("\n"); \
+        failures++; \
+    } \
+} while (0)
+
+static uint8_t rom[0x8000];
+
+int main(void) {
+    rom[0x100] = 0x18; // JR -2
+    rom[0x101] = 0xFE;
+    rom[0x147] = 0x03; // MBC1 + RAM + battery
+    rom[0x149] = 0x02; // 8KB
+
+    CuneGB *gb = cunegb_create(rom, sizeof(rom), 0);
+    CHECK(gb != NULL, "cunegb_create failed");
+    if (!gb) return 1;
+
+    size_t size, size_after;
+    uint8_t *ram = (uint8_t *)cunegb_memory(gb, CUNEGB_CART_RAM, &size);
+    const uint8_t *wram = cunegb_memory(gb, CUNEGB_WRAM, &size_after);
+    CHECK(ram != NULL && size >= 0x2000, "no cartridge RAM view (%zu bytes)", size);
+    if (ram) memset(ram, 0xA5, size);
+
+    cunegb_step(gb, 2, 0);
+    cunegb_reset(gb);
+
+    CHECK(cunegb_memory(gb, CUNEGB_CART_RAM, &size_after) == ram, "cartridge RAM moved on reset");
+    CHECK(size_after == size, "cartridge RAM is %zu bytes after reset, %zu before", size_after, size);
+    CHECK(cunegb_memory(gb, CUNEGB_WRAM, &size_after) == wram, "WRAM moved on reset");
+    if (ram) {
+        size_t cleared = 0;
+        while (cleared < size && ram[cleared] == 0) cleared++;
+        CHECK(cleared == size, "cartridge RAM not cleared at 0x%zX", cleared);
+    }
+    cunegb_step(gb, 2, 0);
+    CHECK(cunegb_frame_count(gb) == 2, "%llu frames after reset", (unsigned long long)cunegb_frame_count(gb));
+
+    cunegb_destroy(gb);
+    printf("%s cunegb: %d failures\n", failures ? "❌" : "✅", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,62 @@
+#include <stdio.h>
+#include <string.h>
+#include "../includes/mmu.h"
+
+// Byte order of the split 16-bit writes, seen through the access hook (`make check`)
+
+int DEBUG_MODE = 0;
+
+static int failures = 0;
+
+#define CHECK(cond, ...) do { \
+    if (!(cond)) { \
+        printf("❌ %s:%d: ", __FILE__, __LINE__); \
+        printf(__VA_ARGS__); \
+        printf("\n"); \
+        failures++; \
+    } \
+} while (0)
+
+typedef struct {
+    uint16_t addr[8];
+    uint8_t val[8];
+    int count;
+} AccessLog;
+
+static void log_access(void *ctx, uint16_t addr, uint8_t val, uint8_t write) {
+    AccessLog *log = ctx;
+    if (!write || log->count == 8) return;
+    log->addr[log->count] = addr;
+    log->val[log->count++] = val;
+}
+
+static void check_order(MMU *mmu, int little_endian, uint16_t addr) {
+    AccessLog log = { 0 };
+    mmu->access_ctx = &log;
+    if (little_endian) mmu_write16_le(mmu, addr, 0xBEEF);
+    else mmu_write16(mmu, addr, 0xBEEF);
+
+    uint16_t first = little_endian ? addr : addr + 1;
+    CHECK(log.count == 2, "%04X: %d writes", addr, log.count);
+    CHECK(log.addr[0] == first && log.val[0] == (little_endian ? 0xEF : 0xBE),
+          "%04X: first write [%04X]=%02X", addr, log.addr[0], log.val[0]);
+    CHECK(mmu_read16(mmu, addr) == 0xBEEF, "%04X: read back %04X", addr, mmu_read16(mmu, addr));
+}
+
+int main(void) {
+    static MMU mmu;
+    mmu_init(&mmu);
+    mmu.trap_write = (1 << 0xC) | (1 << 0xD);
+    mmu.access_hook = log_access;
+    mmu_update_map(&mmu);
+
+    // Trapped WRAM pages, HRAM (no single store with a hook) and a page crossing
+    uint16_t addrs[] = { 0xC100, 0xFF90, 0xCFFF };
+    for (size_t i = 0; i < sizeof(addrs) / sizeof(addrs[0]); i++) {
+        check_order(&mmu, 0, addrs[i]);
+        check_order(&mmu, 1, addrs[i]);
+    }
+
+    printf("%s mmu: %d failures\n", failures ? "❌" : "✅", failures);
+    return failures ? 1 : 0;
+}
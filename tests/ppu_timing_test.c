@@ -0,0 +1,85 @@
+#include <stdio.h>
+#include <string.h>
+#include "../includes/gb.h"
+
+// STAT read across the mode 2 -> 3 boundary (`make check`). The ROM halts
+// until the mode 2 STAT interrupt, then reads STAT every 24 cycles: the
+// cycle-accurate core sees each read on its M-cycle, the fast core at the
+// start of its instruction
+
+int DEBUG_MODE = 0;
+
+static int failures = 0;
+
+#define CHECK(cond, ...) do { \
+    if (!(cond)) { \
+        printf("❌ %s:%d: ", __FILE__, __LINE__); \
+        printf(__VA_ARGS__); \
+        printf("\n"); \
+        failures++; \
+    } \
+} while (0)
+
+#define READS 12
+#define READ_CYCLES 24 // LDH A,(41) + LDH (a8),A
+#define READ_OFFSET 8  // the STAT read is the third M-cycle of LDH A,(41)
+
+static uint8_t rom[0x8000];
+
+static void build_rom(void) {
+    static const uint8_t setup[] = {
+        0xF3,             // DI
+        0x3E, 0x20,       // LD A,0x20     STAT: mode 2 interrupt
+        0xE0, 0x41,       // LDH (41),A
+        0x3E, 0x02,       // LD A,0x02     IE: STAT
+        0xE0, 0xFF,       // LDH (FF),A
+        0xAF,             // XOR A
+        0xE0, 0x0F,       // LDH (0F),A    IF cleared
+        0x76,             // HALT          (IME = 0: wakes up on mode 2 and goes on)
+    };
+    uint16_t pc = 0x0100;
+
+    memcpy(&rom[pc], setup, sizeof(setup));
+    pc += sizeof(setup);
+    for (int i = 0; i < READS; i++) {
+        uint8_t reads[] = { 0xF0, 0x41, 0xE0, 0x80 + i }; // LDH A,(41) / LDH (80+i),A
+        memcpy(&rom[pc], reads, sizeof(reads));
+        pc += sizeof(reads);
+    }
+    rom[pc++] = 0x18; // JR -2
+    rom[pc++] = 0xFE;
+}
+
+// Mode seen `cycles` after mode 2 began
+static uint8_t expected_mode(uint32_t cycles) {
+    if (cycles < PPU_OAM_CYCLES) return 2;
+    if (cycles < PPU_OAM_CYCLES + PPU_TRANSFER_CYCLES) return 3;
+    return 0;
+}
+
+static void check_core(GBAccuracy accuracy, const char *name) {
+    static GameBoy gb;
+    gb_init_accuracy(&gb, accuracy);
+    CHECK(gb_load_rom(&gb, rom, sizeof(rom)) == 0, "%s: cannot load the ROM", name);
+    gb_boot(&gb);
+    gb_run_frame(&gb);
+    gb_run_frame(&gb);
+
+    for (int i = 0; i < READS; i++) {
+        uint32_t at = i * READ_CYCLES + (accuracy == GB_ACCURACY_CYCLE ? READ_OFFSET : 0);
+        uint8_t mode = gb.mmu.hram[i] & 0x03;
+        CHECK(mode == expected_mode(at), "%s: read %d (cycle %u of the line) saw mode %d, expected %d",
+              name, i, at, mode, expected_mode(at));
+    }
+    gb_free(&gb);
+}
+
+int main(void) {
+    build_rom();
+
+    check_core(GB_ACCURACY_CYCLE, "cycle");
+    check_core(GB_ACCURACY_FAST, "fast");
+
+    printf("%s ppu timing: %d failures\n", failures ? "❌" : "✅", failures);
+    return failures ? 1 : 0;
+}
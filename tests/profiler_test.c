@@ -0,0 +1,106 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../includes/mmu.h"
+#include "../includes/profiler.h"
+
+// Collapsed stacks stay inside profiler_sample's buffer whatever the symbols look like
+// (`make check`, run under valgrind or -fsanitize=address to catch the overflow itself)
+
+int DEBUG_MODE = 0;
+
+static int failures = 0;
+
+#define CHECK(cond, ...) do { \
+    if (!(cond)) { \
+        printf("❌ %s:%d: ", __FILE__, __LINE__); \
+        printf(__VA_ARGS__); \
+        printf("\n"); \
+        failures++; \
+    } \
+} while (0)
+
+// The only stack recorded so far
+static const char *only_stack(const Profiler *p) {
+    for (size_t i = 0; i < p->stackCapacity; i++) {
+        if (p->stacks[i].stack) return p->stacks[i].stack;
+    }
+    return NULL;
+}
+
+static void call_deep(Profiler *p, const MMU *mmu, int depth) {
+    for (int i = 0; i < depth; i++) profiler_call(p, 0x0100 + i, 0xFFFE - 2 * i, mmu);
+}
+
+// 64 frames of 199 characters (the longest name the .sym loader keeps) is ~12 KB of stack
+static void test_deep_frames(const MMU *mmu) {
+    char path[] = "/tmp/profiler_test_XXXXXX";
+    int fd = mkstemp(path);
+    CHECK(fd >= 0, "mkstemp failed");
+    if (fd < 0) return;
+
+    FILE *f = fdopen(fd, "w");
+    for (int i = 0; i < PROFILER_MAX_DEPTH; i++) {
+        fprintf(f, "00:%04X ", 0x0100 + i);
+        for (int c = 0; c < 195; c++) fputc('a' + i % 26, f);
+        fprintf(f, "%04d\n", i);
+    }
+    fclose(f);
+
+    Profiler *p = profiler_create(1);
+    CHECK(profiler_load_symbols(p, path) == 0, "cannot load %s", path);
+    remove(path);
+
+    call_deep(p, mmu, PROFILER_MAX_DEPTH + 10);
+    profiler_sample(p, 0x0150, mmu);
+
+    const char *stack = only_stack(p);
+    CHECK(stack != NULL, "no stack recorded");
+    if (stack) {
+        CHECK(strncmp(stack, "gb;", 3) == 0, "stack does not start at the root: %.16s", stack);
+        CHECK(strlen(stack) < 4096, "stack is %zu bytes", strlen(stack));
+    }
+    profiler_free(p);
+}
+
+// A symbol longer than the whole buffer, both as a caller and as the leaf
+static void test_huge_symbol(const MMU *mmu) {
+    Profiler *p = profiler_create(1);
+    char *name = malloc(5000);
+    memset(name, 'x', 4999);
+    name[4999] = '\0';
+
+    p->symbols = malloc(2 * sizeof(ProfilerSymbol));
+    p->symbols[0] = (ProfilerSymbol){ .bank = 0, .addr = 0x0100, .name = name };
+    p->symbols[1] = (ProfilerSymbol){ .bank = 0, .addr = 0x0200, .name = strdup("leaf") };
+    p->symbolCount = 2;
+
+    // Caller: truncated at the end of the buffer, the leaf is dropped
+    call_deep(p, mmu, 3);
+    profiler_sample(p, 0x0250, mmu);
+    const char *stack = only_stack(p);
+    CHECK(stack && strlen(stack) == 4095, "caller stack is %zu bytes", stack ? strlen(stack) : 0);
+
+    // Leaf: no caller, the leaf alone fills the buffer
+    Profiler *q = profiler_create(1);
+    q->symbols = p->symbols;
+    q->symbolCount = p->symbolCount;
+    profiler_sample(q, 0x0150, mmu);
+    stack = only_stack(q);
+    CHECK(stack && strlen(stack) == 4095, "leaf stack is %zu bytes", stack ? strlen(stack) : 0);
+    q->symbols = NULL;
+    q->symbolCount = 0;
+
+    profiler_free(q);
+    profiler_free(p);
+}
+
+int main(void) {
+    static MMU mmu;
+
+    test_deep_frames(&mmu);
+    test_huge_symbol(&mmu);
+
+    printf("%s profiler: %d failures\n", failures ? "❌" : "✅", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,58 @@
+#include <stdio.h>
+#include <string.h>
+#include "../includes/video.h"
+
+// Ghosting changes with the render worker running (`make check`; build with
+// -fsanitize=thread to check that the worker and the emulation don't race)
+
+int DEBUG_MODE = 0;
+
+static int failures = 0;
+
+#define CHECK(cond, ...) do { \
+    if (!(cond)) { \
+        printf("❌ %s:%d: ", __FILE__, __LINE__); \
+        printf(__VA_ARGS__); \
+        printf("\n"); \
+        failures++; \
+    } \
+} while (0)
+
+static PPU ppu;
+
+// Red channel of the top left pixel once `shade` (0 = white ... 3 = black) has gone through
+static int show(Video *video, uint8_t shade) {
+    memset(ppu.framebuffer, shade, sizeof(ppu.framebuffer));
+    video_submit(video, &ppu, 0);
+    video_wait(video);
+    return video->output[0] & 0xFF;
+}
+
+int main(void) {
+    static Video video;
+
+    CHECK(video_init(&video, 1, VIDEO_FILTER_NEAREST) == 0, "video_init failed");
+    CHECK(video_start_worker(&video) == 0, "video_start_worker failed");
+
+    show(&video, 0);
+    CHECK(video_set_ghosting(&video, 50) == 0, "video_set_ghosting(50) failed");
+    CHECK(show(&video, 3) == 0x00, "first frame after the change is not shown as is");
+    int blended = show(&video, 0);
+    CHECK(blended > 0x00 && blended < 0xFF, "white after black with ghosting gave %02X", blended);
+
+    // Changes racing with frames still in flight
+    for (int i = 0; i < 200; i++) {
+        memset(ppu.framebuffer, i & 3, sizeof(ppu.framebuffer));
+        video_submit(&video, &ppu, 0);
+        video_set_ghosting(&video, (i * 7) % (VIDEO_MAX_GHOSTING + 1));
+    }
+    video_wait(&video);
+
+    CHECK(video_set_ghosting(&video, 0) == 0, "video_set_ghosting(0) failed");
+    CHECK(show(&video, 3) == 0x00, "black with ghosting off");
+    CHECK(show(&video, 0) == 0xFF, "white right after black with ghosting off");
+
+    video_free(&video);
+    printf("%s video: %d failures\n", failures ? "❌" : "✅", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,281 @@
+// Binary trace reader (files written by gb --trace)
+//   gb-tracedump dump <trace> [--pc A[-B]] [--mem A[-B]] [--writes] [--op XX] [--from N] [--count N]
+//   gb-tracedump diff <a> <b> [--context N] [--no-cycles]   first divergence
+//   gb-tracedump stats <trace>                              sizes and opcode mix
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../includes/trace.h"
+
+int DEBUG_MODE = 0; // the core is linked in
+
+#define DIFF_MAX_CONTEXT 64
+
+static const char *reg_names[8] = { "A", "F", "B", "C", "D", "E", "H", "L" };
+
+typedef struct {
+    uint16_t pcLow, pcHigh;
+    uint16_t memLow, memHigh;
+    uint8_t hasPc, hasMem, writesOnly;
+    int opcode;        // -1 = any
+    uint64_t from;
+    uint64_t count;    // 0 = no limit
+} DumpFilter;
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s dump <trace> [--pc A[-B]] [--mem A[-B]] [--writes] [--op XX] [--from N] [--count N]\n", prog);
+    fprintf(stderr, "       %s diff <a> <b> [--context N] [--no-cycles]\n", prog);
+    fprintf(stderr, "       %s stats <trace>\n", prog);
+}
+
+// "C000" or "C000-DFFF" (hex)
+static int parse_range(const char *text, uint16_t *low, uint16_t *high) {
+    char *end;
+    unsigned long a = strtoul(text, &end, 16), b = a;
+
+    if (end == text || a > 0xFFFF) return -1;
+    if (*end == '-') {
+        const char *second = end + 1;
+        b = strtoul(second, &end, 16);
+        if (end == second || b > 0xFFFF || b < a) return -1;
+    }
+    if (*end != '\0') return -1;
+    *low = (uint16_t)a;
+    *high = (uint16_t)b;
+    return 0;
+}
+
+static void print_event(FILE *out, const TraceEvent *e) {
+    fprintf(out, "%10llu %12llu  %04X  ", (unsigned long long)e->index, (unsigned long long)e->cycle, e->PC);
+    if (e->flags & TRACE_F_INTERRUPT) fprintf(out, "INT   ");
+    else if (e->flags & TRACE_F_CB) fprintf(out, "CB %02X ", e->cbOpcode);
+    else fprintf(out, "%02X    ", e->opcode);
+
+    for (int i = 0; i < 8; i++) fprintf(out, " %s=%02X", reg_names[i], e->regs[i]);
+    fprintf(out, " SP=%04X", e->SP);
+    for (int i = 0; i < e->accessCount; i++) {
+        const TraceAccess *a = &e->accesses[i];
+        fprintf(out, " %c:%04X=%02X", a->write ? 'W' : 'R', a->addr, a->value);
+    }
+    fputc('\n', out);
+}
+
+static int open_trace(TraceReader *reader, const char *filename) {
+    if (trace_reader_open(reader, filename) == 0) return 0;
+    fprintf(stderr, "Cannot read trace %s\n", filename);
+    return -1;
+}
+
+static int matches(const DumpFilter *f, const TraceEvent *e) {
+    if (e->index < f->from) return 0;
+    if (f->hasPc && (e->PC < f->pcLow || e->PC > f->pcHigh)) return 0;
+    if (f->opcode >= 0 && ((e->flags & TRACE_F_INTERRUPT) || e->opcode != f->opcode)) return 0;
+    if (f->hasMem || f->writesOnly) {
+        for (int i = 0; i < e->accessCount; i++) {
+            const TraceAccess *a = &e->accesses[i];
+            if (f->writesOnly && !a->write) continue;
+            if (f->hasMem && (a->addr < f->memLow || a->addr > f->memHigh)) continue;
+            return 1;
+        }
+        return 0;
+    }
+    return 1;
+}
+
+static int cmd_dump(const char *filename, const DumpFilter *filter) {
+    static TraceEvent event;
+    TraceReader reader;
+    uint64_t shown = 0;
+    int res;
+
+    if (open_trace(&reader, filename) != 0) return 1;
+    while ((res = trace_reader_next(&reader, &event)) > 0) {
+        if (!matches(filter, &event)) continue;
+        print_event(stdout, &event);
+        if (filter->count && ++shown >= filter->count) break;
+    }
+    trace_reader_close(&reader);
+    if (res < 0) {
+        fprintf(stderr, "%s: corrupt block\n", filename);
+        return 1;
+    }
+    return 0;
+}
+
+// Name of the first field that differs, NULL when the events are the same
+static const char *event_difference(const TraceEvent *a, const TraceEvent *b, int cycles) {
+    if (a->PC != b->PC) return "PC";
+    if ((a->flags & (TRACE_F_INTERRUPT | TRACE_F_CB)) != (b->flags & (TRACE_F_INTERRUPT | TRACE_F_CB))) return "kind";
+    if (a->opcode != b->opcode || a->cbOpcode != b->cbOpcode) return "opcode";
+    for (int i = 0; i < 8; i++) {
+        if (a->regs[i] != b->regs[i]) return reg_names[i];
+    }
+    if (a->SP != b->SP) return "SP";
+    if (a->accessCount != b->accessCount) return "memory accesses";
+    for (int i = 0; i < a->accessCount; i++) {
+        if (memcmp(&a->accesses[i], &b->accesses[i], sizeof(TraceAccess)) != 0) return "memory accesses";
+    }
+    if (cycles && a->cycle != b->cycle) return "cycles";
+    return NULL;
+}
+
+static int cmd_diff(const char *fileA, const char *fileB, int context, int cycles) {
+    static TraceEvent history[DIFF_MAX_CONTEXT];
+    static TraceEvent a, b;
+    TraceReader readerA, readerB;
+    uint64_t same = 0;
+    int resA, resB, status = 0;
+
+    if (open_trace(&readerA, fileA) != 0) return 1;
+    if (open_trace(&readerB, fileB) != 0) {
+        trace_reader_close(&readerA);
+        return 1;
+    }
+
+    for (;;) {
+        resA = trace_reader_next(&readerA, &a);
+        resB = trace_reader_next(&readerB, &b);
+        if (resA < 0 || resB < 0) {
+            fprintf(stderr, "%s: corrupt block\n", resA < 0 ? fileA : fileB);
+            status = 2;
+            break;
+        }
+        if (resA == 0 || resB == 0) {
+            if (resA != resB) {
+                printf("Same %llu records, then %s ends\n", (unsigned long long)same, resA == 0 ? fileA : fileB);
+                status = 1;
+            } else {
+                printf("Identical: %llu records\n", (unsigned long long)same);
+            }
+            break;
+        }
+
+        const char *field = event_difference(&a, &b, cycles);
+        if (field) {
+            printf("First difference at record %llu (%s):\n", (unsigned long long)same, field);
+            uint64_t shown = same < (uint64_t)context ? same : (uint64_t)context;
+            for (uint64_t i = same - shown; i < same; i++) {
+                printf("   ");
+                print_event(stdout, &history[i % DIFF_MAX_CONTEXT]);
+            }
+            printf(" a ");
+            print_event(stdout, &a);
+            printf(" b ");
+            print_event(stdout, &b);
+            status = 1;
+            break;
+        }
+        if (context > 0) history[same % DIFF_MAX_CONTEXT] = a;
+        same++;
+    }
+
+    trace_reader_close(&readerA);
+    trace_reader_close(&readerB);
+    return status;
+}
+
+static int cmd_stats(const char *filename) {
+    static TraceEvent event;
+    static uint64_t opcodes[512];
+    TraceReader reader;
+    uint64_t records = 0, interrupts = 0, accesses = 0, writes = 0, lastCycle = 0;
+    int res;
+
+    if (open_trace(&reader, filename) != 0) return 1;
+    while ((res = trace_reader_next(&reader, &event)) > 0) {
+        records++;
+        lastCycle = event.cycle;
+        accesses += event.accessCount;
+        for (int i = 0; i < event.accessCount; i++) writes += event.accesses[i].write;
+        if (event.flags & TRACE_F_INTERRUPT) interrupts++;
+        else opcodes[(event.flags & TRACE_F_CB) ? 256 + event.cbOpcode : event.opcode]++;
+    }
+    long size = ftell(reader.file);
+    uint32_t flags = reader.flags;
+    trace_reader_close(&reader);
+    if (res < 0) {
+        fprintf(stderr, "%s: corrupt block\n", filename);
+        return 1;
+    }
+
+    printf("%s: %s, %llu records (%llu interrupts), %llu cycles (%.2f s)\n", filename,
+           (flags & 1) ? "CGB" : "DMG", (unsigned long long)records, (unsigned long long)interrupts,
+           (unsigned long long)lastCycle, lastCycle / 4194304.0);
+    printf("  %ld bytes, %.2f bytes/record\n", size, records ? (double)size / records : 0.0);
+    printf("  %llu memory accesses (%llu writes)\n", (unsigned long long)accesses, (unsigned long long)writes);
+
+    printf("  Top opcodes:\n");
+    for (int n = 0; n < 10; n++) {
+        int best = -1;
+        for (int i = 0; i < 512; i++) {
+            if (opcodes[i] && (best < 0 || opcodes[i] > opcodes[best])) best = i;
+        }
+        if (best < 0) break;
+        printf("    %s%02X %12llu  %5.1f%%\n", best >= 256 ? "CB " : "   ", best & 0xFF,
+               (unsigned long long)opcodes[best], 100.0 * opcodes[best] / (records - interrupts));
+        opcodes[best] = 0;
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 3) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (strcmp(argv[1], "dump") == 0) {
+        DumpFilter filter;
+        memset(&filter, 0, sizeof(filter));
+        filter.opcode = -1;
+        for (int i = 3; i < argc; i++) {
+            if (strcmp(argv[i], "--pc") == 0 && i + 1 < argc) {
+                if (parse_range(argv[++i], &filter.pcLow, &filter.pcHigh) != 0) {
+                    fprintf(stderr, "Bad range %s\n", argv[i]);
+                    return 1;
+                }
+                filter.hasPc = 1;
+            } else if (strcmp(argv[i], "--mem") == 0 && i + 1 < argc) {
+                if (parse_range(argv[++i], &filter.memLow, &filter.memHigh) != 0) {
+                    fprintf(stderr, "Bad range %s\n", argv[i]);
+                    return 1;
+                }
+                filter.hasMem = 1;
+            } else if (strcmp(argv[i], "--writes") == 0) {
+                filter.writesOnly = 1;
+            } else if (strcmp(argv[i], "--op") == 0 && i + 1 < argc) {
+                filter.opcode = (int)(strtoul(argv[++i], NULL, 16) & 0xFF);
+            } else if (strcmp(argv[i], "--from") == 0 && i + 1 < argc) {
+                filter.from = strtoull(argv[++i], NULL, 0);
+            } else if (strcmp(argv[i], "--count") == 0 && i + 1 < argc) {
+                filter.count = strtoull(argv[++i], NULL, 0);
+            } else {
+                usage(argv[0]);
+                return 1;
+            }
+        }
+        return cmd_dump(argv[2], &filter);
+    }
+
+    if (strcmp(argv[1], "diff") == 0 && argc >= 4) {
+        int context = 8, cycles = 1;
+        for (int i = 4; i < argc; i++) {
+            if (strcmp(argv[i], "--context") == 0 && i + 1 < argc) {
+                context = atoi(argv[++i]);
+                if (context < 0) context = 0;
+                if (context > DIFF_MAX_CONTEXT) context = DIFF_MAX_CONTEXT;
+            } else if (strcmp(argv[i], "--no-cycles") == 0) {
+                cycles = 0;
+            } else {
+                usage(argv[0]);
+                return 1;
+            }
+        }
+        return cmd_diff(argv[2], argv[3], context, cycles);
+    }
+
+    if (strcmp(argv[1], "stats") == 0) return cmd_stats(argv[2]);
+
+    usage(argv[0]);
+    return 1;
+}
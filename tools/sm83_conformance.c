@@ -0,0 +1,554 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "../includes/cpu.h"
+#include "../includes/mmu.h"
+
+// SM83 conformance runner: `make conformance SM83_TESTS=dir`
+// Runs the JSON single-step vectors (one file per opcode, "00.json" ... "cb ff.json"),
+// files are spread over one worker thread per core. Each test runs on both CPU
+// cores and checks the final state, the cycle count and, through the MMU access
+// hook, every bus access listed in "cycles" (address, data, read or write) in
+// order; on the cycle-accurate core each access must also be on its M-cycle
+
+int DEBUG_MODE = 0;
+
+#define MAX_FILES 1024
+#define MAX_ACCESSES 16
+
+// ===== Minimal JSON reader =====
+// Nodes live in one array, children are linked by index (the array grows with realloc)
+typedef enum { JSON_NULL, JSON_BOOL, JSON_NUMBER, JSON_STRING, JSON_ARRAY, JSON_OBJECT } JsonType;
+
+typedef struct {
+    JsonType type;
+    double number;
+    const char *str;    // string value (points into the file buffer, not terminated)
+    size_t str_len;
+    const char *key;    // member name inside an object (points into the file buffer)
+    size_t key_len;
+    int first_child;    // -1 = none
+    int next;           // next sibling, -1 = last
+} JsonNode;
+
+typedef struct {
+    char *text;
+    size_t pos;
+    JsonNode *nodes;
+    int count;
+    int capacity;
+    int error;
+} JsonDoc;
+
+static int json_new_node(JsonDoc *doc, JsonType type) {
+    if (doc->count == doc->capacity) {
+        doc->capacity = doc->capacity ? doc->capacity * 2 : 4096;
+        JsonNode *grown = realloc(doc->nodes, doc->capacity * sizeof(JsonNode));
+        if (!grown) { doc->error = 1; return -1; }
+        doc->nodes = grown;
+    }
+    JsonNode *n = &doc->nodes[doc->count];
+    memset(n, 0, sizeof(*n));
+    n->type = type;
+    n->first_child = n->next = -1;
+    return doc->count++;
+}
+
+static void json_skip_ws(JsonDoc *doc) {
+    while (doc->text[doc->pos] == ' ' || doc->text[doc->pos] == '\n' ||
+           doc->text[doc->pos] == '\r' || doc->text[doc->pos] == '\t') doc->pos++;
+}
+
+// Strings are keys, test names or cycle annotations: no unescaping needed
+static const char *json_string(JsonDoc *doc, size_t *len) {
+    const char *start = &doc->text[++doc->pos];
+    while (doc->text[doc->pos] && doc->text[doc->pos] != '"') {
+        if (doc->text[doc->pos] == '\\' && doc->text[doc->pos + 1]) doc->pos++;
+        doc->pos++;
+    }
+    if (!doc->text[doc->pos]) { doc->error = 1; return start; }
+    *len = &doc->text[doc->pos] - start;
+    doc->pos++;
+    return start;
+}
+
+static int json_value(JsonDoc *doc) {
+    json_skip_ws(doc);
+    char c = doc->text[doc->pos];
+
+    if (c == '{' || c == '[') {
+        int node = json_new_node(doc, c == '{' ? JSON_OBJECT : JSON_ARRAY);
+        char close = c == '{' ? '}' : ']';
+        int last = -1;
+        doc->pos++;
+        json_skip_ws(doc);
+        if (doc->text[doc->pos] == close) { doc->pos++; return node; }
+
+        while (!doc->error) {
+            const char *key = NULL;
+            size_t key_len = 0;
+            if (close == '}') {
+                json_skip_ws(doc);
+                if (doc->text[doc->pos] != '"') { doc->error = 1; break; }
+                key = json_string(doc, &key_len);
+                json_skip_ws(doc);
+                if (doc->text[doc->pos++] != ':') { doc->error = 1; break; }
+            }
+            int child = json_value(doc);
+            if (child < 0) break;
+            doc->nodes[child].key = key;
+            doc->nodes[child].key_len = key_len;
+            if (last < 0) doc->nodes[node].first_child = child;
+            else doc->nodes[last].next = child;
+            last = child;
+
+            json_skip_ws(doc);
+            if (doc->text[doc->pos] == ',') { doc->pos++; continue; }
+            if (doc->text[doc->pos] == close) { doc->pos++; break; }
+            doc->error = 1;
+        }
+        return doc->error ? -1 : node;
+    }
+
+    if (c == '"') {
+        size_t len;
+        int node = json_new_node(doc, JSON_STRING);
+        const char *str = json_string(doc, &len);
+        if (node >= 0) {
+            doc->nodes[node].str = str;
+            doc->nodes[node].str_len = len;
+        }
+        return node;
+    }
+
+    if (c == 't' || c == 'f' || c == 'n') {
+        int node = json_new_node(doc, c == 'n' ? JSON_NULL : JSON_BOOL);
+        if (node >= 0) doc->nodes[node].number = (c == 't');
+        while (doc->text[doc->pos] >= 'a' && doc->text[doc->pos] <= 'z') doc->pos++;
+        return node;
+    }
+
+    char *end;
+    double number = strtod(&doc->text[doc->pos], &end);
+    if (end == &doc->text[doc->pos]) { doc->error = 1; return -1; }
+    doc->pos = end - doc->text;
+    int node = json_new_node(doc, JSON_NUMBER);
+    if (node >= 0) doc->nodes[node].number = number;
+    return node;
+}
+
+static const JsonNode *json_get(const JsonDoc *doc, const JsonNode *object, const char *key) {
+    size_t len = strlen(key);
+    for (int i = object->first_child; i >= 0; i = doc->nodes[i].next) {
+        const JsonNode *n = &doc->nodes[i];
+        if (n->key_len == len && memcmp(n->key, key, len) == 0) return n;
+    }
+    return NULL;
+}
+
+static int json_int(const JsonDoc *doc, const JsonNode *object, const char *key) {
+    const JsonNode *n = json_get(doc, object, key);
+    return n ? (int)n->number : 0;
+}
+
+static int json_length(const JsonDoc *doc, const JsonNode *array) {
+    int count = 0;
+    for (int i = array->first_child; i >= 0; i = doc->nodes[i].next) count++;
+    return count;
+}
+
+// ===== Test execution =====
+typedef struct {
+    uint16_t addr;
+    uint8_t val;
+    uint8_t write;
+    uint16_t cycle;     // M-cycle of the access (cycle-accurate core only)
+} BusAccess;
+
+typedef struct {
+    CPU cpu;
+    MMU mmu;
+    uint8_t memory[0x10000];
+
+    // Every page is trapped, so the access hook logs each access of the instruction
+    BusAccess bus[MAX_ACCESSES];
+    int bus_count;      // may be > MAX_ACCESSES, extra accesses are not stored
+    uint32_t ticked;    // cycles given to cpu->tick so far (cycle-accurate core)
+} Machine;
+
+static void log_access(void *ctx, uint16_t addr, uint8_t val, uint8_t write) {
+    Machine *m = ctx;
+    if (m->bus_count < MAX_ACCESSES) m->bus[m->bus_count] = (BusAccess){ addr, val, write, m->ticked / 4 };
+    m->bus_count++;
+}
+
+// cpu->tick runs up to each access: the cycles before an access tell its M-cycle
+static void count_cycles(void *ctx, uint16_t cycles) {
+    ((Machine *)ctx)->ticked += cycles;
+}
+
+static void load_state(Machine *m, const JsonDoc *doc, const JsonNode *state) {
+    CPU *cpu = &m->cpu;
+
+    cpu_init(cpu);
+    cpu->PC = json_int(doc, state, "pc");
+    cpu->SP = json_int(doc, state, "sp");
+    cpu->A = json_int(doc, state, "a");
+    cpu->F = json_int(doc, state, "f");
+    cpu->B = json_int(doc, state, "b");
+    cpu->C = json_int(doc, state, "c");
+    cpu->D = json_int(doc, state, "d");
+    cpu->E = json_int(doc, state, "e");
+    cpu->H = json_int(doc, state, "h");
+    cpu->L = json_int(doc, state, "l");
+    cpu->ime = json_int(doc, state, "ime");
+    cpu->imePending = json_int(doc, state, "ei");
+    m->mmu.interrupt_enable = json_int(doc, state, "ie");
+
+    const JsonNode *ram = json_get(doc, state, "ram");
+    if (!ram) return;
+    for (int i = ram->first_child; i >= 0; i = doc->nodes[i].next) {
+        const JsonNode *addr = &doc->nodes[doc->nodes[i].first_child];
+        const JsonNode *val = &doc->nodes[addr->next];
+        m->memory[(uint16_t)addr->number] = (uint8_t)val->number;
+    }
+}
+
+// Return 0 when the machine matches the expected state, describe the first mismatch otherwise
+static int check_state(Machine *m, const JsonDoc *doc, const JsonNode *state, char *why, size_t why_size) {
+    const CPU *cpu = &m->cpu;
+    struct { const char *name; int actual; } regs[] = {
+        { "pc", cpu->PC }, { "sp", cpu->SP },
+        { "a", cpu->A }, { "f", cpu->F }, { "b", cpu->B }, { "c", cpu->C },
+        { "d", cpu->D }, { "e", cpu->E }, { "h", cpu->H }, { "l", cpu->L },
+    };
+
+    for (size_t i = 0; i < sizeof(regs) / sizeof(regs[0]); i++) {
+        int expected = json_int(doc, state, regs[i].name);
+        if (regs[i].actual != expected) {
+            snprintf(why, why_size, "%s=0x%04X expected 0x%04X", regs[i].name, regs[i].actual, expected);
+            return 1;
+        }
+    }
+
+    // Vectors with an "ei" field track the EI delay separately, otherwise compare the effective IME
+    int ime = json_get(doc, state, "ei") ? cpu->ime : (cpu->ime || cpu->imePending);
+    if (json_get(doc, state, "ime") && ime != json_int(doc, state, "ime")) {
+        snprintf(why, why_size, "ime=%d expected %d", ime, json_int(doc, state, "ime"));
+        return 1;
+    }
+
+    const JsonNode *ram = json_get(doc, state, "ram");
+    if (!ram) return 0;
+    for (int i = ram->first_child; i >= 0; i = doc->nodes[i].next) {
+        const JsonNode *addr = &doc->nodes[doc->nodes[i].first_child];
+        const JsonNode *val = &doc->nodes[addr->next];
+        uint16_t a = (uint16_t)addr->number;
+        if (m->memory[a] != (uint8_t)val->number) {
+            snprintf(why, why_size, "[0x%04X]=0x%02X expected 0x%02X", a, m->memory[a], (uint8_t)val->number);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// "cycles": one entry per M-cycle, [addr, data, "r-m" | "-wm"] for an access,
+// null or [addr, data, "---"] for an internal cycle
+static int check_bus(const Machine *m, const JsonDoc *doc, const JsonNode *cycles, int timed,
+                     char *why, size_t why_size) {
+    int index = 0;
+    int position = 0;
+
+    for (int i = cycles->first_child; i >= 0; i = doc->nodes[i].next, position++) {
+        const JsonNode *cycle = &doc->nodes[i];
+        if (cycle->type != JSON_ARRAY || json_length(doc, cycle) < 3) continue;
+        const JsonNode *addr = &doc->nodes[cycle->first_child];
+        const JsonNode *val = &doc->nodes[addr->next];
+        const JsonNode *kind = &doc->nodes[val->next];
+        if (kind->type != JSON_STRING) continue;
+        int read = memchr(kind->str, 'r', kind->str_len) != NULL;
+        int write = memchr(kind->str, 'w', kind->str_len) != NULL;
+        if (!read && !write) continue;
+
+        if (index >= m->bus_count || index >= MAX_ACCESSES) {
+            snprintf(why, why_size, "access %d missing, expected %s [0x%04X]", index,
+                     write ? "write" : "read", (uint16_t)addr->number);
+            return 1;
+        }
+        const BusAccess *a = &m->bus[index++];
+        if (a->addr != (uint16_t)addr->number || a->val != (uint8_t)val->number || a->write != write) {
+            snprintf(why, why_size, "access %d %s [0x%04X]=0x%02X expected %s [0x%04X]=0x%02X", index - 1,
+                     a->write ? "write" : "read", a->addr, a->val,
+                     write ? "write" : "read", (uint16_t)addr->number, (uint8_t)val->number);
+            return 1;
+        }
+        if (timed && a->cycle != position) {
+            snprintf(why, why_size, "access %d on M-cycle %d expected %d", index - 1, a->cycle, position);
+            return 1;
+        }
+    }
+    if (index != m->bus_count) {
+        snprintf(why, why_size, "%d accesses expected %d", m->bus_count, index);
+        return 1;
+    }
+    return 0;
+}
+
+typedef struct {
+    char name[256];
+    int tests;
+    int failures;
+    int skipped;        // tests without an initial or final state
+    char first_failure[256];
+} FileResult;
+
+static char tests_dir[1024];
+static FileResult files[MAX_FILES];
+static int file_count = 0;
+static int next_file = 0;
+static int verbose = 0;
+static int check_accesses = 1;
+static pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static char *read_file(const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return NULL;
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    char *text = malloc(size + 1);
+    if (!text) {
+        fprintf(stderr, "Out of memory reading %s\n", path);
+        exit(2);
+    }
+    if (fread(text, 1, size, f) != (size_t)size) { free(text); text = NULL; }
+    if (text) text[size] = '\0';
+    fclose(f);
+    return text;
+}
+
+// One test on one core, 0 when it passes
+static int run_test(Machine *m, const JsonDoc *doc, const JsonNode *initial, const JsonNode *final,
+                    const JsonNode *cycles, int accurate, char *why, size_t why_size) {
+    memset(m->memory, 0, sizeof(m->memory));
+    load_state(m, doc, initial);
+    m->bus_count = 0;
+    m->ticked = 0;
+
+    uint16_t taken;
+    if (accurate) {
+        m->cpu.tick = count_cycles;
+        m->cpu.tickCtx = m;
+        taken = cpu_execute_accurate(&m->cpu, &m->mmu);
+    } else {
+        taken = cpu_execute(&m->cpu, &m->mmu);
+    }
+
+    if (check_state(m, doc, final, why, why_size)) return 1;
+    if (cycles && taken != json_length(doc, cycles) * 4) {
+        snprintf(why, why_size, "%d cycles expected %d", taken, json_length(doc, cycles) * 4);
+        return 1;
+    }
+    if (accurate && m->ticked != taken) {
+        snprintf(why, why_size, "%u cycles given to tick for %d", m->ticked, taken);
+        return 1;
+    }
+    if (cycles && check_accesses) return check_bus(m, doc, cycles, accurate, why, why_size);
+    return 0;
+}
+
+static void run_file(Machine *m, FileResult *result) {
+    char path[1400];
+    snprintf(path, sizeof(path), "%s/%s", tests_dir, result->name);
+
+    JsonDoc doc = { 0 };
+    doc.text = read_file(path);
+    if (!doc.text) {
+        result->failures = 1;
+        snprintf(result->first_failure, sizeof(result->first_failure), "cannot read file");
+        return;
+    }
+
+    int root = json_value(&doc);
+    if (root < 0 || doc.error || doc.nodes[root].type != JSON_ARRAY) {
+        result->failures = 1;
+        snprintf(result->first_failure, sizeof(result->first_failure), "invalid JSON");
+        free(doc.text);
+        free(doc.nodes);
+        return;
+    }
+
+    for (int t = doc.nodes[root].first_child; t >= 0; t = doc.nodes[t].next) {
+        const JsonNode *test = &doc.nodes[t];
+        const JsonNode *initial = json_get(&doc, test, "initial");
+        const JsonNode *final = json_get(&doc, test, "final");
+        const JsonNode *cycles = json_get(&doc, test, "cycles");
+        const JsonNode *name = json_get(&doc, test, "name");
+        if (!initial || !final) {
+            result->skipped++;
+            continue;
+        }
+
+        char why[128];
+        int failed = 0;
+        const char *core = "";
+        for (int accurate = 0; accurate <= 1 && !failed; accurate++) {
+            failed = run_test(m, &doc, initial, final, cycles, accurate, why, sizeof(why));
+            if (failed && accurate) core = "[cycle] ";
+        }
+
+        result->tests++;
+        if (failed) {
+            if (result->failures++ == 0) {
+                snprintf(result->first_failure, sizeof(result->first_failure), "%.*s: %s%s",
+                         name ? (int)name->str_len : 0, name ? name->str : "", core, why);
+            }
+        }
+    }
+
+    free(doc.text);
+    free(doc.nodes);
+}
+
+static void *worker(void *arg) {
+    (void)arg;
+    Machine *m = malloc(sizeof(Machine));
+    if (!m) {
+        fprintf(stderr, "Out of memory\n");
+        exit(2);
+    }
+    mmu_init(&m->mmu);
+    m->mmu.trap_read = m->mmu.trap_write = 0xFFFF;
+    m->mmu.access_hook = log_access;
+    m->mmu.access_ctx = m;
+    mmu_map_flat(&m->mmu, m->memory);
+
+    for (;;) {
+        pthread_mutex_lock(&queue_lock);
+        int index = next_file < file_count ? next_file++ : -1;
+        pthread_mutex_unlock(&queue_lock);
+        if (index < 0) break;
+
+        run_file(m, &files[index]);
+        if (verbose) {
+            fprintf(stderr, "  %-16s %d/%d\n", files[index].name,
+                    files[index].tests - files[index].failures, files[index].tests);
+        }
+    }
+    free(m);
+    return NULL;
+}
+
+static int compare_names(const void *a, const void *b) {
+    return strcmp(((const FileResult *)a)->name, ((const FileResult *)b)->name);
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [--jobs N] [--verbose] [--no-bus] <tests dir>\n", prog);
+}
+
+// Opcodes the suite has no file for (STOP and HALT in tests/sm83), written to `out`
+static int missing_opcodes(char *out, size_t size) {
+    static const uint8_t illegal[] = { 0xD3, 0xDB, 0xDD, 0xE3, 0xE4, 0xEB, 0xEC, 0xED, 0xF4, 0xFC, 0xFD };
+    int missing = 0;
+    size_t len = 0;
+    out[0] = '\0';
+
+    for (int op = 0; op < 0x200; op++) {
+        char name[16];
+        if (op == 0xCB || (op < 0x100 && memchr(illegal, op, sizeof(illegal)))) continue;
+        if (op < 0x100) snprintf(name, sizeof(name), "%02x.json", op);
+        else snprintf(name, sizeof(name), "cb %02x.json", op & 0xFF);
+
+        int found = 0;
+        for (int i = 0; i < file_count && !found; i++) found = strcasecmp(files[i].name, name) == 0;
+        if (found) continue;
+
+        missing++;
+        if (len + 8 < size) len += snprintf(out + len, size - len, "%s%.*s", len ? " " : "", (int)strlen(name) - 5, name);
+    }
+    return missing;
+}
+
+int main(int argc, char **argv) {
+    long jobs = sysconf(_SC_NPROCESSORS_ONLN);
+    const char *dir = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) jobs = strtol(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--verbose") == 0) verbose = 1;
+        else if (strcmp(argv[i], "--no-bus") == 0) check_accesses = 0;
+        else if (argv[i][0] != '-' && !dir) dir = argv[i];
+        else { usage(argv[0]); return 2; }
+    }
+    if (!dir) { usage(argv[0]); return 2; }
+    if (jobs < 1) jobs = 1;
+    snprintf(tests_dir, sizeof(tests_dir), "%s", dir);
+
+    DIR *d = opendir(dir);
+    if (!d) {
+        fprintf(stderr, "Cannot open test directory %s\n", dir);
+        return 2;
+    }
+    struct dirent *entry;
+    while ((entry = readdir(d)) != NULL && file_count < MAX_FILES) {
+        size_t len = strlen(entry->d_name);
+        if (len < 5 || strcmp(entry->d_name + len - 5, ".json") != 0) continue;
+        snprintf(files[file_count++].name, sizeof(files[0].name), "%s", entry->d_name);
+    }
+    closedir(d);
+    if (file_count == 0) {
+        fprintf(stderr, "No .json test file in %s\n", dir);
+        return 2;
+    }
+    qsort(files, file_count, sizeof(FileResult), compare_names);
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    if (jobs > file_count) jobs = file_count;
+    pthread_t *threads = malloc(jobs * sizeof(pthread_t));
+    if (!threads) {
+        fprintf(stderr, "Out of memory\n");
+        return 2;
+    }
+    for (long i = 0; i < jobs; i++) {
+        if (pthread_create(&threads[i], NULL, worker, NULL) != 0) {
+            fprintf(stderr, "Cannot start worker thread %ld\n", i);
+            return 2;
+        }
+    }
+    for (long i = 0; i < jobs; i++) pthread_join(threads[i], NULL);
+    free(threads);
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    long tests = 0, failures = 0, skipped = 0;
+    int failed_files = 0;
+    for (int i = 0; i < file_count; i++) {
+        tests += files[i].tests;
+        failures += files[i].failures;
+        skipped += files[i].skipped;
+        if (files[i].failures) {
+            failed_files++;
+            printf("❌ %-16s %d/%d failed - %s\n", files[i].name, files[i].failures,
+                   files[i].tests, files[i].first_failure);
+        }
+    }
+
+    char missing[256];
+    int missing_count = missing_opcodes(missing, sizeof(missing));
+    if (missing_count) printf("⏭️  %d opcodes skipped, no file: %s\n", missing_count, missing);
+    if (skipped) printf("⏭️  %ld tests skipped, no initial or final state\n", skipped);
+
+    printf("%d files, %ld tests, %ld failures (in %d files) in %.2fs with %ld threads\n",
+           file_count, tests, failures, failed_files, seconds, jobs);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,422 @@
+#!/usr/bin/env python3
+# SM83 test vector generator: writes tests/sm83/*.json for `make conformance`
+# One file per opcode ("00.json" ... "cb ff.json") in the JSON single-step format:
+# random initial state, expected final state from the reference model below,
+# and one "cycles" entry per M-cycle: [addr, data, "r-m" | "-wm"] for a bus
+# access, null for an internal cycle.
+# The model is written from the opcode tables, independently of src/cpu*.c,
+# but by the same hands: it catches slips in the C cores, not a misreading of
+# the hardware both share. Run the SingleStepTests suite for that
+# (make conformance SM83_TESTS=path/to/sm83/v1).
+#
+#   python3 tools/sm83_vectors.py [out_dir] [tests_per_opcode]
+
+import json
+import os
+import random
+import sys
+
+SEED = 0x5383
+Z, N, H, C = 0x80, 0x40, 0x20, 0x10
+R8 = ['b', 'c', 'd', 'e', 'h', 'l', None, 'a']   # index 6 is (HL)
+ILLEGAL = {0xD3, 0xDB, 0xDD, 0xE3, 0xE4, 0xEB, 0xEC, 0xED, 0xF4, 0xFC, 0xFD}
+SKIPPED = {0x10, 0x76}                           # STOP and HALT do not end in one step
+
+
+class Machine:
+    def __init__(self, rng, opcode_bytes):
+        self.rng = rng
+        self.s = {k: rng.randrange(256) for k in 'abcdehl'}
+        self.s['f'] = rng.randrange(16) << 4
+        self.s['pc'] = rng.randrange(0x10000)
+        self.s['sp'] = rng.randrange(0x10000)
+        self.s['ime'] = rng.randrange(2)
+        self.s['ie'] = 0
+        self.initial_ram = {}
+        self.ram = {}
+        self.bus = []
+        for i, b in enumerate(opcode_bytes):
+            addr = (self.s['pc'] + i) & 0xFFFF
+            self.initial_ram[addr] = self.ram[addr] = b
+        self.initial = dict(self.s)
+
+    # Every address touched gets a random initial value, so writes are visible
+    def touch(self, addr):
+        addr &= 0xFFFF
+        if addr not in self.ram:
+            self.initial_ram[addr] = self.ram[addr] = self.rng.randrange(256)
+        return addr
+
+    def read(self, addr):
+        addr = self.touch(addr)
+        self.bus.append([addr, self.ram[addr], 'r-m'])
+        return self.ram[addr]
+
+    def write(self, addr, v):
+        addr = self.touch(addr)
+        self.ram[addr] = v & 0xFF
+        self.bus.append([addr, v & 0xFF, '-wm'])
+
+    def idle(self):
+        self.bus.append(None)
+
+    def fetch(self):
+        v = self.read(self.s['pc'])
+        self.s['pc'] = (self.s['pc'] + 1) & 0xFFFF
+        return v
+
+    def fetch16(self):
+        low = self.fetch()
+        return low | (self.fetch() << 8)
+
+    def pair(self, name):
+        return (self.s[name[0]] << 8) | self.s[name[1]]
+
+    def set_pair(self, name, v):
+        self.s[name[0]] = (v >> 8) & 0xFF
+        self.s[name[1]] = v & 0xFF
+
+    def r16(self, i):   # BC DE HL SP
+        return self.s['sp'] if i == 3 else self.pair(['bc', 'de', 'hl'][i])
+
+    def set_r16(self, i, v):
+        if i == 3:
+            self.s['sp'] = v & 0xFFFF
+        else:
+            self.set_pair(['bc', 'de', 'hl'][i], v & 0xFFFF)
+
+    def r8(self, i):
+        return self.read(self.pair('hl')) if i == 6 else self.s[R8[i]]
+
+    def set_r8(self, i, v):
+        if i == 6:
+            self.write(self.pair('hl'), v)
+        else:
+            self.s[R8[i]] = v & 0xFF
+
+    def flag(self, mask):
+        return 1 if self.s['f'] & mask else 0
+
+    def set_flags(self, z, n, h, c):
+        self.s['f'] = (Z if z else 0) | (N if n else 0) | (H if h else 0) | (C if c else 0)
+
+    # Internal cycle, then the high byte first (PUSH, CALL, RST)
+    def push(self, v):
+        self.idle()
+        self.s['sp'] = (self.s['sp'] - 1) & 0xFFFF
+        self.write(self.s['sp'], v >> 8)
+        self.s['sp'] = (self.s['sp'] - 1) & 0xFFFF
+        self.write(self.s['sp'], v & 0xFF)
+
+    def pop(self):
+        low = self.read(self.s['sp'])
+        high = self.read(self.s['sp'] + 1)
+        self.s['sp'] = (self.s['sp'] + 2) & 0xFFFF
+        return (high << 8) | low
+
+    def cond(self, cc):   # NZ Z NC C
+        return [not self.flag(Z), self.flag(Z), not self.flag(C), self.flag(C)][cc]
+
+    def alu(self, op, v):
+        a, carry = self.s['a'], self.flag(C)
+        if op in (0, 1):                          # ADD ADC
+            cin = carry if op == 1 else 0
+            r = a + v + cin
+            self.set_flags((r & 0xFF) == 0, 0, (a & 0xF) + (v & 0xF) + cin > 0xF, r > 0xFF)
+        elif op in (2, 3, 7):                     # SUB SBC CP
+            cin = carry if op == 3 else 0
+            r = a - v - cin
+            self.set_flags((r & 0xFF) == 0, 1, (a & 0xF) < (v & 0xF) + cin, r < 0)
+        elif op == 4:                             # AND
+            r = a & v
+            self.set_flags(r == 0, 0, 1, 0)
+        elif op == 5:                             # XOR
+            r = a ^ v
+            self.set_flags(r == 0, 0, 0, 0)
+        else:                                     # OR
+            r = a | v
+            self.set_flags(r == 0, 0, 0, 0)
+        if op != 7:
+            self.s['a'] = r & 0xFF
+
+    def add_sp(self, e):
+        sp = self.s['sp']
+        self.set_flags(0, 0, (sp & 0xF) + (e & 0xF) > 0xF, (sp & 0xFF) + e > 0xFF)
+        return (sp + (e - 256 if e > 127 else e)) & 0xFFFF
+
+    def rotate(self, x, v):
+        """CB 00-3F: RLC RRC RL RR SLA SRA SWAP SRL, return (result, carry out)"""
+        carry = self.flag(C)
+        if x == 0: return ((v << 1) | (v >> 7)) & 0xFF, v >> 7
+        if x == 1: return (v >> 1) | ((v & 1) << 7), v & 1
+        if x == 2: return ((v << 1) | carry) & 0xFF, v >> 7
+        if x == 3: return (v >> 1) | (carry << 7), v & 1
+        if x == 4: return (v << 1) & 0xFF, v >> 7
+        if x == 5: return (v >> 1) | (v & 0x80), v & 1
+        if x == 6: return ((v << 4) | (v >> 4)) & 0xFF, 0
+        return v >> 1, v & 1
+
+    def execute_cb(self):
+        op = self.fetch()
+        x, r = (op >> 3) & 7, op & 7
+        v = self.r8(r)
+        group = op >> 6
+        if group == 0:
+            v, carry = self.rotate(x, v)
+            self.set_flags(v == 0, 0, 0, carry)
+            self.set_r8(r, v)
+        elif group == 1:                          # BIT
+            self.set_flags(not (v >> x) & 1, 0, 1, self.flag(C))
+            return 12 if r == 6 else 8
+        elif group == 2:                          # RES
+            self.set_r8(r, v & ~(1 << x))
+        else:                                     # SET
+            self.set_r8(r, v | (1 << x))
+        return 16 if r == 6 else 8
+
+    # Run one instruction, return its length in T-cycles
+    def execute(self):
+        s = self.s
+        op = self.fetch()
+        x, y, z = op >> 6, (op >> 3) & 7, op & 7
+
+        if op == 0xCB:
+            return self.execute_cb()
+
+        if x == 1:                                # LD r,r'
+            self.set_r8(y, self.r8(z))
+            return 8 if 6 in (y, z) else 4
+        if x == 2:                                # ALU A,r
+            self.alu(y, self.r8(z))
+            return 8 if z == 6 else 4
+
+        if x == 0:
+            if op == 0x00:
+                return 4
+            if op == 0x08:                        # LD (a16),SP
+                addr = self.fetch16()
+                self.write(addr, s['sp'] & 0xFF)
+                self.write(addr + 1, s['sp'] >> 8)
+                return 20
+            if op == 0x18:                        # JR e
+                e = self.fetch()
+                s['pc'] = (s['pc'] + (e - 256 if e > 127 else e)) & 0xFFFF
+                self.idle()
+                return 12
+            if op in (0x20, 0x28, 0x30, 0x38):    # JR cc,e
+                e = self.fetch()
+                if self.cond(y - 4):
+                    s['pc'] = (s['pc'] + (e - 256 if e > 127 else e)) & 0xFFFF
+                    self.idle()
+                    return 12
+                return 8
+            if z == 1 and not y & 1:              # LD rr,d16
+                self.set_r16(y >> 1, self.fetch16())
+                return 12
+            if z == 1:                            # ADD HL,rr
+                hl, rr = self.pair('hl'), self.r16(y >> 1)
+                self.set_flags(self.flag(Z), 0, (hl & 0xFFF) + (rr & 0xFFF) > 0xFFF, hl + rr > 0xFFFF)
+                self.set_pair('hl', (hl + rr) & 0xFFFF)
+                self.idle()
+                return 8
+            if z == 2:                            # LD (BC/DE/HL+/HL-),A and back
+                p = y >> 1
+                addr = self.pair(['bc', 'de', 'hl', 'hl'][p])
+                if p == 2: self.set_pair('hl', (addr + 1) & 0xFFFF)
+                if p == 3: self.set_pair('hl', (addr - 1) & 0xFFFF)
+                if y & 1:
+                    s['a'] = self.read(addr)
+                else:
+                    self.write(addr, s['a'])
+                return 8
+            if z == 3:                            # INC/DEC rr
+                self.set_r16(y >> 1, self.r16(y >> 1) + (-1 if y & 1 else 1))
+                self.idle()
+                return 8
+            if z == 4:                            # INC r
+                v = self.r8(y)
+                self.set_r8(y, v + 1)
+                self.set_flags(((v + 1) & 0xFF) == 0, 0, (v & 0xF) == 0xF, self.flag(C))
+                return 12 if y == 6 else 4
+            if z == 5:                            # DEC r
+                v = self.r8(y)
+                self.set_r8(y, v - 1)
+                self.set_flags(((v - 1) & 0xFF) == 0, 1, (v & 0xF) == 0, self.flag(C))
+                return 12 if y == 6 else 4
+            if z == 6:                            # LD r,d8
+                self.set_r8(y, self.fetch())
+                return 12 if y == 6 else 8
+            # z == 7: accumulator and flag operations
+            a = s['a']
+            if y < 4:                             # RLCA RRCA RLA RRA
+                v, carry = self.rotate(y, a)
+                s['a'] = v
+                self.set_flags(0, 0, 0, carry)
+            elif y == 4:                          # DAA
+                f = s['f']
+                carry = self.flag(C)
+                if not f & N:
+                    if carry or a > 0x99:
+                        a += 0x60
+                        carry = 1
+                    if f & H or (a & 0xF) > 9:
+                        a += 0x06
+                else:
+                    if carry: a -= 0x60
+                    if f & H: a -= 0x06
+                s['a'] = a & 0xFF
+                self.set_flags(s['a'] == 0, f & N, 0, carry)
+            elif y == 5:                          # CPL
+                s['a'] = a ^ 0xFF
+                s['f'] |= N | H
+            elif y == 6:                          # SCF
+                self.set_flags(self.flag(Z), 0, 0, 1)
+            else:                                 # CCF
+                self.set_flags(self.flag(Z), 0, 0, not self.flag(C))
+            return 4
+
+        # x == 3
+        if z == 0 and y < 4:                      # RET cc
+            self.idle()
+            if self.cond(y):
+                s['pc'] = self.pop()
+                self.idle()
+                return 20
+            return 8
+        if op == 0xE0:                            # LDH (a8),A
+            self.write(0xFF00 | self.fetch(), s['a'])
+            return 12
+        if op == 0xF0:                            # LDH A,(a8)
+            s['a'] = self.read(0xFF00 | self.fetch())
+            return 12
+        if op in (0xE8, 0xF8):                    # ADD SP,e / LD HL,SP+e
+            r = self.add_sp(self.fetch())
+            self.idle()
+            if op == 0xE8:
+                s['sp'] = r
+                self.idle()
+                return 16
+            self.set_pair('hl', r)
+            return 12
+        if z == 1 and not y & 1:                  # POP rr
+            v = self.pop()
+            p = y >> 1
+            if p == 3:
+                s['a'], s['f'] = v >> 8, v & 0xF0
+            else:
+                self.set_r16(p, v)
+            return 12
+        if op == 0xC9:                            # RET
+            s['pc'] = self.pop()
+            self.idle()
+            return 16
+        if op == 0xD9:                            # RETI
+            s['pc'] = self.pop()
+            s['ime'] = 1
+            self.idle()
+            return 16
+        if op == 0xE9:                            # JP (HL)
+            s['pc'] = self.pair('hl')
+            return 4
+        if op == 0xF9:                            # LD SP,HL
+            s['sp'] = self.pair('hl')
+            self.idle()
+            return 8
+        if z == 2 and y < 4:                      # JP cc,a16
+            addr = self.fetch16()
+            if self.cond(y):
+                s['pc'] = addr
+                self.idle()
+                return 16
+            return 12
+        if op == 0xE2:                            # LD (C),A
+            self.write(0xFF00 | s['c'], s['a'])
+            return 8
+        if op == 0xF2:                            # LD A,(C)
+            s['a'] = self.read(0xFF00 | s['c'])
+            return 8
+        if op == 0xEA:                            # LD (a16),A
+            self.write(self.fetch16(), s['a'])
+            return 16
+        if op == 0xFA:                            # LD A,(a16)
+            s['a'] = self.read(self.fetch16())
+            return 16
+        if op == 0xC3:                            # JP a16
+            s['pc'] = self.fetch16()
+            self.idle()
+            return 16
+        if op == 0xF3:                            # DI
+            s['ime'] = 0
+            return 4
+        if op == 0xFB:                            # EI (effective after the next instruction)
+            s['ime'] = 1
+            return 4
+        if z == 4:                                # CALL cc,a16
+            addr = self.fetch16()
+            if self.cond(y):
+                self.push(s['pc'])
+                s['pc'] = addr
+                return 24
+            return 12
+        if z == 5 and not y & 1:                  # PUSH rr
+            p = y >> 1
+            self.push((s['a'] << 8) | s['f'] if p == 3 else self.r16(p))
+            return 16
+        if op == 0xCD:                            # CALL a16
+            addr = self.fetch16()
+            self.push(s['pc'])
+            s['pc'] = addr
+            return 24
+        if z == 6:                                # ALU A,d8
+            self.alu(y, self.fetch())
+            return 8
+        # z == 7: RST
+        self.push(s['pc'])
+        s['pc'] = y * 8
+        return 16
+
+
+def ram_list(ram):
+    return [[addr, ram[addr]] for addr in sorted(ram)]
+
+
+def make_tests(rng, prefix, count):
+    tests = []
+    for i in range(count):
+        m = Machine(rng, prefix)
+        cycles = m.execute()
+        assert len(m.bus) * 4 == cycles, '%s: %d M-cycles for %d cycles' % (prefix, len(m.bus), cycles)
+        initial = dict(m.initial, ram=ram_list(m.initial_ram))
+        final = dict(m.s, ram=ram_list(m.ram))
+        tests.append({
+            'name': '%s %d' % (' '.join('%02x' % b for b in prefix), i),
+            'initial': initial,
+            'final': final,
+            'cycles': m.bus,
+        })
+    return tests
+
+
+def main():
+    out_dir = sys.argv[1] if len(sys.argv) > 1 else os.path.join(os.path.dirname(__file__), '..', 'tests', 'sm83')
+    count = int(sys.argv[2]) if len(sys.argv) > 2 else 16
+    rng = random.Random(SEED)
+    os.makedirs(out_dir, exist_ok=True)
+
+    files = {}
+    for op in range(256):
+        if op in ILLEGAL or op in SKIPPED or op == 0xCB:
+            continue
+        files['%02x.json' % op] = [op]
+    for op in range(256):
+        files['cb %02x.json' % op] = [0xCB, op]
+
+    for name, prefix in files.items():
+        with open(os.path.join(out_dir, name), 'w') as f:
+            json.dump(make_tests(rng, prefix, count), f, separators=(',', ':'))
+            f.write('\n')
+    print('%d files written to %s' % (len(files), out_dir))
+
+
+if __name__ == '__main__':
+    main()